@@ -1,3 +1,7 @@
-C:/VulkanSDK/1.4.309.0/Bin/glslc.exe shader.vert -o vert.spv
-C:/VulkanSDK/1.4.309.0/Bin/glslc.exe shader.frag -o frag.spv
-pause
\ No newline at end of file
+C:/VulkanSDK/1.4.309.0/Bin/glslc.exe shader.vert -o shader.vert.spv
+C:/VulkanSDK/1.4.309.0/Bin/glslc.exe shader.frag -o shader.frag.spv
+C:/VulkanSDK/1.4.309.0/Bin/glslc.exe vt_feedback.vert -o vt_feedback.vert.spv
+C:/VulkanSDK/1.4.309.0/Bin/glslc.exe vt_feedback.frag -o vt_feedback.frag.spv
+C:/VulkanSDK/1.4.309.0/Bin/glslc.exe shader_vt.frag -o shader_vt.frag.spv
+C:/VulkanSDK/1.4.309.0/Bin/glslc.exe cull.comp -o cull.comp.spv
+pause
@@ -1,18 +1,53 @@
 #version 450
 
+// Specialization constants, set per pipeline by ShaderVariant: the branches on them are
+// resolved when the pipeline is compiled, the unused paths are not in the final code.
+
+// 0 unlit, 1 lambert, 2 half-lambert.
+layout (constant_id = 0) const uint LIGHTING_MODEL = 1;
+
+// 0 none, 1 world normals, 2 lighting only (white albedo).
+layout (constant_id = 1) const uint DEBUG_VIEW = 0;
+
 layout (set = 0, binding = 0) uniform transforms_ {
     mat4 view;
     mat4 projection;
 } transforms;
 
+layout (set = 0, binding = 1) uniform draw_ {
+    mat4 model;
+} draw;
+
 
 layout (location = 0) in vec3 positions;
 layout (location = 1) in vec4 colors;
 layout (location = 2) in vec3 normals;
+layout (location = 3) in vec2 uvs;
 
 layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragUv;
+
+const vec3 LIGHT = vec3(-0.0, 100000.0, 100.0);
 
 void main() {
-    gl_Position = transforms.projection * transforms.view * vec4(positions, 1.0);
-    fragColor = colors * max(dot(normals, vec3(-0.0, 100000.0, 100.0)), 0.1);
-}
\ No newline at end of file
+    gl_Position = transforms.projection * transforms.view * draw.model * vec4(positions, 1.0);
+    fragUv = uvs;
+
+    const vec3 normal = mat3(draw.model) * normals;
+
+    if (DEBUG_VIEW == 1) {
+        fragColor = vec4(normalize(normal) * 0.5 + 0.5, 1.0);
+        return;
+    }
+
+    const vec4 albedo = DEBUG_VIEW == 2 ? vec4(1.0) : colors;
+
+    if (LIGHTING_MODEL == 0) {
+        fragColor = albedo;
+    } else if (LIGHTING_MODEL == 1) {
+        fragColor = albedo * max(dot(normal, LIGHT), 0.1);
+    } else {
+        const float wrapped = dot(normalize(normal), normalize(LIGHT)) * 0.5 + 0.5;
+        fragColor = vec4(albedo.rgb * wrapped * wrapped, albedo.a);
+    }
+}
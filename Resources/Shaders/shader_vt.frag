@@ -0,0 +1,21 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "virtual_texture.glsl"
+
+// Set by VirtualTexture::Specialize, after the ShaderVariant constants 0 and 1.
+layout (constant_id = 2) const uint VIRTUAL_SIZE = 1;
+layout (constant_id = 3) const uint CACHE_TILES = 1;
+
+layout (set = 1, binding = 0) uniform usampler2D pageTable;
+layout (set = 1, binding = 1) uniform sampler2D physicalCache;
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = fragColor * SampleVirtualTexture(pageTable, physicalCache, fragUv, float(VIRTUAL_SIZE),
+                                                float(CACHE_TILES));
+}
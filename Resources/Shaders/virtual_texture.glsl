@@ -0,0 +1,34 @@
+// Virtual texture sampling, include it from material shaders.
+//
+// pageTable:   usampler2D bound to VirtualTexture::PageTableDescriptor().
+//              Texel = (slot x, slot y, resident mip, valid).
+// cache:       sampler2D bound to VirtualTexture::PhysicalCacheDescriptor().
+// virtualSize: virtual texture size in texels (pagesPerSide * tileSize).
+// cacheTiles:  VirtualTextureCreateInfo::physicalTilesPerSide.
+
+vec4 SampleVirtualTexture(usampler2D pageTable, sampler2D cache, vec2 uv, float virtualSize,
+                          float cacheTiles) {
+    vec2 texel = uv * virtualSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+
+    int lastMip = textureQueryLevels(pageTable) - 1;
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    int mip = clamp(int(floor(lod)), 0, lastMip);
+
+    ivec2 pages = textureSize(pageTable, mip);
+    ivec2 page = clamp(ivec2(fract(uv) * vec2(pages)), ivec2(0), pages - 1);
+    uvec4 entry = texelFetch(pageTable, page, mip);
+
+    // Nothing resident yet, not even the last mip.
+    if (entry.a == 0u) {
+        return vec4(0.0);
+    }
+
+    // The entry may come from an ancestor: locate uv inside the tile actually resident.
+    float residentPages = float(textureSize(pageTable, int(entry.b)).x);
+    vec2 inTile = fract(fract(uv) * residentPages);
+    vec2 cacheUv = (vec2(entry.rg) + inTile) / cacheTiles;
+
+    return textureLod(cache, cacheUv, 0.0);
+}
@@ -0,0 +1,25 @@
+#version 450
+
+layout (push_constant) uniform feedback_ {
+    mat4 modelViewProjection;
+    vec4 params; // x: virtual size in texels, y: pages per side at mip 0, z: last mip, w: mip bias
+} feedback;
+
+layout (location = 0) in vec2 fragUv;
+
+// Tile id, must match VirtualTexture::PackTileId: x | y << 12 | mip << 24.
+layout (location = 0) out uint outTileId;
+
+void main() {
+    vec2 texel = fragUv * feedback.params.x;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + feedback.params.w;
+    uint mip = uint(clamp(floor(lod), 0.0, feedback.params.z));
+
+    uint pages = uint(feedback.params.y) >> mip;
+    uvec2 page = min(uvec2(fract(fragUv) * float(pages)), uvec2(pages - 1u));
+
+    outTileId = page.x | (page.y << 12) | (mip << 24);
+}
@@ -0,0 +1,16 @@
+#version 450
+
+layout (push_constant) uniform feedback_ {
+    mat4 modelViewProjection;
+    vec4 params; // x: virtual size in texels, y: pages per side at mip 0, z: last mip, w: mip bias
+} feedback;
+
+layout (location = 0) in vec3 positions;
+layout (location = 1) in vec2 uvs;
+
+layout (location = 0) out vec2 fragUv;
+
+void main() {
+    gl_Position = feedback.modelViewProjection * vec4(positions, 1.0);
+    fragUv = uvs;
+}
@@ -0,0 +1,208 @@
+#include "Benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace Benchmarks
+{
+State::State(int64_t arg, uint64_t max_iterations)
+    : arg(arg), maxIterations(max_iterations)
+{
+}
+
+bool State::KeepRunning()
+{
+    if (skipMessage != nullptr)
+    {
+        return false;
+    }
+
+    if (iterations == 0 && !running)
+    {
+        ResumeTiming();
+    }
+
+    if (iterations < maxIterations)
+    {
+        iterations++;
+        return true;
+    }
+
+    PauseTiming();
+    return false;
+}
+
+void State::PauseTiming()
+{
+    if (running)
+    {
+        elapsed += Clock::now() - start;
+        running = false;
+    }
+}
+
+void State::ResumeTiming()
+{
+    if (!running)
+    {
+        start = Clock::now();
+        running = true;
+    }
+}
+
+int64_t State::Arg() const
+{
+    return arg;
+}
+
+void State::SetItemsProcessed(uint64_t items)
+{
+    itemsProcessed = items;
+}
+
+void State::SkipWithMessage(const char *message)
+{
+    skipMessage = message;
+}
+
+const char *State::SkipMessage() const
+{
+    return skipMessage;
+}
+
+uint64_t State::Iterations() const
+{
+    return iterations;
+}
+
+uint64_t State::ItemsProcessed() const
+{
+    return itemsProcessed;
+}
+
+double State::ElapsedSeconds() const
+{
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+Registration::Registration(
+    const char *name,
+    BenchmarkFunction function,
+    std::initializer_list<int64_t> args)
+{
+    RegisteredBenchmarks().push_back({name, function, args});
+}
+
+std::vector<BenchmarkEntry> &RegisteredBenchmarks()
+{
+    // Function local: registrations run during static initialization, in any order.
+    static std::vector<BenchmarkEntry> benchmarks = {};
+    return benchmarks;
+}
+
+void UseAddress(const volatile void *)
+{
+}
+
+/// Grow the iteration count until a run lasts at least min_seconds.
+static State Run(const BenchmarkEntry &entry, int64_t arg, double min_seconds)
+{
+    uint64_t iterations = 1;
+
+    for (;;)
+    {
+        State state(arg, iterations);
+        entry.function(state);
+
+        const double seconds = state.ElapsedSeconds();
+
+        if (state.SkipMessage() != nullptr || seconds >= min_seconds || iterations >= 1'000'000'000)
+        {
+            return state;
+        }
+
+        // Aim a bit past the target so the next run is very likely the last one.
+        const double scale = seconds > 0.0 ? min_seconds * 1.4 / seconds : 10.0;
+        const double next = static_cast<double>(iterations) * (scale < 10.0 ? scale : 10.0);
+        iterations = next > static_cast<double>(iterations) ? static_cast<uint64_t>(next) : iterations + 1;
+    }
+}
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = nullptr;
+    double minSeconds = 0.5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--filter=", 9) == 0)
+        {
+            filter = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--min-time=", 11) == 0)
+        {
+            minSeconds = atof(argv[i] + 11);
+        }
+        else
+        {
+            printf("Usage: %s [--filter=<substring>] [--min-time=<seconds>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%-48s %14s %14s %16s\n", "Benchmark", "Iterations", "ns/iter", "items/s");
+
+    for (const Benchmarks::BenchmarkEntry &entry : Benchmarks::RegisteredBenchmarks())
+    {
+        if (filter != nullptr && entry.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        std::vector<int64_t> args = entry.args;
+
+        if (args.empty())
+        {
+            args.push_back(0);
+        }
+
+        for (const int64_t arg : args)
+        {
+            const Benchmarks::State state = Benchmarks::Run(entry, arg, minSeconds);
+
+            const std::string name = entry.args.empty()
+                                         ? entry.name
+                                         : entry.name + "/" + std::to_string(arg);
+
+            if (state.SkipMessage() != nullptr)
+            {
+                printf("%-48s skipped: %s\n", name.c_str(), state.SkipMessage());
+                continue;
+            }
+
+            const double seconds = state.ElapsedSeconds();
+            const double nsPerIteration = seconds * 1e9 / static_cast<double>(state.Iterations());
+
+            if (state.ItemsProcessed() > 0)
+            {
+                printf("%-48s %14llu %14.1f %16.4g\n",
+                    name.c_str(),
+                    static_cast<unsigned long long>(state.Iterations()),
+                    nsPerIteration,
+                    static_cast<double>(state.ItemsProcessed()) / seconds);
+            }
+            else
+            {
+                printf("%-48s %14llu %14.1f %16s\n",
+                    name.c_str(),
+                    static_cast<unsigned long long>(state.Iterations()),
+                    nsPerIteration,
+                    "-");
+            }
+        }
+    }
+
+    return 0;
+}
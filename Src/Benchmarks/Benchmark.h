@@ -0,0 +1,106 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace Benchmarks
+{
+/**
+ * @brief Handed to every benchmark function.
+ *
+ * The body of the loop is the measured code:
+ *
+ *      while (state.KeepRunning())
+ *      {
+ *          ...
+ *      }
+ *
+ * The runner calls the function again with more iterations until the loop
+ * lasts at least the minimum time, so setup outside the loop is not measured.
+ */
+class State
+{
+public:
+    State(int64_t arg, uint64_t max_iterations);
+
+    bool KeepRunning();
+
+    /// Exclude setup work inside the loop from the measure.
+    void PauseTiming();
+
+    void ResumeTiming();
+
+    [[nodiscard]] int64_t Arg() const;
+
+    /// Items (allocations, draws, ...) handled by the whole run, for the items/s column.
+    void SetItemsProcessed(uint64_t items);
+
+    /// Can't run here (e.g. no Vulkan driver): call before the loop, the message is printed instead.
+    void SkipWithMessage(const char *message);
+
+    /// Null unless skipped.
+    [[nodiscard]] const char *SkipMessage() const;
+
+    [[nodiscard]] uint64_t Iterations() const;
+
+    [[nodiscard]] uint64_t ItemsProcessed() const;
+
+    [[nodiscard]] double ElapsedSeconds() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    int64_t arg = {};
+    uint64_t iterations = {};
+    uint64_t maxIterations = {};
+    uint64_t itemsProcessed = {};
+    const char *skipMessage = {};
+
+    Clock::time_point start = {};
+    Clock::duration elapsed = {};
+    bool running = {};
+};
+
+using BenchmarkFunction = void (*)(State &state);
+
+struct BenchmarkEntry
+{
+    std::string name = {};
+    BenchmarkFunction function = {};
+
+    /// One run per argument. Empty means a single run with argument 0.
+    std::vector<int64_t> args = {};
+};
+
+/// Static registration, use the BENCHMARK macro.
+struct Registration
+{
+    Registration(const char *name, BenchmarkFunction function, std::initializer_list<int64_t> args);
+};
+
+std::vector<BenchmarkEntry> &RegisteredBenchmarks();
+
+/// Defined in another translation unit, the compiler must assume the pointee is read.
+void UseAddress(const volatile void *p_address);
+
+/// Keep the compiler from optimizing out a value computed by the benchmark.
+template<typename T>
+void DoNotOptimize(const T &value)
+{
+    UseAddress(&value);
+}
+}
+
+#define BENCHMARK_CONCAT_IMPL(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_IMPL(a, b)
+
+/// BENCHMARK(Function) or BENCHMARK(Function, arg0, arg1, ...)
+#define BENCHMARK(function, ...) \
+    static const Benchmarks::Registration BENCHMARK_CONCAT(function##Registration, __LINE__)( \
+        #function, function, {__VA_ARGS__})
+
+#endif //BENCHMARK_H
@@ -0,0 +1,49 @@
+#include "Benchmark.h"
+
+#include "../FileSystem.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Shaders and pipeline caches go through FileSystem::ReadFile. The file is read
+// from the page cache after the first iteration: this is the cost of the copy
+// and of the stream, not of the disk.
+
+namespace
+{
+/// ReadFile on a file of state.Arg() KiB.
+void ReadFileSize(Benchmarks::State &state)
+{
+    const size_t size = static_cast<size_t>(state.Arg()) * 1024;
+    const std::string path = "benchmark_read_" + std::to_string(state.Arg()) + ".bin";
+
+    const std::vector<char> content(size, 'x');
+    FILE *file = fopen(path.c_str(), "wb");
+
+    if (file == nullptr || fwrite(content.data(), 1, size, file) != size)
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+        }
+
+        state.SkipWithMessage("can't write the file in the working directory");
+        return;
+    }
+
+    fclose(file);
+
+    while (state.KeepRunning())
+    {
+        const std::vector<char> read = FileSystem::ReadFile(path.c_str());
+        Benchmarks::DoNotOptimize(read.data());
+    }
+
+    // Items are bytes: the items/s column is the throughput.
+    state.SetItemsProcessed(state.Iterations() * size);
+    remove(path.c_str());
+}
+}
+
+BENCHMARK(ReadFileSize, 4, 64, 1024, 16 * 1024, 64 * 1024);
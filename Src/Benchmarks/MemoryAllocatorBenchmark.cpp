@@ -0,0 +1,207 @@
+#include "Benchmark.h"
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// The DeviceMemoryAllocator needs a device, the TLSF sub-allocator under it does not:
+// these stress its allocate / free throughput on the CPU, which is what every
+// vk_create_buffer / vk_create_image pays besides the (now rare) vkAllocateMemory.
+
+namespace
+{
+/// Sizes and victims are drawn up front so the RNG is not measured.
+constexpr size_t RANDOM_TABLE_SIZE = 1 << 16;
+
+/// Abstract range managed by the allocator. Large enough to never fail.
+constexpr uint64_t RANGE_SIZE = 1ull << 40;
+
+/// Typical buffer alignment (minStorageBufferOffsetAlignment, nonCoherentAtomSize, ...).
+constexpr uint64_t ALIGNMENT = 256;
+
+enum class SizeDistribution
+{
+    /// Uniform in [64 B, 4 KiB]: uniform, staging and small vertex buffers.
+    Small,
+
+    /// Log-uniform in [256 B, 16 MiB]: a mix of meshes and textures.
+    Mixed,
+};
+
+std::vector<uint64_t> RandomSizes(SizeDistribution distribution)
+{
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> sizes(RANDOM_TABLE_SIZE);
+
+    for (uint64_t &size : sizes)
+    {
+        if (distribution == SizeDistribution::Small)
+        {
+            size = std::uniform_int_distribution<uint64_t>(64, 4096)(rng);
+        }
+        else
+        {
+            const double log2Size = std::uniform_real_distribution<double>(8.0, 24.0)(rng);
+            size = static_cast<uint64_t>(std::exp2(log2Size));
+        }
+    }
+
+    return sizes;
+}
+
+std::vector<uint32_t> RandomIndices(uint32_t count)
+{
+    std::mt19937 rng(7);
+    std::vector<uint32_t> indices(RANDOM_TABLE_SIZE);
+
+    for (uint32_t &index : indices)
+    {
+        index = std::uniform_int_distribution<uint32_t>(0, count - 1)(rng);
+    }
+
+    return indices;
+}
+
+/**
+ * Keep state.Arg() allocations alive, each iteration frees a random one and
+ * allocates a new one in its place: the steady state of streaming meshes in and out.
+ */
+void TlsfChurn(Benchmarks::State &state, SizeDistribution distribution)
+{
+    const uint32_t liveCount = static_cast<uint32_t>(state.Arg());
+    const std::vector<uint64_t> sizes = RandomSizes(distribution);
+    const std::vector<uint32_t> victims = RandomIndices(liveCount);
+
+    Renderer::TlsfAllocator allocator = {};
+    allocator.Init(RANGE_SIZE);
+
+    std::vector<Renderer::TlsfAllocator::Allocation> live(liveCount);
+
+    for (uint32_t i = 0; i < liveCount; i++)
+    {
+        live[i] = allocator.Allocate(sizes[i % RANDOM_TABLE_SIZE], ALIGNMENT);
+    }
+
+    size_t cursor = 0;
+
+    while (state.KeepRunning())
+    {
+        const size_t slot = victims[cursor % RANDOM_TABLE_SIZE];
+
+        allocator.Free(live[slot]);
+        live[slot] = allocator.Allocate(sizes[cursor % RANDOM_TABLE_SIZE], ALIGNMENT);
+
+        if (live[slot].node == Renderer::TlsfAllocator::INVALID_NODE)
+        {
+            abort();
+        }
+
+        cursor++;
+    }
+
+    // One free plus one allocation per iteration.
+    state.SetItemsProcessed(state.Iterations() * 2);
+    Benchmarks::DoNotOptimize(allocator.FreeBlockCount());
+}
+
+/// Same pattern through malloc, as a reference point.
+void MallocChurn(Benchmarks::State &state, SizeDistribution distribution)
+{
+    const uint32_t liveCount = static_cast<uint32_t>(state.Arg());
+    const std::vector<uint64_t> sizes = RandomSizes(distribution);
+    const std::vector<uint32_t> victims = RandomIndices(liveCount);
+
+    std::vector<void *> live(liveCount);
+
+    for (uint32_t i = 0; i < liveCount; i++)
+    {
+        live[i] = malloc(sizes[i % RANDOM_TABLE_SIZE]);
+    }
+
+    size_t cursor = 0;
+
+    while (state.KeepRunning())
+    {
+        const size_t slot = victims[cursor % RANDOM_TABLE_SIZE];
+
+        free(live[slot]);
+        live[slot] = malloc(sizes[cursor % RANDOM_TABLE_SIZE]);
+        Benchmarks::DoNotOptimize(live[slot]);
+
+        cursor++;
+    }
+
+    state.SetItemsProcessed(state.Iterations() * 2);
+
+    for (void *p : live)
+    {
+        free(p);
+    }
+}
+
+/// Fill an empty allocator with state.Arg() allocations, then free them all in random order.
+void TlsfFillAndDrain(Benchmarks::State &state)
+{
+    const uint32_t count = static_cast<uint32_t>(state.Arg());
+    const std::vector<uint64_t> sizes = RandomSizes(SizeDistribution::Mixed);
+
+    std::vector<uint32_t> order(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+
+    std::shuffle(order.begin(), order.end(), std::mt19937(3));
+
+    Renderer::TlsfAllocator allocator = {};
+    std::vector<Renderer::TlsfAllocator::Allocation> live(count);
+
+    while (state.KeepRunning())
+    {
+        allocator.Init(RANGE_SIZE);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            live[i] = allocator.Allocate(sizes[i % RANDOM_TABLE_SIZE], ALIGNMENT);
+        }
+
+        for (const uint32_t i : order)
+        {
+            allocator.Free(live[i]);
+        }
+    }
+
+    state.SetItemsProcessed(state.Iterations() * count * 2);
+    Benchmarks::DoNotOptimize(allocator.FreeBlockCount());
+}
+
+void TlsfChurnSmall(Benchmarks::State &state)
+{
+    TlsfChurn(state, SizeDistribution::Small);
+}
+
+void TlsfChurnMixed(Benchmarks::State &state)
+{
+    TlsfChurn(state, SizeDistribution::Mixed);
+}
+
+void MallocChurnSmall(Benchmarks::State &state)
+{
+    MallocChurn(state, SizeDistribution::Small);
+}
+
+void MallocChurnMixed(Benchmarks::State &state)
+{
+    MallocChurn(state, SizeDistribution::Mixed);
+}
+}
+
+BENCHMARK(TlsfChurnSmall, 1'000, 10'000, 100'000);
+BENCHMARK(TlsfChurnMixed, 1'000, 10'000, 100'000);
+BENCHMARK(MallocChurnSmall, 1'000, 10'000, 100'000);
+BENCHMARK(MallocChurnMixed, 1'000, 10'000, 100'000);
+BENCHMARK(TlsfFillAndDrain, 1'000, 10'000);
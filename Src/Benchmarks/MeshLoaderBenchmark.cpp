@@ -0,0 +1,130 @@
+#include "Benchmark.h"
+#include "MeshLoader.h"
+#include "../Renderer/MeshLoaderInternal.h"
+#include "SyntheticMesh.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Scene loading is most of the startup time: the importer (parsing, triangulation,
+// vertex dedupe) and ProcessMesh (transform and copy into the BatchCpu streams).
+// Items are triangles, so the curves read as triangles/s against mesh size.
+
+namespace
+{
+std::string GridObjPath(uint32_t triangle_count)
+{
+    return "benchmark_grid_" + std::to_string(triangle_count) + ".obj";
+}
+
+/// The whole of MeshLoader::Load on bunny.obj, the default test mesh.
+void MeshLoadBunny(Benchmarks::State &state)
+{
+    const char *path = BENCHMARK_RESOURCES_DIR "/Meshes/bunny.obj";
+    size_t triangleCount = 0;
+
+    while (state.KeepRunning())
+    {
+        Renderer::BatchCpu batch = {};
+        Renderer::MeshLoader::Load(path, &batch);
+
+        triangleCount = batch.indices.size() / 3;
+        Benchmarks::DoNotOptimize(batch.indices.data());
+    }
+
+    state.SetItemsProcessed(state.Iterations() * triangleCount);
+}
+
+/// MeshLoader::Load on generated OBJ grids of state.Arg() triangles.
+void MeshLoadGrid(Benchmarks::State &state)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(state.Arg());
+    const std::string path = GridObjPath(triangleCount);
+
+    if (!Benchmarks::WriteGridObj(path.c_str(), triangleCount))
+    {
+        state.SkipWithMessage("can't write the grid OBJ in the working directory");
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        Renderer::BatchCpu batch = {};
+        Renderer::MeshLoader::Load(path.c_str(), &batch);
+        Benchmarks::DoNotOptimize(batch.indices.data());
+    }
+
+    state.SetItemsProcessed(state.Iterations() * triangleCount);
+    remove(path.c_str());
+}
+
+/// ProcessMesh alone on a grid of state.Arg() triangles, the importer excluded.
+void ProcessMeshGrid(Benchmarks::State &state)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(state.Arg());
+    aiMesh *mesh = Benchmarks::NewGridMesh(triangleCount);
+
+    while (state.KeepRunning())
+    {
+        Renderer::BatchCpu batch = {};
+        Renderer::ProcessMesh(mesh, aiMatrix4x4(), &batch);
+        Benchmarks::DoNotOptimize(batch.indices.data());
+    }
+
+    state.SetItemsProcessed(state.Iterations() * triangleCount);
+    delete mesh;
+}
+
+/**
+ * ProcessMesh on state.Arg() threads, one 256K triangles mesh per thread, each
+ * into its own BatchCpu: how far splitting a scene per mesh would scale before
+ * the allocator and memory bandwidth become the limit.
+ */
+void ProcessMeshThreads(Benchmarks::State &state)
+{
+    constexpr uint32_t TRIANGLES_PER_MESH = 256 * 1024;
+
+    const uint32_t threadCount = static_cast<uint32_t>(state.Arg());
+
+    std::vector<aiMesh *> meshes(threadCount);
+
+    for (aiMesh *&mesh : meshes)
+    {
+        mesh = Benchmarks::NewGridMesh(TRIANGLES_PER_MESH);
+    }
+
+    std::vector<Renderer::BatchCpu> batches(threadCount);
+
+    Renderer::ThreadPool threadPool = {};
+    threadPool.Init(threadCount);
+
+    while (state.KeepRunning())
+    {
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            threadPool.Submit([&meshes, &batches, i]()
+            {
+                batches[i] = {};
+                Renderer::ProcessMesh(meshes[i], aiMatrix4x4(), &batches[i]);
+            });
+        }
+
+        threadPool.WaitIdle();
+    }
+
+    state.SetItemsProcessed(state.Iterations() * threadCount * TRIANGLES_PER_MESH);
+    threadPool.Teardown();
+
+    for (aiMesh *mesh : meshes)
+    {
+        delete mesh;
+    }
+}
+}
+
+BENCHMARK(MeshLoadBunny);
+BENCHMARK(MeshLoadGrid, 1'000, 10'000, 100'000, 1'000'000);
+BENCHMARK(ProcessMeshGrid, 1'000, 10'000, 100'000, 1'000'000);
+BENCHMARK(ProcessMeshThreads, 1, 2, 4, 8);
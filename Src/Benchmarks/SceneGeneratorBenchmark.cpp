@@ -0,0 +1,68 @@
+#include "Benchmark.h"
+#include "MeshLoader.h"
+#include "SceneGenerator.h"
+
+#include <cstdio>
+#include <string>
+
+// Scaling with the object count rather than the triangle count: state.Arg() instances
+// of 8 meshes of 500 triangles. Items are instances, the items/s column should stay
+// flat as the count grows by orders of magnitude.
+
+namespace
+{
+Renderer::SceneDesc InstancesDesc(uint32_t instance_count)
+{
+    Renderer::SceneDesc desc = {};
+    desc.kind = Renderer::SceneKind::INSTANCES;
+    desc.instanceCount = instance_count;
+    desc.meshCount = 8;
+    desc.trianglesPerMesh = 500;
+
+    return desc;
+}
+
+/// Generation itself, so it can be told apart from what is measured on its output.
+void GenerateScene(Benchmarks::State &state)
+{
+    const Renderer::SceneDesc desc = InstancesDesc(static_cast<uint32_t>(state.Arg()));
+
+    while (state.KeepRunning())
+    {
+        Renderer::GeneratedScene scene = {};
+        Renderer::SceneGenerator::Generate(desc, &scene);
+        Benchmarks::DoNotOptimize(scene.instances.data());
+    }
+
+    state.SetItemsProcessed(state.Iterations() * desc.instanceCount);
+}
+
+/// MeshLoader::Load on the scene written as OBJ: one object per instance.
+void LoadGeneratedScene(Benchmarks::State &state)
+{
+    const Renderer::SceneDesc desc = InstancesDesc(static_cast<uint32_t>(state.Arg()));
+    const std::string path = "benchmark_scene_" + std::to_string(desc.instanceCount) + ".obj";
+
+    Renderer::GeneratedScene scene = {};
+    Renderer::SceneGenerator::Generate(desc, &scene);
+
+    if (!Renderer::SceneGenerator::WriteObj(scene, path.c_str()))
+    {
+        state.SkipWithMessage("can't write the scene OBJ in the working directory");
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        Renderer::BatchCpu batch = {};
+        Renderer::MeshLoader::Load(path.c_str(), &batch);
+        Benchmarks::DoNotOptimize(batch.indices.data());
+    }
+
+    state.SetItemsProcessed(state.Iterations() * desc.instanceCount);
+    remove(path.c_str());
+}
+}
+
+BENCHMARK(GenerateScene, 100, 1'000, 10'000, 100'000);
+BENCHMARK(LoadGeneratedScene, 100, 1'000, 10'000);
@@ -0,0 +1,129 @@
+#include "SyntheticMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace Benchmarks
+{
+void MakeGrid(uint32_t triangle_count, Renderer::BatchCpu *p_batch)
+{
+    *p_batch = {};
+
+    // As square as possible; the last cell may hold a single triangle.
+    const uint32_t cellCount = (triangle_count + 1) / 2;
+    const uint32_t columns = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(cellCount)))));
+    const uint32_t rows = (cellCount + columns - 1) / columns;
+
+    for (uint32_t y = 0; y <= rows; y++)
+    {
+        for (uint32_t x = 0; x <= columns; x++)
+        {
+            const glm::vec2 uv = {
+                static_cast<float>(x) / static_cast<float>(columns),
+                static_cast<float>(y) / static_cast<float>(rows)
+            };
+
+            p_batch->position.emplace_back(uv.x * 100.0f - 50.0f, 0.0f, uv.y * 100.0f - 50.0f);
+            p_batch->normals.emplace_back(0.0f, 1.0f, 0.0f);
+            p_batch->color.emplace_back(0.36f, 0.36f, 0.5f, 1.0f);
+            p_batch->uvs.push_back(uv);
+        }
+    }
+
+    p_batch->indices.reserve(static_cast<size_t>(triangle_count) * 3);
+
+    for (uint32_t triangle = 0; triangle < triangle_count; triangle++)
+    {
+        const uint32_t cell = triangle / 2;
+        const uint32_t x = cell % columns;
+        const uint32_t y = cell / columns;
+
+        const uint32_t v00 = y * (columns + 1) + x;
+        const uint32_t v10 = v00 + 1;
+        const uint32_t v01 = v00 + columns + 1;
+        const uint32_t v11 = v01 + 1;
+
+        if (triangle % 2 == 0)
+        {
+            p_batch->indices.insert(p_batch->indices.end(), {v00, v01, v10});
+        }
+        else
+        {
+            p_batch->indices.insert(p_batch->indices.end(), {v10, v01, v11});
+        }
+    }
+}
+
+aiMesh *NewGridMesh(uint32_t triangle_count)
+{
+    Renderer::BatchCpu grid = {};
+    MakeGrid(triangle_count, &grid);
+
+    // aiMesh and aiFace free their arrays with delete[].
+    auto *mesh = new aiMesh();
+    mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    mesh->mNumVertices = static_cast<unsigned int>(grid.position.size());
+    mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+    mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        mesh->mVertices[i] = aiVector3D(grid.position[i].x, grid.position[i].y, grid.position[i].z);
+        mesh->mNormals[i] = aiVector3D(grid.normals[i].x, grid.normals[i].y, grid.normals[i].z);
+    }
+
+    mesh->mNumFaces = triangle_count;
+    mesh->mFaces = new aiFace[mesh->mNumFaces];
+
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        aiFace &face = mesh->mFaces[i];
+        face.mNumIndices = 3;
+        face.mIndices = new unsigned int[3]{
+            grid.indices[i * 3 + 0],
+            grid.indices[i * 3 + 1],
+            grid.indices[i * 3 + 2],
+        };
+    }
+
+    return mesh;
+}
+
+bool WriteGridObj(const char *p_path, uint32_t triangle_count)
+{
+    Renderer::BatchCpu grid = {};
+    MakeGrid(triangle_count, &grid);
+
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    for (const glm::vec3 &position : grid.position)
+    {
+        fprintf(file, "v %g %g %g\n", position.x, position.y, position.z);
+    }
+
+    for (const glm::vec3 &normal : grid.normals)
+    {
+        fprintf(file, "vn %g %g %g\n", normal.x, normal.y, normal.z);
+    }
+
+    // OBJ indices start at 1.
+    for (size_t i = 0; i < grid.indices.size(); i += 3)
+    {
+        fprintf(file, "f %u//%u %u//%u %u//%u\n",
+            grid.indices[i + 0] + 1, grid.indices[i + 0] + 1,
+            grid.indices[i + 1] + 1, grid.indices[i + 1] + 1,
+            grid.indices[i + 2] + 1, grid.indices[i + 2] + 1);
+    }
+
+    const bool written = ferror(file) == 0;
+    fclose(file);
+
+    return written;
+}
+}
@@ -0,0 +1,22 @@
+#ifndef SYNTHETIC_MESH_H
+#define SYNTHETIC_MESH_H
+
+#include "Renderer.h"
+
+#include <assimp/mesh.h>
+
+#include <cstdint>
+
+namespace Benchmarks
+{
+/// Meshes of an exact triangle count for the scaling curves: a flat grid, two triangles per cell.
+void MakeGrid(uint32_t triangle_count, Renderer::BatchCpu *p_batch);
+
+/// Same grid as an assimp mesh, as the importer hands it to MeshLoader. Delete it when done.
+aiMesh *NewGridMesh(uint32_t triangle_count);
+
+/// Same grid as a Wavefront OBJ. @return false if the file can't be written.
+bool WriteGridObj(const char *p_path, uint32_t triangle_count);
+}
+
+#endif //SYNTHETIC_MESH_H
@@ -0,0 +1,245 @@
+#include "Benchmark.h"
+#include "GeometryPool.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "SyntheticMesh.h"
+#include "VkCommon.h"
+
+#include <volk/volk.h>
+
+#include <cassert>
+#include <vector>
+
+// The Vulkan helpers on the startup path: the memory type lookup done for every
+// allocation, and the geometry upload of InitBatch (GeometryPool::AddMesh, then
+// staging ring flushes until the data is resident).
+
+namespace
+{
+/// Memory types of a typical discrete GPU, repeated to reach type_count.
+VkPhysicalDeviceMemoryProperties SyntheticMemoryProperties(uint32_t type_count)
+{
+    constexpr VkMemoryPropertyFlags TYPICAL_FLAGS[] = {
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    };
+
+    VkPhysicalDeviceMemoryProperties properties = {};
+    properties.memoryTypeCount = type_count;
+    properties.memoryHeapCount = 2;
+
+    for (uint32_t i = 0; i < type_count; i++)
+    {
+        properties.memoryTypes[i].propertyFlags = TYPICAL_FLAGS[i % 4];
+        properties.memoryTypes[i].heapIndex = i % 2;
+    }
+
+    return properties;
+}
+
+/// vk_query_memory_type_idx over state.Arg() memory types, the last one being the only match: the worst case.
+void MemoryTypeLookup(Benchmarks::State &state)
+{
+    const uint32_t typeCount = static_cast<uint32_t>(state.Arg());
+    const VkPhysicalDeviceMemoryProperties properties = SyntheticMemoryProperties(typeCount);
+    const uint32_t typeFilter = 1u << (typeCount - 1);
+    const VkMemoryPropertyFlags flags = properties.memoryTypes[typeCount - 1].propertyFlags;
+
+    while (state.KeepRunning())
+    {
+        const uint32_t index = Renderer::vk_query_memory_type_idx(typeFilter, flags, properties);
+        Benchmarks::DoNotOptimize(index);
+    }
+
+    state.SetItemsProcessed(state.Iterations());
+}
+
+/// Bare device with one graphics queue: no surface, no extensions, no validation.
+struct BenchmarkDevice
+{
+    VkInstance instance = {};
+    VkPhysicalDevice gpu = {};
+    VkDevice device = {};
+    VkQueue queue = {};
+    VkCommandPool commandPool = {};
+    VkCommandBuffer commandBuffer = {};
+    VkFence fence = {};
+
+    Renderer::DeviceMemoryAllocator memoryAllocator = {};
+    Renderer::StagingRing stagingRing = {};
+
+    /// @return false if there is no Vulkan driver.
+    bool Init()
+    {
+        if (volkInitialize() != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        VkApplicationInfo applicationInfo = {};
+        applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        applicationInfo.pApplicationName = "RendererBenchmarks";
+        applicationInfo.apiVersion = VK_API_VERSION_1_2;
+
+        VkInstanceCreateInfo instanceCreateInfo = {};
+        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceCreateInfo.pApplicationInfo = &applicationInfo;
+
+        if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance) != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        volkLoadInstance(instance);
+
+        uint32_t gpuCount = 0;
+        VK_CHECK(vkEnumeratePhysicalDevices(instance, &gpuCount, nullptr));
+
+        if (gpuCount == 0)
+        {
+            vkDestroyInstance(instance, nullptr);
+            return false;
+        }
+
+        Renderer::QueryGpu(instance, {}, 0, nullptr, &gpu);
+
+        uint32_t queueFamily = 0;
+        Renderer::QueryQueueFamily(gpu, VK_QUEUE_GRAPHICS_BIT, VK_NULL_HANDLE, 0, nullptr, &queueFamily);
+
+        Renderer::vk_create_device(gpu, 1, &queueFamily, 0, nullptr, nullptr, nullptr, &device);
+        volkLoadDevice(device);
+
+        vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+        memoryAllocator.Init(device, gpu, Renderer::DeviceMemoryAllocator::DEFAULT_BLOCK_SIZE, false, nullptr);
+        stagingRing.Init(device, &memoryAllocator, Renderer::StagingRing::DEFAULT_SIZE);
+
+        VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.queueFamilyIndex = queueFamily;
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &commandPool));
+
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandPool = commandPool;
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer));
+
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
+
+        return true;
+    }
+
+    void Teardown()
+    {
+        VK_CHECK(vkDeviceWaitIdle(device));
+
+        vkDestroyFence(device, fence, nullptr);
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        stagingRing.Teardown();
+        memoryAllocator.Teardown();
+
+        vkDestroyDevice(device, nullptr);
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    /// Same loop as Renderer::FlushUploadsAndWait, on a fence instead of the frame timeline.
+    void FlushUploadsAndWait()
+    {
+        while (stagingRing.HasPendingUploads())
+        {
+            VK_CHECK(vkResetCommandPool(device, commandPool, 0));
+
+            VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+            commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+            if (stagingRing.Flush(commandBuffer, 0))
+            {
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+                vkCmdPipelineBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                    0,
+                    1, &barrier,
+                    0, nullptr,
+                    0, nullptr);
+            }
+
+            VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+            VkSubmitInfo submitInfo = {};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &commandBuffer;
+
+            VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fence));
+            VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+            VK_CHECK(vkResetFences(device, 1, &fence));
+
+            stagingRing.Reclaim(0);
+        }
+    }
+};
+
+/**
+ * Upload of a grid of state.Arg() triangles to device local memory, as InitBatch
+ * does for the scene. The pool is created once, each iteration adds the mesh,
+ * waits for it to be resident and removes it.
+ */
+void GeometryUpload(Benchmarks::State &state)
+{
+    BenchmarkDevice context = {};
+
+    if (!context.Init())
+    {
+        state.SkipWithMessage("no Vulkan device");
+        return;
+    }
+
+    const uint32_t triangleCount = static_cast<uint32_t>(state.Arg());
+
+    Renderer::BatchCpu grid = {};
+    Benchmarks::MakeGrid(triangleCount, &grid);
+
+    Renderer::GeometryPool geometryPool = {};
+    geometryPool.Init(
+        context.device,
+        &context.memoryAllocator,
+        &context.stagingRing,
+        nullptr,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        static_cast<uint32_t>(grid.position.size()),
+        static_cast<uint32_t>(grid.indices.size()));
+
+    while (state.KeepRunning())
+    {
+        const uint32_t mesh = geometryPool.AddMesh(grid);
+        context.FlushUploadsAndWait();
+
+        // Nothing reads the mesh: its ranges can go back right away.
+        geometryPool.RemoveMesh(mesh, 0);
+        geometryPool.Reclaim(0);
+    }
+
+    state.SetItemsProcessed(state.Iterations() * triangleCount);
+
+    geometryPool.Teardown();
+    context.Teardown();
+}
+}
+
+BENCHMARK(MemoryTypeLookup, 4, 8, 16, 32);
+BENCHMARK(GeometryUpload, 1'000, 10'000, 100'000, 1'000'000);
@@ -1,11 +1,38 @@
+#include "Profiler.h"
 #include "Renderer.h"
+#include "RendererConfig.h"
 
-int main()
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+int main(int argc, char **argv)
 {
+	PROFILE_THREAD("main");
+
+	const Renderer::RendererConfig config = Renderer::RendererConfig::FromArgs(argc, argv);
+
+	if (config.showHelp)
+	{
+		Renderer::RendererConfig::PrintUsage(argv[0]);
+		return 0;
+	}
+
 	Renderer::Renderer renderer = {};
-	renderer.Init();
+
+	try
+	{
+		renderer.Init(config);
+	}
+	catch (const std::runtime_error &error)
+	{
+		// exit does not destroy renderer: its thread pools still have running workers.
+		printf("\nstartup failed: %s\n", error.what());
+		std::exit(EXIT_FAILURE);
+	}
+
 	renderer.Update(0.0);
 	renderer.Teardown();
 
 	return 0;
-}
\ No newline at end of file
+}
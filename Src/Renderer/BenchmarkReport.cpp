@@ -0,0 +1,184 @@
+#include "BenchmarkReport.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace Renderer
+{
+namespace
+{
+/// Paths may hold backslashes (Windows) and quotes.
+std::string JsonString(const std::string &text)
+{
+    std::string json = "\"";
+
+    for (const char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            json += '\\';
+        }
+
+        json += c;
+    }
+
+    json += '"';
+
+    return json;
+}
+
+std::string SummaryJson(const FrameTimeSummary &summary)
+{
+    char line[256] = {};
+
+    snprintf(line, sizeof(line),
+        "{\"count\": %u, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+        summary.count,
+        summary.mean,
+        summary.p50,
+        summary.p95,
+        summary.p99,
+        summary.max);
+
+    return line;
+}
+}
+
+void BenchmarkReport::Init(const BenchmarkSetup &setup, uint32_t frame_count)
+{
+    this->setup = setup;
+
+    cpuFrameMs.clear();
+    cpuFrameMs.reserve(frame_count);
+    gpuFrameMs.clear();
+    gpuFrameMs.reserve(frame_count);
+}
+
+void BenchmarkReport::SetStartup(double startup_ms, double scene_load_ms)
+{
+    startupMs = startup_ms;
+    sceneLoadMs = scene_load_ms;
+}
+
+void BenchmarkReport::SetFirstFrame(double first_frame_ms)
+{
+    firstFrameMs = first_frame_ms;
+}
+
+void BenchmarkReport::SetPipelines(double pipeline_ms, bool is_cache_warm)
+{
+    pipelineMs = pipeline_ms;
+    isPipelineCacheWarm = is_cache_warm;
+}
+
+void BenchmarkReport::AddCpuFrame(double ms)
+{
+    cpuFrameMs.push_back(ms);
+}
+
+void BenchmarkReport::AddGpuFrame(double ms)
+{
+    gpuFrameMs.push_back(ms);
+}
+
+FrameTimeSummary BenchmarkReport::CpuSummary() const
+{
+    return Summarize(cpuFrameMs);
+}
+
+FrameTimeSummary BenchmarkReport::GpuSummary() const
+{
+    return Summarize(gpuFrameMs);
+}
+
+std::string BenchmarkReport::ToJson() const
+{
+    std::string json = {};
+    char line[256] = {};
+
+    json += "{\n  \"scene\": " + JsonString(setup.scene) + ",\n";
+    json += "  \"cameraPath\": " + JsonString(setup.cameraPath) + ",\n";
+    json += "  \"gpu\": " + JsonString(setup.gpuName) + ",\n";
+
+    snprintf(line, sizeof(line),
+        "  \"width\": %u,\n  \"height\": %u,\n  \"framesInFlight\": %u,\n"
+        "  \"warmupFrames\": %u,\n  \"timestepMs\": %.4f,\n",
+        setup.width,
+        setup.height,
+        setup.framesInFlight,
+        WARMUP_FRAMES,
+        TIMESTEP_SECONDS * 1000.0);
+    json += line;
+
+    snprintf(line, sizeof(line), "  \"startupMs\": %.3f,\n  \"sceneLoadMs\": %.3f,\n  \"firstFrameMs\": %.3f,\n",
+        startupMs,
+        sceneLoadMs,
+        firstFrameMs);
+    json += line;
+
+    snprintf(line, sizeof(line), "  \"pipelineMs\": %.3f,\n  \"pipelineCacheWarm\": %s,\n",
+        pipelineMs,
+        isPipelineCacheWarm ? "true" : "false");
+    json += line;
+
+    json += "  \"cpuFrameMs\": " + SummaryJson(CpuSummary()) + ",\n";
+
+    // null rather than zeros: no timestamps is not a free GPU.
+    json += "  \"gpuFrameMs\": " + (setup.hasGpuTimestamps ? SummaryJson(GpuSummary()) : "null") + "\n}\n";
+
+    return json;
+}
+
+bool BenchmarkReport::WriteJson(const char *p_path) const
+{
+    const std::string json = ToJson();
+
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    const bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    fclose(file);
+
+    return written;
+}
+
+FrameTimeSummary BenchmarkReport::Summarize(const std::vector<double> &samples)
+{
+    FrameTimeSummary summary = {};
+
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    // Same rank rounding as FrameLimiter::Percentiles.
+    const auto at = [&sorted](double fraction)
+    {
+        const size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[index];
+    };
+
+    double sum = 0.0;
+
+    for (const double sample : sorted)
+    {
+        sum += sample;
+    }
+
+    summary.count = static_cast<uint32_t>(sorted.size());
+    summary.mean = sum / static_cast<double>(sorted.size());
+    summary.p50 = at(0.50);
+    summary.p95 = at(0.95);
+    summary.p99 = at(0.99);
+    summary.max = sorted.back();
+
+    return summary;
+}
+}
@@ -0,0 +1,157 @@
+#include "CameraPath.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+namespace Renderer
+{
+void CameraPath::InitOrbit(glm::vec3 center, float radius, float height, double duration, uint32_t key_count)
+{
+    assert(key_count > 1);
+
+    keys.clear();
+    keys.reserve(key_count);
+
+    // The last key closes the turn on the first one.
+    for (uint32_t i = 0; i < key_count; i++)
+    {
+        const float turn = static_cast<float>(i) / static_cast<float>(key_count - 1);
+        const float angle = turn * glm::two_pi<float>();
+
+        // Starts behind the origin on -Z looking at +Z, as the live camera does.
+        const glm::vec3 position = center + glm::vec3(std::sin(angle) * radius, height, -std::cos(angle) * radius);
+
+        AddKey(duration * turn, position, glm::normalize(center - position));
+    }
+}
+
+bool CameraPath::Load(const char *p_path)
+{
+    FILE *file = fopen(p_path, "rb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    keys.clear();
+
+    char line[256] = {};
+
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+        {
+            continue;
+        }
+
+        CameraKey key = {};
+
+        const int read = sscanf(line, "%lf %f %f %f %f %f %f",
+            &key.time,
+            &key.position.x, &key.position.y, &key.position.z,
+            &key.front.x, &key.front.y, &key.front.z);
+
+        if (read == 7)
+        {
+            keys.push_back(key);
+        }
+        else
+        {
+            printf("\ncamera path %s: malformed key ignored: %s", p_path, line);
+        }
+    }
+
+    fclose(file);
+
+    // Hand edited files may be out of order.
+    std::stable_sort(keys.begin(), keys.end(),
+        [](const CameraKey &a, const CameraKey &b)
+        {
+            return a.time < b.time;
+        });
+
+    return !keys.empty();
+}
+
+bool CameraPath::Save(const char *p_path) const
+{
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    fprintf(file, "# time px py pz fx fy fz\n");
+
+    // %.9g round trips a float, %.17g a double.
+    for (const CameraKey &key : keys)
+    {
+        fprintf(file, "%.17g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+            key.time,
+            key.position.x, key.position.y, key.position.z,
+            key.front.x, key.front.y, key.front.z);
+    }
+
+    const bool written = ferror(file) == 0;
+    fclose(file);
+
+    return written;
+}
+
+void CameraPath::AddKey(double time, glm::vec3 position, glm::vec3 front)
+{
+    assert(keys.empty() || time >= keys.back().time);
+
+    keys.push_back({time, position, front});
+}
+
+bool CameraPath::IsEmpty() const
+{
+    return keys.empty();
+}
+
+double CameraPath::Duration() const
+{
+    return keys.empty() ? 0.0 : keys.back().time;
+}
+
+void CameraPath::Sample(double time, glm::vec3 *p_position, glm::vec3 *p_front) const
+{
+    assert(!keys.empty());
+
+    // First key after time.
+    const auto next = std::upper_bound(keys.begin(), keys.end(), time,
+        [](double t, const CameraKey &key)
+        {
+            return t < key.time;
+        });
+
+    if (next == keys.begin() || next == keys.end())
+    {
+        const CameraKey &key = next == keys.begin() ? keys.front() : keys.back();
+
+        *p_position = key.position;
+        *p_front = key.front;
+        return;
+    }
+
+    const CameraKey &a = *(next - 1);
+    const CameraKey &b = *next;
+
+    const float alpha = static_cast<float>((time - a.time) / (b.time - a.time));
+
+    *p_position = glm::mix(a.position, b.position, alpha);
+
+    // Opposite fronts would mix to zero: keep the nearest key then.
+    const glm::vec3 front = glm::mix(a.front, b.front, alpha);
+    *p_front = glm::length(front) > 1e-4f ? glm::normalize(front) : (alpha < 0.5f ? a.front : b.front);
+}
+}
@@ -0,0 +1,412 @@
+#include "ComputeScheduler.h"
+#include "FrameTimeline.h"
+#include "Profiler.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Renderer
+{
+void QueueTimer::Init(
+    VkDevice device,
+    VkPhysicalDevice gpu,
+    uint32_t queue_family_index,
+    uint32_t frame_count,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    allocationCallbacks = p_allocation_callbacks;
+    isRecorded.assign(frame_count, false);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+
+    const uint32_t validBits = families[queue_family_index].timestampValidBits;
+
+    if (validBits == 0)
+    {
+        return;
+    }
+
+    timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties = {};
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    nanosecondsPerTick = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = frame_count * 2;
+
+    VK_CHECK(vkCreateQueryPool(device, &queryPoolCreateInfo, allocationCallbacks, &queryPool));
+}
+
+void QueueTimer::Teardown()
+{
+    if (queryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device, queryPool, allocationCallbacks);
+        queryPool = VK_NULL_HANDLE;
+    }
+
+    isRecorded.clear();
+}
+
+void QueueTimer::Begin(VkCommandBuffer cmd, uint32_t frame_index)
+{
+    if (queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkCmdResetQueryPool(cmd, queryPool, frame_index * 2, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, frame_index * 2);
+
+    isRecorded[frame_index] = true;
+}
+
+void QueueTimer::End(VkCommandBuffer cmd, uint32_t frame_index) const
+{
+    if (queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, frame_index * 2 + 1);
+}
+
+bool QueueTimer::Resolve(uint32_t frame_index, uint64_t *p_begin, uint64_t *p_end)
+{
+    if (queryPool == VK_NULL_HANDLE || !isRecorded[frame_index])
+    {
+        return false;
+    }
+
+    isRecorded[frame_index] = false;
+
+    uint64_t timestamps[2] = {};
+
+    const VkResult result = vkGetQueryPoolResults(device, queryPool, frame_index * 2, 2,
+        sizeof(timestamps), &timestamps[0], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result != VK_SUCCESS)
+    {
+        return false;
+    }
+
+    *p_begin = timestamps[0] & timestampMask;
+    *p_end = timestamps[1] & timestampMask;
+
+    return true;
+}
+
+double QueueTimer::TicksToMs(uint64_t ticks) const
+{
+    return static_cast<double>(ticks) * nanosecondsPerTick / 1e6;
+}
+
+void ComputeScheduler::Init(
+    VkDevice device,
+    VkPhysicalDevice gpu,
+    uint32_t compute_family,
+    VkQueue compute_queue,
+    uint32_t graphics_family,
+    FrameTimeline *p_frame_timeline,
+    uint32_t frame_count,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    queue = compute_queue;
+    frameTimeline = p_frame_timeline;
+    allocationCallbacks = p_allocation_callbacks;
+    isAsync = compute_family != graphics_family;
+    computeValue = 0;
+
+    graphicsTimer.Init(device, gpu, graphics_family, frame_count, allocationCallbacks);
+
+    if (!isAsync)
+    {
+        return;
+    }
+
+    computeTimer.Init(device, gpu, compute_family, frame_count, allocationCallbacks);
+
+    commandPools.resize(frame_count);
+    commandBuffers.resize(frame_count);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = compute_family;
+
+    for (uint32_t i = 0; i < frame_count; i++)
+    {
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, allocationCallbacks,
+            &commandPools[i]));
+
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = commandPools[i];
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffers[i]));
+    }
+
+    CreateTimeline(device, allocationCallbacks, &computeTimeline);
+}
+
+void ComputeScheduler::Teardown()
+{
+    graphicsTimer.Teardown();
+
+    if (isAsync)
+    {
+        computeTimer.Teardown();
+
+        vkDestroySemaphore(device, computeTimeline, allocationCallbacks);
+
+        for (const VkCommandPool commandPool : commandPools)
+        {
+            vkDestroyCommandPool(device, commandPool, allocationCallbacks);
+        }
+    }
+
+    commandPools.clear();
+    commandBuffers.clear();
+    passes.clear();
+}
+
+bool ComputeScheduler::IsAsync() const
+{
+    return isAsync;
+}
+
+uint32_t ComputeScheduler::AddPass(const ComputePass &pass)
+{
+    assert(pass.record && "Compute pass without a record function");
+
+    passes.push_back(pass);
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void ComputeScheduler::BeginFrame(uint32_t frame_index)
+{
+    uint64_t graphicsBegin = 0;
+    uint64_t graphicsEnd = 0;
+
+    if (!graphicsTimer.Resolve(frame_index, &graphicsBegin, &graphicsEnd))
+    {
+        return;
+    }
+
+    lastTimings = {};
+    lastTimings.graphicsMs = graphicsTimer.TicksToMs(graphicsEnd - graphicsBegin);
+
+    uint64_t computeBegin = 0;
+    uint64_t computeEnd = 0;
+
+    if (computeTimer.Resolve(frame_index, &computeBegin, &computeEnd))
+    {
+        lastTimings.computeMs = computeTimer.TicksToMs(computeEnd - computeBegin);
+
+        // The spec only guarantees timestamps of one queue to be comparable; desktop drivers
+        // use one device clock for every queue, which is what the overlap relies on.
+        const uint64_t overlapBegin = std::max(computeBegin, previousGraphicsBegin);
+        const uint64_t overlapEnd = std::min(computeEnd, previousGraphicsEnd);
+
+        if (overlapEnd > overlapBegin)
+        {
+            lastTimings.overlapMs = computeTimer.TicksToMs(overlapEnd - overlapBegin);
+        }
+    }
+
+    previousGraphicsBegin = graphicsBegin;
+    previousGraphicsEnd = graphicsEnd;
+}
+
+bool ComputeScheduler::Submit(uint32_t frame_index)
+{
+    PROFILE_FUNCTION();
+
+    if (!isAsync)
+    {
+        return false;
+    }
+
+    bool hasPasses = false;
+    bool waitsGraphics = false;
+
+    for (const ComputePass &pass : passes)
+    {
+        if (RunsAsync(pass))
+        {
+            hasPasses = true;
+            waitsGraphics |= pass.readsGraphicsOutput;
+        }
+    }
+
+    if (!hasPasses)
+    {
+        return false;
+    }
+
+    // The graphics submission of frame_index waited the compute one of frame_index.
+    VK_CHECK(vkResetCommandPool(device, commandPools[frame_index], 0));
+
+    const VkCommandBuffer cmd = commandBuffers[frame_index];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+    computeTimer.Begin(cmd, frame_index);
+
+    for (const ComputePass &pass : passes)
+    {
+        if (RunsAsync(pass))
+        {
+            pass.record(cmd, frame_index);
+        }
+    }
+
+    computeTimer.End(cmd, frame_index);
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    computeValue++;
+
+    // The previous graphics frame: waiting for the current one would serialize the queues.
+    const uint64_t waitValue = frameTimeline->SubmittedValue();
+    const VkSemaphore waitSemaphore = frameTimeline->Semaphore();
+    constexpr VkPipelineStageFlags WAIT_STAGE = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitsGraphics ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &computeValue;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitsGraphics ? 1 : 0;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &WAIT_STAGE;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &computeTimeline;
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    return true;
+}
+
+void ComputeScheduler::RecordGraphicsPasses(VkCommandBuffer cmd, uint32_t frame_index) const
+{
+    VkPipelineStageFlags consumerStages = 0;
+    VkAccessFlags consumerAccess = 0;
+
+    for (const ComputePass &pass : passes)
+    {
+        if (!RunsAsync(pass))
+        {
+            pass.record(cmd, frame_index);
+
+            consumerStages |= pass.consumerStages;
+            consumerAccess |= pass.consumerAccess;
+        }
+    }
+
+    if (consumerStages == 0)
+    {
+        return;
+    }
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = consumerAccess;
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        consumerStages,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+}
+
+void ComputeScheduler::BeginGraphicsTiming(VkCommandBuffer cmd, uint32_t frame_index)
+{
+    graphicsTimer.Begin(cmd, frame_index);
+}
+
+void ComputeScheduler::EndGraphicsTiming(VkCommandBuffer cmd, uint32_t frame_index) const
+{
+    graphicsTimer.End(cmd, frame_index);
+}
+
+VkSemaphore ComputeScheduler::Semaphore() const
+{
+    return computeTimeline;
+}
+
+uint64_t ComputeScheduler::SignaledValue() const
+{
+    return computeValue;
+}
+
+VkPipelineStageFlags ComputeScheduler::WaitStages() const
+{
+    VkPipelineStageFlags stages = 0;
+
+    for (const ComputePass &pass : passes)
+    {
+        if (RunsAsync(pass))
+        {
+            stages |= pass.consumerStages;
+        }
+    }
+
+    // A wait needs at least one stage.
+    return stages != 0 ? stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+}
+
+QueueTimings ComputeScheduler::LastTimings() const
+{
+    return lastTimings;
+}
+
+bool ComputeScheduler::RunsAsync(const ComputePass &pass) const
+{
+    return isAsync && pass.queue == ComputePassQueue::ASYNC;
+}
+
+void ComputeScheduler::CreateTimeline(
+    VkDevice device,
+    VkAllocationCallbacks *p_allocation_callbacks,
+    VkSemaphore *p_semaphore)
+{
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {};
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCreateInfo.pNext = &semaphoreTypeInfo;
+
+    VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, p_allocation_callbacks, p_semaphore));
+}
+}
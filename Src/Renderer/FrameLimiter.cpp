@@ -0,0 +1,111 @@
+#include "FrameLimiter.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace Renderer
+{
+void FrameLimiter::Init(uint32_t max_fps)
+{
+    period = max_fps > 0
+                 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / max_fps))
+                 : Clock::duration::zero();
+
+    lastFrameEnd = Clock::now();
+    deadline = lastFrameEnd + period;
+    sleepEstimateMs = SLEEP_STEP_MS;
+
+    intervalsMs.clear();
+    intervalsMs.reserve(HISTORY_SIZE);
+    nextInterval = 0;
+}
+
+void FrameLimiter::Wait()
+{
+    if (period != Clock::duration::zero())
+    {
+        const Clock::time_point now = Clock::now();
+
+        if (now > deadline + period)
+        {
+            // Missed by more than a frame: start over from now, don't rush the next frames.
+            deadline = now;
+        }
+        else
+        {
+            SleepUntil(deadline);
+        }
+    }
+
+    const Clock::time_point frameEnd = Clock::now();
+
+    RecordInterval(frameEnd);
+
+    deadline += period;
+}
+
+FrameTimePercentiles FrameLimiter::Percentiles() const
+{
+    FrameTimePercentiles percentiles = {};
+
+    if (intervalsMs.empty())
+    {
+        return percentiles;
+    }
+
+    std::vector<double> sorted = intervalsMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    const auto at = [&sorted](double fraction)
+    {
+        const size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[index];
+    };
+
+    percentiles.p50 = at(0.50);
+    percentiles.p95 = at(0.95);
+    percentiles.p99 = at(0.99);
+    percentiles.max = sorted.back();
+
+    return percentiles;
+}
+
+void FrameLimiter::SleepUntil(Clock::time_point deadline)
+{
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    // Coarse: sleep while even a long sleep step can't overshoot the deadline.
+    while (Milliseconds(deadline - Clock::now()).count() > sleepEstimateMs)
+    {
+        const Clock::time_point start = Clock::now();
+        std::this_thread::sleep_for(Milliseconds(SLEEP_STEP_MS));
+        const double sleptMs = Milliseconds(Clock::now() - start).count();
+
+        // Jump up to a worse overshoot at once, forget it slowly.
+        sleepEstimateMs = std::max(sleptMs, sleepEstimateMs * 0.99 + sleptMs * 0.01);
+    }
+
+    // Fine: spin the last fraction of a millisecond.
+    while (Clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void FrameLimiter::RecordInterval(Clock::time_point frame_end)
+{
+    const double intervalMs = std::chrono::duration<double, std::milli>(frame_end - lastFrameEnd).count();
+    lastFrameEnd = frame_end;
+
+    if (intervalsMs.size() < HISTORY_SIZE)
+    {
+        intervalsMs.push_back(intervalMs);
+    }
+    else
+    {
+        intervalsMs[nextInterval] = intervalMs;
+    }
+
+    nextInterval = (nextInterval + 1) % HISTORY_SIZE;
+}
+}
@@ -0,0 +1,110 @@
+#include "FrameTimeline.h"
+#include "VkCommon.h"
+
+#include <cassert>
+#include <utility>
+
+namespace Renderer
+{
+void FrameTimeline::Init(VkDevice device, VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    allocationCallbacks = p_allocation_callbacks;
+    submittedValue = 0;
+    completedValue = 0;
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {};
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCreateInfo.pNext = &semaphoreTypeInfo;
+
+    VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, allocationCallbacks, &timeline));
+}
+
+void FrameTimeline::Teardown()
+{
+    for (DeferredWork &work : deferred)
+    {
+        work.fn();
+    }
+
+    deferred.clear();
+
+    vkDestroySemaphore(device, timeline, allocationCallbacks);
+}
+
+VkSemaphore FrameTimeline::Semaphore() const
+{
+    return timeline;
+}
+
+uint64_t FrameTimeline::NextValue()
+{
+    return ++submittedValue;
+}
+
+uint64_t FrameTimeline::SubmittedValue() const
+{
+    return submittedValue;
+}
+
+uint64_t FrameTimeline::CompletedValue()
+{
+    VK_CHECK(vkGetSemaphoreCounterValue(device, timeline, &completedValue));
+    return completedValue;
+}
+
+bool FrameTimeline::IsComplete(uint64_t value)
+{
+    return value <= completedValue || value <= CompletedValue();
+}
+
+void FrameTimeline::Wait(uint64_t value)
+{
+    if (value <= completedValue)
+    {
+        return;
+    }
+
+    assert(value <= submittedValue && "Waiting for a value never submitted");
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &value;
+
+    VK_CHECK(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+
+    completedValue = value;
+}
+
+void FrameTimeline::Defer(std::function<void()> fn)
+{
+    // The frame being recorded may still use the object: wait for its submission too.
+    deferred.push_back({submittedValue + 1, std::move(fn)});
+}
+
+void FrameTimeline::Collect()
+{
+    if (deferred.empty())
+    {
+        return;
+    }
+
+    const uint64_t completed = CompletedValue();
+
+    while (!deferred.empty() && deferred.front().value <= completed)
+    {
+        // Popped first: fn may defer more work.
+        std::function<void()> fn = std::move(deferred.front().fn);
+        deferred.pop_front();
+
+        fn();
+    }
+}
+}
@@ -0,0 +1,434 @@
+#include "GeometryPool.h"
+#include "MemoryDefragmenter.h"
+#include "Renderer.h"
+#include "StagingRing.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstring>
+#include <iterator>
+
+namespace Renderer
+{
+void GeometryPool::Init(
+    VkDevice device,
+    DeviceMemoryAllocator *p_memory_allocator,
+    StagingRing *p_staging_ring,
+    MemoryDefragmenter *p_defragmenter,
+    VkMemoryPropertyFlags memory_flags,
+    uint32_t vertex_capacity,
+    uint32_t index_capacity)
+{
+    this->device = device;
+    memoryAllocator = p_memory_allocator;
+    stagingRing = p_staging_ring;
+    defragmenter = p_defragmenter;
+
+    vertexRanges.Init(vertex_capacity);
+    indexRanges.Init(index_capacity);
+
+    for (uint32_t stream = 0; stream < STREAM_COUNT; stream++)
+    {
+        const VkBufferUsageFlags usage = stream == INDEX
+                                             ? VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                                             : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        const uint32_t capacity = stream == INDEX ? index_capacity : vertex_capacity;
+
+        // Transfer source: the defragmenter copies the buffers out when moving them.
+        const VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        vk_create_buffer(
+            device,
+            memoryAllocator,
+            STREAM_STRIDES[stream] * capacity,
+            usage | transferUsage,
+            memory_flags,
+            MemoryCategory::GEOMETRY,
+            memoryAllocator->AllocationCallbacks(),
+            &buffers[stream],
+            &memory[stream]);
+
+        if (defragmenter != nullptr)
+        {
+            movableIds[stream] = defragmenter->Register(
+                &buffers[stream],
+                &memory[stream],
+                STREAM_STRIDES[stream] * capacity,
+                usage | transferUsage,
+                [this](VkBuffer old_buffer, VkBuffer new_buffer)
+                {
+                    stagingRing->RetargetUploads(old_buffer, new_buffer);
+                });
+        }
+    }
+}
+
+void GeometryPool::Teardown()
+{
+    for (uint32_t stream = 0; stream < STREAM_COUNT; stream++)
+    {
+        if (defragmenter != nullptr)
+        {
+            defragmenter->Unregister(movableIds[stream]);
+        }
+
+        vkDestroyBuffer(device, buffers[stream], memoryAllocator->AllocationCallbacks());
+        memoryAllocator->Free(&memory[stream]);
+    }
+
+    meshes.clear();
+    unusedMeshIds.clear();
+    retiredMeshes.clear();
+    retiredRanges.clear();
+    meshCount = 0;
+}
+
+uint32_t GeometryPool::AddMesh(const BatchCpu &mesh)
+{
+    const uint64_t vertexCount = mesh.position.size();
+    const uint64_t indexCount = mesh.indices.size();
+
+    assert(mesh.normals.size() == vertexCount && mesh.color.size() == vertexCount &&
+           mesh.uvs.size() == vertexCount);
+
+    Mesh entry = {};
+    entry.vertices = vertexRanges.Allocate(vertexCount, 1);
+
+    if (entry.vertices.node == TlsfAllocator::INVALID_NODE)
+    {
+        return INVALID_MESH;
+    }
+
+    entry.indices = indexRanges.Allocate(indexCount, 1);
+
+    if (entry.indices.node == TlsfAllocator::INVALID_NODE)
+    {
+        vertexRanges.Free(entry.vertices);
+        return INVALID_MESH;
+    }
+
+    entry.alive = true;
+
+    // Centered on the bounding box: not the tightest sphere, but one pass over the positions.
+    glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+
+    for (const glm::vec3 &position : mesh.position)
+    {
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+
+    const glm::vec3 center = vertexCount > 0 ? (boundsMin + boundsMax) * 0.5f : glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    for (const glm::vec3 &position : mesh.position)
+    {
+        radius = std::max(radius, glm::length(position - center));
+    }
+
+    entry.boundingSphere[0] = center.x;
+    entry.boundingSphere[1] = center.y;
+    entry.boundingSphere[2] = center.z;
+    entry.boundingSphere[3] = radius;
+
+    Write(POSITION, entry.vertices.offset, mesh.position.data(), vertexCount * STREAM_STRIDES[POSITION]);
+    Write(COLOR, entry.vertices.offset, mesh.color.data(), vertexCount * STREAM_STRIDES[COLOR]);
+    Write(NORMAL, entry.vertices.offset, mesh.normals.data(), vertexCount * STREAM_STRIDES[NORMAL]);
+    Write(UV, entry.vertices.offset, mesh.uvs.data(), vertexCount * STREAM_STRIDES[UV]);
+    Write(INDEX, entry.indices.offset, mesh.indices.data(), indexCount * STREAM_STRIDES[INDEX]);
+
+    uint32_t meshId = 0;
+
+    if (!unusedMeshIds.empty())
+    {
+        meshId = unusedMeshIds.back();
+        unusedMeshIds.pop_back();
+        meshes[meshId] = entry;
+    }
+    else
+    {
+        meshId = static_cast<uint32_t>(meshes.size());
+        meshes.push_back(entry);
+    }
+
+    meshCount++;
+
+    return meshId;
+}
+
+void GeometryPool::RemoveMesh(uint32_t mesh_id, uint32_t frame_index)
+{
+    assert(mesh_id < meshes.size() && meshes[mesh_id].alive);
+
+    // The mesh can't be drawn anymore, but its ranges are still read by the frames in flight.
+    meshes[mesh_id].alive = false;
+    meshCount--;
+
+    retiredMeshes.push_back({mesh_id, frame_index});
+}
+
+void GeometryPool::Reclaim(uint32_t frame_index)
+{
+    for (size_t i = 0; i < retiredMeshes.size();)
+    {
+        if (retiredMeshes[i].frameIndex != frame_index)
+        {
+            i++;
+            continue;
+        }
+
+        Mesh &mesh = meshes[retiredMeshes[i].meshId];
+
+        vertexRanges.Free(mesh.vertices);
+        indexRanges.Free(mesh.indices);
+        mesh = {};
+
+        unusedMeshIds.push_back(retiredMeshes[i].meshId);
+
+        retiredMeshes[i] = retiredMeshes.back();
+        retiredMeshes.pop_back();
+    }
+
+    for (size_t i = 0; i < retiredRanges.size();)
+    {
+        if (retiredRanges[i].frameIndex != frame_index)
+        {
+            i++;
+            continue;
+        }
+
+        (retiredRanges[i].isIndex ? indexRanges : vertexRanges).Free(retiredRanges[i].range);
+
+        retiredRanges[i] = retiredRanges.back();
+        retiredRanges.pop_back();
+    }
+}
+
+void GeometryPool::Compact(VkCommandBuffer cmd, uint32_t frame_index, VkDeviceSize byte_budget)
+{
+    if (stagingRing->HasPendingUploads())
+    {
+        return;
+    }
+
+    for (std::vector<VkBufferCopy> &copies : compactCopies)
+    {
+        copies.clear();
+    }
+
+    VkDeviceSize budget = byte_budget;
+
+    for (const bool isIndex : {false, true})
+    {
+        TlsfAllocator &ranges = isIndex ? indexRanges : vertexRanges;
+
+        if (RangeStats(ranges).fragmentation < COMPACT_FRAGMENTATION)
+        {
+            continue;
+        }
+
+        const uint32_t firstStream = isIndex ? INDEX : POSITION;
+        const uint32_t lastStream = isIndex ? INDEX : UV;
+
+        VkDeviceSize elementBytes = 0;
+
+        for (uint32_t stream = firstStream; stream <= lastStream; stream++)
+        {
+            elementBytes += STREAM_STRIDES[stream];
+        }
+
+        // The highest mesh first, for as long as a lower range fits it.
+        while (true)
+        {
+            Mesh *highest = nullptr;
+
+            for (Mesh &mesh : meshes)
+            {
+                if (mesh.alive && (highest == nullptr ||
+                                   (isIndex ? mesh.indices : mesh.vertices).offset >
+                                   (isIndex ? highest->indices : highest->vertices).offset))
+                {
+                    highest = &mesh;
+                }
+            }
+
+            if (highest == nullptr)
+            {
+                break;
+            }
+
+            TlsfAllocator::Allocation &current = isIndex ? highest->indices : highest->vertices;
+
+            if (current.size * elementBytes > budget)
+            {
+                break;
+            }
+
+            const TlsfAllocator::Allocation moved = ranges.Allocate(current.size, 1);
+
+            if (moved.node == TlsfAllocator::INVALID_NODE)
+            {
+                break;
+            }
+
+            if (moved.offset > current.offset)
+            {
+                ranges.Free(moved);
+                break;
+            }
+
+            for (uint32_t stream = firstStream; stream <= lastStream; stream++)
+            {
+                VkBufferCopy region = {};
+                region.srcOffset = current.offset * STREAM_STRIDES[stream];
+                region.dstOffset = moved.offset * STREAM_STRIDES[stream];
+                region.size = current.size * STREAM_STRIDES[stream];
+
+                compactCopies[stream].push_back(region);
+
+                if (defragmenter != nullptr)
+                {
+                    defragmenter->MarkWritten(buffers[stream], region.dstOffset);
+                }
+            }
+
+            // The frames in flight, this one included, still draw from the old range.
+            retiredRanges.push_back({current, isIndex, frame_index});
+            current = moved;
+            budget -= moved.size * elementBytes;
+        }
+    }
+
+    if (std::all_of(std::begin(compactCopies), std::end(compactCopies),
+        [](const std::vector<VkBufferCopy> &copies) { return copies.empty(); }))
+    {
+        return;
+    }
+
+    // The uploads flushed earlier in the command buffer must land before the copy reads.
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+
+    for (uint32_t stream = 0; stream < STREAM_COUNT; stream++)
+    {
+        if (!compactCopies[stream].empty())
+        {
+            // Source and destination ranges never overlap: both are allocated.
+            vkCmdCopyBuffer(cmd, buffers[stream], buffers[stream],
+                static_cast<uint32_t>(compactCopies[stream].size()), compactCopies[stream].data());
+        }
+    }
+
+    // Vertex input of the next draws, or the defragmenter copying the buffer out.
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                            VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+}
+
+void GeometryPool::Bind(VkCommandBuffer cmd) const
+{
+    // Same order as the pipeline vertex bindings.
+    const VkBuffer vertexBuffers[] = {
+        buffers[POSITION],
+        buffers[COLOR],
+        buffers[NORMAL],
+        buffers[UV],
+    };
+
+    constexpr VkDeviceSize OFFSETS[] = {
+        0,
+        0,
+        0,
+        0
+    };
+
+    vkCmdBindVertexBuffers(cmd, 0, 4, &vertexBuffers[0], &OFFSETS[0]);
+    vkCmdBindIndexBuffer(cmd, buffers[INDEX], 0, VK_INDEX_TYPE_UINT32);
+}
+
+MeshDraw GeometryPool::Draw(uint32_t mesh_id) const
+{
+    assert(mesh_id < meshes.size() && meshes[mesh_id].alive);
+
+    const Mesh &mesh = meshes[mesh_id];
+
+    MeshDraw draw = {};
+    draw.indexCount = static_cast<uint32_t>(mesh.indices.size);
+    draw.firstIndex = static_cast<uint32_t>(mesh.indices.offset);
+    draw.vertexOffset = static_cast<int32_t>(mesh.vertices.offset);
+    memcpy(draw.boundingSphere, mesh.boundingSphere, sizeof(draw.boundingSphere));
+
+    return draw;
+}
+
+GeometryPoolStats GeometryPool::Stats() const
+{
+    GeometryPoolStats stats = {};
+    stats.meshCount = meshCount;
+    stats.vertices = RangeStats(vertexRanges);
+    stats.indices = RangeStats(indexRanges);
+
+    return stats;
+}
+
+void GeometryPool::Write(Stream stream, VkDeviceSize offset, const void *p_data, VkDeviceSize size)
+{
+    const VkDeviceSize byteOffset = offset * STREAM_STRIDES[stream];
+
+    if (memory[stream].mapped != nullptr)
+    {
+        memcpy(static_cast<uint8_t *>(memory[stream].mapped) + byteOffset, p_data, size);
+
+        if (defragmenter != nullptr)
+        {
+            defragmenter->MarkWritten(buffers[stream], byteOffset);
+        }
+    }
+    else
+    {
+        stagingRing->Upload(buffers[stream], byteOffset, p_data, size);
+    }
+}
+
+GeometryRangeStats GeometryPool::RangeStats(const TlsfAllocator &allocator)
+{
+    GeometryRangeStats stats = {};
+    stats.capacity = allocator.Size();
+    stats.used = allocator.UsedSize();
+    stats.largestFree = allocator.LargestFreeBlock();
+    stats.freeRanges = allocator.FreeBlockCount();
+
+    const uint64_t totalFree = stats.capacity - stats.used;
+
+    stats.fragmentation = totalFree > 0
+                              ? 1.0f - static_cast<float>(stats.largestFree) /
+                                       static_cast<float>(totalFree)
+                              : 0.0f;
+
+    return stats;
+}
+}
@@ -0,0 +1,263 @@
+#include "GpuCulling.h"
+#include "../FileSystem.h"
+#include "GeometryPool.h"
+#include "MemoryBudget.h"
+#include "VkCommon.h"
+
+#include <glm/geometric.hpp>
+
+#include <cassert>
+#include <cstring>
+
+namespace Renderer
+{
+void GpuCulling::Init(
+    VkDevice device,
+    DeviceMemoryAllocator *p_memory_allocator,
+    uint32_t frame_count,
+    uint32_t capacity,
+    uint32_t queue_family_count,
+    const uint32_t *p_queue_families,
+    VkPipelineCache pipeline_cache)
+{
+    this->device = device;
+    memoryAllocator = p_memory_allocator;
+    this->capacity = capacity;
+
+    InitPipeline(pipeline_cache);
+
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = 2 * frame_count;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = frame_count;
+    poolCreateInfo.poolSizeCount = 1;
+    poolCreateInfo.pPoolSizes = &poolSize;
+
+    VK_CHECK(vkCreateDescriptorPool(device, &poolCreateInfo,
+        memoryAllocator->AllocationCallbacks(), &descriptorPool));
+
+    frames.resize(frame_count);
+
+    for (Frame &frame : frames)
+    {
+        // Written by the CPU every frame, read once by the shader.
+        vk_create_buffer(
+            device,
+            memoryAllocator,
+            sizeof(DrawInput) * capacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            MemoryCategory::OTHER,
+            memoryAllocator->AllocationCallbacks(),
+            &frame.inputBuffer,
+            &frame.inputMemory);
+
+        assert(frame.inputMemory.mapped != nullptr);
+
+        vk_create_concurrent_buffer(
+            device,
+            memoryAllocator,
+            static_cast<VkDeviceSize>(COMMAND_STRIDE) * capacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryCategory::OTHER,
+            queue_family_count,
+            p_queue_families,
+            memoryAllocator->AllocationCallbacks(),
+            &frame.indirectBuffer,
+            &frame.indirectMemory);
+
+        VkDescriptorSetAllocateInfo setAllocateInfo = {};
+        setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setAllocateInfo.descriptorPool = descriptorPool;
+        setAllocateInfo.descriptorSetCount = 1;
+        setAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+        VK_CHECK(vkAllocateDescriptorSets(device, &setAllocateInfo, &frame.descriptorSet));
+
+        VkDescriptorBufferInfo bufferInfos[2] = {};
+        bufferInfos[0].buffer = frame.inputBuffer;
+        bufferInfos[0].range = VK_WHOLE_SIZE;
+        bufferInfos[1].buffer = frame.indirectBuffer;
+        bufferInfos[1].range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet descriptorWrites[2] = {};
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = frame.descriptorSet;
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+
+        vkUpdateDescriptorSets(device, 2, &descriptorWrites[0], 0, nullptr);
+    }
+}
+
+void GpuCulling::Teardown()
+{
+    VkAllocationCallbacks *allocationCallbacks = memoryAllocator->AllocationCallbacks();
+
+    for (Frame &frame : frames)
+    {
+        vkDestroyBuffer(device, frame.inputBuffer, allocationCallbacks);
+        memoryAllocator->Free(&frame.inputMemory);
+
+        vkDestroyBuffer(device, frame.indirectBuffer, allocationCallbacks);
+        memoryAllocator->Free(&frame.indirectMemory);
+    }
+
+    frames.clear();
+
+    // Destroying the pool frees its sets.
+    vkDestroyDescriptorPool(device, descriptorPool, allocationCallbacks);
+    vkDestroyPipeline(device, pipeline, allocationCallbacks);
+    vkDestroyPipelineLayout(device, pipelineLayout, allocationCallbacks);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocationCallbacks);
+}
+
+void GpuCulling::BeginFrame(uint32_t frame_index, const glm::mat4 &view_projection)
+{
+    FrustumConstants &constants = frames[frame_index].constants;
+    constants.drawCount = 0;
+
+    // Gribb-Hartmann on the rows of the matrix, with a [0, 1] depth range.
+    const glm::mat4 m = glm::transpose(view_projection);
+
+    constants.planes[0] = m[3] + m[0];
+    constants.planes[1] = m[3] - m[0];
+    constants.planes[2] = m[3] + m[1];
+    constants.planes[3] = m[3] - m[1];
+    constants.planes[4] = m[2];
+    constants.planes[5] = m[3] - m[2];
+
+    // Normalized: the shader compares the distances with the sphere radius.
+    for (glm::vec4 &plane : constants.planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+void GpuCulling::AddDraw(uint32_t frame_index, const glm::mat4 &model, const MeshDraw &mesh_draw)
+{
+    Frame &frame = frames[frame_index];
+
+    if (frame.constants.drawCount >= capacity)
+    {
+        return;
+    }
+
+    DrawInput input = {};
+    input.model = model;
+    input.boundingSphere = glm::vec4(
+        mesh_draw.boundingSphere[0],
+        mesh_draw.boundingSphere[1],
+        mesh_draw.boundingSphere[2],
+        mesh_draw.boundingSphere[3]);
+    input.indexCount = mesh_draw.indexCount;
+    input.firstIndex = mesh_draw.firstIndex;
+    input.vertexOffset = mesh_draw.vertexOffset;
+
+    DrawInput *inputs = static_cast<DrawInput *>(frame.inputMemory.mapped);
+    memcpy(&inputs[frame.constants.drawCount++], &input, sizeof(DrawInput));
+}
+
+void GpuCulling::Record(VkCommandBuffer cmd, uint32_t frame_index) const
+{
+    const Frame &frame = frames[frame_index];
+
+    if (frame.constants.drawCount == 0)
+    {
+        return;
+    }
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+        &frame.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+        sizeof(FrustumConstants), &frame.constants);
+    vkCmdDispatch(cmd, (frame.constants.drawCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+}
+
+VkBuffer GpuCulling::IndirectBuffer(uint32_t frame_index) const
+{
+    return frames[frame_index].indirectBuffer;
+}
+
+uint32_t GpuCulling::DrawCount(uint32_t frame_index) const
+{
+    return frames[frame_index].constants.drawCount;
+}
+
+VkDeviceSize GpuCulling::CommandOffset(uint32_t draw_index)
+{
+    return static_cast<VkDeviceSize>(draw_index) * COMMAND_STRIDE;
+}
+
+void GpuCulling::InitPipeline(VkPipelineCache pipeline_cache)
+{
+    VkAllocationCallbacks *allocationCallbacks = memoryAllocator->AllocationCallbacks();
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+    setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCreateInfo.bindingCount = 2;
+    setLayoutCreateInfo.pBindings = &bindings[0];
+
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, allocationCallbacks,
+        &descriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(FrustumConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocationCallbacks,
+        &pipelineLayout));
+
+    auto shaderCode = FileSystem::ReadFile("../Resources/Shaders/cull.comp.spv");
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = static_cast<uint32_t>(shaderCode.size());
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
+
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateShaderModule(device, &moduleInfo, allocationCallbacks, &shaderModule));
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+
+    VK_CHECK(vkCreateComputePipelines(device, pipeline_cache, 1, &pipelineInfo,
+        allocationCallbacks, &pipeline));
+
+    vkDestroyShaderModule(device, shaderModule, allocationCallbacks);
+}
+}
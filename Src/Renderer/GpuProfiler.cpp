@@ -0,0 +1,257 @@
+#include "GpuProfiler.h"
+#include "VkCommon.h"
+
+#include <cassert>
+
+namespace Renderer
+{
+void GpuProfiler::Init(
+    VkDevice device,
+    VkPhysicalDevice gpu,
+    uint32_t queue_family_index,
+    uint32_t frame_count,
+    bool has_pipeline_statistics,
+    bool has_inherited_queries,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    allocationCallbacks = p_allocation_callbacks;
+    hasStatistics = has_pipeline_statistics;
+    hasInheritedQueries = has_inherited_queries;
+    frames.assign(frame_count, {});
+    lastStats.clear();
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+
+    const uint32_t validBits = families[queue_family_index].timestampValidBits;
+    hasTimestamps = validBits > 0;
+
+    if (hasTimestamps)
+    {
+        timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(gpu, &properties);
+        nanosecondsPerTick = properties.limits.timestampPeriod;
+    }
+
+    for (FrameQueries &frame : frames)
+    {
+        if (hasTimestamps)
+        {
+            VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+            queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCreateInfo.queryCount = MAX_PASSES * 2;
+
+            VK_CHECK(vkCreateQueryPool(device, &queryPoolCreateInfo, allocationCallbacks,
+                &frame.timestampPool));
+        }
+
+        if (hasStatistics)
+        {
+            VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+            queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            queryPoolCreateInfo.queryCount = MAX_PASSES;
+            queryPoolCreateInfo.pipelineStatistics = STATISTICS;
+
+            VK_CHECK(vkCreateQueryPool(device, &queryPoolCreateInfo, allocationCallbacks,
+                &frame.statisticsPool));
+        }
+    }
+}
+
+void GpuProfiler::Teardown()
+{
+    for (const FrameQueries &frame : frames)
+    {
+        vkDestroyQueryPool(device, frame.timestampPool, allocationCallbacks);
+        vkDestroyQueryPool(device, frame.statisticsPool, allocationCallbacks);
+    }
+
+    frames.clear();
+    lastStats.clear();
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer cmd, uint32_t frame_index)
+{
+    FrameQueries &frame = frames[frame_index];
+    frame.passCount = 0;
+    frame.isRecorded = true;
+
+    if (hasTimestamps)
+    {
+        vkCmdResetQueryPool(cmd, frame.timestampPool, 0, MAX_PASSES * 2);
+    }
+
+    if (hasStatistics)
+    {
+        vkCmdResetQueryPool(cmd, frame.statisticsPool, 0, MAX_PASSES);
+    }
+}
+
+uint32_t GpuProfiler::BeginPass(
+    VkCommandBuffer cmd,
+    uint32_t frame_index,
+    const char *name,
+    bool executes_secondaries)
+{
+    FrameQueries &frame = frames[frame_index];
+
+    if (frame.passCount == MAX_PASSES)
+    {
+        return MAX_PASSES;
+    }
+
+    const uint32_t pass = frame.passCount++;
+    frame.names[pass] = name;
+    frame.hasPassStatistics[pass] = hasStatistics && (!executes_secondaries || hasInheritedQueries);
+
+    if (hasTimestamps)
+    {
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, pass * 2);
+    }
+
+    if (frame.hasPassStatistics[pass])
+    {
+        vkCmdBeginQuery(cmd, frame.statisticsPool, pass, 0);
+    }
+
+    return pass;
+}
+
+void GpuProfiler::EndPass(VkCommandBuffer cmd, uint32_t frame_index, uint32_t pass) const
+{
+    if (pass == MAX_PASSES)
+    {
+        return;
+    }
+
+    const FrameQueries &frame = frames[frame_index];
+    assert(pass < frame.passCount);
+
+    if (frame.hasPassStatistics[pass])
+    {
+        vkCmdEndQuery(cmd, frame.statisticsPool, pass);
+    }
+
+    if (hasTimestamps)
+    {
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampPool, pass * 2 + 1);
+    }
+}
+
+bool GpuProfiler::Collect(uint32_t frame_index)
+{
+    FrameQueries &frame = frames[frame_index];
+
+    if (!frame.isRecorded)
+    {
+        return false;
+    }
+
+    frame.isRecorded = false;
+
+    if (frame.passCount == 0)
+    {
+        lastStats.clear();
+        return true;
+    }
+
+    // No WAIT flag: the frame timeline says the submission is done, but a query never
+    // written (e.g. a pass skipped) must not block the frame.
+    uint64_t timestamps[MAX_PASSES * 2] = {};
+    uint64_t statistics[MAX_PASSES * STATISTICS_COUNT] = {};
+
+    if (hasTimestamps &&
+        vkGetQueryPoolResults(device, frame.timestampPool, 0, frame.passCount * 2,
+            sizeof(timestamps), &timestamps[0], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    {
+        return false;
+    }
+
+    // One pass at a time: the passes with timestamps only left their query unwritten.
+    for (uint32_t pass = 0; pass < frame.passCount; pass++)
+    {
+        if (frame.hasPassStatistics[pass] &&
+            vkGetQueryPoolResults(device, frame.statisticsPool, pass, 1,
+                sizeof(uint64_t) * STATISTICS_COUNT, &statistics[pass * STATISTICS_COUNT],
+                sizeof(uint64_t) * STATISTICS_COUNT, VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        {
+            return false;
+        }
+    }
+
+    lastStats.resize(frame.passCount);
+
+    for (uint32_t pass = 0; pass < frame.passCount; pass++)
+    {
+        GpuPassStats &stats = lastStats[pass];
+        stats.name = frame.names[pass];
+
+        const uint64_t begin = timestamps[pass * 2] & timestampMask;
+        const uint64_t end = timestamps[pass * 2 + 1] & timestampMask;
+        stats.gpuMs = end > begin ? static_cast<double>(end - begin) * nanosecondsPerTick / 1e6 : 0.0;
+
+        // In the bit order of STATISTICS.
+        const uint64_t *passStatistics = &statistics[pass * STATISTICS_COUNT];
+        stats.inputAssemblyPrimitives = passStatistics[0];
+        stats.vertexInvocations = passStatistics[1];
+        stats.clippingPrimitives = passStatistics[2];
+        stats.fragmentInvocations = passStatistics[3];
+        stats.computeInvocations = passStatistics[4];
+    }
+
+    return true;
+}
+
+const std::vector<GpuPassStats> &GpuProfiler::LastStats() const
+{
+    return lastStats;
+}
+
+double GpuProfiler::LastFrameMs() const
+{
+    double frameMs = 0.0;
+
+    // The passes don't nest nor overlap on the queue: they add up.
+    for (const GpuPassStats &stats : lastStats)
+    {
+        frameMs += stats.gpuMs;
+    }
+
+    return frameMs;
+}
+
+bool GpuProfiler::HasTimestamps() const
+{
+    return hasTimestamps;
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::InheritedStatistics() const
+{
+    return hasStatistics && hasInheritedQueries ? STATISTICS : 0;
+}
+
+GpuProfileScope::GpuProfileScope(
+    GpuProfiler *p_profiler,
+    VkCommandBuffer cmd,
+    uint32_t frame_index,
+    const char *name)
+    : profiler(p_profiler),
+      cmd(cmd),
+      frameIndex(frame_index),
+      pass(p_profiler->BeginPass(cmd, frame_index, name, false))
+{
+}
+
+GpuProfileScope::~GpuProfileScope()
+{
+    profiler->EndPass(cmd, frameIndex, pass);
+}
+}
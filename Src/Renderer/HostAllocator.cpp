@@ -0,0 +1,324 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace Renderer
+{
+void HostAllocator::Init()
+{
+    callbacks.pUserData = this;
+    callbacks.pfnAllocation = Allocate;
+    callbacks.pfnReallocation = Reallocate;
+    callbacks.pfnFree = Free;
+    callbacks.pfnInternalAllocation = InternalAllocate;
+    callbacks.pfnInternalFree = InternalFree;
+}
+
+void HostAllocator::Teardown()
+{
+    for (uint32_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++)
+    {
+        const uint64_t leaked = scopes[i].currentBytes.load();
+
+        // Not an assert: some drivers keep instance allocations past vkDestroyInstance.
+        if (leaked > 0)
+        {
+            printf("\n[host allocator] scope %u: %llu bytes still allocated at teardown",
+                i, static_cast<unsigned long long>(leaked));
+        }
+    }
+
+    for (SizeClass &sizeClass : sizeClasses)
+    {
+        for (void *slab : sizeClass.slabs)
+        {
+            std::free(slab);
+        }
+
+        sizeClass.slabs.clear();
+        sizeClass.freeChunks.clear();
+    }
+
+    callbacks = {};
+}
+
+VkAllocationCallbacks *HostAllocator::Callbacks()
+{
+    assert(callbacks.pfnAllocation != nullptr && "Host allocator not initialized");
+    return &callbacks;
+}
+
+void HostAllocator::BeginFrame()
+{
+    HostFrameStats frame = {};
+
+    for (uint32_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++)
+    {
+        frame.allocations[i] = scopes[i].frameAllocations.exchange(0);
+        frame.reallocations[i] = scopes[i].frameReallocations.exchange(0);
+        frame.frees[i] = scopes[i].frameFrees.exchange(0);
+    }
+
+    frame.allocatedBytes = frameAllocatedBytes.exchange(0);
+
+    std::lock_guard lock(lastFrameMutex);
+    lastFrame = frame;
+}
+
+HostScopeStats HostAllocator::ScopeStats(VkSystemAllocationScope scope) const
+{
+    const ScopeCounters &counters = scopes[scope];
+
+    HostScopeStats stats = {};
+    stats.currentBytes = counters.currentBytes.load();
+    stats.peakBytes = counters.peakBytes.load();
+    stats.allocationCount = counters.allocationCount.load();
+    stats.internalBytes = counters.internalBytes.load();
+
+    return stats;
+}
+
+HostFrameStats HostAllocator::LastFrameStats() const
+{
+    std::lock_guard lock(lastFrameMutex);
+    return lastFrame;
+}
+
+void *HostAllocator::Allocate(
+    void *p_user_data,
+    size_t size,
+    size_t alignment,
+    VkSystemAllocationScope scope)
+{
+    HostAllocator *allocator = static_cast<HostAllocator *>(p_user_data);
+
+    if (size == 0)
+    {
+        return nullptr;
+    }
+
+    allocator->scopes[scope].frameAllocations++;
+
+    return allocator->AllocateBlock(size, alignment, scope);
+}
+
+void *HostAllocator::Reallocate(
+    void *p_user_data,
+    void *p_original,
+    size_t size,
+    size_t alignment,
+    VkSystemAllocationScope scope)
+{
+    HostAllocator *allocator = static_cast<HostAllocator *>(p_user_data);
+
+    // Spec: null original behaves like pfnAllocation, zero size like pfnFree.
+    if (p_original == nullptr)
+    {
+        return Allocate(p_user_data, size, alignment, scope);
+    }
+
+    if (size == 0)
+    {
+        Free(p_user_data, p_original);
+        return nullptr;
+    }
+
+    allocator->scopes[scope].frameReallocations++;
+
+    Header *header = HeaderOf(p_original);
+
+    // Still fits its chunk: only the accounting changes.
+    if (header->sizeClass != UNPOOLED &&
+        header->scope == scope &&
+        size <= SizeOfClass(header->sizeClass) &&
+        alignment <= HEADER_SIZE)
+    {
+        ScopeCounters &counters = allocator->scopes[scope];
+        counters.currentBytes += size;
+        counters.currentBytes -= header->size;
+        header->size = size;
+
+        return p_original;
+    }
+
+    void *memory = allocator->AllocateBlock(size, alignment, scope);
+
+    if (memory == nullptr)
+    {
+        // Spec: the original allocation stays valid on failure.
+        return nullptr;
+    }
+
+    memcpy(memory, p_original, std::min<size_t>(size, header->size));
+    allocator->FreeBlock(p_original);
+
+    return memory;
+}
+
+void HostAllocator::Free(void *p_user_data, void *p_memory)
+{
+    if (p_memory == nullptr)
+    {
+        return;
+    }
+
+    HostAllocator *allocator = static_cast<HostAllocator *>(p_user_data);
+
+    allocator->scopes[HeaderOf(p_memory)->scope].frameFrees++;
+    allocator->FreeBlock(p_memory);
+}
+
+void HostAllocator::InternalAllocate(
+    void *p_user_data,
+    size_t size,
+    VkInternalAllocationType type,
+    VkSystemAllocationScope scope)
+{
+    (void)type;
+    static_cast<HostAllocator *>(p_user_data)->scopes[scope].internalBytes += size;
+}
+
+void HostAllocator::InternalFree(
+    void *p_user_data,
+    size_t size,
+    VkInternalAllocationType type,
+    VkSystemAllocationScope scope)
+{
+    (void)type;
+    static_cast<HostAllocator *>(p_user_data)->scopes[scope].internalBytes -= size;
+}
+
+void *HostAllocator::AllocateBlock(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    uint8_t *payload = nullptr;
+    uint32_t baseOffset = 0;
+    uint8_t sizeClass = UNPOOLED;
+
+    if (size <= MAX_POOLED_SIZE && alignment <= HEADER_SIZE)
+    {
+        sizeClass = static_cast<uint8_t>(SizeClassOf(size));
+
+        uint8_t *chunk = static_cast<uint8_t *>(PopChunk(sizeClass));
+
+        if (chunk == nullptr)
+        {
+            return nullptr;
+        }
+
+        payload = chunk + HEADER_SIZE;
+    }
+    else
+    {
+        // The header sits right before the payload: keep it aligned too.
+        alignment = std::max(alignment, HEADER_SIZE);
+
+        uint8_t *base = static_cast<uint8_t *>(std::malloc(size + alignment + HEADER_SIZE));
+
+        if (base == nullptr)
+        {
+            return nullptr;
+        }
+
+        const uintptr_t address = reinterpret_cast<uintptr_t>(base) + HEADER_SIZE;
+        payload = reinterpret_cast<uint8_t *>((address + alignment - 1) & ~(alignment - 1));
+        baseOffset = static_cast<uint32_t>(payload - base);
+    }
+
+    Header *header = HeaderOf(payload);
+    header->size = size;
+    header->baseOffset = baseOffset;
+    header->sizeClass = sizeClass;
+    header->scope = static_cast<uint8_t>(scope);
+
+    ScopeCounters &counters = scopes[scope];
+    const uint64_t current = counters.currentBytes += size;
+    counters.allocationCount++;
+    frameAllocatedBytes += size;
+
+    uint64_t peak = counters.peakBytes.load();
+    while (current > peak && !counters.peakBytes.compare_exchange_weak(peak, current))
+    {
+    }
+
+    return payload;
+}
+
+void HostAllocator::FreeBlock(void *p_memory)
+{
+    const Header *header = HeaderOf(p_memory);
+
+    ScopeCounters &counters = scopes[header->scope];
+    counters.currentBytes -= header->size;
+    counters.allocationCount--;
+
+    if (header->sizeClass == UNPOOLED)
+    {
+        std::free(static_cast<uint8_t *>(p_memory) - header->baseOffset);
+        return;
+    }
+
+    SizeClass &sizeClass = sizeClasses[header->sizeClass];
+
+    std::lock_guard lock(sizeClass.mutex);
+    sizeClass.freeChunks.push_back(static_cast<uint8_t *>(p_memory) - HEADER_SIZE);
+}
+
+void *HostAllocator::PopChunk(uint32_t size_class)
+{
+    SizeClass &sizeClass = sizeClasses[size_class];
+
+    std::lock_guard lock(sizeClass.mutex);
+
+    if (sizeClass.freeChunks.empty())
+    {
+        // malloc alignment (16) is enough: chunk sizes are multiples of HEADER_SIZE.
+        uint8_t *slab = static_cast<uint8_t *>(std::malloc(SLAB_SIZE));
+
+        if (slab == nullptr)
+        {
+            return nullptr;
+        }
+
+        sizeClass.slabs.push_back(slab);
+
+        const size_t chunkSize = HEADER_SIZE + SizeOfClass(size_class);
+
+        for (size_t offset = 0; offset + chunkSize <= SLAB_SIZE; offset += chunkSize)
+        {
+            sizeClass.freeChunks.push_back(slab + offset);
+        }
+    }
+
+    void *chunk = sizeClass.freeChunks.back();
+    sizeClass.freeChunks.pop_back();
+
+    return chunk;
+}
+
+uint32_t HostAllocator::SizeClassOf(size_t size)
+{
+    uint32_t sizeClass = 0;
+
+    while (SizeOfClass(sizeClass) < size)
+    {
+        sizeClass++;
+    }
+
+    assert(sizeClass < SIZE_CLASS_COUNT);
+    return sizeClass;
+}
+
+size_t HostAllocator::SizeOfClass(uint32_t size_class)
+{
+    return static_cast<size_t>(16) << size_class;
+}
+
+HostAllocator::Header *HostAllocator::HeaderOf(void *p_memory)
+{
+    return reinterpret_cast<Header *>(static_cast<uint8_t *>(p_memory) - HEADER_SIZE);
+}
+}
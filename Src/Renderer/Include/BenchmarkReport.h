@@ -0,0 +1,100 @@
+#ifndef BENCHMARK_REPORT_H
+#define BENCHMARK_REPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Renderer
+{
+/// Distribution of a set of frame times, in milliseconds.
+struct FrameTimeSummary
+{
+    uint32_t count = {};
+
+    double mean = {};
+    double p50 = {};
+    double p95 = {};
+    double p99 = {};
+    double max = {};
+};
+
+/// What the numbers were measured on: written next to them.
+struct BenchmarkSetup
+{
+    std::string scene = {};
+
+    /// File of the replayed path, "orbit" for the scripted one.
+    std::string cameraPath = {};
+
+    std::string gpuName = {};
+
+    uint32_t width = {};
+    uint32_t height = {};
+    uint32_t framesInFlight = {};
+
+    /// No GPU frame times without timestamp support on the graphics queue.
+    bool hasGpuTimestamps = {};
+};
+
+/**
+ * @brief CPU and GPU frame times of a benchmark run, written as JSON.
+ *
+ * The run renders WARMUP_FRAMES first (pipelines, caches and driver allocations
+ * settle), then the measured frames. Every measured frame advances the camera
+ * path by TIMESTEP_SECONDS, whatever the real frame time, so a run renders the
+ * same frames on every machine and only the timings differ.
+ *
+ * The CPU time of a frame runs from the start of its iteration to the start of
+ * the next one. The GPU time is the sum of the GpuProfiler passes of the frame,
+ * read back when its frame-in-flight slot is reused.
+ */
+class BenchmarkReport
+{
+public:
+    static constexpr uint32_t WARMUP_FRAMES = 30;
+
+    static constexpr double TIMESTEP_SECONDS = 1.0 / 60.0;
+
+    void Init(const BenchmarkSetup &setup, uint32_t frame_count);
+
+    /// Init time of the renderer, and the part of it spent loading and uploading the scene.
+    void SetStartup(double startup_ms, double scene_load_ms);
+
+    /// From the start of Init to the end of the first presented frame.
+    void SetFirstFrame(double first_frame_ms);
+
+    /// Creation time of the startup pipelines, and whether the pipeline cache was loaded from disk.
+    void SetPipelines(double pipeline_ms, bool is_cache_warm);
+
+    void AddCpuFrame(double ms);
+
+    void AddGpuFrame(double ms);
+
+    [[nodiscard]] FrameTimeSummary CpuSummary() const;
+
+    [[nodiscard]] FrameTimeSummary GpuSummary() const;
+
+    [[nodiscard]] std::string ToJson() const;
+
+    /// @return false if the file can't be written.
+    bool WriteJson(const char *p_path) const;
+
+    /// Nearest rank percentiles, zero when samples is empty.
+    static FrameTimeSummary Summarize(const std::vector<double> &samples);
+
+private:
+    BenchmarkSetup setup = {};
+
+    double startupMs = {};
+    double sceneLoadMs = {};
+    double firstFrameMs = {};
+    double pipelineMs = {};
+    bool isPipelineCacheWarm = {};
+
+    std::vector<double> cpuFrameMs = {};
+    std::vector<double> gpuFrameMs = {};
+};
+}
+
+#endif //BENCHMARK_REPORT_H
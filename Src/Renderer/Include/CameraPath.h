@@ -0,0 +1,64 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+struct CameraKey
+{
+    /// Seconds since the start of the path.
+    double time = {};
+
+    glm::vec3 position = {};
+
+    /// Normalized view direction.
+    glm::vec3 front = {0.0f, 0.0f, 1.0f};
+};
+
+/**
+ * @brief Camera keys in time order, replayed by the benchmark.
+ *
+ * A path is either scripted (InitOrbit) or recorded from a live session
+ * (AddKey every frame, then Save). Sample() interpolates linearly between the
+ * two keys around a time and clamps outside the path, so the same time always
+ * gives the same camera.
+ *
+ * The file format is text, one key per line: "time px py pz fx fy fz". Empty
+ * lines and lines starting with '#' are skipped.
+ */
+class CameraPath
+{
+public:
+    /**
+     * Scripted path: one turn around center, always looking at it.
+     * @param key_count Keys on the circle, the interpolation cuts the corners in between.
+     */
+    void InitOrbit(glm::vec3 center, float radius, float height, double duration, uint32_t key_count);
+
+    /// Replace the keys with the ones in p_path. @return false if the file can't be read or has no key.
+    bool Load(const char *p_path);
+
+    /// @return false if the file can't be written.
+    bool Save(const char *p_path) const;
+
+    /// Append a key: time must not go back.
+    void AddKey(double time, glm::vec3 position, glm::vec3 front);
+
+    [[nodiscard]] bool IsEmpty() const;
+
+    /// Time of the last key.
+    [[nodiscard]] double Duration() const;
+
+    /// The path must not be empty.
+    void Sample(double time, glm::vec3 *p_position, glm::vec3 *p_front) const;
+
+private:
+    std::vector<CameraKey> keys = {};
+};
+}
+
+#endif //CAMERA_PATH_H
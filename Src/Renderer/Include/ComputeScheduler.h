@@ -0,0 +1,194 @@
+#ifndef COMPUTE_SCHEDULER_H
+#define COMPUTE_SCHEDULER_H
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Renderer
+{
+class FrameTimeline;
+
+/// Where a compute pass prefers to run.
+enum class ComputePassQueue : uint32_t
+{
+    /// On the compute queue when the device has one, overlapped with the graphics work.
+    ASYNC,
+
+    /// Always recorded at the beginning of the graphics command buffer.
+    GRAPHICS,
+};
+
+struct ComputePass
+{
+    const char *name = {};
+
+    ComputePassQueue queue = ComputePassQueue::ASYNC;
+
+    /// Reads what the graphics queue wrote the previous frame (e.g. post-processing):
+    /// the async submission waits the frame timeline first.
+    bool readsGraphicsOutput = {};
+
+    /// How the graphics frame consumes the output (e.g. DRAW_INDIRECT, INDIRECT_COMMAND_READ).
+    VkPipelineStageFlags consumerStages = {};
+    VkAccessFlags consumerAccess = {};
+
+    /// Dispatches the pass. Resources are per frame_index: they are never shared by frames in flight.
+    std::function<void(VkCommandBuffer cmd, uint32_t frame_index)> record = {};
+};
+
+/// GPU time of both queues for one frame, in milliseconds.
+struct QueueTimings
+{
+    double graphicsMs = {};
+    double computeMs = {};
+
+    /// Time the compute work of this frame ran beside the graphics work of the previous one.
+    double overlapMs = {};
+};
+
+/**
+ * @brief Two timestamps around the command buffer of every frame in flight.
+ *
+ * Disabled, and every call a no-op, when the queue family has no valid timestamp bits.
+ */
+class QueueTimer
+{
+public:
+    void Init(
+        VkDevice device,
+        VkPhysicalDevice gpu,
+        uint32_t queue_family_index,
+        uint32_t frame_count,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    void Teardown();
+
+    /// First command of cmd: outside a render pass.
+    void Begin(VkCommandBuffer cmd, uint32_t frame_index);
+
+    /// Last command of cmd.
+    void End(VkCommandBuffer cmd, uint32_t frame_index) const;
+
+    /**
+     * The submission of frame_index has completed.
+     * @return false if the timer is disabled or nothing was recorded for frame_index.
+     */
+    bool Resolve(uint32_t frame_index, uint64_t *p_begin, uint64_t *p_end);
+
+    [[nodiscard]] double TicksToMs(uint64_t ticks) const;
+
+private:
+    VkDevice device = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    VkQueryPool queryPool = {};
+    double nanosecondsPerTick = {};
+
+    /// Timestamps are truncated to the valid bits of the family.
+    uint64_t timestampMask = {};
+
+    std::vector<bool> isRecorded = {};
+};
+
+/**
+ * @brief Schedules compute passes on an async compute queue.
+ *
+ * The ASYNC passes of a frame are recorded in one command buffer of the compute
+ * family and submitted by Submit(), before the graphics frame is recorded. They
+ * signal a timeline semaphore the graphics submission waits for, only at the
+ * consumer stages of the passes: the compute work of frame N+1 runs while the
+ * graphics queue still renders frame N.
+ *
+ * Passes that read the graphics output wait for the previous frame only, on the
+ * FrameTimeline the graphics submissions signal.
+ *
+ * Without a compute only family (IsAsync() is false) every pass is recorded by
+ * RecordGraphicsPasses() at the beginning of the graphics command buffer, followed
+ * by a barrier to the consumer stages.
+ */
+class ComputeScheduler
+{
+public:
+    /**
+     * @param compute_family    Same as graphics_family when there is no dedicated family.
+     */
+    void Init(
+        VkDevice device,
+        VkPhysicalDevice gpu,
+        uint32_t compute_family,
+        VkQueue compute_queue,
+        uint32_t graphics_family,
+        FrameTimeline *p_frame_timeline,
+        uint32_t frame_count,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    [[nodiscard]] bool IsAsync() const;
+
+    /// Passes run in the order they were added. @return the pass index.
+    uint32_t AddPass(const ComputePass &pass);
+
+    /// The submission of frame_index has completed: read back its queue timings.
+    void BeginFrame(uint32_t frame_index);
+
+    /**
+     * Record and submit the ASYNC passes of frame_index.
+     * @return true if anything was submitted: the graphics submission must wait
+     *         Semaphore() at SignaledValue(), at WaitStages().
+     */
+    bool Submit(uint32_t frame_index);
+
+    /// Passes that run on the graphics queue this frame, and the barrier to their consumers.
+    void RecordGraphicsPasses(VkCommandBuffer cmd, uint32_t frame_index) const;
+
+    /// First and last commands of the graphics command buffer of frame_index.
+    void BeginGraphicsTiming(VkCommandBuffer cmd, uint32_t frame_index);
+    void EndGraphicsTiming(VkCommandBuffer cmd, uint32_t frame_index) const;
+
+    /// Compute timeline, signaled by every Submit.
+    [[nodiscard]] VkSemaphore Semaphore() const;
+    [[nodiscard]] uint64_t SignaledValue() const;
+    [[nodiscard]] VkPipelineStageFlags WaitStages() const;
+
+    /// Of the last frame read back by BeginFrame.
+    [[nodiscard]] QueueTimings LastTimings() const;
+
+private:
+    [[nodiscard]] bool RunsAsync(const ComputePass &pass) const;
+
+    static void CreateTimeline(VkDevice device, VkAllocationCallbacks *p_allocation_callbacks,
+        VkSemaphore *p_semaphore);
+
+private:
+    VkDevice device = {};
+    VkQueue queue = {};
+    FrameTimeline *frameTimeline = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    bool isAsync = {};
+
+    std::vector<ComputePass> passes = {};
+
+    std::vector<VkCommandPool> commandPools = {};
+    std::vector<VkCommandBuffer> commandBuffers = {};
+
+    VkSemaphore computeTimeline = {};
+    uint64_t computeValue = {};
+
+    QueueTimer computeTimer = {};
+    QueueTimer graphicsTimer = {};
+
+    /// Graphics interval of the frame read back before the current one, in ticks.
+    uint64_t previousGraphicsBegin = {};
+    uint64_t previousGraphicsEnd = {};
+
+    QueueTimings lastTimings = {};
+};
+}
+
+#endif //COMPUTE_SCHEDULER_H
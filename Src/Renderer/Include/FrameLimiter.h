@@ -0,0 +1,69 @@
+#ifndef FRAME_LIMITER_H
+#define FRAME_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+/// Frame time distribution over the last FrameLimiter::HISTORY_SIZE frames, in milliseconds.
+struct FrameTimePercentiles
+{
+    double p50 = {};
+    double p95 = {};
+    double p99 = {};
+    double max = {};
+};
+
+/**
+ * @brief Caps the frame rate on a fixed deadline grid.
+ *
+ * The OS sleep is precise to a millisecond at best, and overshoots by a varying
+ * amount: Wait() sleeps in short steps while the remaining time is above the
+ * worst overshoot measured so far, then spins (yielding) until the deadline.
+ * Deadlines advance by one period from the previous deadline, not from the end of
+ * the wait, so the error of a frame is not carried over to the next one. A frame
+ * later than a whole period re-anchors the grid instead of bursting to catch up.
+ *
+ * It also records the interval between frames for the percentiles.
+ */
+class FrameLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t HISTORY_SIZE = 512;
+
+    /// @param max_fps  0 disables the cap, the intervals are still recorded.
+    void Init(uint32_t max_fps);
+
+    /// Block until the deadline of the current frame, then start the next one.
+    void Wait();
+
+    /// Of the recorded intervals. All zero before the first frame.
+    [[nodiscard]] FrameTimePercentiles Percentiles() const;
+
+private:
+    void SleepUntil(Clock::time_point deadline);
+
+    void RecordInterval(Clock::time_point frame_end);
+
+private:
+    /// Below one OS sleep step there is only spinning left.
+    static constexpr double SLEEP_STEP_MS = 1.0;
+
+    Clock::duration period = {};
+    Clock::time_point deadline = {};
+    Clock::time_point lastFrameEnd = {};
+
+    /// Worst measured length of a SLEEP_STEP_MS sleep, decays slowly towards the recent ones.
+    double sleepEstimateMs = SLEEP_STEP_MS;
+
+    /// Ring of the last HISTORY_SIZE frame intervals.
+    std::vector<double> intervalsMs = {};
+    uint32_t nextInterval = {};
+};
+}
+
+#endif //FRAME_LIMITER_H
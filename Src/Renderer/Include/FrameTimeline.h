@@ -0,0 +1,77 @@
+#ifndef FRAME_TIMELINE_H
+#define FRAME_TIMELINE_H
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace Renderer
+{
+/**
+ * @brief The GPU completion clock of the engine.
+ *
+ * One timeline semaphore, signaled by every graphics submission with a value one
+ * greater than the previous one. "Has the GPU finished submission N" is a
+ * comparison with the semaphore counter: any subsystem can poll it (IsComplete)
+ * or block on it (Wait), without owning a fence.
+ *
+ * Defer() queues work (typically a destruction) until the GPU is done with
+ * everything submitted so far and with the frame being recorded. Collect() runs
+ * the work whose value has completed, once per frame.
+ */
+class FrameTimeline
+{
+public:
+    void Init(VkDevice device, VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// The caller must have waited the device idle: the deferred work still queued runs now.
+    void Teardown();
+
+    /// Signaled by the graphics submissions.
+    [[nodiscard]] VkSemaphore Semaphore() const;
+
+    /// Reserve the value of the next graphics submission: it must signal Semaphore() with it.
+    uint64_t NextValue();
+
+    /// Value of the last submission, 0 before the first one.
+    [[nodiscard]] uint64_t SubmittedValue() const;
+
+    /// Latest value the GPU has reached.
+    uint64_t CompletedValue();
+
+    bool IsComplete(uint64_t value);
+
+    /// Block until the GPU reaches value. 0 returns immediately.
+    void Wait(uint64_t value);
+
+    /// Run fn once the submission following this call has completed.
+    void Defer(std::function<void()> fn);
+
+    /// Run the deferred work whose value has completed, in the order it was queued.
+    void Collect();
+
+private:
+    struct DeferredWork
+    {
+        uint64_t value = {};
+        std::function<void()> fn = {};
+    };
+
+    VkDevice device = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    VkSemaphore timeline = {};
+
+    uint64_t submittedValue = {};
+
+    /// Cached: the counter only grows, no need to ask the driver for values below it.
+    uint64_t completedValue = {};
+
+    /// Sorted by value, Defer only appends greater or equal ones.
+    std::deque<DeferredWork> deferred = {};
+};
+}
+
+#endif //FRAME_TIMELINE_H
@@ -0,0 +1,196 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include "MemoryAllocator.h"
+#include "TlsfAllocator.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+struct BatchCpu;
+class MemoryDefragmenter;
+class StagingRing;
+
+/// Arguments of vkCmdDrawIndexed for one mesh of the pool.
+struct MeshDraw
+{
+    uint32_t indexCount = {};
+    uint32_t firstIndex = {};
+    int32_t vertexOffset = {};
+
+    /// Mesh space bounding sphere: center xyz, radius w. Read by the GPU culling.
+    float boundingSphere[4] = {};
+};
+
+struct GeometryRangeStats
+{
+    /// In elements (vertices or indices).
+    uint64_t capacity = {};
+    uint64_t used = {};
+    uint64_t largestFree = {};
+    uint32_t freeRanges = {};
+
+    /// 1 - largestFree / (capacity - used): 0 means all the free space is one range.
+    float fragmentation = {};
+};
+
+struct GeometryPoolStats
+{
+    uint32_t meshCount = {};
+    GeometryRangeStats vertices = {};
+    GeometryRangeStats indices = {};
+};
+
+/**
+ * @brief Shared vertex and index buffers for every mesh.
+ *
+ * One buffer per vertex attribute (position, color, normal, uv) and one index
+ * buffer, allocated once at Init. Meshes get a vertex range and an index range
+ * from two TLSF allocators counting elements: the attribute buffers share the
+ * vertex range, so a mesh is one vertexOffset and one firstIndex. Everything is
+ * bound once per command buffer.
+ *
+ * Meshes are added and removed at runtime without touching the other meshes.
+ * A removed mesh keeps its ranges until Reclaim() is called for the frame that
+ * removed it, since the GPU may still read them. Compact() moves the meshes at
+ * the end of the ranges into lower free ranges, a few per frame, so the free
+ * space merges back into large ranges.
+ */
+class GeometryPool
+{
+public:
+    static constexpr uint32_t INVALID_MESH = UINT32_MAX;
+
+    static constexpr uint32_t DEFAULT_VERTEX_CAPACITY = 2u * 1024 * 1024;
+    static constexpr uint32_t DEFAULT_INDEX_CAPACITY = 8u * 1024 * 1024;
+
+    /// Draws address vertices with the signed vertexOffset, indices with firstIndex.
+    static constexpr uint32_t MAX_VERTEX_CAPACITY = INT32_MAX;
+    static constexpr uint32_t MAX_INDEX_CAPACITY = UINT32_MAX;
+
+    /// Range fragmentation above which Compact moves meshes.
+    static constexpr float COMPACT_FRAGMENTATION = 0.25f;
+
+    /**
+     * @param memory_flags      DEVICE_LOCAL: data goes through p_staging_ring.
+     *                          HOST_VISIBLE: data is written directly.
+     * @param p_defragmenter    Optional, the pool buffers are registered as movable.
+     */
+    void Init(
+        VkDevice device,
+        DeviceMemoryAllocator *p_memory_allocator,
+        StagingRing *p_staging_ring,
+        MemoryDefragmenter *p_defragmenter,
+        VkMemoryPropertyFlags memory_flags,
+        uint32_t vertex_capacity,
+        uint32_t index_capacity);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    /**
+     * Indices are relative to the first vertex of the mesh.
+     * @warning Device local: mesh data is read by the staging ring flushes, it must stay
+     *          valid until they are done.
+     * @return INVALID_MESH if the pool has no free range big enough.
+     */
+    uint32_t AddMesh(const BatchCpu &mesh);
+
+    /// Ranges are released by Reclaim(frame_index).
+    void RemoveMesh(uint32_t mesh_id, uint32_t frame_index);
+
+    /// The submission of frame_index has completed.
+    void Reclaim(uint32_t frame_index);
+
+    /**
+     * Copy the highest meshes of the fragmented ranges into lower free ranges, at most
+     * byte_budget bytes. Draw() returns the new ranges right away, the old ones are released
+     * by Reclaim(frame_index). Must be recorded outside a render pass, before the draws of
+     * the next frames. Does nothing while uploads are pending: they target the old ranges.
+     */
+    void Compact(VkCommandBuffer cmd, uint32_t frame_index, VkDeviceSize byte_budget);
+
+    /// Bind the attribute buffers (position, color, normal, uv at bindings 0 to 3) and the
+    /// index buffer, once for every mesh.
+    void Bind(VkCommandBuffer cmd) const;
+
+    [[nodiscard]] MeshDraw Draw(uint32_t mesh_id) const;
+
+    [[nodiscard]] GeometryPoolStats Stats() const;
+
+private:
+    struct Mesh
+    {
+        TlsfAllocator::Allocation vertices = {};
+        TlsfAllocator::Allocation indices = {};
+        float boundingSphere[4] = {};
+        bool alive = {};
+    };
+
+    struct RetiredMesh
+    {
+        uint32_t meshId = {};
+        uint32_t frameIndex = {};
+    };
+
+    /// Left behind by Compact.
+    struct RetiredRange
+    {
+        TlsfAllocator::Allocation range = {};
+        bool isIndex = {};
+        uint32_t frameIndex = {};
+    };
+
+    enum Stream : uint32_t
+    {
+        POSITION,
+        COLOR,
+        NORMAL,
+        UV,
+        INDEX,
+        STREAM_COUNT
+    };
+
+    void Write(Stream stream, VkDeviceSize offset, const void *p_data, VkDeviceSize size);
+
+    static GeometryRangeStats RangeStats(const TlsfAllocator &allocator);
+
+private:
+    static constexpr VkDeviceSize STREAM_STRIDES[STREAM_COUNT] = {
+        sizeof(float) * 3,
+        sizeof(float) * 4,
+        sizeof(float) * 3,
+        sizeof(float) * 2,
+        sizeof(uint32_t),
+    };
+
+    VkDevice device = {};
+    DeviceMemoryAllocator *memoryAllocator = {};
+    StagingRing *stagingRing = {};
+    MemoryDefragmenter *defragmenter = {};
+
+    /// The defragmenter patches them in place: never cache them.
+    VkBuffer buffers[STREAM_COUNT] = {};
+    DeviceAllocation memory[STREAM_COUNT] = {};
+    uint32_t movableIds[STREAM_COUNT] = {};
+
+    TlsfAllocator vertexRanges = {};
+    TlsfAllocator indexRanges = {};
+
+    std::vector<Mesh> meshes = {};
+    std::vector<uint32_t> unusedMeshIds = {};
+    std::vector<RetiredMesh> retiredMeshes = {};
+    std::vector<RetiredRange> retiredRanges = {};
+
+    /// Reused by every Compact, per stream.
+    std::vector<VkBufferCopy> compactCopies[STREAM_COUNT] = {};
+
+    uint32_t meshCount = {};
+};
+}
+
+#endif //GEOMETRY_POOL_H
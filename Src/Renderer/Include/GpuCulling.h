@@ -0,0 +1,120 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include "MemoryAllocator.h"
+
+#include <volk/volk.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+struct MeshDraw;
+
+/**
+ * @brief Frustum culling of the draw list in a compute shader.
+ *
+ * The CPU writes one entry per draw (model matrix, bounding sphere, draw
+ * arguments) every frame; the shader writes one VkDrawIndexedIndirectCommand
+ * per draw, with zero instances when the sphere is outside the frustum. The
+ * draw order is preserved: draw i is always at CommandOffset(i).
+ *
+ * Every buffer is per frame in flight. The indirect buffer is shared by the
+ * compute and graphics families (concurrent), so the pass can run on the async
+ * compute queue without ownership transfers.
+ */
+class GpuCulling
+{
+public:
+    static constexpr uint32_t DEFAULT_CAPACITY = 16 * 1024;
+
+    /// Local size of cull.comp.
+    static constexpr uint32_t GROUP_SIZE = 64;
+
+    /**
+     * @param p_queue_families  Families reading or writing the indirect buffer.
+     * @param pipeline_cache    For the culling pipeline, may be VK_NULL_HANDLE.
+     */
+    void Init(
+        VkDevice device,
+        DeviceMemoryAllocator *p_memory_allocator,
+        uint32_t frame_count,
+        uint32_t capacity,
+        uint32_t queue_family_count,
+        const uint32_t *p_queue_families,
+        VkPipelineCache pipeline_cache);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    /**
+     * Write the entries of frame_index. Draws past the capacity are dropped.
+     * @param view_projection   Planes are extracted from it: depth in [0, 1].
+     */
+    void BeginFrame(uint32_t frame_index, const glm::mat4 &view_projection);
+    void AddDraw(uint32_t frame_index, const glm::mat4 &model, const MeshDraw &mesh_draw);
+
+    /// Dispatch the culling of frame_index.
+    void Record(VkCommandBuffer cmd, uint32_t frame_index) const;
+
+    [[nodiscard]] VkBuffer IndirectBuffer(uint32_t frame_index) const;
+
+    /// Draws added to frame_index, at most the capacity.
+    [[nodiscard]] uint32_t DrawCount(uint32_t frame_index) const;
+
+    [[nodiscard]] static VkDeviceSize CommandOffset(uint32_t draw_index);
+
+    static constexpr uint32_t COMMAND_STRIDE = sizeof(VkDrawIndexedIndirectCommand);
+
+private:
+    /// std430 layout of cull.comp.
+    struct DrawInput
+    {
+        glm::mat4 model;
+        glm::vec4 boundingSphere;
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t padding;
+    };
+
+    struct FrustumConstants
+    {
+        glm::vec4 planes[6];
+        uint32_t drawCount;
+    };
+
+    struct Frame
+    {
+        VkBuffer inputBuffer = {};
+        DeviceAllocation inputMemory = {};
+
+        VkBuffer indirectBuffer = {};
+        DeviceAllocation indirectMemory = {};
+
+        VkDescriptorSet descriptorSet = {};
+
+        FrustumConstants constants = {};
+    };
+
+    void InitPipeline(VkPipelineCache pipeline_cache);
+
+private:
+    VkDevice device = {};
+    DeviceMemoryAllocator *memoryAllocator = {};
+
+    uint32_t capacity = {};
+
+    std::vector<Frame> frames = {};
+
+    VkDescriptorSetLayout descriptorSetLayout = {};
+    VkDescriptorPool descriptorPool = {};
+    VkPipelineLayout pipelineLayout = {};
+    VkPipeline pipeline = {};
+};
+}
+
+#endif //GPU_CULLING_H
@@ -0,0 +1,156 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+/// What the GPU did between the markers of one pass.
+struct GpuPassStats
+{
+    const char *name = {};
+
+    double gpuMs = {};
+
+    /// Zero without the pipelineStatisticsQuery feature, or for a pass executing secondaries
+    /// without the inheritedQueries feature.
+    uint64_t inputAssemblyPrimitives = {};
+    uint64_t vertexInvocations = {};
+    uint64_t clippingPrimitives = {};
+    uint64_t fragmentInvocations = {};
+    uint64_t computeInvocations = {};
+};
+
+/**
+ * @brief Timestamps and pipeline statistics around the passes of the graphics command buffer.
+ *
+ * Every frame in flight owns a timestamp pool (two queries per pass) and, if the
+ * device has the pipelineStatisticsQuery feature, a pipeline statistics pool (one
+ * query per pass). BeginFrame() resets the pools of the frame on the GPU.
+ *
+ * The results of a frame are read back by Collect() when its slot comes round
+ * again, after the frame timeline wait: nothing stalls, the stats are
+ * frames-in-flight frames late. A frame whose results are not ready keeps the
+ * previous stats.
+ *
+ * Passes can't nest: a pipeline statistics query can't be active twice in the
+ * same command buffer. Without the inheritedQueries feature no query may be active
+ * around vkCmdExecuteCommands, so such passes only get timestamps.
+ */
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t MAX_PASSES = 16;
+
+    static constexpr VkQueryPipelineStatisticFlags STATISTICS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+    /**
+     * @param has_pipeline_statistics   The pipelineStatisticsQuery feature is enabled on device.
+     * @param has_inherited_queries     The inheritedQueries feature is enabled on device.
+     */
+    void Init(
+        VkDevice device,
+        VkPhysicalDevice gpu,
+        uint32_t queue_family_index,
+        uint32_t frame_count,
+        bool has_pipeline_statistics,
+        bool has_inherited_queries,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    void Teardown();
+
+    /// Outside a render pass, before the first pass of frame_index.
+    void BeginFrame(VkCommandBuffer cmd, uint32_t frame_index);
+
+    /**
+     * The pass must end in the same subpass it begins in, or outside a render pass.
+     * @param executes_secondaries  The pass calls vkCmdExecuteCommands, with the inheritance
+     *                              of InheritedStatistics().
+     * @return the pass index of EndPass, MAX_PASSES (ignored) if the frame is full.
+     */
+    uint32_t BeginPass(VkCommandBuffer cmd, uint32_t frame_index, const char *name, bool executes_secondaries);
+
+    void EndPass(VkCommandBuffer cmd, uint32_t frame_index, uint32_t pass) const;
+
+    /**
+     * The submission of frame_index has completed: read its results back if available.
+     * @return true if LastStats() now holds the results of that submission.
+     */
+    bool Collect(uint32_t frame_index);
+
+    /// Of the last frame collected, in pass order.
+    [[nodiscard]] const std::vector<GpuPassStats> &LastStats() const;
+
+    /// GPU time of the last frame collected: the sum of its passes.
+    [[nodiscard]] double LastFrameMs() const;
+
+    /// The graphics queue has timestamps: gpuMs is measured, zero otherwise.
+    [[nodiscard]] bool HasTimestamps() const;
+
+    /// For the inheritance of the secondaries executed inside a pass, 0 without statistics or
+    /// without the inheritedQueries feature.
+    [[nodiscard]] VkQueryPipelineStatisticFlags InheritedStatistics() const;
+
+private:
+    /// Component count of STATISTICS, in the order of the results.
+    static constexpr uint32_t STATISTICS_COUNT = 5;
+
+    struct FrameQueries
+    {
+        VkQueryPool timestampPool = {};
+        VkQueryPool statisticsPool = {};
+
+        const char *names[MAX_PASSES] = {};
+        uint32_t passCount = {};
+
+        /// The statistics query of the pass was begun.
+        bool hasPassStatistics[MAX_PASSES] = {};
+
+        /// BeginFrame was recorded since the last Collect.
+        bool isRecorded = {};
+    };
+
+private:
+    VkDevice device = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    bool hasTimestamps = {};
+    bool hasStatistics = {};
+    bool hasInheritedQueries = {};
+
+    double nanosecondsPerTick = {};
+    uint64_t timestampMask = {};
+
+    std::vector<FrameQueries> frames = {};
+
+    std::vector<GpuPassStats> lastStats = {};
+};
+
+/// Marks a pass for the lifetime of the scope.
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler *p_profiler, VkCommandBuffer cmd, uint32_t frame_index, const char *name);
+
+    ~GpuProfileScope();
+
+    GpuProfileScope(const GpuProfileScope &) = delete;
+    GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+
+private:
+    GpuProfiler *profiler = {};
+    VkCommandBuffer cmd = {};
+    uint32_t frameIndex = {};
+    uint32_t pass = {};
+};
+}
+
+#endif //GPU_PROFILER_H
@@ -0,0 +1,148 @@
+#ifndef HOST_ALLOCATOR_H
+#define HOST_ALLOCATOR_H
+
+#include <volk/volk.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Renderer
+{
+/// One counter set per VkSystemAllocationScope (COMMAND, OBJECT, CACHE, DEVICE, INSTANCE).
+constexpr uint32_t HOST_ALLOCATION_SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+struct HostScopeStats
+{
+    uint64_t currentBytes = {};
+    uint64_t peakBytes = {};
+    uint64_t allocationCount = {};
+
+    /// Driver internal (executable) memory reported through the notification callbacks.
+    uint64_t internalBytes = {};
+};
+
+/// Calls made between two BeginFrame.
+struct HostFrameStats
+{
+    uint32_t allocations[HOST_ALLOCATION_SCOPE_COUNT] = {};
+    uint32_t reallocations[HOST_ALLOCATION_SCOPE_COUNT] = {};
+    uint32_t frees[HOST_ALLOCATION_SCOPE_COUNT] = {};
+    uint64_t allocatedBytes = {};
+};
+
+/**
+ * @brief VkAllocationCallbacks serving the driver host allocations.
+ *
+ * Small allocations (up to MAX_POOLED_SIZE, alignment up to HEADER_SIZE) come
+ * from size-class free lists refilled by 64 KiB slabs, never given back before
+ * Teardown: drivers allocate and free the same few sizes over and over. The rest
+ * goes to the system allocator. Every allocation carries a HEADER_SIZE header
+ * with its class, scope and size, so free and realloc need no lookup.
+ *
+ * Bytes are tracked per VkSystemAllocationScope, and calls per frame: COMMAND
+ * scope allocations every frame mean the driver allocates inside vkCmd* or
+ * vkQueueSubmit.
+ *
+ * Drivers call it from any thread: one lock per size class, atomic counters.
+ * Disabled means passing nullptr as pAllocator: no cost at all.
+ */
+class HostAllocator
+{
+public:
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr size_t MAX_POOLED_SIZE = 2048;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    void Init();
+
+    /// Every object created with Callbacks() must have been destroyed.
+    void Teardown();
+
+    /// Valid between Init and Teardown, to pass as pAllocator.
+    [[nodiscard]] VkAllocationCallbacks *Callbacks();
+
+    /// Close the counters of the previous frame, see LastFrameStats.
+    void BeginFrame();
+
+    [[nodiscard]] HostScopeStats ScopeStats(VkSystemAllocationScope scope) const;
+
+    [[nodiscard]] HostFrameStats LastFrameStats() const;
+
+private:
+    /// 16, 32, ..., 2048 bytes of payload.
+    static constexpr uint32_t SIZE_CLASS_COUNT = 8;
+    static constexpr uint8_t UNPOOLED = UINT8_MAX;
+
+    struct Header
+    {
+        uint64_t size;
+        uint32_t baseOffset;
+        uint8_t sizeClass;
+        uint8_t scope;
+        uint16_t padding;
+    };
+
+    static_assert(sizeof(Header) == HEADER_SIZE);
+
+    struct SizeClass
+    {
+        std::mutex mutex = {};
+        std::vector<void *> freeChunks = {};
+        std::vector<void *> slabs = {};
+    };
+
+    struct ScopeCounters
+    {
+        std::atomic<uint64_t> currentBytes = {};
+        std::atomic<uint64_t> peakBytes = {};
+        std::atomic<uint64_t> allocationCount = {};
+        std::atomic<uint64_t> internalBytes = {};
+
+        std::atomic<uint32_t> frameAllocations = {};
+        std::atomic<uint32_t> frameReallocations = {};
+        std::atomic<uint32_t> frameFrees = {};
+    };
+
+    static void *VKAPI_PTR Allocate(void *p_user_data, size_t size, size_t alignment,
+        VkSystemAllocationScope scope);
+
+    static void *VKAPI_PTR Reallocate(void *p_user_data, void *p_original, size_t size,
+        size_t alignment, VkSystemAllocationScope scope);
+
+    static void VKAPI_PTR Free(void *p_user_data, void *p_memory);
+
+    static void VKAPI_PTR InternalAllocate(void *p_user_data, size_t size,
+        VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+    static void VKAPI_PTR InternalFree(void *p_user_data, size_t size,
+        VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+    void *AllocateBlock(size_t size, size_t alignment, VkSystemAllocationScope scope);
+
+    void FreeBlock(void *p_memory);
+
+    void *PopChunk(uint32_t size_class);
+
+    static uint32_t SizeClassOf(size_t size);
+
+    static size_t SizeOfClass(uint32_t size_class);
+
+    static Header *HeaderOf(void *p_memory);
+
+private:
+    VkAllocationCallbacks callbacks = {};
+
+    SizeClass sizeClasses[SIZE_CLASS_COUNT] = {};
+    ScopeCounters scopes[HOST_ALLOCATION_SCOPE_COUNT] = {};
+
+    std::atomic<uint64_t> frameAllocatedBytes = {};
+
+    HostFrameStats lastFrame = {};
+    mutable std::mutex lastFrameMutex = {};
+};
+}
+
+#endif //HOST_ALLOCATOR_H
@@ -0,0 +1,180 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+#include "MemoryBudget.h"
+#include "TlsfAllocator.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Renderer
+{
+/// A range of VkDeviceMemory owned by a buffer or an image.
+struct DeviceAllocation
+{
+    VkDeviceMemory memory = {};
+    VkDeviceSize offset = {};
+    VkDeviceSize size = {};
+
+    /// Host address of offset. Null if the memory type is not host visible.
+    void *mapped = {};
+
+    uint32_t memoryTypeIndex = {};
+
+    MemoryCategory category = {};
+
+    /// Owning block, DeviceMemoryAllocator::DEDICATED_BLOCK for a dedicated allocation.
+    uint32_t blockIndex = {};
+
+    TlsfAllocator::Allocation range = {};
+};
+
+struct DeviceMemoryStats
+{
+    /// Sum of every vkAllocateMemory alive.
+    VkDeviceSize reservedBytes = {};
+
+    /// Bytes handed out to resources.
+    VkDeviceSize usedBytes = {};
+
+    uint32_t blockCount = {};
+    uint32_t dedicatedCount = {};
+    uint32_t allocationCount = {};
+};
+
+/// A live block, for the defragmenter and the statistics.
+struct DeviceBlockInfo
+{
+    uint32_t blockIndex = {};
+    uint32_t memoryTypeIndex = {};
+    bool isLinear = {};
+    VkDeviceSize size = {};
+    VkDeviceSize usedBytes = {};
+    uint32_t allocationCount = {};
+};
+
+/**
+ * @brief Sub-allocates resources from a few large VkDeviceMemory blocks.
+ *
+ * One vkAllocateMemory per resource exhausts maxMemoryAllocationCount and costs
+ * a kernel call each time. Blocks are allocated per memory type and split with a
+ * TLSF allocator. Host visible blocks are persistently mapped.
+ *
+ * bufferImageGranularity: when the device reports a value greater than one, linear
+ * (buffers, linear images) and optimal resources never share a block, so they can
+ * never end up on the same granularity page.
+ *
+ * Resources larger than half a block, or asking for it (e.g. render targets
+ * recreated on resize), get a dedicated allocation. So do the resources that
+ * need a new block when the heap has no room left for one.
+ *
+ * Every allocation and every vkAllocateMemory is reported to Budget().
+ *
+ * Thread safe.
+ */
+class DeviceMemoryAllocator
+{
+public:
+    static constexpr uint32_t DEDICATED_BLOCK = UINT32_MAX;
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    /**
+     * @param has_memory_budget         VK_EXT_memory_budget is enabled, see MemoryBudget::Init.
+     * @param p_allocation_callbacks    Host callbacks of the device, null for the driver ones.
+     */
+    void Init(
+        VkDevice device,
+        VkPhysicalDevice gpu,
+        VkDeviceSize preferred_block_size,
+        bool has_memory_budget,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// Every allocation must have been freed.
+    void Teardown();
+
+    /// @return the vkAllocateMemory error when neither a block nor a dedicated allocation
+    /// fits: p_allocation is left empty.
+    [[nodiscard]] VkResult Allocate(
+        const VkMemoryRequirements &requirements,
+        VkMemoryPropertyFlags memory_property_flags,
+        bool is_linear_resource,
+        bool prefer_dedicated,
+        MemoryCategory category,
+        DeviceAllocation *p_allocation);
+
+    void Free(DeviceAllocation *p_allocation);
+
+    /**
+     * Allocate the new home of a resource moved out of source's block: same memory
+     * type, only in blocks already more used than the source one, never in a new block.
+     * @return false if no such block has room.
+     */
+    bool AllocateForMove(
+        const VkMemoryRequirements &requirements,
+        const DeviceAllocation &source,
+        DeviceAllocation *p_allocation);
+
+    /// Dedicated allocations are not listed, they can't fragment.
+    [[nodiscard]] std::vector<DeviceBlockInfo> BlockInfos() const;
+
+    /// Queried once at Init.
+    [[nodiscard]] const VkPhysicalDeviceMemoryProperties &MemoryProperties() const;
+
+    [[nodiscard]] DeviceMemoryStats Stats() const;
+
+    [[nodiscard]] MemoryBudget &Budget();
+
+    /// The device host callbacks: objects bound to this allocator memory are created with them.
+    [[nodiscard]] VkAllocationCallbacks *AllocationCallbacks() const;
+
+private:
+    struct Block
+    {
+        VkDeviceMemory memory = {};
+        uint8_t *mapped = {};
+        uint32_t memoryTypeIndex = {};
+        bool isLinear = {};
+        TlsfAllocator ranges = {};
+    };
+
+    /// min_size must account for the alignment padding of the request.
+    VkResult CreateBlock(
+        uint32_t memory_type_index,
+        bool is_linear,
+        VkDeviceSize min_size,
+        uint32_t *p_block_index);
+
+    VkResult AllocateDedicated(
+        const VkMemoryRequirements &requirements,
+        uint32_t memory_type_index,
+        DeviceAllocation *p_allocation);
+
+    [[nodiscard]] VkDeviceSize BlockSizeForType(uint32_t memory_type_index) const;
+
+    [[nodiscard]] bool IsHostVisible(uint32_t memory_type_index) const;
+
+    [[nodiscard]] uint32_t HeapIndex(uint32_t memory_type_index) const;
+
+private:
+    VkDevice device = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    VkDeviceSize bufferImageGranularity = {};
+    VkDeviceSize preferredBlockSize = {};
+
+    /// Destroyed blocks leave a hole (memory == VK_NULL_HANDLE) so indices stay valid.
+    std::vector<Block> blocks = {};
+
+    DeviceMemoryStats stats = {};
+
+    MemoryBudget budget = {};
+
+    mutable std::mutex mutex = {};
+};
+}
+
+#endif //MEMORY_ALLOCATOR_H
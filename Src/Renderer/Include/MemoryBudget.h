@@ -0,0 +1,145 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Renderer
+{
+/// What a device allocation is used for, given to vk_create_buffer / vk_create_image.
+enum class MemoryCategory : uint32_t
+{
+    GEOMETRY,
+    UNIFORMS,
+    ATTACHMENTS,
+    STAGING,
+    TEXTURES,
+    OTHER,
+    COUNT
+};
+
+const char *MemoryCategoryName(MemoryCategory category);
+
+struct MemoryCounter
+{
+    VkDeviceSize current = {};
+    VkDeviceSize peak = {};
+    uint32_t allocationCount = {};
+};
+
+struct HeapBudget
+{
+    VkDeviceSize size = {};
+    bool deviceLocal = {};
+
+    /// vkAllocateMemory alive on this heap, made by this allocator.
+    MemoryCounter reserved = {};
+
+    /// Process usage reported by VK_EXT_memory_budget, reserved bytes without it.
+    VkDeviceSize usage = {};
+
+    /// What the process can use before the driver starts evicting or failing.
+    /// VK_EXT_memory_budget value, or a share of the heap size without it.
+    VkDeviceSize budget = {};
+};
+
+/**
+ * @brief Accounting of the device memory, per category and per heap.
+ *
+ * The DeviceMemoryAllocator reports every allocation (tagged with its category)
+ * and every block reserved from a heap. With VK_EXT_memory_budget the heap usage
+ * and budget come from the driver, refreshed by Update(); without it the budget
+ * is FALLBACK_BUDGET_SHARE of the heap size and the usage is what we reserved.
+ *
+ * Threshold callbacks run from Update() when a heap usage crosses a share of its
+ * budget, upwards or back down, so streaming systems can back off and resume.
+ *
+ * Thread safe.
+ */
+class MemoryBudget
+{
+public:
+    /// Same heuristic as the drivers without the extension: leave room for the other processes.
+    static constexpr float FALLBACK_BUDGET_SHARE = 0.8f;
+
+    /// Usage share of the budget the renderer warns at.
+    static constexpr float DEFAULT_WARNING_THRESHOLD = 0.9f;
+
+    /**
+     * @param is_over   true when usage went above the threshold, false when it went back under.
+     */
+    using ThresholdCallback = std::function<void(uint32_t heap_index, const HeapBudget &heap, bool is_over)>;
+
+    /**
+     * @param has_memory_budget VK_EXT_memory_budget is enabled on the device (and
+     *                          VK_KHR_get_physical_device_properties2 on the instance).
+     */
+    void Init(VkPhysicalDevice gpu, bool has_memory_budget);
+
+    void Teardown();
+
+    /// Called by the allocator.
+    void OnAllocate(MemoryCategory category, VkDeviceSize size);
+    void OnFree(MemoryCategory category, VkDeviceSize size);
+    void OnReserve(uint32_t heap_index, VkDeviceSize size);
+    void OnRelease(uint32_t heap_index, VkDeviceSize size);
+
+    /// Refresh the driver budget and run the threshold callbacks. Once per frame.
+    void Update();
+
+    /// @param threshold Share of the heap budget, e.g. 0.9f.
+    void AddThresholdCallback(float threshold, ThresholdCallback callback);
+
+    [[nodiscard]] bool HasMemoryBudgetExtension() const;
+
+    [[nodiscard]] MemoryCounter Category(MemoryCategory category) const;
+
+    [[nodiscard]] uint32_t HeapCount() const;
+
+    [[nodiscard]] HeapBudget Heap(uint32_t heap_index) const;
+
+    /// Current and peak numbers of every category and heap.
+    [[nodiscard]] std::string ToJson() const;
+
+    /// @return false if the file can't be written.
+    bool DumpJson(const char *p_path) const;
+
+private:
+    struct Threshold
+    {
+        float share = {};
+        ThresholdCallback callback = {};
+        bool isOver[VK_MAX_MEMORY_HEAPS] = {};
+    };
+
+    /// Caller holds the mutex.
+    void QueryDriverBudget();
+
+    static void Add(MemoryCounter *p_counter, VkDeviceSize size);
+    static void Subtract(MemoryCounter *p_counter, VkDeviceSize size);
+
+private:
+    VkPhysicalDevice gpu = {};
+    bool hasMemoryBudget = {};
+
+    uint32_t heapCount = {};
+    HeapBudget heaps[VK_MAX_MEMORY_HEAPS] = {};
+
+    /// Driver usage lags our vkAllocateMemory until the next query: add what we reserved since.
+    VkDeviceSize driverUsage[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize reservedAtQuery[VK_MAX_MEMORY_HEAPS] = {};
+
+    MemoryCounter categories[static_cast<uint32_t>(MemoryCategory::COUNT)] = {};
+
+    std::vector<Threshold> thresholds = {};
+
+    mutable std::mutex mutex = {};
+};
+}
+
+#endif //MEMORY_BUDGET_H
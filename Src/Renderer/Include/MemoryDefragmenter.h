@@ -0,0 +1,161 @@
+#ifndef MEMORY_DEFRAGMENTER_H
+#define MEMORY_DEFRAGMENTER_H
+
+#include "MemoryAllocator.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Renderer
+{
+struct DefragmentationStats
+{
+    /// 1 - used / reserved over the shared blocks: the share of memory a full compaction would give back.
+    float fragmentation = {};
+
+    uint64_t bytesMoved = {};
+    uint32_t buffersMoved = {};
+
+    /// Buffers being copied chunk by chunk, still used from their old location.
+    uint32_t activeMoves = {};
+
+    /// Moves waiting for their frame to complete before the old copy is released.
+    uint32_t pendingReleases = {};
+};
+
+/**
+ * @brief Incremental compaction of the DeviceMemoryAllocator blocks.
+ *
+ * Owners register the buffers that may move. Every frame, Update() looks for
+ * sparse blocks (usage under SPARSE_BLOCK_USAGE) and copies their registered
+ * buffers into denser blocks of the same memory type with vkCmdCopyBuffer,
+ * within a per-frame byte budget: a buffer larger than the budget is copied in
+ * chunks over several frames, the moves in progress first.
+ *
+ * Meanwhile the owner keeps using the old buffer and reports its writes with
+ * MarkWritten(), the move copies the written range again. Once the last chunk
+ * has completed (Reclaim() of its frame) with no write since, the owner handle
+ * and allocation are patched in place, then the owner callback runs to patch
+ * anything else holding the old handle (descriptor sets, pending uploads).
+ *
+ * The old buffer is still read by the frames in flight: it is destroyed and its
+ * range freed by the next Reclaim() of the frame that completed the move. A
+ * block left empty is released by the allocator.
+ *
+ * Images are not moved: they would need their layout and views recreated.
+ */
+class MemoryDefragmenter
+{
+public:
+    static constexpr uint32_t INVALID_ID = UINT32_MAX;
+
+    /// Bytes copied per frame by default.
+    static constexpr VkDeviceSize DEFAULT_FRAME_BUDGET = 8ull * 1024 * 1024;
+
+    /// Blocks used less than this are evacuated.
+    static constexpr float SPARSE_BLOCK_USAGE = 0.5f;
+
+    /// Called when the move completes, the old buffer stays valid for the frames in flight.
+    using MovedCallback = std::function<void(VkBuffer old_buffer, VkBuffer new_buffer)>;
+
+    void Init(VkDevice device, DeviceMemoryAllocator *p_memory_allocator);
+
+    /// Every buffer must have been unregistered, the caller must have waited the device idle.
+    void Teardown();
+
+    /**
+     * @param p_buffer      Patched in place on move. Must stay valid until Unregister.
+     * @param p_allocation  Patched in place on move. Must stay valid until Unregister.
+     * @param usage         The usage the buffer was created with, must include TRANSFER_SRC.
+     */
+    uint32_t Register(
+        VkBuffer *p_buffer,
+        DeviceAllocation *p_allocation,
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        MovedCallback on_moved);
+
+    /// A move in progress is abandoned, its copy released once no frame writes it.
+    void Unregister(uint32_t id);
+
+    /**
+     * buffer was written from offset on, by the host or by commands recorded before the next
+     * Update. A move in progress copies that part again. Ignored for other buffers.
+     */
+    void MarkWritten(VkBuffer buffer, VkDeviceSize offset);
+
+    /**
+     * Record the copies of this frame, at most frame_budget bytes. Must be recorded
+     * outside a render pass, before the commands using the registered buffers.
+     */
+    void Update(VkCommandBuffer cmd, uint32_t frame_index, VkDeviceSize frame_budget);
+
+    /// The submission of frame_index has completed: complete the moves it copied last.
+    void Reclaim(uint32_t frame_index);
+
+    [[nodiscard]] DefragmentationStats Stats() const;
+
+private:
+    struct Movable
+    {
+        VkBuffer *buffer = {};
+        DeviceAllocation *allocation = {};
+        VkDeviceSize size = {};
+        VkBufferUsageFlags usage = {};
+        MovedCallback onMoved = {};
+        bool registered = {};
+
+        /// Destination of the move in progress, null when not moving.
+        VkBuffer moveBuffer = {};
+        DeviceAllocation moveAllocation = {};
+
+        /// Copied from offset 0 on, a write before it moves it back.
+        VkDeviceSize copiedBytes = {};
+
+        /// Frame of the last chunk: the destination is written until it completes.
+        uint32_t lastCopyFrame = {};
+    };
+
+    struct Retired
+    {
+        VkBuffer buffer = {};
+        DeviceAllocation allocation = {};
+        uint32_t frameIndex = {};
+    };
+
+    struct Chunk
+    {
+        VkBuffer srcBuffer = {};
+        VkBuffer dstBuffer = {};
+        VkBufferCopy region = {};
+    };
+
+    /// Create the new buffer in a denser block. False if there is no room.
+    bool BeginMove(Movable &movable);
+
+    /// Queue the next chunk of the move, at most *p_budget bytes.
+    void CopyChunk(Movable &movable, uint32_t frame_index, VkDeviceSize *p_budget);
+
+    /// Patch the owner and retire the old buffer.
+    void CompleteMove(Movable &movable, uint32_t frame_index);
+
+private:
+    VkDevice device = {};
+    DeviceMemoryAllocator *memoryAllocator = {};
+
+    std::vector<Movable> movables = {};
+    std::vector<uint32_t> unusedIds = {};
+    std::vector<Retired> retired = {};
+
+    /// Reused by every Update.
+    std::vector<Chunk> chunks = {};
+
+    uint64_t bytesMoved = {};
+    uint32_t buffersMoved = {};
+};
+}
+
+#endif //MEMORY_DEFRAGMENTER_H
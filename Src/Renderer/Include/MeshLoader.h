@@ -31,9 +31,6 @@ private:
     static void ProcessNode(aiNode *node, const aiScene *scene, BatchCpu *batch,
         const aiMatrix4x4 &parentTransform);
 
-    static void ProcessMesh(aiMesh *mesh, const aiScene *scene, BatchCpu *batch,
-        const aiMatrix4x4 &parentTransform);
-
     static glm::mat4 ConvertMatrix(const aiMatrix4x4 &aiMat);
 
 private:
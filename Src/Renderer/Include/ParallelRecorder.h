@@ -0,0 +1,113 @@
+#ifndef PARALLEL_RECORDER_H
+#define PARALLEL_RECORDER_H
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Renderer
+{
+class ThreadPool;
+
+struct RecordStats
+{
+    /// From the first job submitted to the last secondary ended.
+    double wallMs = {};
+
+    /// Sum of the recording time of every slice: wallMs * sliceCount when it scales perfectly.
+    double cpuMs = {};
+
+    uint32_t sliceCount = {};
+    uint32_t itemCount = {};
+};
+
+/**
+ * @brief Records a draw list in parallel into secondary command buffers.
+ *
+ * The list is split in contiguous slices, one ThreadPool job each. Every slice
+ * owns a VkCommandPool per frame in flight, so no pool is ever touched by two
+ * threads. The primary executes the secondaries in slice order: the result is
+ * the same as recording the list in order on one thread.
+ *
+ * Slices record inside a render pass (RENDER_PASS_CONTINUE): they must set all
+ * their state (pipeline, viewport, descriptor sets, ...) themselves.
+ */
+class ParallelRecorder
+{
+public:
+    /// Below this, a slice costs more in job overhead than it saves.
+    static constexpr uint32_t MIN_ITEMS_PER_SLICE = 128;
+
+    /// Record items [first, first + count) into cmd. Called from the worker threads.
+    using RecordSliceFn = std::function<void(VkCommandBuffer cmd, uint32_t first, uint32_t count)>;
+
+    /**
+     * @param max_slices    0 means one per thread of p_thread_pool.
+     */
+    void Init(
+        VkDevice device,
+        uint32_t queue_family_index,
+        ThreadPool *p_thread_pool,
+        uint32_t frame_count,
+        uint32_t max_slices,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    /// The submission of frame_index has completed: reset its pools.
+    void BeginFrame(uint32_t frame_index);
+
+    /**
+     * Record item_count items in parallel, then execute the secondaries in primary.
+     * primary must be inside a render pass begun with SECONDARY_COMMAND_BUFFERS contents.
+     * Blocks until every slice is recorded.
+     */
+    void Record(
+        VkCommandBuffer primary,
+        uint32_t frame_index,
+        const VkCommandBufferInheritanceInfo &inheritance,
+        uint32_t item_count,
+        const RecordSliceFn &record_slice);
+
+    [[nodiscard]] uint32_t MaxSlices() const;
+
+    /// Of the last Record call.
+    [[nodiscard]] RecordStats LastStats() const;
+
+private:
+    struct SlicePool
+    {
+        VkCommandPool pool = {};
+
+        /// Reused every frame, one more when a frame records more than once.
+        std::vector<VkCommandBuffer> commandBuffers = {};
+        uint32_t usedCount = {};
+    };
+
+    VkCommandBuffer AcquireCommandBuffer(SlicePool &slice_pool);
+
+    SlicePool &Pool(uint32_t frame_index, uint32_t slice);
+
+private:
+    VkDevice device = {};
+    ThreadPool *threadPool = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    uint32_t frameCount = {};
+    uint32_t maxSlices = {};
+
+    /// frameCount * maxSlices, frame major.
+    std::vector<SlicePool> pools = {};
+
+    /// Reused by every Record.
+    std::vector<VkCommandBuffer> secondaries = {};
+    std::vector<double> sliceMs = {};
+
+    RecordStats lastStats = {};
+};
+}
+
+#endif //PARALLEL_RECORDER_H
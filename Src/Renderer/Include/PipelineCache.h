@@ -0,0 +1,131 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include "ThreadPool.h"
+
+#include <volk/volk.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Renderer
+{
+/**
+ * @brief VkPipelineCache kept on disk between runs, one file per device.
+ *
+ * The file is the cache data behind a header of our own: vendor, device, driver
+ * version and pipelineCacheUUID of the device that wrote it, the data size and a
+ * hash of the data. A file written by another device or driver, truncated or
+ * corrupted is ignored, and the cache starts cold: drivers are not required to
+ * validate what they are given and some crash on stale data.
+ *
+ * Threads compiling pipelines in parallel take a worker cache each, seeded with
+ * the main one, so they never contend on a lock of the driver. The saves merge the
+ * worker caches into the main one first. Saves go to a temporary file renamed over the previous one, so a
+ * crash while writing never leaves a torn file. SaveAsync only copies the data on
+ * the calling thread and writes it on a thread of its own, so the frame loop never
+ * waits on the disk.
+ */
+class PipelineCache
+{
+public:
+    /// SaveAsync() from the frame loop at most this often, so a crash loses little compilation.
+    static constexpr double SAVE_INTERVAL_SECONDS = 30.0;
+
+    /**
+     * Load the file of gpu from p_directory if valid, otherwise start empty.
+     * @param p_directory   Null: in memory only, nothing is loaded nor saved.
+     */
+    void Init(
+        VkDevice device,
+        VkPhysicalDevice gpu,
+        const char *p_directory,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// Finish the pending write, save and destroy. The device must be idle.
+    void Teardown();
+
+    /// For vkCreate*Pipelines at startup, from any thread. Not during the frame loop: the saves
+    /// merge into it, the threads compiling then take a worker cache.
+    [[nodiscard]] VkPipelineCache Cache() const;
+
+    /// Cache for one compiling thread, with the data of the main one: a warm start stays warm.
+    /// Merged by every save, destroyed by Teardown. Thread safe.
+    [[nodiscard]] VkPipelineCache CreateWorkerCache();
+
+    /**
+     * Merge the worker caches, then write the main cache if its data grew since the last save or the load.
+     * @return false if the file can't be written, the previous one is left untouched.
+     */
+    bool Save();
+
+    /// Merge the worker caches and copy the cache data if it grew, then write it on the writer thread. A write that fails is
+    /// reported from there, and the next save tries again.
+    void SaveAsync();
+
+    /// The cache was loaded from a valid file.
+    [[nodiscard]] bool IsWarm() const;
+
+    /// Bytes of cache data loaded at Init, zero when cold.
+    [[nodiscard]] size_t LoadedSize() const;
+
+private:
+    /// Ours, in front of the driver data.
+    struct FileHeader
+    {
+        uint32_t magic = {};
+        uint32_t version = {};
+        uint32_t vendorId = {};
+        uint32_t deviceId = {};
+        uint32_t driverVersion = {};
+        uint8_t pipelineCacheUuid[VK_UUID_SIZE] = {};
+        uint64_t dataSize = {};
+        uint64_t dataHash = {};
+    };
+
+    static constexpr uint32_t FILE_MAGIC = 0x48435050; // "PPCH"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    /// Into the main cache, which only the saves write. The worker caches stay in use.
+    void MergeWorkerCaches();
+
+    /// Header and data of the file, empty when the cache didn't grow since the last write.
+    [[nodiscard]] std::vector<char> Snapshot() const;
+
+    /// Temporary file renamed over path. Thread safe: only reads path and file.
+    [[nodiscard]] bool Write(const std::vector<char> &file) const;
+
+    /// @return the reason data can't be given to the driver, null if it can.
+    [[nodiscard]] const char *Validate(const std::vector<char> &file) const;
+
+    static uint64_t Hash(const char *p_data, size_t size);
+
+private:
+    VkDevice device = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    VkPhysicalDeviceProperties gpuProperties = {};
+
+    /// Empty when in memory only.
+    std::string path = {};
+
+    VkPipelineCache cache = {};
+
+    std::mutex workerMutex = {};
+    std::vector<VkPipelineCache> workerCaches = {};
+
+    size_t loadedSize = {};
+
+    /// Data size of the last file written, set by the writer thread too.
+    std::atomic<size_t> savedSize = {};
+
+    /// One thread: the writes land in the order of the snapshots.
+    ThreadPool writeThread = {};
+};
+}
+
+#endif //PIPELINE_CACHE_H
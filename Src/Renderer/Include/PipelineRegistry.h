@@ -0,0 +1,208 @@
+#ifndef PIPELINE_REGISTRY_H
+#define PIPELINE_REGISTRY_H
+
+#include "ThreadPool.h"
+
+#include <volk/volk.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Renderer
+{
+class PipelineCache;
+
+/**
+ * @brief Everything vkCreateGraphicsPipelines reads: equal descriptions are the same pipeline.
+ *
+ * Plain values, fixed size arrays: it can be copied, compared and hashed as is.
+ * Viewport and scissor are dynamic, they are not part of it.
+ */
+struct GraphicsPipelineDesc
+{
+    static constexpr uint32_t MAX_VERTEX_BINDINGS = 4;
+    static constexpr uint32_t MAX_VERTEX_ATTRIBUTES = 8;
+    static constexpr uint32_t MAX_SPECIALIZATION_CONSTANTS = 8;
+
+    /// From PipelineRegistry::AddShader: a module per distinct SPIR-V, so the handle stands for the code.
+    VkShaderModule vertexShader = {};
+    VkShaderModule fragmentShader = {};
+
+    uint32_t vertexBindingCount = {};
+    VkVertexInputBindingDescription vertexBindings[MAX_VERTEX_BINDINGS] = {};
+    uint32_t vertexAttributeCount = {};
+    VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTES] = {};
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+    /// Straight alpha blending of the color attachment, replace otherwise.
+    bool alphaBlend = false;
+
+    /// Values of the specialization constants 0 to specializationCount - 1, given to both stages.
+    uint32_t specializationCount = {};
+    uint32_t specialization[MAX_SPECIALIZATION_CONSTANTS] = {};
+
+    VkPipelineLayout layout = {};
+    VkRenderPass renderPass = {};
+    uint32_t subpass = {};
+
+    /// Field by field, the padding never counts. Arrays only up to their count.
+    [[nodiscard]] uint64_t Hash() const;
+
+    bool operator==(const GraphicsPipelineDesc &other) const;
+};
+
+/// Of Request: PENDING until a background thread is done with it.
+enum class PipelineState : uint32_t
+{
+    PENDING,
+    READY,
+
+    /// The driver refused it: Get stays VK_NULL_HANDLE, draws keep their fallback.
+    FAILED,
+};
+
+/// One executable of a compiled pipeline, from VK_KHR_pipeline_executable_properties.
+struct PipelineExecutableStats
+{
+    std::string name = {};
+    VkShaderStageFlags stages = {};
+
+    /// Zero when the driver doesn't report an instruction count.
+    uint64_t instructionCount = {};
+};
+
+struct PipelineRegistryStats
+{
+    /// Request calls.
+    uint64_t requests = {};
+
+    /// Distinct descriptions, each one compiled once.
+    uint32_t pipelines = {};
+    uint32_t pending = {};
+    uint32_t failed = {};
+
+    /// Sum over the compilations done, on the background threads.
+    double compileMs = {};
+};
+
+/**
+ * @brief Every graphics pipeline of the renderer, created once per description on background threads.
+ *
+ * Request hashes the description and returns the handle of the pipeline already
+ * registered for it, or registers a new one and queues its compilation. It never
+ * waits on the driver: until Get returns a pipeline, the draws using it are skipped
+ * or bind a fallback, so a new material or mode appearing mid-session costs no hitch.
+ * Wait is for the pipelines the first frame can't do without.
+ *
+ * Compilation has threads of its own rather than the renderer ThreadPool: a
+ * compilation takes milliseconds and would hold up the recording slices queued
+ * behind it. Each one compiles with a worker cache of the PipelineCache, warm
+ * pipelines come back quickly.
+ */
+class PipelineRegistry
+{
+public:
+    using Handle = uint32_t;
+
+    static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    /// A couple are enough to keep up with a burst of new pipelines, without taking cores from the frame.
+    static constexpr uint32_t DEFAULT_COMPILE_THREADS = 2;
+
+    /**
+     * @param capture_statistics    The pipelineExecutableInfo feature is enabled: compile with
+     *                              CAPTURE_STATISTICS and keep the executables statistics.
+     */
+    void Init(
+        VkDevice device,
+        PipelineCache *p_pipeline_cache,
+        uint32_t compile_thread_count,
+        bool capture_statistics,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// Finish the compilations in flight, then destroy the pipelines and the shader modules.
+    /// None of them may be in use by the device.
+    void Teardown();
+
+    /// Module of spirv, created at the first call with this code. Thread safe.
+    VkShaderModule AddShader(const std::vector<char> &spirv);
+
+    /// Handle of the pipeline of desc, the same for equal descriptions. Thread safe, doesn't block on compilations.
+    Handle Request(const GraphicsPipelineDesc &desc);
+
+    /// VK_NULL_HANDLE while PENDING or FAILED.
+    [[nodiscard]] VkPipeline Get(Handle handle) const;
+
+    [[nodiscard]] PipelineState State(Handle handle) const;
+
+    /// Block until the pipeline is compiled. @return VK_NULL_HANDLE if it FAILED.
+    VkPipeline Wait(Handle handle);
+
+    [[nodiscard]] PipelineRegistryStats Stats() const;
+
+    /// Empty while PENDING, or without capture_statistics.
+    [[nodiscard]] std::vector<PipelineExecutableStats> ExecutableStats(Handle handle) const;
+
+private:
+    struct Entry
+    {
+        GraphicsPipelineDesc desc = {};
+        uint64_t hash = {};
+
+        PipelineState state = PipelineState::PENDING;
+        VkPipeline pipeline = {};
+
+        std::vector<PipelineExecutableStats> executables = {};
+    };
+
+    struct ShaderEntry
+    {
+        /// Compared on a hash match: two codes with the same hash get a module each.
+        std::vector<char> spirv = {};
+        VkShaderModule module = {};
+    };
+
+    /// On a compile thread.
+    void Compile(Handle handle);
+
+    std::vector<PipelineExecutableStats> QueryExecutables(VkPipeline pipeline) const;
+
+private:
+    VkDevice device = {};
+    PipelineCache *pipelineCache = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+    bool captureStatistics = {};
+
+    ThreadPool compileThreads = {};
+
+    /// One per compile thread, taken by Compile for the time of a compilation.
+    std::vector<VkPipelineCache> freeWorkerCaches = {};
+
+    mutable std::mutex mutex = {};
+    std::condition_variable compiled = {};
+
+    /// Deque: entries don't move while the compile threads read their description.
+    std::deque<Entry> entries = {};
+    std::unordered_multimap<uint64_t, Handle> handlesByHash = {};
+
+    std::unordered_multimap<uint64_t, ShaderEntry> shadersByHash = {};
+
+    PipelineRegistryStats stats = {};
+};
+}
+
+#endif //PIPELINE_REGISTRY_H
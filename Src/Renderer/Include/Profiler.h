@@ -0,0 +1,109 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+
+namespace Renderer
+{
+enum class ProfileEventType : uint32_t
+{
+    ZONE,
+    FRAME,
+    COUNTER,
+};
+
+struct ProfileEvent
+{
+    /// Static storage only (literals, __func__): it is read back at export.
+    const char *name = {};
+
+    ProfileEventType type = {};
+
+    /// Since the first event of the process.
+    uint64_t beginNs = {};
+
+    /// ZONE only.
+    uint64_t durationNs = {};
+
+    /// COUNTER value, FRAME number.
+    double value = {};
+};
+
+/**
+ * @brief CPU instrumentation, exported as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+ *
+ * Every thread writes its events to its own ring of EVENTS_PER_THREAD, created on its
+ * first event: recording takes no lock and never allocates after that, the ring
+ * keeps the most recent events. Only the owning thread writes a ring; its head is
+ * published with release semantics and ExportChromeTrace reads it with acquire.
+ * The export copies a ring, then reads its head again and drops the events the
+ * thread overwrote meanwhile: threads can keep recording while it runs.
+ *
+ * Timestamps come from std::chrono::steady_clock (QueryPerformanceCounter on Windows,
+ * TSC backed on every recent CPU).
+ *
+ * Use the PROFILE_* macros: they compile to nothing without RENDERER_ENABLE_PROFILER.
+ */
+class Profiler
+{
+public:
+    static constexpr uint32_t EVENTS_PER_THREAD = 1u << 16;
+
+    /// Shown in the trace instead of the thread id.
+    static void SetThreadName(const char *name);
+
+    /// End of a frame: numbers the frames in the trace.
+    static void FrameMark();
+
+    static void Counter(const char *name, double value);
+
+    static void Zone(const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+    [[nodiscard]] static uint64_t NowNs();
+
+    /// @return false if the file can't be written.
+    static bool ExportChromeTrace(const char *p_path);
+};
+
+/// Records a zone from construction to destruction.
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name)
+        : name(name),
+          beginNs(Profiler::NowNs())
+    {
+    }
+
+    ~ProfileZone()
+    {
+        Profiler::Zone(name, beginNs, Profiler::NowNs());
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+    const char *name = {};
+    uint64_t beginNs = {};
+};
+}
+
+#ifdef RENDERER_ENABLE_PROFILER
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#define PROFILE_ZONE(name) ::Renderer::ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_FRAME() ::Renderer::Profiler::FrameMark()
+#define PROFILE_COUNTER(name, value) ::Renderer::Profiler::Counter(name, static_cast<double>(value))
+#define PROFILE_THREAD(name) ::Renderer::Profiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif //PROFILER_H
@@ -5,6 +5,30 @@
 #ifndef RUN_H
 #define RUN_H
 
+#include "BenchmarkReport.h"
+#include "CameraPath.h"
+#include "ComputeScheduler.h"
+#include "FrameLimiter.h"
+#include "FrameTimeline.h"
+#include "GeometryPool.h"
+#include "GpuProfiler.h"
+#include "GpuCulling.h"
+#include "HostAllocator.h"
+#include "MemoryAllocator.h"
+#include "MemoryDefragmenter.h"
+#include "ParallelRecorder.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "RendererConfig.h"
+#include "SceneGenerator.h"
+#include "ShaderVariant.h"
+#include "StagingRing.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+#include "TransferQueue.h"
+#include "UniformRing.h"
+#include "VirtualTexture.h"
+
 #include <volk/volk.h>
 #include <SDL2/SDL.h>
 #include <glm/vec3.hpp>
@@ -23,74 +47,74 @@ struct BatchCpu
     std::vector<glm::vec3> position;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec4> color;
+    std::vector<glm::vec2> uvs;
     std::vector<uint32_t> indices;
 };
 
-/// Groups all gpu buffers and gpu memories that fit one draw call command.
-/// It reflects the BatchCpu data.
-struct BatchGpu
-{
-    VkBuffer positionBuffer = {};
-    VkDeviceMemory positionMem = {};
-
-    VkBuffer normalBuffer = {};
-    VkDeviceMemory normalMem = {};
-
-    VkBuffer colorBuffer = {};
-    VkDeviceMemory colorMem = {};
-
-    VkBuffer indexBuffer = {};
-    VkDeviceMemory indexMem = {};
-};
-
-/// Uniform buffer
+/// Per-view constants, set 0 binding 0.
 struct PerFrameDataCpu
 {
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 projection;
 };
 
-template <size_t N>
-struct PerFrameDataGpu
+/// Per-draw constants, set 0 binding 1.
+struct PerDrawDataCpu
+{
+    alignas(16) glm::mat4 model;
+};
+
+/// One entry of the draw list, recorded in parallel slices.
+struct DrawItem
 {
-    VkBuffer buffers[N] = {};
-    VkDeviceMemory memory[N] = {};
-    void *data_mapped[N] = {};
-    VkDescriptorSet descriptorSets[N] = {};
+    uint32_t meshId = {};
+    glm::mat4 model = glm::mat4(1.0f);
 };
 
 /**
  * @brief Frame in flight (FIF) control CPU pacing and resource reuse.
  *
- * SoA of objects needed to handle the vulkan presentation synchronization
- * properly.
+ * Per-frame context of the objects needed to handle the vulkan presentation
+ * synchronization properly. The renderer holds RendererConfig::framesInFlight of
+ * them: one lets the CPU record a frame only once the GPU finished the previous
+ * one (lowest latency), more let it run ahead (higher throughput).
  */
-struct FramesInFlightType
+struct FrameInFlightType
 {
     /**
-     * @brief Defines the amount of frames in flight generated.
+     * Semaphore signaled when the image is acquired by the swapchain.
      */
-    static constexpr size_t MAX_FIF_COUNT = 2;
+    VkSemaphore acquiredImageSemaphore = {};
 
     /**
-     * Semaphore signaled when the image is acquired by the swapchain.
+     * Frame timeline value signaled by the last submission of the slot.
      */
-    VkSemaphore acquiredImageSemaphore[MAX_FIF_COUNT] = {};
+    uint64_t submitValue = {};
 
     /**
-     * Fence signaled when all commands submitted have completed execution.
+     *
      */
-    VkFence submitFence[MAX_FIF_COUNT] = {};
+    VkCommandPool commandPool = {};
 
     /**
      *
      */
-    VkCommandPool commandPool[MAX_FIF_COUNT] = {};
+    VkCommandBuffer commandBuffer = {};
+
+    /**
+     * SDL performance counter when the input of the last frame of the slot was sampled.
+     */
+    Uint64 inputTime = {};
+
+    /**
+     * Headless readback only: host visible copy of the image the slot rendered last.
+     */
+    VkBuffer readbackBuffer = {};
 
     /**
      *
      */
-    VkCommandBuffer commandBuffer[MAX_FIF_COUNT] = {};
+    DeviceAllocation readbackMemory = {};
 };
 
 /**
@@ -102,11 +126,22 @@ struct FramesInFlightType
  */
 struct PresentationFrameType
 {
+    /**
+     * Of the swapchain, which may be more than the minImageCount requested.
+     * Headless: one offscreen image per frame in flight.
+     */
+    uint32_t imageCount = {};
+
     /**
      *
      */
     VkImage *image = {};
 
+    /**
+     * Headless only: the offscreen images are owned, the swapchain ones aren't. Null otherwise.
+     */
+    DeviceAllocation *imageMemory = {};
+
     /**
      *
      */
@@ -127,13 +162,15 @@ class Renderer
 {
 public:
     /// Init all renderer resources
-    void Init();
+    /// Throws std::runtime_error when a startup task fails (e.g. the scene can't be read): the
+    /// renderer is then half initialized and can't be torn down.
+    void Init(const RendererConfig &renderer_config);
 
     /// Issue renderer commands and draw on the screen
     void Update(double delta_time);
 
     /// De-init all renderer resources in order
-    void Teardown() const;
+    void Teardown();
 
 private:
     void InitInstance();
@@ -142,26 +179,184 @@ private:
 
     void InitDevice();
 
+    /// The current swapchain, if any, is passed as oldSwapchain: retire it first.
     void InitSwapchain();
 
+    /**
+     * Headless replacement of the swapchain: one offscreen image per frame in flight,
+     * with the surface format and extent taken from the config.
+     */
+    void InitOffscreenImages();
+
+    /// Surface capabilities, with the extent taken from the window when the surface leaves it undefined.
+    void QuerySurfaceCapabilities();
+
+    /**
+     * Rebuild the swapchain and the resources sized by it (views, framebuffers,
+     * multisample and depth images). The old ones are destroyed by the frame
+     * timeline once the frames using them complete: no device idle.
+     * @return false if the window has no area (minimized): nothing was changed.
+     */
+    bool RecreateSwapchain();
+
+    /// Destroy a swapchain with its presentation frames and attachments.
+    void DestroySwapchain(
+        VkSwapchainKHR old_swapchain,
+        PresentationFrameType *p_frames,
+        VkImage sample_image,
+        VkImageView sample_image_view,
+        DeviceAllocation *p_sample_image_memory,
+        VkImage depth_stencil_image,
+        VkImageView depth_stencil_image_view,
+        DeviceAllocation *p_depth_stencil_memory);
+
     /// Multi-sample image resolver, depth-stencil image
     void InitOtherImages();
 
     void InitCommand();
 
+    /// Load or generate the scene on the CPU: no Vulkan call, runs alongside the device setup.
+    void ImportScene();
+
+    /// Upload the imported scene and build the draw list.
     void InitBatch();
 
+    /// Submit the pending uploads and block until they are done. Init only.
+    void FlushUploadsAndWait();
+
+    /// Make the geometry copies visible to the vertex input stage.
+    static void RecordGeometryUploadBarrier(VkCommandBuffer cmd);
+
     void InitFramebuffers() const;
 
     void InitRenderpass();
 
     void InitUniformBuffer();
 
+    /// Read the SPIR-V of InitPipeline: no Vulkan call, runs alongside the device setup.
+    void ReadShaders();
+
     void InitPipeline();
 
+    /// Descriptor set of the uniform ring, once both the pipeline layout and the ring exist.
+    void InitDescriptorSets();
+
+    /// Compute scheduler and the passes it runs (culling).
+    void InitCompute();
+
+    /// Virtual texture of config.virtualTexturePath. A file that can't be used is reported,
+    /// the scene renders without it.
+    void InitVirtualTexture();
+
     void PrepareDepthStencil();
 
+    /**
+     * Write the image copied by the last submission of frame_index as a binary PPM.
+     * The submission must be complete.
+     * @return false if the file can't be written.
+     */
+    bool WriteReadback(uint32_t frame_index, const char *p_path) const;
+
+    /// Once per second: throughput, recording, queues, frame times, GPU passes and latency.
+    void PrintFrameStats();
+
+    /// The input sampled at input_time reached the display, or the GPU completion without present wait.
+    void RecordLatency(Uint64 input_time);
+
+    /// --variant-report: a pipeline per variant of the mesh shaders, compiled before the first frame.
+    void InitVariantReport();
+
+    /// GPU time of the main pass, collected from slot, for the variant it drew.
+    void AddVariantGpuFrame(uint32_t slot);
+
+    /// Collect the frames still in flight and print the report.
+    void FinishVariantReport();
+
+    /// --benchmark: the camera path to replay and the report setup.
+    void InitBenchmark();
+
+    /// Collect the frames still in flight, print and write the report.
+    void FinishBenchmark();
+
+    /// @return false once the window is closed.
+    bool PollEvents();
+
+    /// Keyboard moves, eased.
+    void UpdateCamera(double delta_time);
+
+    /**
+     * Q and E keys, or the variant of the report.
+     * @return the variant measured by this frame, UINT32_MAX if none.
+     */
+    uint32_t SelectPipeline();
+
+    /// Replayed by the benchmark, or recorded with --record-camera-path.
+    void UpdateCameraPath(double delta_time, bool is_frame_measured);
+
+    /**
+     * Wait the slot of fifIndex, collect its results and acquire the next image.
+     * @return false if the swapchain is out of date: the frame is skipped.
+     */
+    bool AcquireFrame(uint32_t *p_image_index);
+
+    /// The command buffer of fifIndex, and the transfer and compute submissions it waits.
+    void RecordFrame(uint32_t image_index, bool *p_has_transfer, bool *p_has_compute);
+
+    /// Staging flush or transfer acquire, pool compaction and defragmentation.
+    void RecordUploads(bool has_transfer);
+
+    void RecordVirtualTextureFeedback(const glm::mat4 &view_projection);
+
+    /// drawList recorded in parallel secondaries, inside the render pass.
+    void RecordMainPass(uint32_t image_index, uint32_t view_offset);
+
+    /// Headless: copy the rendered image to the readback buffer of fifIndex.
+    void RecordReadback(uint32_t image_index);
+
+    void SubmitFrame(uint32_t image_index, bool has_transfer, bool has_compute);
+
+    /// Present, then wait for the previous present with VK_KHR_present_wait.
+    void PresentFrame(uint32_t image_index);
+
 private:
+    RendererConfig config = {};
+
+    /**
+     * Wall time of Init, for the benchmark report.
+     */
+    double startupMs = {};
+
+    /**
+     * Part of startupMs spent loading the scene and uploading its geometry.
+     */
+    double sceneLoadMs = {};
+
+    /**
+     * Start of Init, the first frame reports its time from here.
+     */
+    Uint64 initStart = {};
+
+    /**
+     * Init to the first frame handed to the presentation engine (submitted, headless):
+     * what the startup graph minimizes.
+     */
+    double firstFrameMs = {};
+
+    /**
+     * Mesh pipeline creation in InitPipeline, to compare cold and warm pipeline caches.
+     */
+    double pipelineMs = {};
+
+    /**
+     * Only initialized with RendererConfig::useHostAllocator.
+     */
+    HostAllocator hostAllocator = {};
+
+    /**
+     * pAllocator of every vulkan object, null unless the host allocator is used.
+     */
+    VkAllocationCallbacks *allocationCallbacks = {};
+
     /**
      *
      */
@@ -172,6 +367,17 @@ private:
      */
     VkDebugUtilsMessengerEXT debugMessenger = {};
 
+    /**
+     * VK_EXT_debug_utils is enabled: the messenger exists. Drivers without the
+     * validation layer installed (e.g. CI images) run without both.
+     */
+    bool hasDebugUtils = {};
+
+    /**
+     * VK_KHR_get_physical_device_properties2 is enabled, needed by VK_EXT_memory_budget.
+     */
+    bool hasPhysicalDeviceProperties2 = {};
+
     /**
      *
      */
@@ -192,10 +398,75 @@ private:
      */
     uint32_t queueFamilyIndex = {};
 
+    /**
+     * Queue of a transfer only family, same as queue when the gpu has none.
+     */
+    VkQueue transferQueue = {};
+
+    /**
+     *
+     */
+    uint32_t transferQueueFamilyIndex = {};
+
+    /**
+     * Queue of a compute only family, same as queue when the gpu has none.
+     */
+    VkQueue computeQueue = {};
+
+    /**
+     *
+     */
+    uint32_t computeQueueFamilyIndex = {};
+
+    /**
+     * Every buffer and image memory is sub-allocated from here.
+     */
+    DeviceMemoryAllocator memoryAllocator = {};
+
+    /**
+     * Compacts memoryAllocator blocks a few megabytes per frame.
+     */
+    MemoryDefragmenter defragmenter = {};
+
+    /**
+     * Upload path to device local memory.
+     */
+    StagingRing stagingRing = {};
+
+    /**
+     * Submits the stagingRing copies on transferQueue, when it is dedicated.
+     */
+    TransferQueue uploadQueue = {};
+
+    /**
+     * Ranges of the last stagingRing flush, reported to the defragmenter.
+     */
+    std::vector<StagingFlushRange> flushedRanges = {};
+
+    /**
+     * Completion clock of every graphics submission.
+     */
+    FrameTimeline frameTimeline = {};
+
+    /**
+     * GPU time and pipeline statistics of the passes of the graphics command buffer.
+     */
+    GpuProfiler gpuProfiler = {};
+
+    /**
+     * The pipelineStatisticsQuery feature is enabled.
+     */
+    bool hasPipelineStatistics = {};
+
+    /**
+     * The inheritedQueries feature is enabled: the secondaries count in the main pass statistics.
+     */
+    bool hasInheritedQueries = {};
+
     /**
      *
      */
-    FramesInFlightType framesInFlight = {};
+    std::vector<FrameInFlightType> framesInFlight = {};
 
     /**
      *
@@ -213,12 +484,12 @@ private:
     VkFormat depthStencilFormat = {};
 
     /**
-     *
+     * Null in headless mode.
      */
     SDL_Window *window = {};
 
     /**
-     *
+     * Null in headless mode.
      */
     VkSurfaceKHR surface = {};
 
@@ -227,6 +498,42 @@ private:
      */
     VkSwapchainKHR swapchain = {};
 
+    /**
+     * config.presentMode, or its fallback when the surface doesn't support it.
+     */
+    VkPresentModeKHR presentMode = {};
+
+    /**
+     * VK_KHR_present_id and VK_KHR_present_wait are enabled: the loop waits for the
+     * previous present to reach the display instead of queueing frames ahead.
+     */
+    bool hasPresentWait = {};
+
+    /**
+     * VK_KHR_pipeline_executable_properties is enabled: the variant report has instruction counts.
+     */
+    bool hasPipelineExecutableInfo = {};
+
+    /**
+     * Id of the last present, 0 before the first one.
+     */
+    uint64_t presentId = {};
+
+    /**
+     * Last present id of the previous swapchain: the ids up to it can't be waited on the current one.
+     */
+    uint64_t swapchainFirstPresentId = {};
+
+    /**
+     * Resized, suboptimal or out of date: recreate before the next frame.
+     */
+    bool isSwapchainDirty = {};
+
+    /**
+     * Caps the frame rate to config.maxFps and records the frame times.
+     */
+    FrameLimiter frameLimiter = {};
+
     /**
      *
      */
@@ -245,7 +552,7 @@ private:
     /**
      *
      */
-    VkDeviceMemory framebufferSampleImageMemory = {};
+    DeviceAllocation framebufferSampleImageMemory = {};
 
     /**
      *
@@ -260,12 +567,17 @@ private:
     /**
      *
      */
-    VkDeviceMemory depthStencilMemory = {};
+    DeviceAllocation depthStencilMemory = {};
 
     /**
-     *
+     * Per-view and per-draw constants of every frame in flight.
+     */
+    UniformRing uniformRing = {};
+
+    /**
+     * Both bindings point to uniformRing, selected with dynamic offsets.
      */
-    PerFrameDataGpu<FramesInFlightType::MAX_FIF_COUNT> uniformBufferFrames = {};
+    VkDescriptorSet uniformDescriptorSet = {};
 
     /**
      *
@@ -278,14 +590,19 @@ private:
     VkPipelineLayout pipelineLayout = {};
 
     /**
-     *
+     * Every graphics pipeline, compiled on its own threads.
      */
-    VkPipeline pipeline = {};
+    PipelineRegistry pipelineRegistry = {};
 
     /**
-     *
+     * State of the scene draws: the other modes are variations of it.
      */
-    VkPipeline pipelineWireframe = {};
+    GraphicsPipelineDesc meshPipelineDesc = {};
+
+    /**
+     * Of meshPipelineDesc, ready from the first frame: the fallback of the pipelines still compiling.
+     */
+    PipelineRegistry::Handle meshPipeline = PipelineRegistry::INVALID_HANDLE;
 
     /**
      *
@@ -302,10 +619,167 @@ private:
      */
     BatchCpu batchData = {};
 
+    /**
+     * Scene of --scene=generated:..., between ImportScene and InitBatch. Released after the upload.
+     */
+    GeneratedScene generatedScene = {};
+
+    /**
+     * Totals of the scene meshes, checked against the geometry pool limits by ImportScene.
+     */
+    uint64_t sceneVertexCount = {};
+    uint64_t sceneIndexCount = {};
+
+    /**
+     * SPIR-V of the main pipeline, between ReadShaders and InitPipeline.
+     */
+    std::vector<char> vertShaderCode = {};
+    std::vector<char> fragShaderCode = {};
+
+    /**
+     * Fragment shader sampling the virtual texture, read only when one is configured.
+     */
+    std::vector<char> virtualTextureFragShaderCode = {};
+
+    /**
+     * Vertex and index buffers shared by every mesh.
+     */
+    GeometryPool geometryPool = {};
+
+    /**
+     *
+     */
+    uint32_t batchMesh = GeometryPool::INVALID_MESH;
+
+    /**
+     * Drawn in order every frame.
+     */
+    std::vector<DrawItem> drawList = {};
+
+    /**
+     * Uniform ring offset of each drawList entry, filled before the parallel recording.
+     */
+    std::vector<uint32_t> drawDataOffsets = {};
+
+    /**
+     * Workers of the parallel recording.
+     */
+    ThreadPool threadPool = {};
+
+    /**
+     * Records drawList into secondary command buffers, one pool per slice and frame in flight.
+     */
+    ParallelRecorder recorder = {};
+
+    /**
+     * Runs the compute passes on computeQueue, overlapped with the graphics work.
+     */
+    ComputeScheduler computeScheduler = {};
+
+    /**
+     * Visibility of drawList, one indirect draw per entry.
+     */
+    GpuCulling culling = {};
+
+    /**
+     * Every pipeline is created with it: compiled once, loaded from disk by the next runs.
+     */
+    PipelineCache pipelineCache = {};
+
+    /**
+     * Streamed from the feedback of the scene draws, sampled by the mesh pipeline.
+     */
+    VirtualTexture virtualTexture = {};
+
+    /**
+     * virtualTexture is initialized: the mesh pipeline samples it through set 1.
+     */
+    bool hasVirtualTexture = {};
+
+    /**
+     * Page table and physical cache, set 1 of the mesh pipeline.
+     */
+    VkDescriptorSetLayout virtualTextureSetLayout = {};
+
+    /**
+     *
+     */
+    VkDescriptorSet virtualTextureDescriptorSet = {};
+
+    /**
+     * Slot of the frame being recorded.
+     */
+    uint32_t fifIndex = {};
+
+    /**
+     * Slot of the last frame submitted, UINT32_MAX before the first one.
+     */
+    uint32_t lastFifIndex = UINT32_MAX;
+
+    /**
+     * For --frames and the benchmark warm-up.
+     */
+    uint32_t renderedFrameCount = {};
+
+    /**
+     * Eased toward cameraPosNew, which the keyboard moves.
+     */
+    glm::vec3 cameraPos = {0.0f, 0.0f, -100.0f};
+    glm::vec3 cameraPosNew = {0.0f, 0.0f, -100.0f};
+    glm::vec3 cameraFront = {0.0f, 0.0f, 1.0f};
+    glm::vec3 cameraUp = {0.0f, 1.0f, 0.0f};
+
+    /**
+     * Replayed by the benchmark, or recorded from this session.
+     */
+    CameraPath cameraPath = {};
+    double cameraRecordTime = {};
+
+    /**
+     * Q switches to the wireframe pipeline, requested the first time: the fill one is drawn while it compiles.
+     */
+    PipelineRegistry::Handle chosenPipeline = PipelineRegistry::INVALID_HANDLE;
+    PipelineRegistry::Handle wireframePipeline = PipelineRegistry::INVALID_HANDLE;
+
+    /**
+     * Draw throughput since the last PrintFrameStats, to compare the geometry paths.
+     */
+    uint32_t statsFrameCount = {};
+    double statsElapsed = {};
+
+    /**
+     * Input to display with the present wait, input to GPU completion without: compare the
+     * frames in flight counts by the same measure.
+     */
+    double statsLatencyMs = {};
+    double statsLatencyMaxMs = {};
+    uint32_t statsLatencyCount = {};
+
+    /**
+     * Input time of the frame presented last.
+     */
+    Uint64 presentedInputTime = {};
+
     /**
      *
      */
-    BatchGpu batch = {};
+    BenchmarkReport benchmarkReport = {};
+
+    /**
+     * The frame of the slot was measured: its GPU time goes in the report once collected.
+     */
+    std::vector<bool> isSlotMeasured = {};
+
+    /**
+     * --variant-report: a pipeline per variant of the mesh shaders, each one drawn in turn.
+     */
+    std::vector<ShaderVariantStats> variantStats = {};
+    std::vector<PipelineRegistry::Handle> variantPipelines = {};
+
+    /**
+     * Variant drawn by the frame of the slot, UINT32_MAX when not measured.
+     */
+    std::vector<uint32_t> slotVariant = {};
 };
 }
 
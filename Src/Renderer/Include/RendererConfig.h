@@ -0,0 +1,99 @@
+#ifndef RENDERER_CONFIG_H
+#define RENDERER_CONFIG_H
+
+#include <volk/volk.h>
+
+#include <cstdint>
+
+namespace Renderer
+{
+/// Startup options, fixed for the whole run.
+struct RendererConfig
+{
+    static constexpr uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+    /// Measured frames of --benchmark without --frames.
+    static constexpr uint32_t DEFAULT_BENCHMARK_FRAMES = 600;
+
+    /// Frames per variant of --variant-report, the first VARIANT_WARMUP_FRAMES not measured.
+    static constexpr uint32_t VARIANT_REPORT_FRAMES = 120;
+    static constexpr uint32_t VARIANT_WARMUP_FRAMES = 10;
+
+    static constexpr const char *DEFAULT_SCENE = "../Resources/Meshes/SM_Behemoth.fbx";
+
+    /// --host-allocator: driver host allocations go through HostAllocator and are tracked.
+    bool useHostAllocator = false;
+
+    /// --record-slices=N: at most N parallel recording slices, 0 means one per worker.
+    /// Compare the recording time across values to check the scaling.
+    uint32_t recordSlices = 0;
+
+    /// --present-mode=fifo|fifo-relaxed|mailbox|immediate: falls back when the surface lacks it.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+    /// --max-fps=N: frame rate cap of the frame limiter, 0 means uncapped.
+    uint32_t maxFps = 60;
+
+    /// --frames-in-flight=N: frames the CPU records ahead of the GPU, clamped to
+    /// [MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT]. Lower is less input latency, higher more throughput.
+    uint32_t framesInFlight = 2;
+
+    /// --headless: no window nor surface, the frames are rendered into offscreen images.
+    /// Runs on drivers without presentation (e.g. lavapipe in CI).
+    bool headless = false;
+
+    /// --size=WxH: extent of the headless images. The window starts at this size too.
+    uint32_t width = 640;
+    uint32_t height = 480;
+
+    /// --frames=N: exit after N frames, 0 means run until the window is closed.
+    uint32_t frameCount = 0;
+
+    /// --readback=PATH: headless only, write the last frame to PATH (binary PPM) at exit.
+    /// Points into argv, null when not set.
+    const char *readbackPath = nullptr;
+
+    /// --scene=PATH: mesh file loaded at init. "generated:..." generates a scene instead, see SceneGenerator::Parse.
+    const char *scenePath = DEFAULT_SCENE;
+
+    /// --benchmark: replay the camera path with a fixed timestep and write the frame time
+    /// statistics to benchmarkOutput. Implies --headless and --max-fps=0; --frames counts the
+    /// measured frames (default DEFAULT_BENCHMARK_FRAMES).
+    bool benchmark = false;
+
+    /// --camera-path=PATH: path replayed by the benchmark, null for the scripted orbit.
+    const char *cameraPathFile = nullptr;
+
+    /// --benchmark-output=PATH: JSON report of the benchmark.
+    const char *benchmarkOutput = "benchmark.json";
+
+    /// --record-camera=PATH: save the live camera of the session as a path, at exit.
+    const char *recordCameraPath = nullptr;
+
+    /// --pipeline-cache=DIR: directory of the pipeline cache files, one per device.
+    /// --no-pipeline-cache sets it null: pipelines compile cold and nothing is written.
+    const char *pipelineCacheDirectory = ".";
+
+    /// --shader-variant=SPEC: toggles of the mesh shaders, see ShaderVariant::Parse. Null for the default variant.
+    const char *shaderVariant = nullptr;
+
+    /// --variant-report: render every shader variant for VARIANT_REPORT_FRAMES frames, uncapped,
+    /// then print their instruction counts and GPU times and exit.
+    bool variantReport = false;
+
+    /// --virtual-texture=PATH: tile file (see VirtualTexture) sampled by the meshes with their uvs.
+    /// Null renders without it; so does a file that fails to open.
+    const char *virtualTexturePath = nullptr;
+
+    /// --help: print the options and exit.
+    bool showHelp = false;
+
+    /// Unknown options are reported and ignored.
+    static RendererConfig FromArgs(int argc, const char *const *argv);
+
+    static void PrintUsage(const char *p_program);
+};
+}
+
+#endif //RENDERER_CONFIG_H
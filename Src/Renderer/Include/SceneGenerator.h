@@ -0,0 +1,112 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+/// Renderer.h includes this header: complete where the meshes are used.
+struct BatchCpu;
+
+enum class SceneKind : uint32_t
+{
+    /// instanceCount instances of meshCount meshes, scattered in a cube.
+    INSTANCES,
+
+    /// Same, on a regular square grid on the ground.
+    GRID,
+
+    /// Dense pile of instances with scales over two orders of magnitude.
+    CLUTTER,
+
+    /// Chains of depth nodes, each one placed relative to its parent.
+    HIERARCHY,
+
+    /// One mesh of trianglesPerMesh triangles, drawn once.
+    HUGE_MESH,
+};
+
+/// Parameters of a generated scene. The same description gives the same scene on every machine.
+struct SceneDesc
+{
+    SceneKind kind = SceneKind::INSTANCES;
+
+    uint32_t seed = 1;
+    uint32_t instanceCount = 1000;
+    uint32_t meshCount = 8;
+
+    /// Approximate: the meshes are tessellated spheres, rounded to whole rings.
+    uint32_t trianglesPerMesh = 1000;
+
+    /// HIERARCHY only: nodes per chain.
+    uint32_t depth = 16;
+};
+
+struct SceneInstance
+{
+    uint32_t meshIndex = {};
+
+    /// Index of the parent instance, -1 for a root. Parents come before their children.
+    int32_t parent = -1;
+
+    /// Relative to the parent.
+    glm::mat4 local = glm::mat4(1.0f);
+
+    /// Parent transforms applied.
+    glm::mat4 model = glm::mat4(1.0f);
+};
+
+struct GeneratedScene
+{
+    std::vector<BatchCpu> meshes = {};
+    std::vector<SceneInstance> instances = {};
+
+    /// Drawn triangles: every instance counts its mesh once.
+    [[nodiscard]] uint64_t TriangleCount() const;
+};
+
+/**
+ * @brief Synthetic scenes of any size for the scaling measures.
+ *
+ * Meshes are displaced spheres, instances reference them with a transform, so
+ * a scene exercises the loader, the geometry pool, the culling and the
+ * recording the same way a real one does, at 10^5 objects or 10^8 triangles.
+ *
+ * Randomness comes from a generator of its own rather than <random>, whose
+ * distributions differ between standard libraries: a seed draws the same
+ * numbers on Windows and Linux, so benchmark results stay comparable.
+ */
+class SceneGenerator
+{
+    SceneGenerator() = delete;
+
+public:
+    /// Prefix of --scene for a generated scene, e.g. "generated:grid,instances=10000,triangles=500".
+    static constexpr const char *SPEC_PREFIX = "generated:";
+
+    /**
+     * Parse "KIND[,key=value...]" with KIND instances, grid, clutter, hierarchy or huge-mesh
+     * and keys seed, instances, meshes, triangles, depth. Missing keys keep their default.
+     * @return false on an unknown kind or key, p_desc is left untouched.
+     */
+    static bool Parse(const char *p_spec, SceneDesc *p_desc);
+
+    static void Generate(const SceneDesc &desc, GeneratedScene *p_scene);
+
+    /// Every instance baked into one mesh, in world space.
+    static void Flatten(const GeneratedScene &scene, BatchCpu *p_batch);
+
+    /// Flattened scene as a Wavefront OBJ that MeshLoader reads back. @return false if the file can't be written.
+    static bool WriteObj(const GeneratedScene &scene, const char *p_path);
+
+    static const char *KindName(SceneKind kind);
+
+private:
+    static void GenerateMesh(uint32_t triangle_count, uint64_t seed, BatchCpu *p_mesh);
+};
+}
+
+#endif //SCENE_GENERATOR_H
@@ -0,0 +1,88 @@
+#ifndef SHADER_VARIANT_H
+#define SHADER_VARIANT_H
+
+#include "PipelineRegistry.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Renderer
+{
+struct ShaderVariantStats;
+
+/// LIGHTING_MODEL of shader.vert.
+enum class LightingModel : uint32_t
+{
+    UNLIT,
+    LAMBERT,
+    HALF_LAMBERT,
+    COUNT,
+};
+
+/// DEBUG_VIEW of shader.vert.
+enum class DebugView : uint32_t
+{
+    NONE,
+    NORMALS,
+
+    /// White albedo: the lighting alone.
+    LIGHTING,
+    COUNT,
+};
+
+/**
+ * @brief Feature toggles of the mesh shaders, given to the pipeline as specialization constants.
+ *
+ * The driver folds the branches on the constants when the pipeline is compiled, so a
+ * variant carries no code of the features it doesn't use, with a single SPIR-V. The
+ * values are part of GraphicsPipelineDesc, hence of the registry key: each variant
+ * is a pipeline of its own, compiled once.
+ */
+struct ShaderVariant
+{
+    /// constant_id of the toggles in the shaders.
+    static constexpr uint32_t LIGHTING_MODEL_CONSTANT = 0;
+    static constexpr uint32_t DEBUG_VIEW_CONSTANT = 1;
+
+    LightingModel lightingModel = LightingModel::LAMBERT;
+    DebugView debugView = DebugView::NONE;
+
+    /// Write the constants of the variant into p_desc.
+    void Specialize(GraphicsPipelineDesc *p_desc) const;
+
+    /// e.g. "lambert/normals".
+    [[nodiscard]] std::string Name() const;
+
+    /**
+     * Parse "key=value[,key=value]" with keys lighting (unlit, lambert, half-lambert) and
+     * debug (none, normals, lighting). Missing keys keep their default.
+     * @return false on an unknown key or value, p_variant is left untouched.
+     */
+    static bool Parse(const char *p_spec, ShaderVariant *p_variant);
+
+    /// Every combination of the toggles, for the variant report.
+    static std::vector<ShaderVariant> All();
+
+    static const char *LightingModelName(LightingModel lighting_model);
+    static const char *DebugViewName(DebugView debug_view);
+
+    /// Instruction counts per stage and mean GPU time of the main pass, one line per variant.
+    static void PrintReport(const std::vector<ShaderVariantStats> &stats);
+};
+
+/// One line of the variant report.
+struct ShaderVariantStats
+{
+    ShaderVariant variant = {};
+
+    /// Empty without VK_KHR_pipeline_executable_properties.
+    std::vector<PipelineExecutableStats> executables = {};
+
+    /// Of the main pass, over the measured frames.
+    double gpuMsSum = {};
+    uint32_t gpuFrameCount = {};
+};
+}
+
+#endif //SHADER_VARIANT_H
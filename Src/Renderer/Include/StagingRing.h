@@ -0,0 +1,162 @@
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+
+#include "MemoryAllocator.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace Renderer
+{
+struct StagingRingStats
+{
+    /// Bytes copied to device local memory since Init.
+    uint64_t uploadedBytes = {};
+
+    uint64_t copyCommands = {};
+    uint64_t copyRegions = {};
+
+    /// Ring bytes waiting for their frame fence.
+    VkDeviceSize inFlightBytes = {};
+};
+
+/// Destination range written by the last Flush, for barriers on that range only.
+struct StagingFlushRange
+{
+    VkBuffer buffer = {};
+    VkDeviceSize offset = {};
+    VkDeviceSize size = {};
+};
+
+/**
+ * @brief Upload path to DEVICE_LOCAL buffers through one persistently mapped ring.
+ *
+ * Upload() only queues the request. Flush() copies as much pending data as the
+ * free ring space allows and records the copies: one vkCmdCopyBuffer per
+ * destination buffer, with one region per upload. The space is given back by
+ * Reclaim() once the frame that recorded the copies has completed, so the ring
+ * never stalls on the GPU by itself.
+ *
+ * Uploads larger than the free space are split in chunks across Flush calls,
+ * even larger than the whole ring.
+ */
+class StagingRing
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_SIZE = 32ull * 1024 * 1024;
+
+    void Init(
+        VkDevice device,
+        DeviceMemoryAllocator *p_memory_allocator,
+        VkDeviceSize size);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    /// @warning p_data is read by the Flush calls, it must stay valid until HasPendingUploads() is false.
+    void Upload(
+        VkBuffer dst_buffer,
+        VkDeviceSize dst_offset,
+        const void *p_data,
+        VkDeviceSize size);
+
+    /**
+     * Record the copies of the pending uploads that fit in the ring.
+     * @return true if any copy was recorded: the caller must make the transfer writes
+     * visible to their consumers before using the destination buffers.
+     */
+    bool Flush(VkCommandBuffer cmd, uint32_t frame_index);
+
+    /**
+     * One range per destination buffer of the last Flush, covering all its regions.
+     * Replaces the content of p_ranges.
+     */
+    void FlushedRanges(std::vector<StagingFlushRange> *p_ranges) const;
+
+    /// The submission of frame_index has completed, release its ring space.
+    void Reclaim(uint32_t frame_index);
+
+    /// A destination buffer has been replaced (e.g. moved by the defragmenter): redirect its pending uploads.
+    void RetargetUploads(VkBuffer old_buffer, VkBuffer new_buffer);
+
+    [[nodiscard]] bool HasPendingUploads() const;
+
+    [[nodiscard]] StagingRingStats Stats() const;
+
+private:
+    /// Source offsets are kept aligned for the memcpy, vkCmdCopyBuffer needs none.
+    static constexpr VkDeviceSize ALIGNMENT = 16;
+
+    /// Don't waste a copy region on a tiny tail before the ring wraps.
+    static constexpr VkDeviceSize MIN_CHUNK_SIZE = 64 * 1024;
+
+    struct PendingUpload
+    {
+        VkBuffer dstBuffer = {};
+        VkDeviceSize dstOffset = {};
+        const uint8_t *data = {};
+        VkDeviceSize size = {};
+
+        /// Bytes already copied to the ring.
+        VkDeviceSize uploaded = {};
+    };
+
+    struct InFlightRange
+    {
+        uint32_t frameIndex = {};
+
+        /// Ring head after the flush, the tail moves here on Reclaim.
+        VkDeviceSize end = {};
+
+        /// Including alignment and wrap padding.
+        VkDeviceSize size = {};
+    };
+
+    struct CopyBatch
+    {
+        VkBuffer dstBuffer = {};
+        std::vector<VkBufferCopy> regions = {};
+
+        /// Bounds of the regions in dstBuffer.
+        VkDeviceSize dstBegin = {};
+        VkDeviceSize dstEnd = {};
+    };
+
+    /// Reserve up to size contiguous bytes, at least min(size, MIN_CHUNK_SIZE).
+    bool Reserve(
+        VkDeviceSize size,
+        VkDeviceSize *p_offset,
+        VkDeviceSize *p_reserved);
+
+    void AddRegion(VkBuffer dst_buffer, const VkBufferCopy &region);
+
+private:
+    VkDevice device = {};
+    DeviceMemoryAllocator *memoryAllocator = {};
+
+    VkBuffer buffer = {};
+    DeviceAllocation memory = {};
+
+    VkDeviceSize capacity = {};
+    VkDeviceSize head = {};
+    VkDeviceSize tail = {};
+    VkDeviceSize used = {};
+
+    /// Bytes reserved by the running Flush.
+    VkDeviceSize flushBytes = {};
+
+    std::deque<PendingUpload> pendingUploads = {};
+    std::deque<InFlightRange> inFlightRanges = {};
+
+    /// Reused by every Flush.
+    std::vector<CopyBatch> copyBatches = {};
+    uint32_t copyBatchCount = {};
+
+    StagingRingStats stats = {};
+};
+}
+
+#endif //STAGING_RING_H
@@ -0,0 +1,108 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+namespace Renderer
+{
+class ThreadPool;
+
+enum class TaskThread : uint32_t
+{
+    /// Any worker of the thread pool.
+    ANY,
+
+    /// The thread calling Run (e.g. SDL window calls).
+    MAIN,
+};
+
+/// When a task ran, relative to the start of Run.
+struct TaskTiming
+{
+    const char *name = {};
+    double startMs = {};
+    double endMs = {};
+    bool isMainThread = {};
+};
+
+/**
+ * @brief Tasks with dependencies, run once each as soon as their dependencies are done.
+ *
+ * A task can only depend on tasks added before it, so the graph can't have cycles.
+ * MAIN tasks run on the thread calling Run, the other ones on the thread pool, so
+ * independent work (e.g. importing the scene) overlaps the main thread chain.
+ *
+ * A task may throw: its exception is caught on the thread that ran it, the tasks
+ * depending on it are skipped, and Run rethrows it once every task is done.
+ */
+class TaskGraph
+{
+public:
+    using TaskId = uint32_t;
+    using Function = std::function<void()>;
+
+    /// @param name     Must outlive the graph (string literal): used for the timings and the profiler zones.
+    TaskId Add(
+        const char *name,
+        TaskThread thread,
+        std::initializer_list<TaskId> dependencies,
+        Function function);
+
+    /// Run every task and return when all of them are done. The graph can't be run again.
+    /// Rethrows the exception of the first task that threw, in Add order.
+    void Run(ThreadPool *p_thread_pool);
+
+    /// In Add order. Valid after Run.
+    [[nodiscard]] const std::vector<TaskTiming> &Timings() const;
+
+    /// One line per task, then the wall clock time against the sum of the tasks.
+    void PrintTimings(const char *p_title) const;
+
+private:
+    struct Task
+    {
+        Function function = {};
+        TaskThread thread = {};
+
+        std::vector<TaskId> dependents = {};
+        uint32_t dependencyCount = {};
+
+        /// Dependencies not done yet, while running.
+        uint32_t remaining = {};
+
+        /// A dependency threw or was skipped: the function isn't called.
+        bool isSkipped = {};
+
+        /// Thrown by the function, rethrown by Run.
+        std::exception_ptr exception = {};
+    };
+
+    /// Hand a task whose dependencies are done to its thread.
+    void Dispatch(TaskId id);
+
+    void Execute(TaskId id);
+
+private:
+    std::vector<Task> tasks = {};
+    std::vector<TaskTiming> timings = {};
+
+    ThreadPool *threadPool = {};
+
+    std::mutex mutex = {};
+    std::condition_variable mainTaskReady = {};
+    std::deque<TaskId> mainTasks = {};
+    uint32_t pendingCount = {};
+
+    uint64_t runStartNs = {};
+    double runMs = {};
+};
+}
+
+#endif //TASK_GRAPH_H
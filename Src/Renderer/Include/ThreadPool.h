@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Renderer
+{
+/**
+ * @brief Fixed set of worker threads consuming a FIFO of jobs.
+ *
+ * Used for work that must not block the render thread (e.g. streaming tiles
+ * from disk). Jobs must not throw: an exception escaping a job terminates the
+ * program, the same as any other unhandled exception.
+ */
+class ThreadPool
+{
+public:
+    using Job = std::function<void()>;
+
+    /// Spawn the workers.
+    /// @param thread_count     0 means std::thread::hardware_concurrency() - 1 (at least 1).
+    void Init(uint32_t thread_count);
+
+    /// Finish the queued jobs and join the workers.
+    void Teardown();
+
+    /// Queue a job. Thread safe.
+    void Submit(Job job);
+
+    /// Block until the queue is empty and no worker is executing a job.
+    void WaitIdle();
+
+    [[nodiscard]] uint32_t ThreadCount() const;
+
+private:
+    void WorkerLoop();
+
+private:
+    std::vector<std::thread> workers = {};
+    std::deque<Job> jobs = {};
+
+    std::mutex mutex = {};
+    std::condition_variable jobAvailable = {};
+    std::condition_variable idle = {};
+
+    uint32_t busyCount = 0;
+    bool stopping = false;
+};
+}
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,97 @@
+#ifndef TLSF_ALLOCATOR_H
+#define TLSF_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+/**
+ * @brief Two-Level Segregated Fit allocator over an abstract range [0, size).
+ *
+ * It never touches the memory it manages, it only hands out offsets, so the
+ * same code sub-allocates VkDeviceMemory blocks (in bytes) and geometry
+ * buffers (in elements).
+ *
+ * Free blocks are kept in segregated lists indexed by (log2(size), 32 linear
+ * subdivisions). A request is first fitted in its own list, which also holds
+ * blocks smaller than it, then in the next non-empty list found with two bitmap
+ * scans, where every block fits. Freed blocks are merged with their free
+ * neighbours right away.
+ */
+class TlsfAllocator
+{
+public:
+    static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+    struct Allocation
+    {
+        uint64_t offset = {};
+        uint64_t size = {};
+
+        /// Opaque, pass it back to Free(). INVALID_NODE when the allocation failed.
+        uint32_t node = INVALID_NODE;
+    };
+
+    void Init(uint64_t size);
+
+    /// @return an allocation with node == INVALID_NODE if no free block fits.
+    Allocation Allocate(uint64_t size, uint64_t alignment);
+
+    void Free(const Allocation &allocation);
+
+    [[nodiscard]] uint64_t Size() const;
+
+    [[nodiscard]] uint64_t UsedSize() const;
+
+    [[nodiscard]] uint32_t AllocationCount() const;
+
+    [[nodiscard]] uint32_t FreeBlockCount() const;
+
+    /// O(n) in the number of blocks, meant for statistics.
+    [[nodiscard]] uint64_t LargestFreeBlock() const;
+
+private:
+    static constexpr uint32_t SL_LOG2 = 5;
+    static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+    static constexpr uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+
+    struct Node
+    {
+        uint64_t offset = {};
+        uint64_t size = {};
+        uint32_t prevPhysical = INVALID_NODE;
+        uint32_t nextPhysical = INVALID_NODE;
+        uint32_t prevFree = INVALID_NODE;
+        uint32_t nextFree = INVALID_NODE;
+        bool isFree = false;
+    };
+
+    static void Mapping(uint64_t size, uint32_t *p_fl, uint32_t *p_sl);
+
+    uint32_t FindSuitable(uint64_t size) const;
+
+    void InsertFree(uint32_t node);
+
+    void RemoveFree(uint32_t node);
+
+    uint32_t NewNode();
+
+    void ReleaseNode(uint32_t node);
+
+private:
+    std::vector<Node> nodes = {};
+    std::vector<uint32_t> unusedNodes = {};
+
+    uint64_t flBitmap = {};
+    uint32_t slBitmap[FL_COUNT] = {};
+    uint32_t freeHeads[FL_COUNT][SL_COUNT] = {};
+
+    uint64_t size = {};
+    uint64_t usedSize = {};
+    uint32_t allocationCount = {};
+    uint32_t freeBlockCount = {};
+};
+}
+
+#endif //TLSF_ALLOCATOR_H
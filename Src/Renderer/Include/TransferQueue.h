@@ -0,0 +1,97 @@
+#ifndef TRANSFER_QUEUE_H
+#define TRANSFER_QUEUE_H
+
+#include "StagingRing.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace Renderer
+{
+/**
+ * @brief Runs the staging ring copies on a dedicated transfer queue.
+ *
+ * Every frame, Submit() records the StagingRing flush in a command buffer of the
+ * transfer family and submits it, signaling a timeline semaphore. The graphics
+ * submission of the same frame waits for that value and records the acquire half
+ * of the queue family ownership transfer (RecordAcquire) before using the data:
+ * the copies run while the previous frames still render.
+ *
+ * Ownership is transferred only for the written ranges: the graphics queue keeps
+ * reading the rest of the buffers meanwhile. The transfer queue does not acquire
+ * the ranges before writing them: their previous content is overwritten anyway.
+ *
+ * Without a transfer only family (IsDedicated() is false) nothing is created: the
+ * caller flushes the ring on its graphics command buffer as before.
+ */
+class TransferQueue
+{
+public:
+    /**
+     * @param transfer_family   Same as graphics_family when there is no dedicated family.
+     * @param p_allocation_callbacks    Host callbacks of the device, may be null.
+     */
+    void Init(
+        VkDevice device,
+        uint32_t transfer_family,
+        VkQueue transfer_queue,
+        uint32_t graphics_family,
+        uint32_t frame_count,
+        VkAllocationCallbacks *p_allocation_callbacks);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    [[nodiscard]] bool IsDedicated() const;
+
+    /**
+     * Record and submit the pending uploads of p_staging_ring that fit.
+     * The graphics submission of frame_index must have completed.
+     * @return true if anything was submitted: the graphics frame must call RecordAcquire
+     *         and wait Semaphore() at SignaledValue().
+     */
+    bool Submit(StagingRing *p_staging_ring, uint32_t frame_index);
+
+    /// Acquire the ranges of the last Submit on the graphics queue, for vertex input and transfers.
+    void RecordAcquire(VkCommandBuffer graphics_cmd) const;
+
+    /// Timeline semaphore signaled by every Submit.
+    [[nodiscard]] VkSemaphore Semaphore() const;
+
+    /// Value signaled by the last Submit.
+    [[nodiscard]] uint64_t SignaledValue() const;
+
+    /// Stages the graphics queue waits for the transfer at.
+    static constexpr VkPipelineStageFlags WAIT_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                                        VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+private:
+    void FillOwnershipBarriers(
+        VkAccessFlags src_access,
+        VkAccessFlags dst_access,
+        std::vector<VkBufferMemoryBarrier> *p_barriers) const;
+
+private:
+    VkDevice device = {};
+    VkQueue queue = {};
+    VkAllocationCallbacks *allocationCallbacks = {};
+
+    uint32_t transferFamily = {};
+    uint32_t graphicsFamily = {};
+    bool isDedicated = {};
+
+    std::vector<VkCommandPool> commandPools = {};
+    std::vector<VkCommandBuffer> commandBuffers = {};
+
+    VkSemaphore timeline = {};
+    uint64_t signaledValue = {};
+
+    /// Ranges of the last Submit, reused every frame.
+    std::vector<StagingFlushRange> flushedRanges = {};
+    mutable std::vector<VkBufferMemoryBarrier> barriers = {};
+};
+}
+
+#endif //TRANSFER_QUEUE_H
@@ -0,0 +1,80 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include "MemoryAllocator.h"
+
+#include <volk/volk.h>
+
+#include <cstdint>
+
+namespace Renderer
+{
+/**
+ * @brief One persistently mapped buffer for the per-view and per-draw constants.
+ *
+ * The buffer is split in one region per frame in flight. Each frame its region
+ * is filled linearly: Push() copies the data and returns the offset to pass to
+ * vkCmdBindDescriptorSets as a dynamic offset. A single descriptor set, written
+ * once, covers every frame and every draw: no map calls and no descriptor
+ * updates at runtime.
+ *
+ * The region of a frame is rewritten only after its fence is signaled, which is
+ * already guaranteed by the frame in flight loop.
+ *
+ * A full region never grows: the frames in flight still read the buffer. Push()
+ * returns INVALID_OFFSET instead and the caller skips what needed the data.
+ */
+class UniformRing
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 4ull * 1024 * 1024;
+    static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+    void Init(
+        VkDevice device,
+        VkPhysicalDevice gpu,
+        DeviceMemoryAllocator *p_memory_allocator,
+        uint32_t frame_count,
+        VkDeviceSize frame_size);
+
+    void Teardown();
+
+    /// Start writing the region of frame_index, discarding its previous content.
+    void BeginFrame(uint32_t frame_index);
+
+    /// @return the dynamic offset of the copy, INVALID_OFFSET if the region of the frame is full.
+    [[nodiscard]] uint32_t Push(const void *p_data, VkDeviceSize size);
+
+    template<typename T>
+    [[nodiscard]] uint32_t Push(const T &data)
+    {
+        return Push(&data, sizeof(T));
+    }
+
+    /// Usable as uniform and storage buffer.
+    [[nodiscard]] VkBuffer Buffer() const;
+
+    /// Bytes pushed in the current frame, alignment included.
+    [[nodiscard]] VkDeviceSize FrameUsedBytes() const;
+
+    /// Pushes of the current frame that returned INVALID_OFFSET.
+    [[nodiscard]] uint32_t FrameRejectedPushes() const;
+
+private:
+    VkDevice device = {};
+    DeviceMemoryAllocator *memoryAllocator = {};
+
+    VkBuffer buffer = {};
+    DeviceAllocation memory = {};
+
+    /// Max of minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment.
+    VkDeviceSize alignment = {};
+
+    VkDeviceSize frameSize = {};
+    VkDeviceSize frameBegin = {};
+    VkDeviceSize frameCursor = {};
+    uint32_t frameRejectedPushes = {};
+};
+}
+
+#endif //UNIFORM_RING_H
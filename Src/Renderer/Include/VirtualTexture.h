@@ -0,0 +1,273 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include "MemoryAllocator.h"
+#include "PipelineRegistry.h"
+#include "ThreadPool.h"
+
+#include <volk/volk.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace Renderer
+{
+/**
+ * @brief Header of a virtual texture file (*.avt).
+ *
+ * The header is followed by the tiles of every mip, mip 0 first. Tiles of one
+ * mip are stored row-major, each one is tileSize * tileSize RGBA8 texels.
+ */
+struct VirtualTextureFileHeader
+{
+    static constexpr uint32_t MAGIC = 0x30545641; // "AVT0"
+
+    uint32_t magic = MAGIC;
+
+    /// Texels per tile side.
+    uint32_t tileSize = {};
+
+    /// Tiles per side at mip 0. Must be a power of two, at most 4096.
+    uint32_t pagesPerSide = {};
+
+    /// log2(pagesPerSide) + 1. The last mip is a single tile.
+    uint32_t mipCount = {};
+};
+
+struct VirtualTextureCreateInfo
+{
+    /// Path to the *.avt file streamed from.
+    const char *filePath = {};
+
+    /// The physical cache holds physicalTilesPerSide^2 tiles, whatever the virtual size is.
+    /// 1 to 256: Init throws otherwise.
+    uint32_t physicalTilesPerSide = 32;
+
+    /// Feedback target resolution is the framebuffer extent divided by this value.
+    uint32_t feedbackDivisor = 8;
+
+    /// Max tiles copied into the physical cache each frame.
+    uint32_t maxUploadsPerFrame = 16;
+
+    /// Max new disk reads issued each frame.
+    uint32_t maxRequestsPerFrame = 64;
+
+    /// Threads of the tile loads. Their own: a read blocked on the disk never delays a job of the
+    /// renderer ThreadPool, such as a recording slice.
+    uint32_t loadThreadCount = 2;
+
+    VkExtent2D framebufferExtent = {};
+
+    /// One feedback target and one staging region per frame in flight.
+    uint32_t frameCount = {};
+};
+
+struct VirtualTextureStats
+{
+    uint32_t residentTiles = {};
+    uint32_t pendingLoads = {};
+    uint32_t requestedTiles = {};
+    uint32_t uploadedTiles = {};
+    uint32_t evictedTiles = {};
+};
+
+/**
+ * @brief Feedback driven tile streaming for textures that do not fit in memory.
+ *
+ * The GPU memory is fixed at Init: one physical cache image holding the
+ * resident tiles and one page table image (one mip per virtual mip) mapping
+ * virtual pages to cache slots. Unmapped pages point to the closest resident
+ * ancestor, the last mip is pinned so sampling always finds something.
+ *
+ * Per frame:
+ *  1. Update() resolves the feedback written the last time this frame slot was
+ *     used (the caller already waited its fence), issues disk reads on the
+ *     load threads, uploads finished tiles under the per-frame budget evicting the
+ *     least recently used slots, then uploads the page table texels they changed,
+ *     one copy per mip.
+ *  2. RecordFeedback() renders the scene at low resolution writing the tile id
+ *     each pixel needs, then copies the target to a host visible buffer.
+ *
+ * Materials sample through Resources/Shaders/virtual_texture.glsl, see shader_vt.frag.
+ */
+class VirtualTexture
+{
+public:
+    static constexpr uint32_t INVALID_TILE = 0xFFFFFFFF;
+
+    /// constant_id of the sizes in shader_vt.frag, after the ShaderVariant toggles.
+    static constexpr uint32_t VIRTUAL_SIZE_CONSTANT = 2;
+    static constexpr uint32_t CACHE_TILES_CONSTANT = 3;
+
+    void Init(
+        VkDevice device,
+        DeviceMemoryAllocator *p_memory_allocator,
+        const VirtualTextureCreateInfo &create_info);
+
+    /// The caller must have waited the device idle.
+    void Teardown();
+
+    /// Resolve the feedback of frame_index, stream and upload tiles.
+    /// Must be recorded before any draw sampling the virtual texture.
+    void Update(VkCommandBuffer cmd, uint32_t frame_index);
+
+    /// Render the feedback pass. The draw callback binds the position (binding 0,
+    /// vec3) and uv (binding 3, vec2) streams, as GeometryPool::Bind does, and
+    /// issues the draws with PushTransform before each one.
+    void RecordFeedback(
+        VkCommandBuffer cmd,
+        uint32_t frame_index,
+        const std::function<void(VkCommandBuffer)> &draw);
+
+    /// In the draw callback of RecordFeedback: clip space transform of the next draws.
+    void PushTransform(VkCommandBuffer cmd, const glm::mat4 &model_view_projection) const;
+
+    /// Write the virtual size and the cache size into the constants of p_desc, for shader_vt.frag.
+    void Specialize(GraphicsPipelineDesc *p_desc) const;
+
+    [[nodiscard]] VkDescriptorImageInfo PhysicalCacheDescriptor() const;
+
+    [[nodiscard]] VkDescriptorImageInfo PageTableDescriptor() const;
+
+    [[nodiscard]] const VirtualTextureStats &Stats() const;
+
+    /// Pack a virtual tile address. Must match vt_feedback.frag.
+    static uint32_t PackTileId(uint32_t x, uint32_t y, uint32_t mip);
+
+    static void UnpackTileId(uint32_t tile_id, uint32_t *p_x, uint32_t *p_y, uint32_t *p_mip);
+
+private:
+    struct PhysicalSlot
+    {
+        uint32_t tileId = INVALID_TILE;
+        uint64_t lastUsedFrame = {};
+    };
+
+    struct LoadedTile
+    {
+        uint32_t tileId = INVALID_TILE;
+        std::vector<uint8_t> texels = {};
+    };
+
+    struct PerFrame
+    {
+        VkImage feedbackImage = {};
+        DeviceAllocation feedbackImageMemory = {};
+        VkImageView feedbackImageView = {};
+
+        VkImage feedbackDepthImage = {};
+        DeviceAllocation feedbackDepthMemory = {};
+        VkImageView feedbackDepthView = {};
+
+        VkFramebuffer feedbackFramebuffer = {};
+
+        VkBuffer readbackBuffer = {};
+        DeviceAllocation readbackMemory = {};
+
+        /// False until the first feedback of this slot has been recorded.
+        bool hasFeedback = false;
+    };
+
+    /// Pages [minX, maxX] x [minY, maxY] of one mip, empty when minX > maxX.
+    struct PageRect
+    {
+        uint32_t minX = UINT32_MAX;
+        uint32_t minY = UINT32_MAX;
+        uint32_t maxX = 0;
+        uint32_t maxY = 0;
+    };
+
+    void InitFeedbackPass();
+
+    void InitFeedbackPipeline();
+
+    void ResolveFeedback(uint32_t frame_index);
+
+    void RequestTile(uint32_t tile_id);
+
+    void LoadTile(uint32_t tile_id);
+
+    uint32_t AcquireSlot();
+
+    /// The residency of a tile changed: its page and every page of the finer mips it covers.
+    void MarkPagesDirty(uint32_t x, uint32_t y, uint32_t mip);
+
+    /// Recompute the entries of the dirty pages, coarsest mip first.
+    void RebuildPageTable();
+
+    /// Copy the dirty pages of every mip to stagingOffset, one region per mip, and clear them.
+    /// @return the copies, for vkCmdCopyBufferToImage.
+    std::vector<VkBufferImageCopy> StagePageTable(VkDeviceSize staging_offset);
+
+    [[nodiscard]] uint64_t TileFileOffset(uint32_t tile_id) const;
+
+    [[nodiscard]] VkDeviceSize PageTableByteSize() const;
+
+private:
+    VkDevice device = {};
+    DeviceMemoryAllocator *memoryAllocator = {};
+
+    VirtualTextureCreateInfo createInfo = {};
+
+    /// createInfo.filePath is not owned, keep a copy for the loader jobs.
+    std::string filePath = {};
+
+    ThreadPool loadThreads = {};
+
+    VirtualTextureFileHeader fileHeader = {};
+
+    VkExtent2D feedbackExtent = {};
+    std::vector<PerFrame> frames = {};
+
+    VkRenderPass feedbackRenderPass = {};
+    VkPipelineLayout feedbackPipelineLayout = {};
+    VkPipeline feedbackPipeline = {};
+
+    VkImage physicalCacheImage = {};
+    DeviceAllocation physicalCacheMemory = {};
+    VkImageView physicalCacheView = {};
+    VkSampler physicalCacheSampler = {};
+
+    VkImage pageTableImage = {};
+    DeviceAllocation pageTableMemory = {};
+    VkImageView pageTableView = {};
+    VkSampler pageTableSampler = {};
+
+    /// Persistently mapped, one region per frame in flight.
+    VkBuffer stagingBuffer = {};
+    DeviceAllocation stagingMemory = {};
+    VkDeviceSize stagingRegionSize = {};
+
+    std::vector<PhysicalSlot> slots = {};
+
+    /// residency[mip][y * pages + x] = slot index or -1.
+    std::vector<std::vector<int32_t>> residency = {};
+
+    /// CPU copy of the page table, RGBA8_UINT: (slot x, slot y, resident mip, valid).
+    std::vector<std::vector<uint32_t>> pageTable = {};
+
+    /// Per mip: the pages to rebuild and upload at the next Update. Everything at Init.
+    std::vector<PageRect> dirtyPages = {};
+    bool imagesInitialized = false;
+
+    /// Tiles requested from disk and not uploaded yet. Render thread only.
+    std::unordered_set<uint32_t> pendingTiles = {};
+
+    /// Loaded, but every slot was needed by the frame: uploaded first at the next Update.
+    std::vector<LoadedTile> retryTiles = {};
+
+    /// Filled by the loader jobs, drained by Update().
+    std::mutex loadedMutex = {};
+    std::vector<LoadedTile> loadedTiles = {};
+
+    uint64_t frameCounter = {};
+    VirtualTextureStats stats = {};
+};
+}
+
+#endif //VIRTUAL_TEXTURE_H
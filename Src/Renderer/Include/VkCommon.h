@@ -5,12 +5,18 @@
 #ifndef COMMON_H
 #define COMMON_H
 
-#include <Volk/volk.h>
+#include <volk/volk.h>
 #include <cstdint>
 
 namespace Renderer {
+	class DeviceMemoryAllocator;
+	struct DeviceAllocation;
+	enum class MemoryCategory : uint32_t;
+
 	/// Wrap most common vulkan calls (e.g. VkCreateInstance, VkCreateBuffer, VkCreateImage, ...).
 	/// To delete vulkan resources, you must do the normal vulkan calls (e.g. vkDestroyInstance, ...).
+	/// Buffer and image memory is given back with DeviceMemoryAllocator::Free, and is
+	/// tagged with a MemoryCategory for the budget accounting.
 
 	// @TODO: I would like something that can report the error. How should it be done?
 #define VK_CHECK(result)					\
@@ -36,15 +42,24 @@ namespace Renderer {
 		VkPhysicalDevice gpu,
 		VkSampleCountFlagBits *p_sample);
 
-	/// @todo Platform dependent. Consider to solve the platform implementation at static link time.
+	/// @param surface	The family must present to it, VK_NULL_HANDLE for no presentation (headless).
 	void QueryQueueFamily(
 		VkPhysicalDevice gpu,
 		VkQueueFlagBits queue_flag_bits_requested,
-		bool must_support_presentation,
+		VkSurfaceKHR surface,
 		uint32_t family_idx_discarded_count,
 		const uint32_t *family_idx_discarded,
 		uint32_t *p_queue_family_idx);
 
+	/// First family with all of required_flags and none of excluded_flags, e.g. a transfer
+	/// only family: TRANSFER required, GRAPHICS | COMPUTE excluded.
+	/// @return false if there is none, unlike QueryQueueFamily the caller picks a fallback.
+	bool vk_query_dedicated_queue_family(
+		VkPhysicalDevice gpu,
+		VkQueueFlags required_flags,
+		VkQueueFlags excluded_flags,
+		uint32_t *p_queue_family_idx);
+
 	void vk_query_supported_format(
 		VkPhysicalDevice gpu,
 		uint32_t requested_format_count,
@@ -66,6 +81,28 @@ namespace Renderer {
 		VkSurfaceKHR surface,
 		VkSurfaceCapabilitiesKHR *p_surface_capabilities);
 
+	/// The requested mode if the surface supports it, otherwise the closest one:
+	/// MAILBOX and IMMEDIATE fall back to each other, then to FIFO, which is always supported.
+	void vk_query_present_mode(
+		VkPhysicalDevice gpu,
+		VkSurfaceKHR surface,
+		VkPresentModeKHR requested_mode,
+		VkPresentModeKHR *p_present_mode);
+
+	/// Same spelling as the --present-mode option.
+	const char *vk_present_mode_name(
+		VkPresentModeKHR present_mode);
+
+	/// Optional extensions: check before adding them to the create info.
+	bool vk_query_instance_extension_support(
+		const char *p_extension);
+
+	bool vk_query_instance_layer_support(
+		const char *p_layer);
+
+	bool vk_query_device_extension_support(
+		VkPhysicalDevice gpu,
+		const char *p_extension);
 
 	/// @todo Sketch implementation. Refactor it...
 	/// Go through every memory type to look what fit the request.
@@ -103,13 +140,17 @@ namespace Renderer {
 		VkSurfaceKHR surface,
 		VkSurfaceFormatKHR *p_format,
 		VkSurfaceCapabilitiesKHR *p_capabilities,
+		VkPresentModeKHR present_mode,
 		VkSwapchainKHR old_swapchain,
 		VkAllocationCallbacks *p_allocator,
 		VkSwapchainKHR *p_swapchain);
 
+	/// The swapchain may create more images than requested: query the count with
+	/// p_swapchain_images null first.
 	void vk_query_swapchain_images(
 		VkDevice device,
 		VkSwapchainKHR swapchain,
+		uint32_t *p_swapchain_image_count,
 		VkImage *p_swapchain_images);
 #pragma endregion
 
@@ -119,15 +160,32 @@ namespace Renderer {
 	// ==========================
 
 #pragma region VkBuffer / VkBufferView
+	/// @throws std::runtime_error	Out of device memory: the buffer is destroyed.
 	void vk_create_buffer(
 		VkDevice device,
-		VkPhysicalDevice physical_device,
+		DeviceMemoryAllocator *p_memory_allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage_flags,
+		VkMemoryPropertyFlags memory_property_flag_bits,
+		MemoryCategory category,
+		VkAllocationCallbacks *p_allocator,
+		VkBuffer *p_buffer,
+		DeviceAllocation *p_allocation);
+
+	/// Same as vk_create_buffer, shared by the given queue families without ownership transfers.
+	/// @param queue_family_count	Less than two families falls back to exclusive sharing.
+	void vk_create_concurrent_buffer(
+		VkDevice device,
+		DeviceMemoryAllocator *p_memory_allocator,
 		VkDeviceSize size,
 		VkBufferUsageFlags usage_flags,
 		VkMemoryPropertyFlags memory_property_flag_bits,
+		MemoryCategory category,
+		uint32_t queue_family_count,
+		const uint32_t *p_queue_family_indices,
 		VkAllocationCallbacks *p_allocator,
 		VkBuffer *p_buffer,
-		VkDeviceMemory *p_memory);
+		DeviceAllocation *p_allocation);
 
 	/// @warning	Provided buffer must be valid.
 	void vk_create_buffer_view(
@@ -146,19 +204,24 @@ namespace Renderer {
 	// ==========================
 
 #pragma region VkImage / VkImageView
+	/// Render targets (color/depth attachments) get a dedicated allocation, since they
+	/// are big and recreated together on resize.
+	/// @throws std::runtime_error	Out of device memory: the image is destroyed.
 	void vk_create_image(
 		VkDevice device,
-		VkPhysicalDevice physical_device,
+		DeviceMemoryAllocator *p_memory_allocator,
 		VkImageType image_type,
 		VkFormat format,
 		VkExtent3D extent,
+		uint32_t mip_levels,
 		VkSampleCountFlagBits samples,
 		VkImageTiling tiling,
 		VkImageUsageFlags usage,
 		VkMemoryPropertyFlagBits memory_property_flag_bits,
+		MemoryCategory category,
 		VkAllocationCallbacks *p_allocator,
 		VkImage *p_image,
-		VkDeviceMemory *p_memory);
+		DeviceAllocation *p_allocation);
 
 	/// @warning	Provided image must be valid.
 	void vk_create_image_view(
@@ -166,11 +229,28 @@ namespace Renderer {
 		VkImage image,
 		VkImageAspectFlags aspect_flags,
 		VkImageViewType view_type,
+		uint32_t mip_levels,
 		VkFormat format,
 		VkComponentMapping components,
 		VkAllocationCallbacks *p_allocator,
 		VkImageView *p_image_view);
 #pragma endregion
+
+
+	// ==========================
+	// Sampler
+	// ==========================
+
+#pragma region VkSampler
+	void vk_create_sampler(
+		VkDevice device,
+		VkFilter filter,
+		VkSamplerMipmapMode mipmap_mode,
+		VkSamplerAddressMode address_mode,
+		float max_lod,
+		VkAllocationCallbacks *p_allocator,
+		VkSampler *p_sampler);
+#pragma endregion
 }
 
 #endif //COMMON_H
@@ -0,0 +1,457 @@
+#include "MemoryAllocator.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Renderer
+{
+void DeviceMemoryAllocator::Init(
+    VkDevice device,
+    VkPhysicalDevice gpu,
+    VkDeviceSize preferred_block_size,
+    bool has_memory_budget,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    allocationCallbacks = p_allocation_callbacks;
+    preferredBlockSize = preferred_block_size;
+
+    // Gpus have multiple heaps and each heap has different memory type support.
+    // They never change, query them once instead of on every allocation.
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memoryProperties);
+
+    VkPhysicalDeviceProperties gpuProperties = {};
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+    bufferImageGranularity = gpuProperties.limits.bufferImageGranularity;
+
+    budget.Init(gpu, has_memory_budget);
+}
+
+void DeviceMemoryAllocator::Teardown()
+{
+    std::lock_guard lock(mutex);
+
+    for (Block &block : blocks)
+    {
+        if (block.memory != VK_NULL_HANDLE)
+        {
+            assert(block.ranges.AllocationCount() == 0 && "Leaked device allocation");
+            vkFreeMemory(device, block.memory, allocationCallbacks);
+        }
+    }
+
+    assert(stats.dedicatedCount == 0 && "Leaked dedicated device allocation");
+
+    blocks.clear();
+    stats = {};
+
+    budget.Teardown();
+}
+
+VkResult DeviceMemoryAllocator::Allocate(
+    const VkMemoryRequirements &requirements,
+    VkMemoryPropertyFlags memory_property_flags,
+    bool is_linear_resource,
+    bool prefer_dedicated,
+    MemoryCategory category,
+    DeviceAllocation *p_allocation)
+{
+    const uint32_t memoryTypeIndex = vk_query_memory_type_idx(
+        requirements.memoryTypeBits,
+        memory_property_flags,
+        memoryProperties);
+
+    std::lock_guard lock(mutex);
+
+    const auto allocateDedicated = [&]()
+    {
+        const VkResult result = AllocateDedicated(requirements, memoryTypeIndex, p_allocation);
+
+        if (result == VK_SUCCESS)
+        {
+            p_allocation->category = category;
+            budget.OnAllocate(category, p_allocation->size);
+        }
+
+        return result;
+    };
+
+    if (prefer_dedicated || requirements.size > BlockSizeForType(memoryTypeIndex) / 2)
+    {
+        return allocateDedicated();
+    }
+
+    // Without a granularity constraint every resource can share the same blocks.
+    const bool isLinear = bufferImageGranularity > 1 ? is_linear_resource : true;
+
+    TlsfAllocator::Allocation range = {};
+    uint32_t blockIndex = 0;
+
+    for (; blockIndex < blocks.size(); blockIndex++)
+    {
+        Block &block = blocks[blockIndex];
+
+        if (block.memory == VK_NULL_HANDLE ||
+            block.memoryTypeIndex != memoryTypeIndex ||
+            block.isLinear != isLinear)
+        {
+            continue;
+        }
+
+        range = block.ranges.Allocate(requirements.size, requirements.alignment);
+
+        if (range.node != TlsfAllocator::INVALID_NODE)
+        {
+            break;
+        }
+    }
+
+    if (range.node == TlsfAllocator::INVALID_NODE)
+    {
+        // Worst case padding included: the new block must fit the request whatever its alignment.
+        const VkDeviceSize minBlockSize = requirements.size + requirements.alignment - 1;
+
+        // No room left in the heap for a block, even halved: the request alone may still fit.
+        if (CreateBlock(memoryTypeIndex, isLinear, minBlockSize, &blockIndex) != VK_SUCCESS)
+        {
+            return allocateDedicated();
+        }
+
+        range = blocks[blockIndex].ranges.Allocate(requirements.size, requirements.alignment);
+
+        assert(range.node != TlsfAllocator::INVALID_NODE);
+    }
+
+    const Block &block = blocks[blockIndex];
+
+    p_allocation->memory = block.memory;
+    p_allocation->offset = range.offset;
+    p_allocation->size = range.size;
+    p_allocation->mapped = block.mapped ? block.mapped + range.offset : nullptr;
+    p_allocation->memoryTypeIndex = memoryTypeIndex;
+    p_allocation->category = category;
+    p_allocation->blockIndex = blockIndex;
+    p_allocation->range = range;
+
+    stats.usedBytes += range.size;
+    stats.allocationCount++;
+
+    budget.OnAllocate(category, range.size);
+
+    return VK_SUCCESS;
+}
+
+void DeviceMemoryAllocator::Free(DeviceAllocation *p_allocation)
+{
+    if (p_allocation->memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+
+    stats.usedBytes -= p_allocation->size;
+    stats.allocationCount--;
+
+    budget.OnFree(p_allocation->category, p_allocation->size);
+
+    if (p_allocation->blockIndex == DEDICATED_BLOCK)
+    {
+        vkFreeMemory(device, p_allocation->memory, allocationCallbacks);
+        budget.OnRelease(HeapIndex(p_allocation->memoryTypeIndex), p_allocation->size);
+
+        stats.reservedBytes -= p_allocation->size;
+        stats.dedicatedCount--;
+        *p_allocation = {};
+        return;
+    }
+
+    Block &block = blocks[p_allocation->blockIndex];
+    block.ranges.Free(p_allocation->range);
+
+    // Release empty blocks, but keep one per memory type to avoid churn when a
+    // single resource is created and destroyed repeatedly.
+    if (block.ranges.AllocationCount() == 0)
+    {
+        const bool hasSibling = std::any_of(blocks.begin(), blocks.end(),
+            [&block](const Block &other)
+            {
+                return &other != &block &&
+                       other.memory != VK_NULL_HANDLE &&
+                       other.memoryTypeIndex == block.memoryTypeIndex &&
+                       other.isLinear == block.isLinear;
+            });
+
+        if (hasSibling)
+        {
+            vkFreeMemory(device, block.memory, allocationCallbacks);
+            budget.OnRelease(HeapIndex(block.memoryTypeIndex), block.ranges.Size());
+
+            stats.reservedBytes -= block.ranges.Size();
+            stats.blockCount--;
+            block = {};
+        }
+    }
+
+    *p_allocation = {};
+}
+
+bool DeviceMemoryAllocator::AllocateForMove(
+    const VkMemoryRequirements &requirements,
+    const DeviceAllocation &source,
+    DeviceAllocation *p_allocation)
+{
+    assert(source.blockIndex != DEDICATED_BLOCK);
+
+    std::lock_guard lock(mutex);
+
+    const Block &sourceBlock = blocks[source.blockIndex];
+    const double sourceUsage = static_cast<double>(sourceBlock.ranges.UsedSize()) /
+                               static_cast<double>(sourceBlock.ranges.Size());
+
+    // Densest first: fill the blocks that are staying, never move into a sparser one
+    // (it would be evacuated in turn).
+    uint32_t bestBlock = DEDICATED_BLOCK;
+    double bestUsage = sourceUsage;
+
+    for (uint32_t i = 0; i < blocks.size(); i++)
+    {
+        const Block &block = blocks[i];
+
+        if (i == source.blockIndex ||
+            block.memory == VK_NULL_HANDLE ||
+            block.memoryTypeIndex != source.memoryTypeIndex ||
+            block.isLinear != sourceBlock.isLinear ||
+            (requirements.memoryTypeBits & (1u << block.memoryTypeIndex)) == 0 ||
+            block.ranges.Size() - block.ranges.UsedSize() < requirements.size)
+        {
+            continue;
+        }
+
+        const double usage = static_cast<double>(block.ranges.UsedSize()) /
+                             static_cast<double>(block.ranges.Size());
+
+        if (usage > bestUsage)
+        {
+            bestUsage = usage;
+            bestBlock = i;
+        }
+    }
+
+    if (bestBlock == DEDICATED_BLOCK)
+    {
+        return false;
+    }
+
+    Block &block = blocks[bestBlock];
+    const TlsfAllocator::Allocation range = block.ranges.Allocate(requirements.size, requirements.alignment);
+
+    // Enough free bytes, but not in one range.
+    if (range.node == TlsfAllocator::INVALID_NODE)
+    {
+        return false;
+    }
+
+    p_allocation->memory = block.memory;
+    p_allocation->offset = range.offset;
+    p_allocation->size = range.size;
+    p_allocation->mapped = block.mapped ? block.mapped + range.offset : nullptr;
+    p_allocation->memoryTypeIndex = block.memoryTypeIndex;
+    p_allocation->category = source.category;
+    p_allocation->blockIndex = bestBlock;
+    p_allocation->range = range;
+
+    stats.usedBytes += range.size;
+    stats.allocationCount++;
+
+    budget.OnAllocate(source.category, range.size);
+
+    return true;
+}
+
+std::vector<DeviceBlockInfo> DeviceMemoryAllocator::BlockInfos() const
+{
+    std::lock_guard lock(mutex);
+
+    std::vector<DeviceBlockInfo> infos = {};
+    infos.reserve(blocks.size());
+
+    for (uint32_t i = 0; i < blocks.size(); i++)
+    {
+        const Block &block = blocks[i];
+
+        if (block.memory == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+
+        DeviceBlockInfo info = {};
+        info.blockIndex = i;
+        info.memoryTypeIndex = block.memoryTypeIndex;
+        info.isLinear = block.isLinear;
+        info.size = block.ranges.Size();
+        info.usedBytes = block.ranges.UsedSize();
+        info.allocationCount = block.ranges.AllocationCount();
+
+        infos.push_back(info);
+    }
+
+    return infos;
+}
+
+const VkPhysicalDeviceMemoryProperties &DeviceMemoryAllocator::MemoryProperties() const
+{
+    return memoryProperties;
+}
+
+DeviceMemoryStats DeviceMemoryAllocator::Stats() const
+{
+    std::lock_guard lock(mutex);
+    return stats;
+}
+
+MemoryBudget &DeviceMemoryAllocator::Budget()
+{
+    return budget;
+}
+
+VkAllocationCallbacks *DeviceMemoryAllocator::AllocationCallbacks() const
+{
+    return allocationCallbacks;
+}
+
+VkResult DeviceMemoryAllocator::CreateBlock(
+    uint32_t memory_type_index,
+    bool is_linear,
+    VkDeviceSize min_size,
+    uint32_t *p_block_index)
+{
+    Block block = {};
+    block.memoryTypeIndex = memory_type_index;
+    block.isLinear = is_linear;
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = BlockSizeForType(memory_type_index);
+    allocateInfo.memoryTypeIndex = memory_type_index;
+
+    // The heap may be too fragmented (or too small) for a full block: halve it
+    // until it fits, but never under what the request needs.
+    VkResult result = vkAllocateMemory(device, &allocateInfo, allocationCallbacks, &block.memory);
+
+    while (result != VK_SUCCESS && allocateInfo.allocationSize / 2 >= min_size)
+    {
+        allocateInfo.allocationSize /= 2;
+        result = vkAllocateMemory(device, &allocateInfo, allocationCallbacks, &block.memory);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        return result;
+    }
+
+    if (IsHostVisible(memory_type_index))
+    {
+        void *mapped = nullptr;
+        result = vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+
+        if (result != VK_SUCCESS)
+        {
+            vkFreeMemory(device, block.memory, allocationCallbacks);
+            return result;
+        }
+
+        block.mapped = static_cast<uint8_t *>(mapped);
+    }
+
+    block.ranges.Init(allocateInfo.allocationSize);
+
+    budget.OnReserve(HeapIndex(memory_type_index), allocateInfo.allocationSize);
+
+    stats.reservedBytes += allocateInfo.allocationSize;
+    stats.blockCount++;
+
+    // Reuse a hole left by a released block.
+    for (uint32_t i = 0; i < blocks.size(); i++)
+    {
+        if (blocks[i].memory == VK_NULL_HANDLE)
+        {
+            blocks[i] = std::move(block);
+            *p_block_index = i;
+            return VK_SUCCESS;
+        }
+    }
+
+    blocks.push_back(std::move(block));
+    *p_block_index = static_cast<uint32_t>(blocks.size() - 1);
+
+    return VK_SUCCESS;
+}
+
+VkResult DeviceMemoryAllocator::AllocateDedicated(
+    const VkMemoryRequirements &requirements,
+    uint32_t memory_type_index,
+    DeviceAllocation *p_allocation)
+{
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = memory_type_index;
+
+    *p_allocation = {};
+
+    VkResult result = vkAllocateMemory(device, &allocateInfo, allocationCallbacks, &p_allocation->memory);
+
+    if (result != VK_SUCCESS)
+    {
+        *p_allocation = {};
+        return result;
+    }
+
+    if (IsHostVisible(memory_type_index))
+    {
+        result = vkMapMemory(device, p_allocation->memory, 0, VK_WHOLE_SIZE, 0, &p_allocation->mapped);
+
+        if (result != VK_SUCCESS)
+        {
+            vkFreeMemory(device, p_allocation->memory, allocationCallbacks);
+            *p_allocation = {};
+            return result;
+        }
+    }
+
+    p_allocation->offset = 0;
+    p_allocation->size = requirements.size;
+    p_allocation->memoryTypeIndex = memory_type_index;
+    p_allocation->blockIndex = DEDICATED_BLOCK;
+
+    budget.OnReserve(HeapIndex(memory_type_index), requirements.size);
+
+    stats.reservedBytes += requirements.size;
+    stats.usedBytes += requirements.size;
+    stats.dedicatedCount++;
+    stats.allocationCount++;
+
+    return VK_SUCCESS;
+}
+
+VkDeviceSize DeviceMemoryAllocator::BlockSizeForType(uint32_t memory_type_index) const
+{
+    const VkDeviceSize heapSize = memoryProperties.memoryHeaps[HeapIndex(memory_type_index)].size;
+
+    // Small heaps (e.g. the 256 MiB BAR window) must not be eaten by a single block.
+    return std::min(preferredBlockSize, heapSize / 8);
+}
+
+bool DeviceMemoryAllocator::IsHostVisible(uint32_t memory_type_index) const
+{
+    return (memoryProperties.memoryTypes[memory_type_index].propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+uint32_t DeviceMemoryAllocator::HeapIndex(uint32_t memory_type_index) const
+{
+    return memoryProperties.memoryTypes[memory_type_index].heapIndex;
+}
+}
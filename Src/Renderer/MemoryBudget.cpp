@@ -0,0 +1,285 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+namespace Renderer
+{
+const char *MemoryCategoryName(MemoryCategory category)
+{
+    switch (category)
+    {
+        case MemoryCategory::GEOMETRY: return "geometry";
+        case MemoryCategory::UNIFORMS: return "uniforms";
+        case MemoryCategory::ATTACHMENTS: return "attachments";
+        case MemoryCategory::STAGING: return "staging";
+        case MemoryCategory::TEXTURES: return "textures";
+        case MemoryCategory::OTHER: return "other";
+        default: return "unknown";
+    }
+}
+
+void MemoryBudget::Init(VkPhysicalDevice gpu, bool has_memory_budget)
+{
+    std::lock_guard lock(mutex);
+
+    this->gpu = gpu;
+    hasMemoryBudget = has_memory_budget;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memoryProperties);
+
+    heapCount = memoryProperties.memoryHeapCount;
+
+    for (uint32_t i = 0; i < heapCount; i++)
+    {
+        heaps[i] = {};
+        heaps[i].size = memoryProperties.memoryHeaps[i].size;
+        heaps[i].deviceLocal = (memoryProperties.memoryHeaps[i].flags &
+                                VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        heaps[i].budget = static_cast<VkDeviceSize>(
+            static_cast<double>(heaps[i].size) * FALLBACK_BUDGET_SHARE);
+    }
+
+    QueryDriverBudget();
+}
+
+void MemoryBudget::Teardown()
+{
+    std::lock_guard lock(mutex);
+
+    thresholds.clear();
+}
+
+void MemoryBudget::OnAllocate(MemoryCategory category, VkDeviceSize size)
+{
+    std::lock_guard lock(mutex);
+    Add(&categories[static_cast<uint32_t>(category)], size);
+}
+
+void MemoryBudget::OnFree(MemoryCategory category, VkDeviceSize size)
+{
+    std::lock_guard lock(mutex);
+    Subtract(&categories[static_cast<uint32_t>(category)], size);
+}
+
+void MemoryBudget::OnReserve(uint32_t heap_index, VkDeviceSize size)
+{
+    std::lock_guard lock(mutex);
+
+    HeapBudget &heap = heaps[heap_index];
+    Add(&heap.reserved, size);
+
+    heap.usage = hasMemoryBudget
+                     ? driverUsage[heap_index] + heap.reserved.current - std::min(
+                           heap.reserved.current, reservedAtQuery[heap_index])
+                     : heap.reserved.current;
+}
+
+void MemoryBudget::OnRelease(uint32_t heap_index, VkDeviceSize size)
+{
+    std::lock_guard lock(mutex);
+
+    HeapBudget &heap = heaps[heap_index];
+    Subtract(&heap.reserved, size);
+
+    // Released memory is only seen by the driver at the next query: keep the old usage until then.
+    heap.usage = hasMemoryBudget
+                     ? std::max(driverUsage[heap_index], heap.reserved.current)
+                     : heap.reserved.current;
+}
+
+void MemoryBudget::Update()
+{
+    struct Crossing
+    {
+        ThresholdCallback callback = {};
+        uint32_t heapIndex = {};
+        HeapBudget heap = {};
+        bool isOver = {};
+    };
+
+    std::vector<Crossing> crossings = {};
+
+    {
+        std::lock_guard lock(mutex);
+
+        QueryDriverBudget();
+
+        for (Threshold &threshold : thresholds)
+        {
+            for (uint32_t i = 0; i < heapCount; i++)
+            {
+                const bool isOver = static_cast<double>(heaps[i].usage) >
+                                    static_cast<double>(heaps[i].budget) * threshold.share;
+
+                if (isOver != threshold.isOver[i])
+                {
+                    threshold.isOver[i] = isOver;
+                    crossings.push_back({threshold.callback, i, heaps[i], isOver});
+                }
+            }
+        }
+    }
+
+    // Callbacks may query the budget, free memory or add thresholds: run them unlocked, from
+    // copies since thresholds may grow meanwhile.
+    for (const Crossing &crossing : crossings)
+    {
+        crossing.callback(crossing.heapIndex, crossing.heap, crossing.isOver);
+    }
+}
+
+void MemoryBudget::AddThresholdCallback(float threshold, ThresholdCallback callback)
+{
+    assert(threshold > 0.0f && "Threshold is a share of the budget");
+
+    std::lock_guard lock(mutex);
+
+    Threshold entry = {};
+    entry.share = threshold;
+    entry.callback = std::move(callback);
+
+    thresholds.push_back(std::move(entry));
+}
+
+bool MemoryBudget::HasMemoryBudgetExtension() const
+{
+    return hasMemoryBudget;
+}
+
+MemoryCounter MemoryBudget::Category(MemoryCategory category) const
+{
+    std::lock_guard lock(mutex);
+    return categories[static_cast<uint32_t>(category)];
+}
+
+uint32_t MemoryBudget::HeapCount() const
+{
+    return heapCount;
+}
+
+HeapBudget MemoryBudget::Heap(uint32_t heap_index) const
+{
+    assert(heap_index < heapCount);
+
+    std::lock_guard lock(mutex);
+    return heaps[heap_index];
+}
+
+std::string MemoryBudget::ToJson() const
+{
+    std::lock_guard lock(mutex);
+
+    std::string json = {};
+    char line[256] = {};
+
+    snprintf(line, sizeof(line), "{\n  \"memoryBudgetExtension\": %s,\n  \"categories\": {\n",
+        hasMemoryBudget ? "true" : "false");
+    json += line;
+
+    constexpr uint32_t CATEGORY_COUNT = static_cast<uint32_t>(MemoryCategory::COUNT);
+
+    for (uint32_t i = 0; i < CATEGORY_COUNT; i++)
+    {
+        const MemoryCounter &counter = categories[i];
+
+        snprintf(line, sizeof(line),
+            "    \"%s\": {\"current\": %llu, \"peak\": %llu, \"allocations\": %u}%s\n",
+            MemoryCategoryName(static_cast<MemoryCategory>(i)),
+            static_cast<unsigned long long>(counter.current),
+            static_cast<unsigned long long>(counter.peak),
+            counter.allocationCount,
+            i + 1 < CATEGORY_COUNT ? "," : "");
+        json += line;
+    }
+
+    json += "  },\n  \"heaps\": [\n";
+
+    for (uint32_t i = 0; i < heapCount; i++)
+    {
+        const HeapBudget &heap = heaps[i];
+
+        snprintf(line, sizeof(line),
+            "    {\"index\": %u, \"deviceLocal\": %s, \"size\": %llu, \"budget\": %llu, "
+            "\"usage\": %llu, \"reserved\": %llu, \"peakReserved\": %llu}%s\n",
+            i,
+            heap.deviceLocal ? "true" : "false",
+            static_cast<unsigned long long>(heap.size),
+            static_cast<unsigned long long>(heap.budget),
+            static_cast<unsigned long long>(heap.usage),
+            static_cast<unsigned long long>(heap.reserved.current),
+            static_cast<unsigned long long>(heap.reserved.peak),
+            i + 1 < heapCount ? "," : "");
+        json += line;
+    }
+
+    json += "  ]\n}\n";
+
+    return json;
+}
+
+bool MemoryBudget::DumpJson(const char *p_path) const
+{
+    const std::string json = ToJson();
+
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    const bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    fclose(file);
+
+    return written;
+}
+
+void MemoryBudget::QueryDriverBudget()
+{
+    if (!hasMemoryBudget)
+    {
+        for (uint32_t i = 0; i < heapCount; i++)
+        {
+            heaps[i].usage = heaps[i].reserved.current;
+        }
+
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memoryProperties = {};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = &budgetProperties;
+
+    vkGetPhysicalDeviceMemoryProperties2KHR(gpu, &memoryProperties);
+
+    for (uint32_t i = 0; i < heapCount; i++)
+    {
+        driverUsage[i] = budgetProperties.heapUsage[i];
+        reservedAtQuery[i] = heaps[i].reserved.current;
+
+        heaps[i].usage = budgetProperties.heapUsage[i];
+        heaps[i].budget = budgetProperties.heapBudget[i];
+    }
+}
+
+void MemoryBudget::Add(MemoryCounter *p_counter, VkDeviceSize size)
+{
+    p_counter->current += size;
+    p_counter->peak = std::max(p_counter->peak, p_counter->current);
+    p_counter->allocationCount++;
+}
+
+void MemoryBudget::Subtract(MemoryCounter *p_counter, VkDeviceSize size)
+{
+    assert(p_counter->current >= size && p_counter->allocationCount > 0);
+
+    p_counter->current -= size;
+    p_counter->allocationCount--;
+}
+}
@@ -0,0 +1,309 @@
+#include "MemoryDefragmenter.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Renderer
+{
+void MemoryDefragmenter::Init(VkDevice device, DeviceMemoryAllocator *p_memory_allocator)
+{
+    this->device = device;
+    memoryAllocator = p_memory_allocator;
+    bytesMoved = 0;
+    buffersMoved = 0;
+}
+
+void MemoryDefragmenter::Teardown()
+{
+    for (Retired &entry : retired)
+    {
+        vkDestroyBuffer(device, entry.buffer, memoryAllocator->AllocationCallbacks());
+        memoryAllocator->Free(&entry.allocation);
+    }
+
+    assert(std::none_of(movables.begin(), movables.end(),
+        [](const Movable &movable) { return movable.registered; }) && "Buffer still registered");
+
+    movables.clear();
+    unusedIds.clear();
+    retired.clear();
+}
+
+uint32_t MemoryDefragmenter::Register(
+    VkBuffer *p_buffer,
+    DeviceAllocation *p_allocation,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    MovedCallback on_moved)
+{
+    Movable movable = {};
+    movable.buffer = p_buffer;
+    movable.allocation = p_allocation;
+    movable.size = size;
+    movable.usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    movable.onMoved = std::move(on_moved);
+    movable.registered = true;
+
+    if (!unusedIds.empty())
+    {
+        const uint32_t id = unusedIds.back();
+        unusedIds.pop_back();
+        movables[id] = std::move(movable);
+        return id;
+    }
+
+    movables.push_back(std::move(movable));
+    return static_cast<uint32_t>(movables.size() - 1);
+}
+
+void MemoryDefragmenter::Unregister(uint32_t id)
+{
+    assert(id < movables.size() && movables[id].registered);
+
+    Movable &movable = movables[id];
+
+    // The last chunk may still be copying into it.
+    if (movable.moveBuffer != VK_NULL_HANDLE)
+    {
+        retired.push_back({movable.moveBuffer, movable.moveAllocation, movable.lastCopyFrame});
+    }
+
+    movable = {};
+    unusedIds.push_back(id);
+}
+
+void MemoryDefragmenter::MarkWritten(VkBuffer buffer, VkDeviceSize offset)
+{
+    for (Movable &movable : movables)
+    {
+        if (movable.moveBuffer != VK_NULL_HANDLE && *movable.buffer == buffer)
+        {
+            movable.copiedBytes = std::min(movable.copiedBytes, offset);
+            return;
+        }
+    }
+}
+
+void MemoryDefragmenter::Update(VkCommandBuffer cmd, uint32_t frame_index, VkDeviceSize frame_budget)
+{
+    chunks.clear();
+
+    VkDeviceSize budget = frame_budget;
+
+    // Moves in progress first: completing them is what releases memory.
+    for (Movable &movable : movables)
+    {
+        if (budget == 0)
+        {
+            break;
+        }
+
+        if (movable.moveBuffer != VK_NULL_HANDLE && movable.copiedBytes < movable.size)
+        {
+            CopyChunk(movable, frame_index, &budget);
+        }
+    }
+
+    std::vector<DeviceBlockInfo> blocks = memoryAllocator->BlockInfos();
+
+    // Emptiest first: they are the cheapest to release.
+    std::erase_if(blocks, [](const DeviceBlockInfo &block)
+    {
+        return static_cast<float>(block.usedBytes) >=
+               static_cast<float>(block.size) * SPARSE_BLOCK_USAGE;
+    });
+
+    std::sort(blocks.begin(), blocks.end(), [](const DeviceBlockInfo &a, const DeviceBlockInfo &b)
+    {
+        return a.usedBytes < b.usedBytes;
+    });
+
+    for (const DeviceBlockInfo &block : blocks)
+    {
+        for (Movable &movable : movables)
+        {
+            if (budget == 0)
+            {
+                break;
+            }
+
+            if (!movable.registered ||
+                movable.moveBuffer != VK_NULL_HANDLE ||
+                movable.allocation->blockIndex != block.blockIndex)
+            {
+                continue;
+            }
+
+            if (BeginMove(movable))
+            {
+                CopyChunk(movable, frame_index, &budget);
+            }
+        }
+    }
+
+    if (chunks.empty())
+    {
+        return;
+    }
+
+    // Writes of the previous commands (uploads, shaders) must land before the copy reads.
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+
+    for (const Chunk &chunk : chunks)
+    {
+        vkCmdCopyBuffer(cmd, chunk.srcBuffer, chunk.dstBuffer, 1, &chunk.region);
+    }
+
+    // Any later command may consume the moved buffers, or overwrite the source range.
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+}
+
+void MemoryDefragmenter::Reclaim(uint32_t frame_index)
+{
+    for (size_t i = 0; i < retired.size();)
+    {
+        if (retired[i].frameIndex != frame_index)
+        {
+            i++;
+            continue;
+        }
+
+        vkDestroyBuffer(device, retired[i].buffer, memoryAllocator->AllocationCallbacks());
+
+        // Releases the block once its last range is gone.
+        memoryAllocator->Free(&retired[i].allocation);
+
+        retired[i] = retired.back();
+        retired.pop_back();
+    }
+
+    // After the release: the buffers retired here are still used by the frames in flight.
+    for (Movable &movable : movables)
+    {
+        if (movable.moveBuffer != VK_NULL_HANDLE &&
+            movable.copiedBytes == movable.size &&
+            movable.lastCopyFrame == frame_index)
+        {
+            CompleteMove(movable, frame_index);
+        }
+    }
+}
+
+DefragmentationStats MemoryDefragmenter::Stats() const
+{
+    VkDeviceSize reserved = 0;
+    VkDeviceSize used = 0;
+
+    for (const DeviceBlockInfo &block : memoryAllocator->BlockInfos())
+    {
+        reserved += block.size;
+        used += block.usedBytes;
+    }
+
+    DefragmentationStats stats = {};
+    stats.fragmentation = reserved > 0
+                              ? 1.0f - static_cast<float>(used) / static_cast<float>(reserved)
+                              : 0.0f;
+    stats.bytesMoved = bytesMoved;
+    stats.buffersMoved = buffersMoved;
+    stats.activeMoves = static_cast<uint32_t>(std::count_if(movables.begin(), movables.end(),
+        [](const Movable &movable) { return movable.moveBuffer != VK_NULL_HANDLE; }));
+    stats.pendingReleases = static_cast<uint32_t>(retired.size());
+
+    return stats;
+}
+
+bool MemoryDefragmenter::BeginMove(Movable &movable)
+{
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = movable.size;
+    bufferCreateInfo.usage = movable.usage;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer newBuffer = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateBuffer(device, &bufferCreateInfo, memoryAllocator->AllocationCallbacks(),
+        &newBuffer));
+
+    VkMemoryRequirements requirements = {};
+    vkGetBufferMemoryRequirements(device, newBuffer, &requirements);
+
+    DeviceAllocation newAllocation = {};
+
+    if (!memoryAllocator->AllocateForMove(requirements, *movable.allocation, &newAllocation))
+    {
+        vkDestroyBuffer(device, newBuffer, memoryAllocator->AllocationCallbacks());
+        return false;
+    }
+
+    VK_CHECK(vkBindBufferMemory(device, newBuffer, newAllocation.memory, newAllocation.offset));
+
+    movable.moveBuffer = newBuffer;
+    movable.moveAllocation = newAllocation;
+    movable.copiedBytes = 0;
+
+    return true;
+}
+
+void MemoryDefragmenter::CopyChunk(Movable &movable, uint32_t frame_index, VkDeviceSize *p_budget)
+{
+    Chunk chunk = {};
+    chunk.srcBuffer = *movable.buffer;
+    chunk.dstBuffer = movable.moveBuffer;
+    chunk.region.srcOffset = movable.copiedBytes;
+    chunk.region.dstOffset = movable.copiedBytes;
+    chunk.region.size = std::min(movable.size - movable.copiedBytes, *p_budget);
+
+    chunks.push_back(chunk);
+
+    movable.copiedBytes += chunk.region.size;
+    movable.lastCopyFrame = frame_index;
+    *p_budget -= chunk.region.size;
+}
+
+void MemoryDefragmenter::CompleteMove(Movable &movable, uint32_t frame_index)
+{
+    const VkBuffer oldBuffer = *movable.buffer;
+
+    // The frames in flight still read the old buffer: released by the next Reclaim of this frame.
+    retired.push_back({oldBuffer, *movable.allocation, frame_index});
+
+    *movable.buffer = movable.moveBuffer;
+    *movable.allocation = movable.moveAllocation;
+
+    movable.moveBuffer = VK_NULL_HANDLE;
+    movable.moveAllocation = {};
+    movable.copiedBytes = 0;
+
+    bytesMoved += movable.size;
+    buffersMoved++;
+
+    if (movable.onMoved)
+    {
+        movable.onMoved(oldBuffer, *movable.buffer);
+    }
+}
+}
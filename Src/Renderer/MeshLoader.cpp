@@ -3,23 +3,33 @@
 //
 
 #include "MeshLoader.h"
+#include "MeshLoaderInternal.h"
 
 #include <assimp/cimport.h> // Plain-C interface
 #include <assimp/postprocess.h> // Post processing flags
 #include <assimp/scene.h> // Output data structure
 #include <stdexcept>
 
+#include "Profiler.h"
 #include "Renderer.h"
 
 namespace Renderer
 {
 void MeshLoader::Load(const char *file_path, BatchCpu *batch)
 {
-    const aiScene *scene = aiImportFile(
-        file_path,
-        aiProcess_Triangulate |
-        aiProcess_GenNormals |
-        aiProcess_JoinIdenticalVertices);
+    PROFILE_FUNCTION();
+
+    const aiScene *scene = nullptr;
+
+    {
+        PROFILE_ZONE("aiImportFile");
+
+        scene = aiImportFile(
+            file_path,
+            aiProcess_Triangulate |
+            aiProcess_GenNormals |
+            aiProcess_JoinIdenticalVertices);
+    }
 
     if (!scene)
     {
@@ -35,7 +45,11 @@ void MeshLoader::Load(const char *file_path, BatchCpu *batch)
     aiMatrix4x4 rotZ;
     aiMatrix4x4::Rotation(glm::radians(60.0f), aiVector3D(0, 0, 1), rotZ);
 
-    ProcessNode(scene->mRootNode, scene, batch, rotX * rotY * rotZ);
+    {
+        PROFILE_ZONE("ProcessNode");
+
+        ProcessNode(scene->mRootNode, scene, batch, rotX * rotY * rotZ);
+    }
 
     aiReleaseImport(scene);
 }
@@ -48,7 +62,7 @@ void MeshLoader::ProcessNode(aiNode *node, const aiScene *scene, BatchCpu *batch
     for (uint32_t i = 0; i < node->mNumMeshes; i++)
     {
         aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessMesh(mesh, scene, batch, worldTransform);
+        ProcessMesh(mesh, worldTransform, batch);
     }
 
     for (uint32_t i = 0; i < node->mNumChildren; i++)
@@ -57,8 +71,7 @@ void MeshLoader::ProcessNode(aiNode *node, const aiScene *scene, BatchCpu *batch
     }
 }
 
-void MeshLoader::ProcessMesh(aiMesh *mesh, const aiScene *scene, BatchCpu *batch,
-    const aiMatrix4x4 &parentTransform)
+void ProcessMesh(const aiMesh *mesh, const aiMatrix4x4 &parentTransform, BatchCpu *batch)
 {
     const uint32_t baseIndex = batch->position.size();
 
@@ -83,6 +96,16 @@ void MeshLoader::ProcessMesh(aiMesh *mesh, const aiScene *scene, BatchCpu *batch
         normal.y = transformedNormals.y;
         normal.z = transformedNormals.z;
         batch->normals.push_back(normal);
+
+        // Texture coordinates (first channel only). Meshes without uvs get zeros so
+        // every stream keeps the same vertex count.
+        glm::vec2 uv = {};
+        if (mesh->HasTextureCoords(0))
+        {
+            uv.x = mesh->mTextureCoords[0][i].x;
+            uv.y = mesh->mTextureCoords[0][i].y;
+        }
+        batch->uvs.push_back(uv);
     }
 
 
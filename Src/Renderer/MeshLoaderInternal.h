@@ -0,0 +1,16 @@
+#ifndef MESH_LOADER_INTERNAL_H
+#define MESH_LOADER_INTERNAL_H
+
+#include <assimp/scene.h>
+
+// Not under Include: MeshLoader internals, shared with the micro-benchmarks only.
+
+namespace Renderer
+{
+struct BatchCpu;
+
+/// Append the vertices of mesh, moved by parentTransform, and its indices to batch.
+void ProcessMesh(const aiMesh *mesh, const aiMatrix4x4 &parentTransform, BatchCpu *batch);
+}
+
+#endif //MESH_LOADER_INTERNAL_H
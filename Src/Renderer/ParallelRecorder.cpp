@@ -0,0 +1,176 @@
+#include "ParallelRecorder.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <latch>
+
+namespace Renderer
+{
+void ParallelRecorder::Init(
+    VkDevice device,
+    uint32_t queue_family_index,
+    ThreadPool *p_thread_pool,
+    uint32_t frame_count,
+    uint32_t max_slices,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    threadPool = p_thread_pool;
+    allocationCallbacks = p_allocation_callbacks;
+    frameCount = frame_count;
+    maxSlices = max_slices != 0 ? max_slices : std::max(threadPool->ThreadCount(), 1u);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = queue_family_index;
+
+    pools.resize(static_cast<size_t>(frameCount) * maxSlices);
+
+    for (SlicePool &slicePool : pools)
+    {
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, allocationCallbacks,
+            &slicePool.pool));
+    }
+
+    secondaries.reserve(maxSlices);
+    sliceMs.resize(maxSlices);
+}
+
+void ParallelRecorder::Teardown()
+{
+    // Destroying the pool frees its command buffers.
+    for (SlicePool &slicePool : pools)
+    {
+        vkDestroyCommandPool(device, slicePool.pool, allocationCallbacks);
+    }
+
+    pools.clear();
+    secondaries.clear();
+    sliceMs.clear();
+}
+
+void ParallelRecorder::BeginFrame(uint32_t frame_index)
+{
+    for (uint32_t slice = 0; slice < maxSlices; slice++)
+    {
+        SlicePool &slicePool = Pool(frame_index, slice);
+
+        VK_CHECK(vkResetCommandPool(device, slicePool.pool, 0));
+        slicePool.usedCount = 0;
+    }
+}
+
+void ParallelRecorder::Record(
+    VkCommandBuffer primary,
+    uint32_t frame_index,
+    const VkCommandBufferInheritanceInfo &inheritance,
+    uint32_t item_count,
+    const RecordSliceFn &record_slice)
+{
+    PROFILE_FUNCTION();
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const uint32_t wantedSlices = (item_count + MIN_ITEMS_PER_SLICE - 1) / MIN_ITEMS_PER_SLICE;
+    const uint32_t sliceCount = std::clamp(wantedSlices, 1u, maxSlices);
+
+    // Allocated on this thread: the pools are not touched by the workers outside their slice.
+    secondaries.resize(sliceCount);
+
+    for (uint32_t slice = 0; slice < sliceCount; slice++)
+    {
+        secondaries[slice] = AcquireCommandBuffer(Pool(frame_index, slice));
+    }
+
+    std::latch done(sliceCount);
+
+    for (uint32_t slice = 0; slice < sliceCount; slice++)
+    {
+        // Contiguous and balanced: the first item_count % sliceCount slices get one more.
+        const uint32_t first = static_cast<uint32_t>(
+            static_cast<uint64_t>(item_count) * slice / sliceCount);
+        const uint32_t end = static_cast<uint32_t>(
+            static_cast<uint64_t>(item_count) * (slice + 1) / sliceCount);
+
+        threadPool->Submit([this, slice, first, end, &inheritance, &record_slice, &done]
+        {
+            PROFILE_ZONE("record slice");
+
+            const auto sliceStart = std::chrono::steady_clock::now();
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                              VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritance;
+
+            const VkCommandBuffer cmd = secondaries[slice];
+
+            VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+            record_slice(cmd, first, end - first);
+            VK_CHECK(vkEndCommandBuffer(cmd));
+
+            sliceMs[slice] = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - sliceStart).count();
+
+            done.count_down();
+        });
+    }
+
+    done.wait();
+
+    // Slice order, whatever the order the workers finished in.
+    vkCmdExecuteCommands(primary, sliceCount, secondaries.data());
+
+    lastStats = {};
+    lastStats.wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    lastStats.sliceCount = sliceCount;
+    lastStats.itemCount = item_count;
+
+    for (uint32_t slice = 0; slice < sliceCount; slice++)
+    {
+        lastStats.cpuMs += sliceMs[slice];
+    }
+}
+
+uint32_t ParallelRecorder::MaxSlices() const
+{
+    return maxSlices;
+}
+
+RecordStats ParallelRecorder::LastStats() const
+{
+    return lastStats;
+}
+
+VkCommandBuffer ParallelRecorder::AcquireCommandBuffer(SlicePool &slice_pool)
+{
+    if (slice_pool.usedCount == slice_pool.commandBuffers.size())
+    {
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = slice_pool.pool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &cmd));
+
+        slice_pool.commandBuffers.push_back(cmd);
+    }
+
+    return slice_pool.commandBuffers[slice_pool.usedCount++];
+}
+
+ParallelRecorder::SlicePool &ParallelRecorder::Pool(uint32_t frame_index, uint32_t slice)
+{
+    assert(frame_index < frameCount && slice < maxSlices);
+    return pools[static_cast<size_t>(frame_index) * maxSlices + slice];
+}
+}
@@ -0,0 +1,341 @@
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "VkCommon.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace Renderer
+{
+void PipelineCache::Init(
+    VkDevice device,
+    VkPhysicalDevice gpu,
+    const char *p_directory,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    PROFILE_FUNCTION();
+
+    this->device = device;
+    allocationCallbacks = p_allocation_callbacks;
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+
+    loadedSize = 0;
+    savedSize = 0;
+    path.clear();
+
+    std::vector<char> file = {};
+
+    if (p_directory != nullptr)
+    {
+        // Per device: a machine with two GPUs keeps a warm cache for each.
+        char name[64] = {};
+        snprintf(name, sizeof(name), "pipeline_cache_%04x_%04x.bin",
+            gpuProperties.vendorID,
+            gpuProperties.deviceID);
+
+        path = (std::filesystem::path(p_directory) / name).string();
+
+        if (FILE *handle = fopen(path.c_str(), "rb"))
+        {
+            fseek(handle, 0, SEEK_END);
+            const long size = ftell(handle);
+            fseek(handle, 0, SEEK_SET);
+
+            if (size > 0)
+            {
+                file.resize(static_cast<size_t>(size));
+
+                if (fread(file.data(), 1, file.size(), handle) != file.size())
+                {
+                    file.clear();
+                }
+            }
+
+            fclose(handle);
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheCreateInfo = {};
+    cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    if (!file.empty())
+    {
+        if (const char *reason = Validate(file))
+        {
+            printf("\npipeline cache %s: %s, starting cold", path.c_str(), reason);
+        }
+        else
+        {
+            loadedSize = file.size() - sizeof(FileHeader);
+            cacheCreateInfo.initialDataSize = loadedSize;
+            cacheCreateInfo.pInitialData = file.data() + sizeof(FileHeader);
+        }
+    }
+
+    VK_CHECK(vkCreatePipelineCache(device, &cacheCreateInfo, allocationCallbacks, &cache));
+
+    savedSize = loadedSize;
+
+    if (!path.empty())
+    {
+        writeThread.Init(1);
+    }
+}
+
+void PipelineCache::Teardown()
+{
+    // Joined first: its write would race the final one.
+    writeThread.Teardown();
+
+    if (!Save())
+    {
+        printf("\npipeline cache %s: can't be written", path.c_str());
+    }
+
+    for (const VkPipelineCache workerCache : workerCaches)
+    {
+        vkDestroyPipelineCache(device, workerCache, allocationCallbacks);
+    }
+
+    workerCaches.clear();
+
+    vkDestroyPipelineCache(device, cache, allocationCallbacks);
+    cache = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::Cache() const
+{
+    return cache;
+}
+
+VkPipelineCache PipelineCache::CreateWorkerCache()
+{
+    PROFILE_FUNCTION();
+
+    std::lock_guard lock(workerMutex);
+
+    size_t dataSize = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, nullptr));
+
+    std::vector<char> data(dataSize);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, data.data()));
+
+    VkPipelineCacheCreateInfo cacheCreateInfo = {};
+    cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheCreateInfo.initialDataSize = dataSize;
+    cacheCreateInfo.pInitialData = data.data();
+
+    VkPipelineCache workerCache = VK_NULL_HANDLE;
+    VK_CHECK(vkCreatePipelineCache(device, &cacheCreateInfo, allocationCallbacks, &workerCache));
+
+    workerCaches.push_back(workerCache);
+
+    return workerCache;
+}
+
+bool PipelineCache::Save()
+{
+    PROFILE_FUNCTION();
+
+    MergeWorkerCaches();
+
+    const std::vector<char> file = Snapshot();
+
+    if (file.empty())
+    {
+        return true;
+    }
+
+    if (!Write(file))
+    {
+        return false;
+    }
+
+    savedSize = file.size() - sizeof(FileHeader);
+
+    return true;
+}
+
+void PipelineCache::SaveAsync()
+{
+    PROFILE_FUNCTION();
+
+    MergeWorkerCaches();
+
+    std::vector<char> file = Snapshot();
+
+    if (file.empty())
+    {
+        return;
+    }
+
+    writeThread.Submit([this, file = std::move(file)]()
+    {
+        if (!Write(file))
+        {
+            printf("\npipeline cache %s: can't be written", path.c_str());
+            return;
+        }
+
+        savedSize = file.size() - sizeof(FileHeader);
+    });
+}
+
+void PipelineCache::MergeWorkerCaches()
+{
+    PROFILE_FUNCTION();
+
+    std::lock_guard lock(workerMutex);
+
+    // In memory only: nothing is saved, nothing to merge.
+    if (path.empty() || workerCaches.empty())
+    {
+        return;
+    }
+
+    // The workers may compile meanwhile: they only write their own caches, the main one is the destination.
+    VK_CHECK(vkMergePipelineCaches(device, cache, static_cast<uint32_t>(workerCaches.size()),
+        workerCaches.data()));
+}
+
+std::vector<char> PipelineCache::Snapshot() const
+{
+    if (path.empty())
+    {
+        return {};
+    }
+
+    size_t dataSize = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, nullptr));
+
+    // Caches only grow: same size, nothing new since the last save.
+    if (dataSize == savedSize)
+    {
+        return {};
+    }
+
+    std::vector<char> file(sizeof(FileHeader) + dataSize);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, file.data() + sizeof(FileHeader)));
+
+    FileHeader header = {};
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.vendorId = gpuProperties.vendorID;
+    header.deviceId = gpuProperties.deviceID;
+    header.driverVersion = gpuProperties.driverVersion;
+    memcpy(header.pipelineCacheUuid, gpuProperties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = dataSize;
+    header.dataHash = Hash(file.data() + sizeof(FileHeader), dataSize);
+    memcpy(file.data(), &header, sizeof(FileHeader));
+
+    return file;
+}
+
+bool PipelineCache::Write(const std::vector<char> &file) const
+{
+    PROFILE_FUNCTION();
+
+    // Written aside, then renamed over the previous file: readers see the old or the new one, whole.
+    const std::string temporaryPath = path + ".tmp";
+
+    FILE *handle = fopen(temporaryPath.c_str(), "wb");
+
+    if (handle == nullptr)
+    {
+        return false;
+    }
+
+    const bool written = fwrite(file.data(), 1, file.size(), handle) == file.size();
+    const bool closed = fclose(handle) == 0;
+
+    std::error_code error = {};
+
+    if (written && closed)
+    {
+        std::filesystem::rename(temporaryPath, path, error);
+    }
+
+    if (!written || !closed || error)
+    {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool PipelineCache::IsWarm() const
+{
+    return loadedSize != 0;
+}
+
+size_t PipelineCache::LoadedSize() const
+{
+    return loadedSize;
+}
+
+const char *PipelineCache::Validate(const std::vector<char> &file) const
+{
+    if (file.size() < sizeof(FileHeader) + sizeof(VkPipelineCacheHeaderVersionOne))
+    {
+        return "truncated";
+    }
+
+    FileHeader header = {};
+    memcpy(&header, file.data(), sizeof(FileHeader));
+
+    if (header.magic != FILE_MAGIC || header.version != FILE_VERSION)
+    {
+        return "not a pipeline cache of this version";
+    }
+
+    if (header.vendorId != gpuProperties.vendorID || header.deviceId != gpuProperties.deviceID)
+    {
+        return "written by another device";
+    }
+
+    if (header.driverVersion != gpuProperties.driverVersion ||
+        memcmp(header.pipelineCacheUuid, gpuProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return "written by another driver";
+    }
+
+    const char *data = file.data() + sizeof(FileHeader);
+    const size_t dataSize = file.size() - sizeof(FileHeader);
+
+    if (header.dataSize != dataSize || header.dataHash != Hash(data, dataSize))
+    {
+        return "corrupted";
+    }
+
+    // The driver header too: the data may come from a layer or a driver that reports another UUID.
+    VkPipelineCacheHeaderVersionOne driverHeader = {};
+    memcpy(&driverHeader, data, sizeof(driverHeader));
+
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.headerSize < sizeof(driverHeader) ||
+        driverHeader.vendorID != gpuProperties.vendorID ||
+        driverHeader.deviceID != gpuProperties.deviceID ||
+        memcmp(driverHeader.pipelineCacheUUID, gpuProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return "driver header mismatch";
+    }
+
+    return nullptr;
+}
+
+uint64_t PipelineCache::Hash(const char *p_data, size_t size)
+{
+    // FNV-1a: catches torn and corrupted files, not meant against tampering.
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(p_data[i]);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+}
@@ -0,0 +1,545 @@
+#include "PipelineRegistry.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "VkCommon.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+namespace Renderer
+{
+namespace
+{
+/// FNV-1a, fed one field at a time.
+struct Hasher
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    void Add(const void *p_data, size_t size)
+    {
+        const auto *bytes = static_cast<const uint8_t *>(p_data);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    template<typename T>
+    void Add(const T &value)
+    {
+        Add(&value, sizeof(T));
+    }
+};
+}
+
+uint64_t GraphicsPipelineDesc::Hash() const
+{
+    Hasher hasher = {};
+
+    hasher.Add(vertexShader);
+    hasher.Add(fragmentShader);
+
+    hasher.Add(vertexBindingCount);
+
+    for (uint32_t i = 0; i < vertexBindingCount; i++)
+    {
+        hasher.Add(vertexBindings[i].binding);
+        hasher.Add(vertexBindings[i].stride);
+        hasher.Add(vertexBindings[i].inputRate);
+    }
+
+    hasher.Add(vertexAttributeCount);
+
+    for (uint32_t i = 0; i < vertexAttributeCount; i++)
+    {
+        hasher.Add(vertexAttributes[i].location);
+        hasher.Add(vertexAttributes[i].binding);
+        hasher.Add(vertexAttributes[i].format);
+        hasher.Add(vertexAttributes[i].offset);
+    }
+
+    hasher.Add(topology);
+    hasher.Add(polygonMode);
+    hasher.Add(cullMode);
+    hasher.Add(frontFace);
+    hasher.Add(sampleCount);
+    hasher.Add(depthTest);
+    hasher.Add(depthWrite);
+    hasher.Add(depthCompareOp);
+    hasher.Add(alphaBlend);
+
+    hasher.Add(specializationCount);
+    hasher.Add(specialization, sizeof(uint32_t) * specializationCount);
+
+    hasher.Add(layout);
+    hasher.Add(renderPass);
+    hasher.Add(subpass);
+
+    return hasher.hash;
+}
+
+bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc &other) const
+{
+    if (vertexBindingCount != other.vertexBindingCount ||
+        vertexAttributeCount != other.vertexAttributeCount ||
+        specializationCount != other.specializationCount)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < vertexBindingCount; i++)
+    {
+        const VkVertexInputBindingDescription &a = vertexBindings[i];
+        const VkVertexInputBindingDescription &b = other.vertexBindings[i];
+
+        if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < vertexAttributeCount; i++)
+    {
+        const VkVertexInputAttributeDescription &a = vertexAttributes[i];
+        const VkVertexInputAttributeDescription &b = other.vertexAttributes[i];
+
+        if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset)
+        {
+            return false;
+        }
+    }
+
+    return vertexShader == other.vertexShader &&
+           fragmentShader == other.fragmentShader &&
+           topology == other.topology &&
+           polygonMode == other.polygonMode &&
+           cullMode == other.cullMode &&
+           frontFace == other.frontFace &&
+           sampleCount == other.sampleCount &&
+           depthTest == other.depthTest &&
+           depthWrite == other.depthWrite &&
+           depthCompareOp == other.depthCompareOp &&
+           alphaBlend == other.alphaBlend &&
+           memcmp(specialization, other.specialization, sizeof(uint32_t) * specializationCount) == 0 &&
+           layout == other.layout &&
+           renderPass == other.renderPass &&
+           subpass == other.subpass;
+}
+
+void PipelineRegistry::Init(
+    VkDevice device,
+    PipelineCache *p_pipeline_cache,
+    uint32_t compile_thread_count,
+    bool capture_statistics,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    pipelineCache = p_pipeline_cache;
+    allocationCallbacks = p_allocation_callbacks;
+    captureStatistics = capture_statistics;
+    stats = {};
+
+    for (uint32_t i = 0; i < compile_thread_count; i++)
+    {
+        freeWorkerCaches.push_back(pipelineCache->CreateWorkerCache());
+    }
+
+    compileThreads.Init(compile_thread_count);
+}
+
+void PipelineRegistry::Teardown()
+{
+    // Joined first: no compilation may still write the entries.
+    compileThreads.Teardown();
+
+    for (const Entry &entry : entries)
+    {
+        vkDestroyPipeline(device, entry.pipeline, allocationCallbacks);
+    }
+
+    for (const auto &[hash, shader] : shadersByHash)
+    {
+        vkDestroyShaderModule(device, shader.module, allocationCallbacks);
+    }
+
+    printf("\npipeline registry: %llu requests, %u pipelines, %u failed, %.2f ms compiling",
+        static_cast<unsigned long long>(stats.requests),
+        stats.pipelines,
+        stats.failed,
+        stats.compileMs);
+
+    entries.clear();
+    handlesByHash.clear();
+    shadersByHash.clear();
+
+    // Destroyed by the PipelineCache, after their last merge.
+    freeWorkerCaches.clear();
+}
+
+VkShaderModule PipelineRegistry::AddShader(const std::vector<char> &spirv)
+{
+    Hasher hasher = {};
+    hasher.Add(spirv.data(), spirv.size());
+
+    std::lock_guard lock(mutex);
+
+    // Equal hashes are compared in full, as the descriptions in Request.
+    const auto [first, last] = shadersByHash.equal_range(hasher.hash);
+
+    for (auto it = first; it != last; ++it)
+    {
+        if (it->second.spirv == spirv)
+        {
+            return it->second.module;
+        }
+    }
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = spirv.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(spirv.data());
+
+    VkShaderModule module = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateShaderModule(device, &moduleInfo, allocationCallbacks, &module));
+
+    shadersByHash.emplace(hasher.hash, ShaderEntry{spirv, module});
+
+    return module;
+}
+
+PipelineRegistry::Handle PipelineRegistry::Request(const GraphicsPipelineDesc &desc)
+{
+    assert(desc.vertexBindingCount <= GraphicsPipelineDesc::MAX_VERTEX_BINDINGS);
+    assert(desc.vertexAttributeCount <= GraphicsPipelineDesc::MAX_VERTEX_ATTRIBUTES);
+    assert(desc.specializationCount <= GraphicsPipelineDesc::MAX_SPECIALIZATION_CONSTANTS);
+
+    const uint64_t hash = desc.Hash();
+
+    Handle handle = INVALID_HANDLE;
+
+    {
+        std::lock_guard lock(mutex);
+
+        stats.requests++;
+
+        // Equal hashes are compared in full: a collision gets a pipeline of its own.
+        const auto [first, last] = handlesByHash.equal_range(hash);
+
+        for (auto it = first; it != last; ++it)
+        {
+            if (entries[it->second].desc == desc)
+            {
+                return it->second;
+            }
+        }
+
+        handle = static_cast<Handle>(entries.size());
+
+        Entry &entry = entries.emplace_back();
+        entry.desc = desc;
+        entry.hash = hash;
+
+        handlesByHash.emplace(hash, handle);
+
+        stats.pipelines++;
+        stats.pending++;
+    }
+
+    compileThreads.Submit([this, handle]()
+    {
+        Compile(handle);
+    });
+
+    return handle;
+}
+
+VkPipeline PipelineRegistry::Get(Handle handle) const
+{
+    std::lock_guard lock(mutex);
+
+    return entries[handle].pipeline;
+}
+
+PipelineState PipelineRegistry::State(Handle handle) const
+{
+    std::lock_guard lock(mutex);
+
+    return entries[handle].state;
+}
+
+VkPipeline PipelineRegistry::Wait(Handle handle)
+{
+    PROFILE_FUNCTION();
+
+    std::unique_lock lock(mutex);
+
+    compiled.wait(lock, [this, handle]
+    {
+        return entries[handle].state != PipelineState::PENDING;
+    });
+
+    return entries[handle].pipeline;
+}
+
+PipelineRegistryStats PipelineRegistry::Stats() const
+{
+    std::lock_guard lock(mutex);
+
+    return stats;
+}
+
+std::vector<PipelineExecutableStats> PipelineRegistry::ExecutableStats(Handle handle) const
+{
+    std::lock_guard lock(mutex);
+
+    return entries[handle].executables;
+}
+
+void PipelineRegistry::Compile(Handle handle)
+{
+    PROFILE_FUNCTION();
+
+    GraphicsPipelineDesc desc = {};
+    uint64_t hash = {};
+
+    {
+        std::lock_guard lock(mutex);
+
+        desc = entries[handle].desc;
+        hash = entries[handle].hash;
+    }
+
+    const uint64_t compileStart = Profiler::NowNs();
+
+    // Constant i at offset 4 * i: both stages get the same values, a stage ignores the ids it doesn't declare.
+    VkSpecializationMapEntry specializationEntries[GraphicsPipelineDesc::MAX_SPECIALIZATION_CONSTANTS] = {};
+
+    for (uint32_t i = 0; i < desc.specializationCount; i++)
+    {
+        specializationEntries[i].constantID = i;
+        specializationEntries[i].offset = i * sizeof(uint32_t);
+        specializationEntries[i].size = sizeof(uint32_t);
+    }
+
+    VkSpecializationInfo specializationInfo = {};
+    specializationInfo.mapEntryCount = desc.specializationCount;
+    specializationInfo.pMapEntries = &specializationEntries[0];
+    specializationInfo.dataSize = desc.specializationCount * sizeof(uint32_t);
+    specializationInfo.pData = &desc.specialization[0];
+
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+
+    for (VkPipelineShaderStageCreateInfo &stage : shaderStages)
+    {
+        stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage.pName = "main";
+        stage.pSpecializationInfo = desc.specializationCount > 0 ? &specializationInfo : nullptr;
+    }
+
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = desc.vertexShader;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = desc.fragmentShader;
+
+    constexpr VkDynamicState DYNAMIC_STATES[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateInfo.dynamicStateCount = 2;
+    dynamicStateInfo.pDynamicStates = &DYNAMIC_STATES[0];
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = desc.vertexBindingCount;
+    vertexInputInfo.pVertexBindingDescriptions = &desc.vertexBindings[0];
+    vertexInputInfo.vertexAttributeDescriptionCount = desc.vertexAttributeCount;
+    vertexInputInfo.pVertexAttributeDescriptions = &desc.vertexAttributes[0];
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyInfo.topology = desc.topology;
+    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    // Dynamic: only the counts are read.
+    VkPipelineViewportStateCreateInfo viewportInfo = {};
+    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportInfo.viewportCount = 1;
+    viewportInfo.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
+    rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationInfo.depthClampEnable = VK_FALSE;
+    rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationInfo.polygonMode = desc.polygonMode;
+    rasterizationInfo.cullMode = desc.cullMode;
+    rasterizationInfo.frontFace = desc.frontFace;
+    rasterizationInfo.depthBiasEnable = VK_FALSE;
+    rasterizationInfo.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
+    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleInfo.rasterizationSamples = desc.sampleCount;
+    multisampleInfo.sampleShadingEnable = VK_TRUE;
+    multisampleInfo.minSampleShading = 1.0f;
+    multisampleInfo.alphaToCoverageEnable = VK_FALSE;
+    multisampleInfo.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+    depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilInfo.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+    depthStencilInfo.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencilInfo.depthCompareOp = desc.depthCompareOp;
+    depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+    depthStencilInfo.stencilTestEnable = VK_FALSE;
+    depthStencilInfo.minDepthBounds = 0.0f;
+    depthStencilInfo.maxDepthBounds = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+    colorBlendAttachment.blendEnable = desc.alphaBlend ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+    colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendInfo.logicOpEnable = VK_FALSE;
+    colorBlendInfo.logicOp = VK_LOGIC_OP_COPY;
+    colorBlendInfo.attachmentCount = 1;
+    colorBlendInfo.pAttachments = &colorBlendAttachment;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.flags = captureStatistics ? VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR : 0;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = &shaderStages[0];
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+    pipelineInfo.pViewportState = &viewportInfo;
+    pipelineInfo.pRasterizationState = &rasterizationInfo;
+    pipelineInfo.pMultisampleState = &multisampleInfo;
+    pipelineInfo.pDepthStencilState = &depthStencilInfo;
+    pipelineInfo.pColorBlendState = &colorBlendInfo;
+    pipelineInfo.pDynamicState = &dynamicStateInfo;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = desc.subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    // A cache per thread: the compilations running in parallel don't contend on one.
+    VkPipelineCache workerCache = VK_NULL_HANDLE;
+
+    {
+        std::lock_guard lock(mutex);
+
+        // As many caches as threads: one is always free.
+        assert(!freeWorkerCaches.empty());
+        workerCache = freeWorkerCaches.back();
+        freeWorkerCaches.pop_back();
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    const VkResult result = vkCreateGraphicsPipelines(device, workerCache, 1, &pipelineInfo,
+        allocationCallbacks, &pipeline);
+
+    const double compileMs = static_cast<double>(Profiler::NowNs() - compileStart) / 1'000'000.0;
+
+    if (result != VK_SUCCESS)
+    {
+        printf("\npipeline %016llx: creation failed (%d)", static_cast<unsigned long long>(hash), result);
+    }
+
+    std::vector<PipelineExecutableStats> executables = {};
+
+    if (result == VK_SUCCESS && captureStatistics)
+    {
+        executables = QueryExecutables(pipeline);
+    }
+
+    {
+        std::lock_guard lock(mutex);
+
+        freeWorkerCaches.push_back(workerCache);
+
+        Entry &entry = entries[handle];
+        entry.pipeline = result == VK_SUCCESS ? pipeline : VK_NULL_HANDLE;
+        entry.state = result == VK_SUCCESS ? PipelineState::READY : PipelineState::FAILED;
+        entry.executables = std::move(executables);
+
+        stats.pending--;
+        stats.failed += result == VK_SUCCESS ? 0 : 1;
+        stats.compileMs += compileMs;
+
+        compiled.notify_all();
+    }
+}
+
+std::vector<PipelineExecutableStats> PipelineRegistry::QueryExecutables(VkPipeline pipeline) const
+{
+    VkPipelineInfoKHR pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INFO_KHR;
+    pipelineInfo.pipeline = pipeline;
+
+    uint32_t executableCount = 0;
+    VK_CHECK(vkGetPipelineExecutablePropertiesKHR(device, &pipelineInfo, &executableCount, nullptr));
+
+    std::vector<VkPipelineExecutablePropertiesKHR> properties(executableCount);
+
+    for (VkPipelineExecutablePropertiesKHR &property : properties)
+    {
+        property.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_PROPERTIES_KHR;
+    }
+
+    VK_CHECK(vkGetPipelineExecutablePropertiesKHR(device, &pipelineInfo, &executableCount, properties.data()));
+
+    std::vector<PipelineExecutableStats> executables(executableCount);
+
+    for (uint32_t i = 0; i < executableCount; i++)
+    {
+        executables[i].name = properties[i].name;
+        executables[i].stages = properties[i].stages;
+
+        VkPipelineExecutableInfoKHR executableInfo = {};
+        executableInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_INFO_KHR;
+        executableInfo.pipeline = pipeline;
+        executableInfo.executableIndex = i;
+
+        uint32_t statisticCount = 0;
+        VK_CHECK(vkGetPipelineExecutableStatisticsKHR(device, &executableInfo, &statisticCount, nullptr));
+
+        std::vector<VkPipelineExecutableStatisticKHR> statistics(statisticCount);
+
+        for (VkPipelineExecutableStatisticKHR &statistic : statistics)
+        {
+            statistic.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_STATISTIC_KHR;
+        }
+
+        VK_CHECK(vkGetPipelineExecutableStatisticsKHR(device, &executableInfo, &statisticCount,
+            statistics.data()));
+
+        // Names are up to the driver: "Instruction Count", "Instructions", "Instructions Emitted"...
+        for (const VkPipelineExecutableStatisticKHR &statistic : statistics)
+        {
+            if (statistic.format == VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_UINT64_KHR &&
+                strncmp(statistic.name, "Instruction", 11) == 0)
+            {
+                executables[i].instructionCount = statistic.value.u64;
+                break;
+            }
+        }
+    }
+
+    return executables;
+}
+}
@@ -0,0 +1,215 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Renderer
+{
+namespace
+{
+struct ThreadEvents
+{
+    uint32_t threadId = {};
+    std::atomic<const char *> threadName = {};
+
+    std::unique_ptr<ProfileEvent[]> events = {};
+
+    /// Events ever written: the ring index is head % EVENTS_PER_THREAD.
+    std::atomic<uint64_t> head = {};
+};
+
+/// Rings outlive their threads (e.g. a torn down thread pool): they are exported at exit.
+std::mutex registryMutex = {};
+std::vector<std::unique_ptr<ThreadEvents>> registry = {};
+
+std::atomic<uint64_t> frameNumber = {};
+
+const std::chrono::steady_clock::time_point processEpoch = std::chrono::steady_clock::now();
+
+thread_local ThreadEvents *threadEvents = nullptr;
+
+ThreadEvents &LocalEvents()
+{
+    if (threadEvents == nullptr)
+    {
+        std::lock_guard lock(registryMutex);
+
+        auto events = std::make_unique<ThreadEvents>();
+        events->threadId = static_cast<uint32_t>(registry.size());
+        events->events = std::make_unique<ProfileEvent[]>(Profiler::EVENTS_PER_THREAD);
+
+        threadEvents = events.get();
+        registry.push_back(std::move(events));
+    }
+
+    return *threadEvents;
+}
+
+void Push(const ProfileEvent &event)
+{
+    ThreadEvents &local = LocalEvents();
+
+    // Single writer: a relaxed read of its own head.
+    const uint64_t head = local.head.load(std::memory_order_relaxed);
+
+    // An exporter that sees part of this event also sees head, and drops the slot.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    local.events[head % Profiler::EVENTS_PER_THREAD] = event;
+    local.head.store(head + 1, std::memory_order_release);
+}
+
+/// Names are code identifiers and literals: only quotes and backslashes need escaping.
+void WriteJsonString(FILE *file, const char *text)
+{
+    fputc('"', file);
+
+    for (const char *c = text; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', file);
+        }
+
+        fputc(*c, file);
+    }
+
+    fputc('"', file);
+}
+}
+
+void Profiler::SetThreadName(const char *name)
+{
+    LocalEvents().threadName.store(name, std::memory_order_relaxed);
+}
+
+void Profiler::FrameMark()
+{
+    ProfileEvent event = {};
+    event.name = "frame";
+    event.type = ProfileEventType::FRAME;
+    event.beginNs = NowNs();
+    event.value = static_cast<double>(frameNumber.fetch_add(1, std::memory_order_relaxed));
+
+    Push(event);
+}
+
+void Profiler::Counter(const char *name, double value)
+{
+    ProfileEvent event = {};
+    event.name = name;
+    event.type = ProfileEventType::COUNTER;
+    event.beginNs = NowNs();
+    event.value = value;
+
+    Push(event);
+}
+
+void Profiler::Zone(const char *name, uint64_t begin_ns, uint64_t end_ns)
+{
+    ProfileEvent event = {};
+    event.name = name;
+    event.type = ProfileEventType::ZONE;
+    event.beginNs = begin_ns;
+    event.durationNs = end_ns - begin_ns;
+
+    Push(event);
+}
+
+uint64_t Profiler::NowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - processEpoch).count());
+}
+
+bool Profiler::ExportChromeTrace(const char *p_path)
+{
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard lock(registryMutex);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool isFirst = true;
+
+    std::vector<ProfileEvent> snapshot = {};
+
+    // Chrome trace timestamps are in microseconds.
+    for (const std::unique_ptr<ThreadEvents> &thread : registry)
+    {
+        const char *threadName = thread->threadName.load(std::memory_order_relaxed);
+
+        if (threadName != nullptr)
+        {
+            fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                isFirst ? "" : ",\n", thread->threadId);
+            WriteJsonString(file, threadName);
+            fprintf(file, "}}");
+            isFirst = false;
+        }
+
+        const uint64_t head = thread->head.load(std::memory_order_acquire);
+        const uint64_t first = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+
+        snapshot.clear();
+
+        for (uint64_t i = first; i < head; i++)
+        {
+            snapshot.push_back(thread->events[i % EVENTS_PER_THREAD]);
+        }
+
+        // The thread kept recording: the slots of the events written since, and of the one
+        // being written, may be torn. Dropped before reading their names.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t latestHead = thread->head.load(std::memory_order_relaxed);
+        const uint64_t firstIntact = latestHead >= EVENTS_PER_THREAD ? latestHead - EVENTS_PER_THREAD + 1 : 0;
+
+        for (uint64_t i = std::max(first, firstIntact); i < head; i++)
+        {
+            const ProfileEvent &event = snapshot[i - first];
+
+            fprintf(file, "%s{\"name\":", isFirst ? "" : ",\n");
+            WriteJsonString(file, event.name);
+            isFirst = false;
+
+            const double ts = static_cast<double>(event.beginNs) / 1000.0;
+
+            switch (event.type)
+            {
+                case ProfileEventType::ZONE:
+                    fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                        thread->threadId, ts, static_cast<double>(event.durationNs) / 1000.0);
+                    break;
+
+                case ProfileEventType::FRAME:
+                    fprintf(file, ",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                                  "\"args\":{\"frame\":%.0f}}",
+                        thread->threadId, ts, event.value);
+                    break;
+
+                case ProfileEventType::COUNTER:
+                    fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+                        thread->threadId, ts, event.value);
+                    break;
+            }
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    const bool written = ferror(file) == 0;
+    fclose(file);
+
+    return written;
+}
+}
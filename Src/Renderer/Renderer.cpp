@@ -4,7 +4,11 @@
 
 #include "Renderer.h"
 #include "../FileSystem.h"
+#include "BenchmarkReport.h"
+#include "CameraPath.h"
 #include "MeshLoader.h"
+#include "Profiler.h"
+#include "SceneGenerator.h"
 #include "VkCommon.h"
 
 // Must define this macro and include the header file in one and only one implementation file.
@@ -14,21 +18,30 @@
 
 #include <SDL2/SDL_vulkan.h>
 
-namespace Utils
-{
-
-float ToClosestPowerOfTwo(const float x)
-{
-    return pow(2.0f, ceil(log2(x)));
-}
-
-}
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
 
 namespace Renderer
 {
 // @todo just for testing purpose.
-static uint32_t INDICES_COUNT = {};
-
+static uint64_t INDICES_COUNT = {};
+
+#ifdef RENDERER_HOST_VISIBLE_GEOMETRY
+// Legacy path: every vertex fetch reads host memory (over PCIe on discrete gpus).
+static constexpr VkMemoryPropertyFlags GEOMETRY_MEMORY_FLAGS =
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+static constexpr const char *GEOMETRY_PATH_NAME = "host visible";
+#else
+static constexpr VkMemoryPropertyFlags GEOMETRY_MEMORY_FLAGS = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+static constexpr const char *GEOMETRY_PATH_NAME = "device local";
+#endif
+
+/// Written by the M key, relative to the working directory.
+static constexpr const char *MEMORY_REPORT_PATH = "memory_report.json";
+static constexpr const char *TRACE_PATH = "profile_trace.json";
 
 VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -78,36 +91,95 @@ constexpr VkDebugUtilsMessengerCreateInfoEXT DEBUG_UTILS_MESSENGER_CREATE_INFO =
     .pUserData = nullptr,
 };
 
-void Renderer::Init()
+void Renderer::Init(const RendererConfig &renderer_config)
 {
-    // Init the window class
-    VK_CHECK((SDL_Init(SDL_INIT_VIDEO) == 0)
+    PROFILE_FUNCTION();
+
+    initStart = SDL_GetPerformanceCounter();
+
+    config = renderer_config;
+
+    // Before the instance: objects must be destroyed with the callbacks they were created with.
+    if (config.useHostAllocator)
+    {
+        hostAllocator.Init();
+        allocationCallbacks = hostAllocator.Callbacks();
+    }
+
+    // Headless: SDL only for the events and the timers, no video driver is needed.
+    VK_CHECK((SDL_Init(config.headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) == 0)
         ? VK_SUCCESS
         : VK_ERROR_UNKNOWN);
 
-    window = SDL_CreateWindow(
-        "Adro Engine",
-        SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED,
-        640,
-        480,
-        SDL_WINDOW_VULKAN);
+    // Workers of the startup graph first, then of the parallel recording.
+    threadPool.Init(0);
 
-    VK_CHECK(volkInitialize());
+    // Startup as a graph: the scene import and the SPIR-V reads need no device, they run on
+    // the workers while the main thread goes through window, instance, device and swapchain.
+    // Window system calls stay on the main thread.
+    TaskGraph startup = {};
 
-    InitInstance();
-    InitSurface();
-    InitDevice();
-    InitSwapchain();
-    InitOtherImages();
-    InitUniformBuffer();
-    InitCommand();
-    InitBatch();
-    InitRenderpass();
-    InitFramebuffers();
-    InitPipeline();
+    const auto windowTask = startup.Add("window", TaskThread::MAIN, {}, [this]()
+    {
+        if (!config.headless)
+        {
+            window = SDL_CreateWindow(
+                "Adro Engine",
+                SDL_WINDOWPOS_UNDEFINED,
+                SDL_WINDOWPOS_UNDEFINED,
+                static_cast<int>(config.width),
+                static_cast<int>(config.height),
+                SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+        }
+    });
+
+    const auto instanceTask = startup.Add("instance", TaskThread::MAIN, {windowTask}, [this]() { InitInstance(); });
+
+    const auto surfaceTask = startup.Add("surface", TaskThread::MAIN, {instanceTask}, [this]() { InitSurface(); });
+    const auto deviceTask = startup.Add("device", TaskThread::MAIN, {surfaceTask}, [this]() { InitDevice(); });
+    const auto swapchainTask = startup.Add("swapchain", TaskThread::MAIN, {deviceTask}, [this]() { InitSwapchain(); });
+    const auto attachmentsTask = startup.Add("attachments", TaskThread::ANY, {swapchainTask}, [this]() { InitOtherImages(); });
+    const auto commandsTask = startup.Add("commands", TaskThread::ANY, {deviceTask}, [this]() { InitCommand(); });
+
+    const auto sceneImportTask = startup.Add("scene import", TaskThread::ANY, {}, [this]() { ImportScene(); });
+    const auto sceneUploadTask = startup.Add("scene upload", TaskThread::ANY, {sceneImportTask, commandsTask}, [this]() { InitBatch(); });
+
+    // Sized by the draw list.
+    const auto uniformsTask = startup.Add("uniform ring", TaskThread::ANY, {sceneUploadTask}, [this]() { InitUniformBuffer(); });
+
+    const auto renderPassTask = startup.Add("render pass", TaskThread::ANY, {attachmentsTask}, [this]() { InitRenderpass(); });
+    startup.Add("framebuffers", TaskThread::ANY, {renderPassTask}, [this]() { InitFramebuffers(); });
+
+    const auto shadersTask = startup.Add("shader read", TaskThread::ANY, {}, [this]() { ReadShaders(); });
+
+    const auto pipelineCacheTask = startup.Add("pipeline cache", TaskThread::ANY, {deviceTask}, [this]()
+    {
+        pipelineCache.Init(device, gpu, config.pipelineCacheDirectory, allocationCallbacks);
+    });
+
+    // Sized by the swapchain extent. The mesh pipeline depends on whether it loaded.
+    const auto virtualTextureTask = startup.Add("virtual texture", TaskThread::ANY, {swapchainTask}, [this]() { InitVirtualTexture(); });
+
+    const auto pipelinesTask = startup.Add("pipelines", TaskThread::ANY, {renderPassTask, shadersTask, pipelineCacheTask, virtualTextureTask}, [this]() { InitPipeline(); });
+    startup.Add("descriptors", TaskThread::ANY, {pipelinesTask, uniformsTask}, [this]() { InitDescriptorSets(); });
+
+    // The culling is sized by the draw list too.
+    startup.Add("compute", TaskThread::ANY, {sceneUploadTask, pipelineCacheTask}, [this]() { InitCompute(); });
+
+    // Submits on the graphics queue with the first frame command buffer, as the upload does:
+    // after it, queues need external synchronization.
+    startup.Add("depth stencil", TaskThread::ANY, {attachmentsTask, sceneUploadTask}, [this]() { PrepareDepthStencil(); });
 
-    PrepareDepthStencil();
+    startup.Run(&threadPool);
+
+    frameLimiter.Init(config.maxFps);
+
+    startupMs = static_cast<double>(SDL_GetPerformanceCounter() - initStart) * 1000.0 /
+                static_cast<double>(SDL_GetPerformanceFrequency());
+
+    startup.PrintTimings("startup graph");
+
+    printf("\nstartup: %.2f ms, scene load %.2f ms", startupMs, sceneLoadMs);
 }
 
 void Renderer::Update(double delta_time)
@@ -117,27 +189,34 @@ void Renderer::Update(double delta_time)
     Uint64 last = 0;
     double deltaTime = 0;
 
-    // Target frame rate (optional)
-    constexpr int MAX_FPS = 60;
-    constexpr double TARGET_FRAME_TIME = 1000.0 / MAX_FPS; // in milliseconds// Camera data
+    // Pipelines compiled since the last save survive a crash.
+    double pipelineCacheElapsed = 0.0;
 
-    uint32_t fifIndex = 0u;
+    chosenPipeline = meshPipeline;
 
-    glm::vec3 cameraPos = {0.0f, .0f, -100.0f};
-    glm::vec3 cameraPosNew = {0.0f, .0f, -100.0f};
-    glm::vec3 cameraFront = {0.0f, 0.0f, 1.0f};
-    glm::vec3 cameraUp = {0.0f, 1.0f, 0.0f};
+    isSlotMeasured.assign(config.framesInFlight, false);
+    slotVariant.assign(config.framesInFlight, UINT32_MAX);
 
-    constexpr float P = 1.0f / 100.0f;
-    constexpr float T = 0.396f;
-    const float halfTime = -T / glm::log2(P);
+    if (config.variantReport)
+    {
+        InitVariantReport();
+    }
+
+    if (config.benchmark)
+    {
+        InitBenchmark();
+    }
 
-    VkPipeline chosenPipeline = pipeline;
+    // Warm-up frames are rendered but not measured.
+    const uint32_t lastFrame = config.variantReport
+                                   ? static_cast<uint32_t>(variantPipelines.size()) * RendererConfig::VARIANT_REPORT_FRAMES
+                                   : config.frameCount + (config.benchmark ? BenchmarkReport::WARMUP_FRAMES : 0);
 
     bool stillRunning = true;
     while (stillRunning)
     {
-        constexpr float CAMERA_MOVE_SPEED = 200.639f;
+        PROFILE_ZONE("frame");
+
         last = now;
         now = SDL_GetPerformanceCounter();
 
@@ -145,424 +224,1187 @@ void Renderer::Update(double delta_time)
         deltaTime = static_cast<double>(now - last) / static_cast<double>(
                         SDL_GetPerformanceFrequency());
 
-        const float cameraLerpAlpha = 1.0f - glm::pow(
-                                          2.0f, -static_cast<float>(deltaTime) / halfTime);
-
-        SDL_Event event = {};
+        statsFrameCount++;
+        statsElapsed += deltaTime;
 
-        // Input state
-        while (SDL_PollEvent(&event))
+        if (statsElapsed >= 1.0)
         {
-            switch (event.type)
-            {
-                case SDL_QUIT: stillRunning = false;
-                    break;
-
-                default:
-                    // Do nothing.
-                    break;
-            }
+            PrintFrameStats();
         }
 
-        const Uint8 *keyStates = SDL_GetKeyboardState(nullptr);
+        stillRunning = PollEvents();
+
+        const Uint64 inputTime = SDL_GetPerformanceCounter();
+
+        UpdateCamera(deltaTime);
+
+        const uint32_t frameVariant = SelectPipeline();
+        const bool isFrameMeasured = config.benchmark && renderedFrameCount >= BenchmarkReport::WARMUP_FRAMES;
 
-        if (keyStates[SDL_SCANCODE_W])
+        pipelineCacheElapsed += deltaTime;
+
+        // Only the copy of the data is on this thread, still not in the measured frames.
+        if (pipelineCacheElapsed >= PipelineCache::SAVE_INTERVAL_SECONDS && !isFrameMeasured)
         {
-            cameraPosNew += CAMERA_MOVE_SPEED * static_cast<float>(deltaTime) * cameraFront;
+            PROFILE_ZONE("pipeline cache save");
+
+            // Writes only when the cache grew.
+            pipelineCache.SaveAsync();
+            pipelineCacheElapsed = 0.0;
         }
 
-        if (keyStates[SDL_SCANCODE_S])
+        UpdateCameraPath(deltaTime, isFrameMeasured);
+
+        // Nothing to present to: sleep until the next event instead of spinning.
+        if ((window != nullptr && (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED) != 0) ||
+            (isSwapchainDirty && !RecreateSwapchain()))
         {
-            cameraPosNew -= CAMERA_MOVE_SPEED * static_cast<float>(deltaTime) * cameraFront;
+            SDL_WaitEvent(nullptr);
+            continue;
         }
 
-        if (keyStates[SDL_SCANCODE_A])
+        uint32_t next_image = 0;
+
+        if (!AcquireFrame(&next_image))
         {
-            cameraPosNew -= glm::normalize(glm::cross(cameraFront, cameraUp)) *
-                CAMERA_MOVE_SPEED * static_cast<float>(deltaTime);
+            continue;
         }
 
-        if (keyStates[SDL_SCANCODE_D])
+        bool hasTransfer = false;
+        bool hasCompute = false;
+
+        RecordFrame(next_image, &hasTransfer, &hasCompute);
+
+        framesInFlight[fifIndex].inputTime = inputTime;
+        isSlotMeasured[fifIndex] = isFrameMeasured;
+        slotVariant[fifIndex] = frameVariant;
+
+        SubmitFrame(next_image, hasTransfer, hasCompute);
+
+        // Headless: the frame is done once submitted, the readback waits the frame timeline.
+        if (!config.headless)
         {
-            cameraPosNew += glm::normalize(glm::cross(cameraFront, cameraUp)) *
-                CAMERA_MOVE_SPEED * static_cast<float>(deltaTime);
+            PresentFrame(next_image);
         }
 
-        if (keyStates[SDL_SCANCODE_Q])
+        presentedInputTime = inputTime;
+
+        // Startup as the user sees it: the graph, then the first frame recorded and presented.
+        if (lastFifIndex == UINT32_MAX)
         {
-            chosenPipeline = pipelineWireframe;
+            firstFrameMs = static_cast<double>(SDL_GetPerformanceCounter() - initStart) * 1000.0 /
+                           static_cast<double>(SDL_GetPerformanceFrequency());
+
+            printf("\nfirst frame: %.2f ms after start", firstFrameMs);
+
+            if (config.benchmark)
+            {
+                benchmarkReport.SetFirstFrame(firstFrameMs);
+            }
         }
-        else if (keyStates[SDL_SCANCODE_E])
+
         {
-            chosenPipeline = pipeline;
-        }
+            PROFILE_ZONE("limiter");
 
-        cameraPos = glm::mix(cameraPos, cameraPosNew, cameraLerpAlpha);
+            frameLimiter.Wait();
+        }
 
-        vkWaitForFences(device, 1, &framesInFlight.submitFence[fifIndex],
-            VK_TRUE, UINT64_MAX);
+        PROFILE_COUNTER("draws", drawList.size());
+        PROFILE_COUNTER("frame ms", deltaTime * 1000.0);
+        PROFILE_FRAME();
 
-        uint32_t next_image = 0u;
-        VK_CHECK(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX,
-            framesInFlight.acquiredImageSemaphore[fifIndex],
-            VK_NULL_HANDLE, &next_image));
+        if (isFrameMeasured)
+        {
+            // Iteration start to iteration start: uncapped, nothing else runs in between.
+            benchmarkReport.AddCpuFrame(static_cast<double>(SDL_GetPerformanceCounter() - now) * 1000.0 /
+                                        static_cast<double>(SDL_GetPerformanceFrequency()));
+        }
 
-        vkResetFences(device, 1, &framesInFlight.submitFence[fifIndex]);
-        vkResetCommandPool(device, framesInFlight.commandPool[fifIndex], 0);
+        lastFifIndex = fifIndex;
+        fifIndex = (fifIndex + 1) % config.framesInFlight;
 
-        PerFrameDataCpu uBuffer = {
-            glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp),
-            glm::perspectiveRH_ZO(glm::radians(45.0f),
-                static_cast<float>(surfaceCapabilities.currentExtent.width) /
-                static_cast<float>(surfaceCapabilities.currentExtent.height),
-                0.1f, 10000.0f),
-        };
+        if (lastFrame != 0 && ++renderedFrameCount == lastFrame)
+        {
+            stillRunning = false;
+        }
+    }
 
-        // Flip vulkan Y-axis
-        uBuffer.projection[1][1] *= -1;
+    if (config.variantReport)
+    {
+        FinishVariantReport();
+    }
 
-        VK_CHECK(vkMapMemory(device, uniformBufferFrames.memory[fifIndex], 0,
-            sizeof(uBuffer), 0, &uniformBufferFrames.data_mapped[fifIndex]));
+    if (config.benchmark)
+    {
+        FinishBenchmark();
+    }
 
-        constexpr size_t uBufferSize = sizeof(PerFrameDataCpu);
+    if (config.recordCameraPath != nullptr && !cameraPath.IsEmpty())
+    {
+        const bool saved = cameraPath.Save(config.recordCameraPath);
+        printf("\n%s %s", saved ? "camera path written to" : "can't write", config.recordCameraPath);
+    }
 
-        memcpy(uniformBufferFrames.data_mapped[fifIndex], &uBuffer, uBufferSize);
+    if (config.readbackPath != nullptr && lastFifIndex != UINT32_MAX)
+    {
+        frameTimeline.Wait(framesInFlight[lastFifIndex].submitValue);
 
-        vkUnmapMemory(device, uniformBufferFrames.memory[fifIndex]);
+        const bool written = WriteReadback(lastFifIndex, config.readbackPath);
+        printf("\n%s %s", written ? "last frame written to" : "can't write", config.readbackPath);
+    }
+}
 
-        VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        commandBufferBeginInfo.flags = 0;
-        commandBufferBeginInfo.pInheritanceInfo = nullptr;
+void Renderer::PrintFrameStats()
+{
+    const double trianglesPerSecond = static_cast<double>(INDICES_COUNT / 3) *
+                                      statsFrameCount / statsElapsed;
+
+    const DefragmentationStats defragmentationStats = defragmenter.Stats();
+
+    printf("\n%s geometry: %.2f ms/frame, %.1f M triangles/s, "
+           "memory fragmentation %.2f, %.1f MiB moved, %u moves in progress",
+        GEOMETRY_PATH_NAME,
+        statsElapsed * 1000.0 / statsFrameCount,
+        trianglesPerSecond / 1e6,
+        defragmentationStats.fragmentation,
+        static_cast<double>(defragmentationStats.bytesMoved) / (1024.0 * 1024.0),
+        defragmentationStats.activeMoves);
+
+    const RecordStats recordStats = recorder.LastStats();
+
+    // cpu / wall: how many slices actually recorded at the same time.
+    printf("\nrecording: %.3f ms for %u draws, %u slices, %.1fx parallel",
+        recordStats.wallMs,
+        recordStats.itemCount,
+        recordStats.sliceCount,
+        recordStats.wallMs > 0.0 ? recordStats.cpuMs / recordStats.wallMs : 0.0);
+
+    const QueueTimings queueTimings = computeScheduler.LastTimings();
+
+    // overlap > 0: the culling of a frame ran while the previous one was rendering.
+    printf("\nqueues: graphics %.3f ms, compute %.3f ms, overlap %.3f ms (%s)",
+        queueTimings.graphicsMs,
+        queueTimings.computeMs,
+        queueTimings.overlapMs,
+        computeScheduler.IsAsync() ? "async" : "graphics queue only");
+
+    const FrameTimePercentiles frameTimes = frameLimiter.Percentiles();
+
+    printf("\nframe time: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms (%s, %u fps cap)",
+        frameTimes.p50,
+        frameTimes.p95,
+        frameTimes.p99,
+        frameTimes.max,
+        config.headless ? "headless" : vk_present_mode_name(presentMode),
+        config.maxFps);
+
+    if (config.useHostAllocator)
+    {
+        // Command scope allocations every frame: the driver allocates on the hot path.
+        const HostFrameStats hostFrame = hostAllocator.LastFrameStats();
+        uint32_t hostAllocations = 0;
 
-        VK_CHECK(vkBeginCommandBuffer(framesInFlight.commandBuffer[fifIndex],
-            &commandBufferBeginInfo));
+        for (uint32_t scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; scope++)
+        {
+            hostAllocations += hostFrame.allocations[scope] + hostFrame.reallocations[scope];
+        }
 
-        vkCmdBindDescriptorSets(framesInFlight.commandBuffer[fifIndex],
-            VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-            &uniformBufferFrames.descriptorSets[fifIndex], 0, nullptr);
+        printf("\nhost allocations: %u/frame (%u command scope), %.1f KiB/frame",
+            hostAllocations,
+            hostFrame.allocations[VK_SYSTEM_ALLOCATION_SCOPE_COMMAND] +
+            hostFrame.reallocations[VK_SYSTEM_ALLOCATION_SCOPE_COMMAND],
+            static_cast<double>(hostFrame.allocatedBytes) / 1024.0);
+    }
 
-        constexpr VkClearValue CLEAR_VALUES[2] = {
-            {
-                .color = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}}
-            },
-            {
-                .depthStencil = {1.0f, 0},
-            }
-        };
+    for (const GpuPassStats &pass : gpuProfiler.LastStats())
+    {
+        printf("\ngpu %-8s %.3f ms, %llu primitives (%llu after clipping), %llu vertices, "
+               "%llu fragments, %llu compute invocations",
+            pass.name,
+            pass.gpuMs,
+            static_cast<unsigned long long>(pass.inputAssemblyPrimitives),
+            static_cast<unsigned long long>(pass.clippingPrimitives),
+            static_cast<unsigned long long>(pass.vertexInvocations),
+            static_cast<unsigned long long>(pass.fragmentInvocations),
+            static_cast<unsigned long long>(pass.computeInvocations));
+    }
 
-        VkRenderPassBeginInfo renderPassBeginInfo = {};
-        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassBeginInfo.renderPass = renderPass;
-        renderPassBeginInfo.framebuffer = presentationFrames.framebuffer[next_image];
-        renderPassBeginInfo.renderArea.offset = {0, 0};
-        renderPassBeginInfo.renderArea.extent = surfaceCapabilities.currentExtent;
-        renderPassBeginInfo.clearValueCount = 2;
-        renderPassBeginInfo.pClearValues = &CLEAR_VALUES[0];
-
-        vkCmdBeginRenderPass(framesInFlight.commandBuffer[fifIndex],
-            &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(framesInFlight.commandBuffer[fifIndex],
-            VK_PIPELINE_BIND_POINT_GRAPHICS, chosenPipeline);
-
-        VkViewport viewport = {};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(surfaceCapabilities.currentExtent.width);
-        viewport.height = static_cast<float>(surfaceCapabilities.currentExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        vkCmdSetViewport(framesInFlight.commandBuffer[fifIndex], 0, 1, &viewport);
-
-        VkRect2D scissor = {};
-        scissor.offset = {0, 0};
-        scissor.extent = surfaceCapabilities.currentExtent;
-
-        vkCmdSetScissor(framesInFlight.commandBuffer[fifIndex], 0, 1, &scissor);
-
-        const VkBuffer bindsBuffer[] = {
-            batch.positionBuffer,
-            batch.colorBuffer,
-            batch.normalBuffer,
-        };
+    printf("\npipelining: %u frames in flight, %.1f fps, input latency %.2f ms avg, %.2f ms max (%s)",
+        config.framesInFlight,
+        statsFrameCount / statsElapsed,
+        statsLatencyCount > 0 ? statsLatencyMs / statsLatencyCount : 0.0,
+        statsLatencyMaxMs,
+        hasPresentWait ? "to display" : "to GPU completion");
 
-        constexpr VkDeviceSize OFFSETS[] = {
-            0,
-            0,
-            0
-        };
+    // The draws without their constants are skipped: they would read another draw's.
+    if (uniformRing.FrameRejectedPushes() > 0)
+    {
+        printf("\nuniform ring full: %u of %zu draws skipped last frame (%llu bytes used)",
+            uniformRing.FrameRejectedPushes(),
+            drawList.size(),
+            static_cast<unsigned long long>(uniformRing.FrameUsedBytes()));
+    }
 
-        vkCmdBindVertexBuffers(framesInFlight.commandBuffer[fifIndex], 0, 3, &bindsBuffer[0],
-            &OFFSETS[0]);
+    if (hasVirtualTexture)
+    {
+        const VirtualTextureStats &virtualTextureStats = virtualTexture.Stats();
+
+        printf("\nvirtual texture: %u tiles resident, %u loading, last frame %u requested, "
+               "%u uploaded, %u evicted",
+            virtualTextureStats.residentTiles,
+            virtualTextureStats.pendingLoads,
+            virtualTextureStats.requestedTiles,
+            virtualTextureStats.uploadedTiles,
+            virtualTextureStats.evictedTiles);
+    }
 
-        vkCmdBindIndexBuffer(framesInFlight.commandBuffer[fifIndex],
-            batch.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    statsFrameCount = 0;
+    statsElapsed = 0.0;
+    statsLatencyMs = 0.0;
+    statsLatencyMaxMs = 0.0;
+    statsLatencyCount = 0;
+}
 
-        vkCmdDrawIndexed(framesInFlight.commandBuffer[fifIndex], INDICES_COUNT,
-            1, 0, 0, 0);
+void Renderer::RecordLatency(Uint64 input_time)
+{
+    const double latencyMs = static_cast<double>(SDL_GetPerformanceCounter() - input_time) * 1000.0 /
+                             static_cast<double>(SDL_GetPerformanceFrequency());
 
-        vkCmdEndRenderPass(framesInFlight.commandBuffer[fifIndex]);
+    statsLatencyMs += latencyMs;
+    statsLatencyMaxMs = std::max(statsLatencyMaxMs, latencyMs);
+    statsLatencyCount++;
+}
 
-        VK_CHECK(vkEndCommandBuffer(framesInFlight.commandBuffer[fifIndex]));
+void Renderer::InitVariantReport()
+{
+    for (const ShaderVariant &variant : ShaderVariant::All())
+    {
+        GraphicsPipelineDesc desc = meshPipelineDesc;
+        variant.Specialize(&desc);
 
-        VkSemaphore waitSemaphores[] = {
-            framesInFlight.acquiredImageSemaphore[fifIndex]
-        };
+        variantStats.push_back({variant});
+        variantPipelines.push_back(pipelineRegistry.Request(desc));
+    }
 
-        VkPipelineStageFlags waitStages[] = {
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-        };
+    // Compiled in parallel by the registry: no measured frame waits on a compilation.
+    for (size_t i = 0; i < variantPipelines.size(); i++)
+    {
+        pipelineRegistry.Wait(variantPipelines[i]);
+        variantStats[i].executables = pipelineRegistry.ExecutableStats(variantPipelines[i]);
+    }
+}
 
-        VkSemaphore signal_semaphores[] = {
-            presentationFrames.renderFinishedSemaphore[next_image]
-        };
+void Renderer::AddVariantGpuFrame(uint32_t slot)
+{
+    // The main pass is the only one the variants change.
+    for (const GpuPassStats &pass : gpuProfiler.LastStats())
+    {
+        if (strcmp(pass.name, "main") == 0)
+        {
+            variantStats[slotVariant[slot]].gpuMsSum += pass.gpuMs;
+            variantStats[slotVariant[slot]].gpuFrameCount++;
+        }
+    }
+}
 
-        VkSubmitInfo submitInfo = {};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &framesInFlight.commandBuffer[fifIndex];
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signal_semaphores;
+void Renderer::FinishVariantReport()
+{
+    // The last frames in flight haven't had their slot reused: collect them now.
+    for (uint32_t i = 0; i < config.framesInFlight; i++)
+    {
+        const uint32_t slot = (fifIndex + i) % config.framesInFlight;
 
-        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, framesInFlight.submitFence[fifIndex]));
+        frameTimeline.Wait(framesInFlight[slot].submitValue);
 
-        VkResult result = {};
-        VkPresentInfoKHR presentInfo = {};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &presentationFrames.renderFinishedSemaphore[next_image];
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = &swapchain;
-        presentInfo.pImageIndices = &next_image;
-        presentInfo.pResults = &result;
+        if (gpuProfiler.Collect(slot) && slotVariant[slot] != UINT32_MAX)
+        {
+            AddVariantGpuFrame(slot);
+        }
+    }
 
-        // @todo: cannot present the image if the window is minimized.
-        VK_CHECK(vkQueuePresentKHR(queue, &presentInfo));
+    ShaderVariant::PrintReport(variantStats);
+}
 
-        // --- Your game update & render logic here ---
-        // Example: updateGame(deltaTime); render();
+void Renderer::InitBenchmark()
+{
+    const bool isPathLoaded = config.cameraPathFile != nullptr && cameraPath.Load(config.cameraPathFile);
 
-        // Frame limiting: Sleep if frame is faster than target frame time
-        if (deltaTime < TARGET_FRAME_TIME)
+    if (!isPathLoaded)
+    {
+        if (config.cameraPathFile != nullptr)
         {
-            SDL_Delay(static_cast<Uint32>(TARGET_FRAME_TIME - deltaTime));
+            printf("\ncan't read camera path %s, using the orbit", config.cameraPathFile);
         }
 
-        fifIndex = (fifIndex + 1) % FramesInFlightType::MAX_FIF_COUNT;
+        // One turn over the measured frames, from the live start position.
+        constexpr uint32_t ORBIT_KEY_COUNT = 64;
+        cameraPath.InitOrbit({0.0f, 0.0f, 0.0f}, 100.0f, 0.0f,
+            config.frameCount * BenchmarkReport::TIMESTEP_SECONDS, ORBIT_KEY_COUNT);
     }
+
+    VkPhysicalDeviceProperties gpuProperties = {};
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+
+    BenchmarkSetup setup = {};
+    setup.scene = config.scenePath;
+    setup.cameraPath = isPathLoaded ? config.cameraPathFile : "orbit";
+    setup.gpuName = gpuProperties.deviceName;
+    setup.width = surfaceCapabilities.currentExtent.width;
+    setup.height = surfaceCapabilities.currentExtent.height;
+    setup.framesInFlight = config.framesInFlight;
+    setup.hasGpuTimestamps = gpuProfiler.HasTimestamps();
+
+    benchmarkReport.Init(setup, config.frameCount);
+    benchmarkReport.SetStartup(startupMs, sceneLoadMs);
+    benchmarkReport.SetPipelines(pipelineMs, pipelineCache.IsWarm());
 }
 
-void Renderer::Teardown() const
+void Renderer::FinishBenchmark()
 {
-    VK_CHECK(
-        vkDeviceWaitIdle(device));
+    // The last frames in flight haven't had their slot reused: collect them now.
+    for (uint32_t i = 0; i < config.framesInFlight; i++)
+    {
+        const uint32_t slot = (fifIndex + i) % config.framesInFlight;
 
-    vkDestroyDescriptorPool(
-        device,
-        descriptorPool,
-        nullptr);
-    vkDestroyDescriptorSetLayout(
-        device,
-        descriptorSetLayout,
-        nullptr);
-    vkDestroyRenderPass(
-        device,
-        renderPass,
-        nullptr);
-    vkDestroyPipelineLayout(
-        device,
-        pipelineLayout,
-        nullptr);
-    vkDestroyPipeline(
-        device,
-        pipeline,
-        nullptr);
-    vkDestroyPipeline(
-        device,
-        pipelineWireframe,
-        nullptr);
+        frameTimeline.Wait(framesInFlight[slot].submitValue);
 
-    vkDestroyBuffer(
-        device,
-        batch.colorBuffer,
-        nullptr);
-    vkFreeMemory(
-        device,
-        batch.colorMem,
-        nullptr);
+        if (gpuProfiler.Collect(slot) && isSlotMeasured[slot])
+        {
+            benchmarkReport.AddGpuFrame(gpuProfiler.LastFrameMs());
+        }
+    }
 
-    vkDestroyBuffer(
-        device,
-        batch.normalBuffer,
-        nullptr);
-    vkFreeMemory(
-        device,
-        batch.normalMem,
-        nullptr);
+    const FrameTimeSummary cpuTimes = benchmarkReport.CpuSummary();
+    const FrameTimeSummary gpuTimes = benchmarkReport.GpuSummary();
 
-    vkDestroyBuffer(
-        device,
-        batch.positionBuffer,
-        nullptr);
-    vkFreeMemory(
-        device,
-        batch.positionMem,
-        nullptr);
+    printf("\nbenchmark: %u frames, cpu mean %.3f ms p50 %.3f p95 %.3f p99 %.3f max %.3f, "
+           "gpu mean %.3f ms p50 %.3f p95 %.3f p99 %.3f max %.3f",
+        cpuTimes.count,
+        cpuTimes.mean, cpuTimes.p50, cpuTimes.p95, cpuTimes.p99, cpuTimes.max,
+        gpuTimes.mean, gpuTimes.p50, gpuTimes.p95, gpuTimes.p99, gpuTimes.max);
 
-    vkDestroyBuffer(
-        device,
-        batch.indexBuffer,
-        nullptr);
-    vkFreeMemory(
-        device,
-        batch.indexMem,
-        nullptr);
+    const bool written = benchmarkReport.WriteJson(config.benchmarkOutput);
+    printf("\n%s %s", written ? "benchmark report written to" : "can't write", config.benchmarkOutput);
+}
 
-    for (const VkDeviceMemory &memory : uniformBufferFrames.memory)
-    {
-        vkFreeMemory(
-            device,
-            memory,
-            nullptr);
-    }
+bool Renderer::PollEvents()
+{
+    PROFILE_ZONE("input");
+
+    bool stillRunning = true;
+    SDL_Event event = {};
 
-    for (const VkBuffer &buffer : uniformBufferFrames.buffers)
+    // Input state
+    while (SDL_PollEvent(&event))
     {
-        vkDestroyBuffer(
-            device,
-            buffer,
-            nullptr);
+        switch (event.type)
+        {
+            case SDL_QUIT: stillRunning = false;
+                break;
+
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                {
+                    isSwapchainDirty = true;
+                }
+                break;
+
+            case SDL_KEYDOWN:
+                if (event.key.keysym.scancode == SDL_SCANCODE_M && event.key.repeat == 0)
+                {
+                    const bool dumped = memoryAllocator.Budget().DumpJson(MEMORY_REPORT_PATH);
+                    printf("\n%s %s", dumped ? "memory report written to" : "can't write",
+                        MEMORY_REPORT_PATH);
+                }
+
+                if (event.key.keysym.scancode == SDL_SCANCODE_P && event.key.repeat == 0)
+                {
+                    const bool exported = Profiler::ExportChromeTrace(TRACE_PATH);
+                    printf("\n%s %s", exported ? "trace written to" : "can't write", TRACE_PATH);
+                }
+                break;
+
+            default:
+                // Do nothing.
+                break;
+        }
     }
 
-    // Multisaple image
-    vkDestroyImageView(
-        device,
-        framebufferSampleImageView,
-        nullptr);
-    vkDestroyImage(
-        device,
-        framebufferSampleImage,
-        nullptr);
-    vkFreeMemory(
-        device,
-        framebufferSampleImageMemory,
-        nullptr);
+    return stillRunning;
+}
 
-    // Depth stencil
-    vkDestroyImageView(
-        device,
-        depthStencilImageView,
-        nullptr);
-    vkDestroyImage(
-        device,
-        depthStencilImage,
-        nullptr);
-    vkFreeMemory(
-        device,
-        depthStencilMemory,
-        nullptr);
+void Renderer::UpdateCamera(double delta_time)
+{
+    constexpr float CAMERA_MOVE_SPEED = 200.639f;
 
-    for (uint32_t i = 0; i < surfaceCapabilities.minImageCount; i++)
-    {
-        vkDestroyFramebuffer(
-            device,
-            presentationFrames.framebuffer[i],
-            nullptr);
+    constexpr float P = 1.0f / 100.0f;
+    constexpr float T = 0.396f;
+    const float halfTime = -T / glm::log2(P);
 
-        vkDestroyImageView(
-            device,
-            presentationFrames.imageView[i],
-            nullptr);
+    const float cameraLerpAlpha = 1.0f - glm::pow(
+                                      2.0f, -static_cast<float>(delta_time) / halfTime);
 
-        vkDestroySemaphore(
-            device,
-            presentationFrames.renderFinishedSemaphore[i],
-            nullptr);
-    }
+    const Uint8 *keyStates = SDL_GetKeyboardState(nullptr);
 
-    for (const VkSemaphore &framesInFlightSemaphore : framesInFlight.acquiredImageSemaphore)
+    if (keyStates[SDL_SCANCODE_W])
     {
-        vkDestroySemaphore(device, framesInFlightSemaphore, nullptr);
+        cameraPosNew += CAMERA_MOVE_SPEED * static_cast<float>(delta_time) * cameraFront;
     }
 
-    for (const VkFence &framesInFlightFence : framesInFlight.submitFence)
+    if (keyStates[SDL_SCANCODE_S])
     {
-        vkDestroyFence(device, framesInFlightFence, nullptr);
+        cameraPosNew -= CAMERA_MOVE_SPEED * static_cast<float>(delta_time) * cameraFront;
     }
 
-    vkDestroySwapchainKHR(
-        device,
-        swapchain,
-        nullptr);
-
-    for (const VkCommandPool &framesInFlightCommandPool : framesInFlight.commandPool)
+    if (keyStates[SDL_SCANCODE_A])
     {
-        vkDestroyCommandPool(device, framesInFlightCommandPool, nullptr);
+        cameraPosNew -= glm::normalize(glm::cross(cameraFront, cameraUp)) *
+            CAMERA_MOVE_SPEED * static_cast<float>(delta_time);
     }
 
-    vkDestroyDevice(
-        device,
-        nullptr);
-    vkDestroySurfaceKHR(
-        instance,
-        surface,
-        nullptr);
-    vkDestroyDebugUtilsMessengerEXT(
-        instance,
-        debugMessenger,
-        nullptr);
-    vkDestroyInstance(
-        instance,
-        nullptr);
+    if (keyStates[SDL_SCANCODE_D])
+    {
+        cameraPosNew += glm::normalize(glm::cross(cameraFront, cameraUp)) *
+            CAMERA_MOVE_SPEED * static_cast<float>(delta_time);
+    }
 
-    SDL_DestroyWindow(
-        window);
-    SDL_Quit();
+    cameraPos = glm::mix(cameraPos, cameraPosNew, cameraLerpAlpha);
 }
 
-void Renderer::InitInstance()
+uint32_t Renderer::SelectPipeline()
 {
-    VK_CHECK(volkInitialize());
+    const Uint8 *keyStates = SDL_GetKeyboardState(nullptr);
 
-    // @todo:	calculate the layers count from the array.
-    const char *requestedLayers[] = {"VK_LAYER_KHRONOS_validation"};
+    if (keyStates[SDL_SCANCODE_Q])
+    {
+        if (wireframePipeline == PipelineRegistry::INVALID_HANDLE)
+        {
+            GraphicsPipelineDesc wireframeDesc = meshPipelineDesc;
+            wireframeDesc.polygonMode = VK_POLYGON_MODE_LINE;
 
-    // @todo:	calculate the extension count from the array.
-    const char *requestedExtensions[] = {VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
-                                         VK_KHR_SURFACE_EXTENSION_NAME,
-                                         VK_KHR_WIN32_SURFACE_EXTENSION_NAME};
+            wireframePipeline = pipelineRegistry.Request(wireframeDesc);
+        }
 
-    VkApplicationInfo applicationInfo = {};
-    applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    applicationInfo.pApplicationName = "Adro";
-    applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    applicationInfo.apiVersion = VK_MAKE_VERSION(1, 0, 0);
+        chosenPipeline = wireframePipeline;
+    }
+    else if (keyStates[SDL_SCANCODE_E])
+    {
+        chosenPipeline = meshPipeline;
+    }
 
-    VkInstanceCreateInfo instanceCreateInfo = {};
+    // The report picks the pipeline: each variant in turn, the first frames of each one not measured.
+    uint32_t frameVariant = UINT32_MAX;
+
+    if (config.variantReport)
+    {
+        const uint32_t variantIndex = renderedFrameCount / RendererConfig::VARIANT_REPORT_FRAMES;
+        chosenPipeline = variantPipelines[variantIndex];
+
+        if (renderedFrameCount % RendererConfig::VARIANT_REPORT_FRAMES >= RendererConfig::VARIANT_WARMUP_FRAMES)
+        {
+            frameVariant = variantIndex;
+        }
+    }
+
+    return frameVariant;
+}
+
+void Renderer::UpdateCameraPath(double delta_time, bool is_frame_measured)
+{
+    if (config.benchmark)
+    {
+        // Fixed timestep, no easing: frame N sees the same camera on every machine.
+        const uint32_t pathFrame = is_frame_measured ? renderedFrameCount - BenchmarkReport::WARMUP_FRAMES : 0;
+
+        cameraPath.Sample(pathFrame * BenchmarkReport::TIMESTEP_SECONDS, &cameraPos, &cameraFront);
+        cameraPosNew = cameraPos;
+    }
+    else if (config.recordCameraPath != nullptr)
+    {
+        cameraPath.AddKey(cameraRecordTime, cameraPos, cameraFront);
+        cameraRecordTime += delta_time;
+    }
+}
+
+bool Renderer::AcquireFrame(uint32_t *p_image_index)
+{
+    // The last submission of this slot: every per-frame resource of fifIndex is free after it.
+    {
+        PROFILE_ZONE("wait frame");
+
+        frameTimeline.Wait(framesInFlight[fifIndex].submitValue);
+        frameTimeline.Collect();
+    }
+
+    const bool isSlotCollected = gpuProfiler.Collect(fifIndex);
+
+    if (isSlotCollected && isSlotMeasured[fifIndex])
+    {
+        benchmarkReport.AddGpuFrame(gpuProfiler.LastFrameMs());
+    }
+
+    if (isSlotCollected && slotVariant[fifIndex] != UINT32_MAX)
+    {
+        AddVariantGpuFrame(fifIndex);
+    }
+
+    if (!hasPresentWait && framesInFlight[fifIndex].inputTime != 0)
+    {
+        RecordLatency(framesInFlight[fifIndex].inputTime);
+        framesInFlight[fifIndex].inputTime = 0;
+    }
+
+    // Before anything of the frame is submitted: an out of date swapchain skips it whole.
+    // Headless: the slot owns its image, free since the wait above.
+    *p_image_index = fifIndex;
+    VkResult acquireResult = VK_SUCCESS;
+
+    if (!config.headless)
+    {
+        PROFILE_ZONE("acquire");
+
+        acquireResult = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX,
+            framesInFlight[fifIndex].acquiredImageSemaphore,
+            VK_NULL_HANDLE, p_image_index);
+    }
+
+    if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        isSwapchainDirty = true;
+        return false;
+    }
+
+    // Suboptimal still signals the semaphore: render this frame, recreate before the next.
+    if (acquireResult == VK_SUBOPTIMAL_KHR)
+    {
+        isSwapchainDirty = true;
+    }
+    else
+    {
+        VK_CHECK(acquireResult);
+    }
+
+    return true;
+}
+
+void Renderer::RecordFrame(uint32_t image_index, bool *p_has_transfer, bool *p_has_compute)
+{
+    stagingRing.Reclaim(fifIndex);
+    geometryPool.Reclaim(fifIndex);
+    defragmenter.Reclaim(fifIndex);
+
+    memoryAllocator.Budget().Update();
+    computeScheduler.BeginFrame(fifIndex);
+
+    if (config.useHostAllocator)
+    {
+        hostAllocator.BeginFrame();
+    }
+
+    // Submitted first: the copies run while this frame is recorded.
+    *p_has_transfer = uploadQueue.IsDedicated() &&
+                      uploadQueue.Submit(&stagingRing, fifIndex);
+
+    PerFrameDataCpu uBuffer = {
+        glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp),
+        glm::perspectiveRH_ZO(glm::radians(45.0f),
+            static_cast<float>(surfaceCapabilities.currentExtent.width) /
+            static_cast<float>(surfaceCapabilities.currentExtent.height),
+            0.1f, 10000.0f),
+    };
+
+    // Flip vulkan Y-axis
+    uBuffer.projection[1][1] *= -1;
+
+    // Culled on the compute queue, while the previous frame is still rendering.
+    culling.BeginFrame(fifIndex, uBuffer.projection * uBuffer.view);
+
+    for (const DrawItem &drawItem : drawList)
+    {
+        culling.AddDraw(fifIndex, drawItem.model, geometryPool.Draw(drawItem.meshId));
+    }
+
+    *p_has_compute = computeScheduler.Submit(fifIndex);
+
+    vkResetCommandPool(device, framesInFlight[fifIndex].commandPool, 0);
+    recorder.BeginFrame(fifIndex);
+
+    // The region of this frame is free: its last submission has just been waited.
+    uniformRing.BeginFrame(fifIndex);
+
+    // First push of an empty region, at least DEFAULT_FRAME_SIZE: always fits.
+    const uint32_t viewOffset = uniformRing.Push(uBuffer);
+    assert(viewOffset != UniformRing::INVALID_OFFSET);
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = 0;
+    commandBufferBeginInfo.pInheritanceInfo = nullptr;
+
+    VK_CHECK(vkBeginCommandBuffer(framesInFlight[fifIndex].commandBuffer,
+        &commandBufferBeginInfo));
+
+    computeScheduler.BeginGraphicsTiming(framesInFlight[fifIndex].commandBuffer, fifIndex);
+    gpuProfiler.BeginFrame(framesInFlight[fifIndex].commandBuffer, fifIndex);
+
+    RecordUploads(*p_has_transfer);
+
+    {
+        GpuProfileScope scope(&gpuProfiler, framesInFlight[fifIndex].commandBuffer, fifIndex, "compute");
+
+        // Without an async compute queue the culling runs here, before the render pass.
+        computeScheduler.RecordGraphicsPasses(framesInFlight[fifIndex].commandBuffer, fifIndex);
+    }
+
+    if (hasVirtualTexture)
+    {
+        RecordVirtualTextureFeedback(uBuffer.projection * uBuffer.view);
+    }
+
+    RecordMainPass(image_index, viewOffset);
+
+    if (framesInFlight[fifIndex].readbackBuffer != VK_NULL_HANDLE)
+    {
+        RecordReadback(image_index);
+    }
+
+    computeScheduler.EndGraphicsTiming(framesInFlight[fifIndex].commandBuffer, fifIndex);
+
+    VK_CHECK(vkEndCommandBuffer(framesInFlight[fifIndex].commandBuffer));
+}
+
+void Renderer::RecordUploads(bool has_transfer)
+{
+    GpuProfileScope scope(&gpuProfiler, framesInFlight[fifIndex].commandBuffer, fifIndex, "uploads");
+
+    bool hasFlushed = has_transfer;
+
+    if (has_transfer)
+    {
+        // Copied on the transfer queue: take the written ranges back.
+        uploadQueue.RecordAcquire(framesInFlight[fifIndex].commandBuffer);
+    }
+    else if (!uploadQueue.IsDedicated() &&
+             stagingRing.Flush(framesInFlight[fifIndex].commandBuffer, fifIndex))
+    {
+        // Streamed geometry, if any, must be copied outside the render pass.
+        RecordGeometryUploadBarrier(framesInFlight[fifIndex].commandBuffer);
+        hasFlushed = true;
+    }
+
+    if (hasFlushed)
+    {
+        // A buffer being moved must copy the uploaded ranges again.
+        stagingRing.FlushedRanges(&flushedRanges);
+
+        for (const StagingFlushRange &range : flushedRanges)
+        {
+            defragmenter.MarkWritten(range.buffer, range.offset);
+        }
+    }
+
+    // Bounded: a long session compacts a bit every frame instead of stalling once.
+    geometryPool.Compact(framesInFlight[fifIndex].commandBuffer, fifIndex,
+        MemoryDefragmenter::DEFAULT_FRAME_BUDGET);
+    defragmenter.Update(framesInFlight[fifIndex].commandBuffer, fifIndex,
+        MemoryDefragmenter::DEFAULT_FRAME_BUDGET);
+}
+
+void Renderer::RecordVirtualTextureFeedback(const glm::mat4 &view_projection)
+{
+    GpuProfileScope scope(&gpuProfiler, framesInFlight[fifIndex].commandBuffer, fifIndex, "feedback");
+
+    // The last feedback of this slot was waited with the slot: stream the tiles it asked
+    // for, then write the ones this frame needs, read back the next time the slot is used.
+    virtualTexture.Update(framesInFlight[fifIndex].commandBuffer, fifIndex);
+
+    const VkBuffer feedbackIndirectBuffer = culling.IndirectBuffer(fifIndex);
+
+    virtualTexture.RecordFeedback(framesInFlight[fifIndex].commandBuffer, fifIndex,
+        [&](VkCommandBuffer cmd)
+        {
+            geometryPool.Bind(cmd);
+
+            // Same culled draws as the main pass.
+            for (uint32_t i = 0; i < culling.DrawCount(fifIndex); i++)
+            {
+                virtualTexture.PushTransform(cmd, view_projection * drawList[i].model);
+
+                vkCmdDrawIndexedIndirect(cmd, feedbackIndirectBuffer, GpuCulling::CommandOffset(i), 1,
+                    GpuCulling::COMMAND_STRIDE);
+            }
+        });
+}
+
+void Renderer::RecordMainPass(uint32_t image_index, uint32_t view_offset)
+{
+    constexpr VkClearValue CLEAR_VALUES[2] = {
+        {
+            .color = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}}
+        },
+        {
+            .depthStencil = {1.0f, 0},
+        }
+    };
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = renderPass;
+    renderPassBeginInfo.framebuffer = presentationFrames.framebuffer[image_index];
+    renderPassBeginInfo.renderArea.offset = {0, 0};
+    renderPassBeginInfo.renderArea.extent = surfaceCapabilities.currentExtent;
+    renderPassBeginInfo.clearValueCount = 2;
+    renderPassBeginInfo.pClearValues = &CLEAR_VALUES[0];
+
+    // The uniform ring is not thread safe: push the per-draw data before recording.
+    drawDataOffsets.resize(drawList.size());
+
+    for (size_t i = 0; i < drawList.size(); i++)
+    {
+        const PerDrawDataCpu drawData = {
+            drawList[i].model,
+        };
+
+        drawDataOffsets[i] = uniformRing.Push(drawData);
+    }
+
+    // Around the render pass: the secondaries can't begin a query of their own.
+    const uint32_t mainPass = gpuProfiler.BeginPass(framesInFlight[fifIndex].commandBuffer, fifIndex,
+        "main", true);
+
+    vkCmdBeginRenderPass(framesInFlight[fifIndex].commandBuffer,
+        &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(surfaceCapabilities.currentExtent.width);
+    viewport.height = static_cast<float>(surfaceCapabilities.currentExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor = {};
+    scissor.offset = {0, 0};
+    scissor.extent = surfaceCapabilities.currentExtent;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = presentationFrames.framebuffer[image_index];
+    inheritanceInfo.pipelineStatistics = gpuProfiler.InheritedStatistics();
+
+    // Secondaries inherit nothing but the render pass: every slice binds its own state.
+    const VkBuffer indirectBuffer = culling.IndirectBuffer(fifIndex);
+
+    // Still compiling: the fill pipeline stands in, the frame doesn't wait.
+    VkPipeline boundPipeline = pipelineRegistry.Get(chosenPipeline);
+
+    if (boundPipeline == VK_NULL_HANDLE)
+    {
+        boundPipeline = pipelineRegistry.Get(meshPipeline);
+    }
+
+    recorder.Record(framesInFlight[fifIndex].commandBuffer, fifIndex, inheritanceInfo,
+        culling.DrawCount(fifIndex),
+        [&](VkCommandBuffer cmd, uint32_t first, uint32_t count)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
+            vkCmdSetViewport(cmd, 0, 1, &viewport);
+            vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+            // Every mesh lives in the pool buffers: bind once, draw with offsets.
+            geometryPool.Bind(cmd);
+
+            if (hasVirtualTexture)
+            {
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelineLayout, 1, 1, &virtualTextureDescriptorSet, 0, nullptr);
+            }
+
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                if (drawDataOffsets[i] == UniformRing::INVALID_OFFSET)
+                {
+                    continue;
+                }
+
+                // One descriptor set for every draw, only the offsets change.
+                const uint32_t dynamicOffsets[] = {
+                    view_offset,
+                    drawDataOffsets[i],
+                };
+
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelineLayout, 0, 1, &uniformDescriptorSet, 2, &dynamicOffsets[0]);
+
+                // Written by the culling: no instance when the mesh is outside the frustum.
+                vkCmdDrawIndexedIndirect(cmd, indirectBuffer, GpuCulling::CommandOffset(i), 1,
+                    GpuCulling::COMMAND_STRIDE);
+            }
+        });
+
+    vkCmdEndRenderPass(framesInFlight[fifIndex].commandBuffer);
+
+    gpuProfiler.EndPass(framesInFlight[fifIndex].commandBuffer, fifIndex, mainPass);
+}
+
+void Renderer::RecordReadback(uint32_t image_index)
+{
+    // Ordered after the resolve and its transition by the render pass dependency.
+    VkBufferImageCopy copyRegion = {};
+    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copyRegion.imageSubresource.layerCount = 1;
+    copyRegion.imageExtent = {config.width, config.height, 1};
+
+    vkCmdCopyImageToBuffer(framesInFlight[fifIndex].commandBuffer,
+        presentationFrames.image[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        framesInFlight[fifIndex].readbackBuffer, 1, &copyRegion);
+
+    // Read on the host once the frame timeline says the submission is done.
+    VkMemoryBarrier hostBarrier = {};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(framesInFlight[fifIndex].commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+void Renderer::SubmitFrame(uint32_t image_index, bool has_transfer, bool has_compute)
+{
+    // The binary semaphores ignore their value.
+    VkSemaphore waitSemaphores[3] = {};
+    VkPipelineStageFlags waitStages[3] = {};
+    uint64_t waitValues[3] = {};
+    uint32_t waitCount = 0;
+
+    if (!config.headless)
+    {
+        waitSemaphores[waitCount] = framesInFlight[fifIndex].acquiredImageSemaphore;
+        waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        waitValues[waitCount++] = 0;
+    }
+
+    if (has_transfer)
+    {
+        waitSemaphores[waitCount] = uploadQueue.Semaphore();
+        waitStages[waitCount] = TransferQueue::WAIT_STAGES;
+        waitValues[waitCount++] = uploadQueue.SignaledValue();
+    }
+
+    if (has_compute)
+    {
+        waitSemaphores[waitCount] = computeScheduler.Semaphore();
+        waitStages[waitCount] = computeScheduler.WaitStages();
+        waitValues[waitCount++] = computeScheduler.SignaledValue();
+    }
+
+    framesInFlight[fifIndex].submitValue = frameTimeline.NextValue();
+
+    // Presentation only takes binary semaphores, everything else waits the frame timeline.
+    // Headless: the frame timeline only.
+    VkSemaphore signal_semaphores[] = {
+        frameTimeline.Semaphore(),
+        presentationFrames.renderFinishedSemaphore[image_index]
+    };
+
+    const uint64_t signalValues[] = {
+        framesInFlight[fifIndex].submitValue,
+        0
+    };
+
+    const uint32_t signalCount = config.headless ? 1 : 2;
+
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+    timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineSubmitInfo.waitSemaphoreValueCount = waitCount;
+    timelineSubmitInfo.pWaitSemaphoreValues = &waitValues[0];
+    timelineSubmitInfo.signalSemaphoreValueCount = signalCount;
+    timelineSubmitInfo.pSignalSemaphoreValues = &signalValues[0];
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineSubmitInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = &waitSemaphores[0];
+    submitInfo.pWaitDstStageMask = &waitStages[0];
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &framesInFlight[fifIndex].commandBuffer;
+    submitInfo.signalSemaphoreCount = signalCount;
+    submitInfo.pSignalSemaphores = &signal_semaphores[0];
+
+    {
+        PROFILE_ZONE("submit");
+
+        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+    }
+}
+
+void Renderer::PresentFrame(uint32_t image_index)
+{
+    presentId++;
+
+    VkPresentIdKHR presentIdInfo = {};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+
+    VkResult result = {};
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.pNext = hasPresentWait ? &presentIdInfo : nullptr;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &presentationFrames.renderFinishedSemaphore[image_index];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &swapchain;
+    presentInfo.pImageIndices = &image_index;
+    presentInfo.pResults = &result;
+
+    VkResult presentResult = {};
+
+    {
+        PROFILE_ZONE("present");
+
+        presentResult = vkQueuePresentKHR(queue, &presentInfo);
+    }
+
+    if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+    {
+        isSwapchainDirty = true;
+    }
+    else
+    {
+        VK_CHECK(presentResult);
+    }
+
+    if (hasPresentWait && presentId - 1 > swapchainFirstPresentId)
+    {
+        PROFILE_ZONE("present wait");
+
+        // At most one present queued: the input of the next frame is sampled after the
+        // previous one is on screen. A timeout or an out of date swapchain isn't fatal here.
+        constexpr uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+        const VkResult waitResult = vkWaitForPresentKHR(device, swapchain, presentId - 1,
+            PRESENT_WAIT_TIMEOUT_NS);
+
+        if (waitResult == VK_SUCCESS && presentedInputTime != 0)
+        {
+            RecordLatency(presentedInputTime);
+        }
+    }
+}
+
+void Renderer::Teardown()
+{
+    PROFILE_FUNCTION();
+
+    VK_CHECK(
+        vkDeviceWaitIdle(device));
+
+    // First: its compile threads may still use the layout, the render pass and the pipeline cache.
+    pipelineRegistry.Teardown();
+
+    if (hasVirtualTexture)
+    {
+        virtualTexture.Teardown();
+
+        vkDestroyDescriptorSetLayout(
+            device,
+            virtualTextureSetLayout,
+            allocationCallbacks);
+    }
+
+    vkDestroyDescriptorPool(
+        device,
+        descriptorPool,
+        allocationCallbacks);
+    vkDestroyDescriptorSetLayout(
+        device,
+        descriptorSetLayout,
+        allocationCallbacks);
+    vkDestroyRenderPass(
+        device,
+        renderPass,
+        allocationCallbacks);
+    vkDestroyPipelineLayout(
+        device,
+        pipelineLayout,
+        allocationCallbacks);
+
+    // First: the deferred work may destroy objects torn down below.
+    frameTimeline.Teardown();
+
+    gpuProfiler.Teardown();
+    culling.Teardown();
+    computeScheduler.Teardown();
+    pipelineCache.Teardown();
+    uploadQueue.Teardown();
+    stagingRing.Teardown();
+
+    geometryPool.Teardown();
+
+    uniformRing.Teardown();
+
+    DestroySwapchain(
+        swapchain,
+        &presentationFrames,
+        framebufferSampleImage,
+        framebufferSampleImageView,
+        &framebufferSampleImageMemory,
+        depthStencilImage,
+        depthStencilImageView,
+        &depthStencilMemory);
+
+    for (FrameInFlightType &frameInFlight : framesInFlight)
+    {
+        vkDestroySemaphore(device, frameInFlight.acquiredImageSemaphore, allocationCallbacks);
+
+        if (frameInFlight.readbackBuffer != VK_NULL_HANDLE)
+        {
+            vkDestroyBuffer(device, frameInFlight.readbackBuffer, allocationCallbacks);
+            memoryAllocator.Free(&frameInFlight.readbackMemory);
+        }
+    }
+
+    recorder.Teardown();
+    threadPool.Teardown();
+
+    for (const FrameInFlightType &frameInFlight : framesInFlight)
+    {
+        vkDestroyCommandPool(device, frameInFlight.commandPool, allocationCallbacks);
+    }
+
+    defragmenter.Teardown();
+    memoryAllocator.Teardown();
+
+    vkDestroyDevice(
+        device,
+        allocationCallbacks);
+
+    // Headless: VK_KHR_surface isn't enabled, the function isn't loaded.
+    if (surface != VK_NULL_HANDLE)
+    {
+        vkDestroySurfaceKHR(
+            instance,
+            surface,
+            nullptr);
+    }
+
+    if (hasDebugUtils)
+    {
+        vkDestroyDebugUtilsMessengerEXT(
+            instance,
+            debugMessenger,
+            allocationCallbacks);
+    }
+
+    vkDestroyInstance(
+        instance,
+        allocationCallbacks);
+
+    if (config.useHostAllocator)
+    {
+        hostAllocator.Teardown();
+        allocationCallbacks = nullptr;
+    }
+
+    if (window != nullptr)
+    {
+        SDL_DestroyWindow(
+            window);
+    }
+
+    SDL_Quit();
+}
+
+void Renderer::InitInstance()
+{
+    PROFILE_FUNCTION();
+
+    VK_CHECK(volkInitialize());
+
+    // Optional: CI images and software drivers often come without the SDK layers.
+    std::vector<const char *> requestedLayers = {};
+
+    if (vk_query_instance_layer_support("VK_LAYER_KHRONOS_validation"))
+    {
+        requestedLayers.push_back("VK_LAYER_KHRONOS_validation");
+    }
+
+    std::vector<const char *> requestedExtensions = {};
+
+    // The surface extensions of the platform (win32, xlib, wayland, ...) as SDL needs them.
+    if (window != nullptr)
+    {
+        uint32_t surfaceExtensionCount = 0;
+        VK_CHECK(SDL_Vulkan_GetInstanceExtensions(window, &surfaceExtensionCount, nullptr)
+            ? VK_SUCCESS
+            : VK_ERROR_EXTENSION_NOT_PRESENT);
+
+        requestedExtensions.resize(surfaceExtensionCount);
+        VK_CHECK(SDL_Vulkan_GetInstanceExtensions(window, &surfaceExtensionCount, requestedExtensions.data())
+            ? VK_SUCCESS
+            : VK_ERROR_EXTENSION_NOT_PRESENT);
+    }
+
+    hasDebugUtils = vk_query_instance_extension_support(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
+    if (hasDebugUtils)
+    {
+        requestedExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    }
+
+    // Optional, the memory budget falls back to the heap sizes without it.
+    hasPhysicalDeviceProperties2 = vk_query_instance_extension_support(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
+    if (hasPhysicalDeviceProperties2)
+    {
+        requestedExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+
+    VkApplicationInfo applicationInfo = {};
+    applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    applicationInfo.pApplicationName = "Adro";
+    applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    // 1.2: timeline semaphores are core, the transfer queue signals one.
+    applicationInfo.apiVersion = VK_API_VERSION_1_2;
+
+    VkInstanceCreateInfo instanceCreateInfo = {};
     instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    instanceCreateInfo.pNext = &DEBUG_UTILS_MESSENGER_CREATE_INFO;
+    instanceCreateInfo.pNext = hasDebugUtils ? &DEBUG_UTILS_MESSENGER_CREATE_INFO : nullptr;
     // @TODO: turn it on only if needed (debug build).
     instanceCreateInfo.pApplicationInfo = &applicationInfo;
-    instanceCreateInfo.enabledLayerCount = std::size(requestedLayers);
-    instanceCreateInfo.ppEnabledLayerNames = &requestedLayers[0];
-    instanceCreateInfo.enabledExtensionCount = std::size(requestedExtensions);
-    instanceCreateInfo.ppEnabledExtensionNames = &requestedExtensions[0];
+    instanceCreateInfo.enabledLayerCount = static_cast<uint32_t>(requestedLayers.size());
+    instanceCreateInfo.ppEnabledLayerNames = requestedLayers.data();
+    instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(requestedExtensions.size());
+    instanceCreateInfo.ppEnabledExtensionNames = requestedExtensions.data();
 
-    VK_CHECK(vkCreateInstance(&instanceCreateInfo, nullptr, &instance));
+    VK_CHECK(vkCreateInstance(&instanceCreateInfo, allocationCallbacks, &instance));
 
     volkLoadInstance(instance);
 
-    vkCreateDebugUtilsMessengerEXT(instance, &DEBUG_UTILS_MESSENGER_CREATE_INFO,
-        nullptr, &debugMessenger);
+    if (hasDebugUtils)
+    {
+        vkCreateDebugUtilsMessengerEXT(instance, &DEBUG_UTILS_MESSENGER_CREATE_INFO,
+            allocationCallbacks, &debugMessenger);
+    }
+
+    printf("\nvalidation: %s", requestedLayers.empty() ? "layer not installed" : "enabled");
 }
 
 void Renderer::InitSurface()
 {
+    PROFILE_FUNCTION();
+
+    // Headless: nothing to present to.
+    if (window == nullptr)
+    {
+        return;
+    }
+
     // @todo use the vulkan call and not the sdl one.
     VK_CHECK(
         SDL_Vulkan_CreateSurface(
@@ -575,6 +1417,8 @@ void Renderer::InitSurface()
 
 void Renderer::InitDevice()
 {
+    PROFILE_FUNCTION();
+
     VkPhysicalDeviceFeatures gpuRequiredFeatures = {};
     gpuRequiredFeatures.geometryShader = VK_TRUE;
     gpuRequiredFeatures.tessellationShader = VK_TRUE;
@@ -583,44 +1427,199 @@ void Renderer::InitDevice()
     gpuRequiredFeatures.sampleRateShading = VK_TRUE;
     gpuRequiredFeatures.samplerAnisotropy = VK_TRUE;
 
-    // @todo:	calculate the device extension count from the array.
-    const char *deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // Headless renders offscreen: a gpu without presentation (e.g. compute only servers) will do.
+    std::vector<const char *> deviceExtensions = {};
 
-    QueryGpu(instance, gpuRequiredFeatures, std::size(deviceExtensions),
-        deviceExtensions, &gpu);
+    if (!config.headless)
+    {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    // Required extensions only: optional ones must not discard a gpu.
+    QueryGpu(instance, gpuRequiredFeatures, static_cast<uint32_t>(deviceExtensions.size()),
+        deviceExtensions.data(), &gpu);
+
+    // Optional too: the profiler times the passes without it.
+    VkPhysicalDeviceFeatures gpuSupportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(gpu, &gpuSupportedFeatures);
+
+    hasPipelineStatistics = gpuSupportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+    gpuRequiredFeatures.pipelineStatisticsQuery = gpuSupportedFeatures.pipelineStatisticsQuery;
+
+    // Without it no query may be active around the secondaries: the main pass is timed only.
+    hasInheritedQueries = gpuSupportedFeatures.inheritedQueries == VK_TRUE;
+    gpuRequiredFeatures.inheritedQueries = gpuSupportedFeatures.inheritedQueries;
+
+    const bool hasMemoryBudget = hasPhysicalDeviceProperties2 &&
+                                 vk_query_device_extension_support(gpu,
+                                     VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    if (hasMemoryBudget)
+    {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+
+    if (!config.headless &&
+        vk_query_device_extension_support(gpu, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+        vk_query_device_extension_support(gpu, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &presentIdFeatures;
+
+        vkGetPhysicalDeviceFeatures2(gpu, &features2);
+
+        hasPresentWait = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+    }
+
+    if (hasPresentWait)
+    {
+        deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+
+    // Optional: instruction counts of the shader variants in --variant-report.
+    VkPhysicalDevicePipelineExecutablePropertiesFeaturesKHR executableFeatures = {};
+    executableFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_EXECUTABLE_PROPERTIES_FEATURES_KHR;
+
+    if (config.variantReport &&
+        vk_query_device_extension_support(gpu, VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &executableFeatures;
+
+        vkGetPhysicalDeviceFeatures2(gpu, &features2);
+
+        hasPipelineExecutableInfo = executableFeatures.pipelineExecutableInfo == VK_TRUE;
+    }
+
+    if (hasPipelineExecutableInfo)
+    {
+        deviceExtensions.push_back(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME);
+    }
 
-    QueryQueueFamily(gpu, VK_QUEUE_GRAPHICS_BIT, true, 0, nullptr,
+    QueryQueueFamily(gpu, VK_QUEUE_GRAPHICS_BIT, surface, 0, nullptr,
         &queueFamilyIndex);
 
+    // A transfer only family is usually backed by the copy engines: the uploads run
+    // beside the rendering. Without one, they stay on the graphics queue.
+    if (!vk_query_dedicated_queue_family(gpu, VK_QUEUE_TRANSFER_BIT,
+        VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, &transferQueueFamilyIndex))
+    {
+        transferQueueFamilyIndex = queueFamilyIndex;
+    }
+
+    // Same for the async compute: a compute family without graphics runs beside the graphics queue.
+    if (!vk_query_dedicated_queue_family(gpu, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT,
+        &computeQueueFamilyIndex))
+    {
+        computeQueueFamilyIndex = queueFamilyIndex;
+    }
+
     constexpr float QUEUE_PRIORITIES = 1.0f;
 
-    VkDeviceQueueCreateInfo queueCreateInfo = {};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.flags = 0;
-    queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &QUEUE_PRIORITIES;
+    VkDeviceQueueCreateInfo queueCreateInfos[3] = {};
+    uint32_t queueFamilyCount = 0;
+
+    for (const uint32_t familyIndex : {queueFamilyIndex, transferQueueFamilyIndex, computeQueueFamilyIndex})
+    {
+        const bool isCreated = std::any_of(queueCreateInfos, queueCreateInfos + queueFamilyCount,
+            [familyIndex](const VkDeviceQueueCreateInfo &info)
+            {
+                return info.queueFamilyIndex == familyIndex;
+            });
+
+        if (isCreated)
+        {
+            continue;
+        }
+
+        VkDeviceQueueCreateInfo &queueCreateInfo = queueCreateInfos[queueFamilyCount++];
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.flags = 0;
+        queueCreateInfo.queueFamilyIndex = familyIndex;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &QUEUE_PRIORITIES;
+    }
+
+    VkPhysicalDeviceVulkan12Features gpuRequiredFeatures12 = {};
+    gpuRequiredFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    gpuRequiredFeatures12.timelineSemaphore = VK_TRUE;
 
-    constexpr uint32_t QUEUE_FAMILY_COUNT = 1;
+    // The queried features are all VK_TRUE: enable them as they are.
+    if (hasPresentWait)
+    {
+        gpuRequiredFeatures12.pNext = &presentIdFeatures;
+    }
+
+    if (hasPipelineExecutableInfo)
+    {
+        executableFeatures.pNext = gpuRequiredFeatures12.pNext;
+        gpuRequiredFeatures12.pNext = &executableFeatures;
+    }
 
     VkDeviceCreateInfo deviceCreateInfo = {};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.pNext = &gpuRequiredFeatures12;
     deviceCreateInfo.flags = 0;
-    deviceCreateInfo.queueCreateInfoCount = QUEUE_FAMILY_COUNT;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceCreateInfo.enabledExtensionCount = std::size(deviceExtensions);
-    deviceCreateInfo.ppEnabledExtensionNames = &deviceExtensions[0];
+    deviceCreateInfo.queueCreateInfoCount = queueFamilyCount;
+    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfos[0];
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
     deviceCreateInfo.pEnabledFeatures = &gpuRequiredFeatures;
 
-    VK_CHECK(vkCreateDevice(gpu, &deviceCreateInfo, nullptr, &device));
+    VK_CHECK(vkCreateDevice(gpu, &deviceCreateInfo, allocationCallbacks, &device));
 
     volkLoadDevice(device);
 
     vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+    vkGetDeviceQueue(device, transferQueueFamilyIndex, 0, &transferQueue);
+    vkGetDeviceQueue(device, computeQueueFamilyIndex, 0, &computeQueue);
+
+    printf("\ntransfer queue: family %u%s",
+        transferQueueFamilyIndex,
+        transferQueueFamilyIndex != queueFamilyIndex ? " (dedicated)" : " (graphics)");
+    printf("\npresent wait: %s", hasPresentWait ? "supported" : "not supported");
+    printf("\ncompute queue: family %u%s",
+        computeQueueFamilyIndex,
+        computeQueueFamilyIndex != queueFamilyIndex ? " (async)" : " (graphics)");
+
+    memoryAllocator.Init(device, gpu, DeviceMemoryAllocator::DEFAULT_BLOCK_SIZE, hasMemoryBudget,
+        allocationCallbacks);
+
+    memoryAllocator.Budget().AddThresholdCallback(
+        MemoryBudget::DEFAULT_WARNING_THRESHOLD,
+        [](uint32_t heap_index, const HeapBudget &heap, bool is_over)
+        {
+            printf("\n[memory] heap %u %s %.0f%% of its budget: %.1f/%.1f MiB",
+                heap_index,
+                is_over ? "above" : "back under",
+                MemoryBudget::DEFAULT_WARNING_THRESHOLD * 100.0f,
+                static_cast<double>(heap.usage) / (1024.0 * 1024.0),
+                static_cast<double>(heap.budget) / (1024.0 * 1024.0));
+        });
+
+    defragmenter.Init(device, &memoryAllocator);
 }
 
 void Renderer::InitSwapchain()
 {
+    PROFILE_FUNCTION();
+
+    if (config.headless)
+    {
+        InitOffscreenImages();
+        return;
+    }
+
     VkFormat requiredSurfaceFormats[1] = {
         VK_FORMAT_R8G8B8A8_SRGB,
     };
@@ -632,39 +1631,131 @@ void Renderer::InitSwapchain()
         requiredSurfaceFormats,
         &surfaceFormat);
 
-    vk_query_surface_capabilities(
+    QuerySurfaceCapabilities();
+
+    vk_query_present_mode(
         gpu,
         surface,
-        &surfaceCapabilities);
+        config.presentMode,
+        &presentMode);
+
+    // Once: the same fallback is taken on every recreation.
+    if (swapchain == VK_NULL_HANDLE && presentMode != config.presentMode)
+    {
+        printf("\npresent mode %s not supported, using %s",
+            vk_present_mode_name(config.presentMode),
+            vk_present_mode_name(presentMode));
+    }
 
     vk_create_swapchain(
         device,
         surface,
         &surfaceFormat,
         &surfaceCapabilities,
-        // At this point is VK_NULL_HANDLE
+        presentMode,
+        // VK_NULL_HANDLE at init, the retired swapchain on recreation
         swapchain,
-        nullptr,
+        allocationCallbacks,
         &swapchain);
 
-    presentationFrames.image = new VkImage[surfaceCapabilities.minImageCount];
-    presentationFrames.imageView = new VkImageView[surfaceCapabilities.minImageCount];
-    presentationFrames.framebuffer = new VkFramebuffer[surfaceCapabilities.minImageCount];
-    presentationFrames.renderFinishedSemaphore = new VkSemaphore[surfaceCapabilities.minImageCount];
+    vk_query_swapchain_images(
+        device,
+        swapchain,
+        &presentationFrames.imageCount,
+        nullptr);
+
+    presentationFrames.image = new VkImage[presentationFrames.imageCount];
+    presentationFrames.imageView = new VkImageView[presentationFrames.imageCount];
+    presentationFrames.framebuffer = new VkFramebuffer[presentationFrames.imageCount];
+    presentationFrames.renderFinishedSemaphore = new VkSemaphore[presentationFrames.imageCount];
 
     vk_query_swapchain_images(
         device,
         swapchain,
+        &presentationFrames.imageCount,
         &presentationFrames.image[0]);
 
     // Create the view of the swapchain images
-    for (uint32_t i = 0; i < surfaceCapabilities.minImageCount; i++)
+    for (uint32_t i = 0; i < presentationFrames.imageCount; i++)
+    {
+        vk_create_image_view(
+            device,
+            presentationFrames.image[i],
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_VIEW_TYPE_2D,
+            1,
+            surfaceFormat.format,
+            {
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY
+            },
+            allocationCallbacks,
+            &presentationFrames.imageView[i]);
+    }
+
+    for (uint32_t i = 0; i < presentationFrames.imageCount; i++)
+    {
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreCreateInfo.flags = 0;
+
+        VK_CHECK(
+            vkCreateSemaphore(
+                device,
+                &semaphoreCreateInfo,
+                allocationCallbacks,
+                &presentationFrames.renderFinishedSemaphore[i]));
+    }
+}
+
+void Renderer::InitOffscreenImages()
+{
+    surfaceFormat = {VK_FORMAT_R8G8B8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+
+    surfaceCapabilities = {};
+    surfaceCapabilities.currentExtent = {config.width, config.height};
+    surfaceCapabilities.minImageExtent = surfaceCapabilities.currentExtent;
+    surfaceCapabilities.maxImageExtent = surfaceCapabilities.currentExtent;
+    surfaceCapabilities.minImageCount = config.framesInFlight;
+    surfaceCapabilities.maxImageCount = config.framesInFlight;
+    surfaceCapabilities.maxImageArrayLayers = 1;
+
+    // One per frame in flight: the slot renders into its own image, nothing to acquire.
+    presentationFrames.imageCount = config.framesInFlight;
+
+    presentationFrames.image = new VkImage[presentationFrames.imageCount];
+    presentationFrames.imageMemory = new DeviceAllocation[presentationFrames.imageCount];
+    presentationFrames.imageView = new VkImageView[presentationFrames.imageCount];
+    presentationFrames.framebuffer = new VkFramebuffer[presentationFrames.imageCount];
+    // Nothing waits on them without a present: null handles, destroyed as no-ops.
+    presentationFrames.renderFinishedSemaphore = new VkSemaphore[presentationFrames.imageCount]();
+
+    for (uint32_t i = 0; i < presentationFrames.imageCount; i++)
     {
+        vk_create_image(
+            device,
+            &memoryAllocator,
+            VK_IMAGE_TYPE_2D,
+            surfaceFormat.format,
+            {config.width, config.height, 1},
+            1,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryCategory::ATTACHMENTS,
+            allocationCallbacks,
+            &presentationFrames.image[i],
+            &presentationFrames.imageMemory[i]);
+
         vk_create_image_view(
             device,
             presentationFrames.image[i],
             VK_IMAGE_ASPECT_COLOR_BIT,
             VK_IMAGE_VIEW_TYPE_2D,
+            1,
             surfaceFormat.format,
             {
                 VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -672,27 +1763,174 @@ void Renderer::InitSwapchain()
                 VK_COMPONENT_SWIZZLE_IDENTITY,
                 VK_COMPONENT_SWIZZLE_IDENTITY
             },
-            nullptr,
+            allocationCallbacks,
             &presentationFrames.imageView[i]);
     }
+}
+
+void Renderer::QuerySurfaceCapabilities()
+{
+    vk_query_surface_capabilities(
+        gpu,
+        surface,
+        &surfaceCapabilities);
+
+    // 0xFFFFFFFF: the surface takes the size of the swapchain (e.g. Wayland).
+    if (surfaceCapabilities.currentExtent.width == UINT32_MAX)
+    {
+        int width = 0;
+        int height = 0;
+        SDL_Vulkan_GetDrawableSize(window, &width, &height);
+
+        surfaceCapabilities.currentExtent.width = std::clamp(static_cast<uint32_t>(width),
+            surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+        surfaceCapabilities.currentExtent.height = std::clamp(static_cast<uint32_t>(height),
+            surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+    }
+}
+
+bool Renderer::RecreateSwapchain()
+{
+    PROFILE_FUNCTION();
+
+    const Uint64 recreateStart = SDL_GetPerformanceCounter();
+
+    QuerySurfaceCapabilities();
+
+    if (surfaceCapabilities.currentExtent.width == 0 || surfaceCapabilities.currentExtent.height == 0)
+    {
+        return false;
+    }
+
+    // Still used by the frames in flight: destroyed after the next submission completes.
+    // The presents queued before it are assumed done with their semaphores by then, there
+    // is no present fence without VK_EXT_swapchain_maintenance1.
+    frameTimeline.Defer(
+        [this,
+            oldSwapchain = swapchain,
+            oldFrames = presentationFrames,
+            oldSampleImage = framebufferSampleImage,
+            oldSampleImageView = framebufferSampleImageView,
+            oldSampleImageMemory = framebufferSampleImageMemory,
+            oldDepthStencilImage = depthStencilImage,
+            oldDepthStencilImageView = depthStencilImageView,
+            oldDepthStencilMemory = depthStencilMemory]() mutable
+        {
+            DestroySwapchain(
+                oldSwapchain,
+                &oldFrames,
+                oldSampleImage,
+                oldSampleImageView,
+                &oldSampleImageMemory,
+                oldDepthStencilImage,
+                oldDepthStencilImageView,
+                &oldDepthStencilMemory);
+        });
+
+    presentationFrames = {};
+
+    InitSwapchain();
+    InitOtherImages();
+    InitFramebuffers();
+
+    // Depth-stencil needs no transition: the render pass starts from UNDEFINED and clears it.
+    // Present ids are per swapchain.
+    swapchainFirstPresentId = presentId;
+    isSwapchainDirty = false;
+
+    const double stallMs = static_cast<double>(SDL_GetPerformanceCounter() - recreateStart) * 1000.0 /
+                           static_cast<double>(SDL_GetPerformanceFrequency());
+
+    printf("\nswapchain recreated: %ux%u, %u images, %.2f ms stall",
+        surfaceCapabilities.currentExtent.width,
+        surfaceCapabilities.currentExtent.height,
+        presentationFrames.imageCount,
+        stallMs);
+
+    return true;
+}
+
+void Renderer::DestroySwapchain(
+    VkSwapchainKHR old_swapchain,
+    PresentationFrameType *p_frames,
+    VkImage sample_image,
+    VkImageView sample_image_view,
+    DeviceAllocation *p_sample_image_memory,
+    VkImage depth_stencil_image,
+    VkImageView depth_stencil_image_view,
+    DeviceAllocation *p_depth_stencil_memory)
+{
+    // Multisample image
+    vkDestroyImageView(
+        device,
+        sample_image_view,
+        allocationCallbacks);
+    vkDestroyImage(
+        device,
+        sample_image,
+        allocationCallbacks);
+    memoryAllocator.Free(p_sample_image_memory);
+
+    // Depth stencil
+    vkDestroyImageView(
+        device,
+        depth_stencil_image_view,
+        allocationCallbacks);
+    vkDestroyImage(
+        device,
+        depth_stencil_image,
+        allocationCallbacks);
+    memoryAllocator.Free(p_depth_stencil_memory);
 
-    for (uint32_t i = 0; i < surfaceCapabilities.minImageCount; i++)
+    for (uint32_t i = 0; i < p_frames->imageCount; i++)
     {
-        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        semaphoreCreateInfo.flags = 0;
+        vkDestroyFramebuffer(
+            device,
+            p_frames->framebuffer[i],
+            allocationCallbacks);
 
-        VK_CHECK(
-            vkCreateSemaphore(
+        vkDestroyImageView(
+            device,
+            p_frames->imageView[i],
+            allocationCallbacks);
+
+        vkDestroySemaphore(
+            device,
+            p_frames->renderFinishedSemaphore[i],
+            allocationCallbacks);
+
+        // Offscreen images: the swapchain owns its own.
+        if (p_frames->imageMemory != nullptr)
+        {
+            vkDestroyImage(
                 device,
-                &semaphoreCreateInfo,
-                nullptr,
-                &presentationFrames.renderFinishedSemaphore[i]));
+                p_frames->image[i],
+                allocationCallbacks);
+            memoryAllocator.Free(&p_frames->imageMemory[i]);
+        }
+    }
+
+    delete[] p_frames->image;
+    delete[] p_frames->imageMemory;
+    delete[] p_frames->imageView;
+    delete[] p_frames->framebuffer;
+    delete[] p_frames->renderFinishedSemaphore;
+    *p_frames = {};
+
+    // Headless: VK_KHR_swapchain isn't enabled, the function isn't loaded.
+    if (old_swapchain != VK_NULL_HANDLE)
+    {
+        vkDestroySwapchainKHR(
+            device,
+            old_swapchain,
+            allocationCallbacks);
     }
 }
 
 void Renderer::InitOtherImages()
 {
+    PROFILE_FUNCTION();
+
     VkSampleCountFlagBits sampleCounts = VK_SAMPLE_COUNT_1_BIT;
     vk_query_sample_counts(
         gpu,
@@ -700,7 +1938,7 @@ void Renderer::InitOtherImages()
 
     vk_create_image(
         device,
-        gpu,
+        &memoryAllocator,
         VK_IMAGE_TYPE_2D,
         surfaceFormat.format,
         {
@@ -708,11 +1946,13 @@ void Renderer::InitOtherImages()
             surfaceCapabilities.currentExtent.height,
             1
         },
+        1,
         sampleCounts,
         VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        nullptr,
+        MemoryCategory::ATTACHMENTS,
+        allocationCallbacks,
         &framebufferSampleImage,
         &framebufferSampleImageMemory);
 
@@ -721,6 +1961,7 @@ void Renderer::InitOtherImages()
         framebufferSampleImage,
         VK_IMAGE_ASPECT_COLOR_BIT,
         VK_IMAGE_VIEW_TYPE_2D,
+        1,
         surfaceFormat.format,
         {
             VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -728,7 +1969,7 @@ void Renderer::InitOtherImages()
             VK_COMPONENT_SWIZZLE_IDENTITY,
             VK_COMPONENT_SWIZZLE_IDENTITY
         },
-        nullptr,
+        allocationCallbacks,
         &framebufferSampleImageView);
 
     // Depth + Stencil
@@ -750,15 +1991,17 @@ void Renderer::InitOtherImages()
 
     vk_create_image(
         device,
-        gpu,
+        &memoryAllocator,
         VK_IMAGE_TYPE_2D,
         depthStencilFormat,
-        {surfaceCapabilities.currentExtent.width, surfaceCapabilities.currentExtent.width, 1},
+        {surfaceCapabilities.currentExtent.width, surfaceCapabilities.currentExtent.height, 1},
+        1,
         sampleCounts,
         VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        nullptr,
+        MemoryCategory::ATTACHMENTS,
+        allocationCallbacks,
         &depthStencilImage,
         &depthStencilMemory);
 
@@ -767,6 +2010,7 @@ void Renderer::InitOtherImages()
         depthStencilImage,
         VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
         VK_IMAGE_VIEW_TYPE_2D,
+        1,
         depthStencilFormat,
         {
             VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -774,23 +2018,32 @@ void Renderer::InitOtherImages()
             VK_COMPONENT_SWIZZLE_IDENTITY,
             VK_COMPONENT_SWIZZLE_IDENTITY
         },
-        nullptr,
+        allocationCallbacks,
         &depthStencilImageView);
 }
 
 void Renderer::InitCommand()
 {
+    PROFILE_FUNCTION();
+
+    frameTimeline.Init(device, allocationCallbacks);
+
+    gpuProfiler.Init(device, gpu, queueFamilyIndex, config.framesInFlight, hasPipelineStatistics,
+        hasInheritedQueries, allocationCallbacks);
+
     VkCommandPoolCreateInfo commandPoolCreateInfo = {};
     commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
                                   VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
 
-    for (size_t i = 0; i < FramesInFlightType::MAX_FIF_COUNT; i++)
+    framesInFlight.resize(config.framesInFlight);
+
+    for (size_t i = 0; i < framesInFlight.size(); i++)
     {
-        VkCommandPool &fifCommandPool = framesInFlight.commandPool[i];
+        VkCommandPool &fifCommandPool = framesInFlight[i].commandPool;
 
-        VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr,
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, allocationCallbacks,
             &fifCommandPool));
 
         VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
@@ -800,162 +2053,301 @@ void Renderer::InitCommand()
         commandBufferAllocateInfo.commandBufferCount = 1;
 
         VK_CHECK(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo,
-            &framesInFlight.commandBuffer[i]));
+            &framesInFlight[i].commandBuffer));
 
         VkSemaphoreCreateInfo semaphoreCreateInfo = {};
         semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
         semaphoreCreateInfo.flags = 0;
 
-        VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
-            &framesInFlight.acquiredImageSemaphore[i]));
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, allocationCallbacks,
+            &framesInFlight[i].acquiredImageSemaphore));
 
-        VkFenceCreateInfo fenceCreateInfo = {};
-        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        // Nothing submitted yet: waiting for 0 returns immediately.
+        framesInFlight[i].submitValue = 0;
 
-        VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr,
-            &framesInFlight.submitFence[i]));
+        if (config.readbackPath != nullptr)
+        {
+            // RGBA8, tightly packed.
+            vk_create_buffer(
+                device,
+                &memoryAllocator,
+                static_cast<VkDeviceSize>(config.width) * config.height * 4,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                MemoryCategory::STAGING,
+                allocationCallbacks,
+                &framesInFlight[i].readbackBuffer,
+                &framesInFlight[i].readbackMemory);
+        }
     }
+
+    // The thread pool is up since Init: one worker per core but the render thread.
+    recorder.Init(device, queueFamilyIndex, &threadPool, config.framesInFlight,
+        config.recordSlices, allocationCallbacks);
+
+    uploadQueue.Init(device, transferQueueFamilyIndex, transferQueue, queueFamilyIndex,
+        config.framesInFlight, allocationCallbacks);
 }
 
 
+void Renderer::ImportScene()
+{
+    PROFILE_FUNCTION();
+
+    const Uint64 importStart = SDL_GetPerformanceCounter();
+
+    // A file is one mesh drawn once, a generated scene many meshes drawn by many instances.
+    const size_t prefixLength = strlen(SceneGenerator::SPEC_PREFIX);
+
+    if (strncmp(config.scenePath, SceneGenerator::SPEC_PREFIX, prefixLength) == 0)
+    {
+        SceneDesc sceneDesc = {};
+
+        if (!SceneGenerator::Parse(config.scenePath + prefixLength, &sceneDesc))
+        {
+            printf("\nscene %s: malformed, generating the default one", config.scenePath);
+        }
+
+        SceneGenerator::Generate(sceneDesc, &generatedScene);
+
+        for (const BatchCpu &mesh : generatedScene.meshes)
+        {
+            sceneVertexCount += mesh.position.size();
+            sceneIndexCount += mesh.indices.size();
+        }
+    }
+    else
+    {
+        MeshLoader::Load(
+            config.scenePath,
+            &batchData);
+
+        std::vector<glm::vec4> defaultColors(
+            batchData.position.size(),
+            glm::vec4(
+                .36f,
+                .36f,
+                .5f,
+                1.0f));
+        batchData.color = defaultColors;
+
+        generatedScene.instances.push_back({});
+
+        sceneVertexCount = batchData.position.size();
+        sceneIndexCount = batchData.indices.size();
+    }
+
+    // Checked by the import rather than the upload: nothing is allocated yet, and the tasks
+    // depending on the scene are skipped.
+    if (sceneVertexCount > GeometryPool::MAX_VERTEX_CAPACITY || sceneIndexCount > GeometryPool::MAX_INDEX_CAPACITY)
+    {
+        throw std::runtime_error("Scene too large for the geometry pool");
+    }
+
+    // The upload adds its own time.
+    sceneLoadMs = static_cast<double>(SDL_GetPerformanceCounter() - importStart) * 1000.0 /
+                  static_cast<double>(SDL_GetPerformanceFrequency());
+}
+
 void Renderer::InitBatch()
 {
-    MeshLoader::Load(
-        "../Resources/Meshes/SM_Behemoth.fbx",
-        &batchData);
-
-    INDICES_COUNT = batchData.indices.size();
-
-    std::vector<glm::vec4> defaultColors(
-        batchData.position.size(),
-        glm::vec4(
-            .36f,
-            .36f,
-            .5f,
-            1.0f));
-    batchData.color = defaultColors;
-
-    const size_t actualPositionBufferSize = sizeof(glm::vec3) * batchData.position.size();
-    // Allocate a buffer with greater size than requested
-    const size_t positionBufferSize = static_cast<size_t>(Utils::ToClosestPowerOfTwo(
-        static_cast<float>(actualPositionBufferSize)));;
-    vk_create_buffer(
-        device,
-        gpu,
-        positionBufferSize,
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        nullptr,
-        &batch.positionBuffer,
-        &batch.positionMem);
-
-    void *positionData = nullptr;
-    VK_CHECK(
-        vkMapMemory(
-            device,
-            batch.positionMem,
-            0,
-            positionBufferSize,
-            0,
-            &positionData));
-
-    memcpy(
-        positionData,
-        &batchData.position[0],
-        sizeof(glm::vec3) * batchData.position.size()); // Write only the actual mesh data size.
-
-    vkUnmapMemory(
-        device,
-        batch.positionMem);
+    PROFILE_FUNCTION();
 
-    const size_t actualNormalBufferSize = sizeof(glm::vec3) * batchData.normals.size();
-    const size_t normalBufferSize = static_cast<size_t>(Utils::ToClosestPowerOfTwo(
-        static_cast<float>(actualNormalBufferSize)));
-    vk_create_buffer(
-        device,
-        gpu,
-        normalBufferSize,
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        nullptr,
-        &batch.normalBuffer,
-        &batch.normalMem);
-
-    void *normal_data = nullptr;
-    VK_CHECK(
-        vkMapMemory(
-            device,
-            batch.normalMem,
-            0,
-            normalBufferSize,
-            0,
-            &normal_data));
-
-    memcpy(
-        normal_data,
-        &batchData.normals[0],
-        sizeof(glm::vec3) * batchData.normals.size());
-
-    vkUnmapMemory(
-        device,
-        batch.normalMem);
+    stagingRing.Init(device, &memoryAllocator, StagingRing::DEFAULT_SIZE);
+
+    const bool isGenerated = !generatedScene.meshes.empty();
+
+    const auto sceneMesh = [&](uint32_t mesh_index) -> const BatchCpu &
+    {
+        return isGenerated ? generatedScene.meshes[mesh_index] : batchData;
+    };
+
+    const uint32_t sceneMeshCount = isGenerated ? static_cast<uint32_t>(generatedScene.meshes.size()) : 1;
+
+    const Uint64 uploadStart = SDL_GetPerformanceCounter();
 
-    const size_t actualColorBufferSize = sizeof(glm::vec4) * batchData.color.size();
-    const size_t colorBufferSize = static_cast<size_t>(Utils::ToClosestPowerOfTwo(
-        static_cast<float>(actualColorBufferSize)));
-    vk_create_buffer(
+    // Room for the scene, and for the meshes added at runtime.
+    geometryPool.Init(
         device,
-        gpu,
-        colorBufferSize,
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        nullptr,
-        &batch.colorBuffer,
-        &batch.colorMem);
+        &memoryAllocator,
+        &stagingRing,
+        &defragmenter,
+        GEOMETRY_MEMORY_FLAGS,
+        std::max(GeometryPool::DEFAULT_VERTEX_CAPACITY, static_cast<uint32_t>(sceneVertexCount)),
+        std::max(GeometryPool::DEFAULT_INDEX_CAPACITY, static_cast<uint32_t>(sceneIndexCount)));
+
+    std::vector<uint32_t> meshIds(sceneMeshCount);
+
+    for (uint32_t i = 0; i < sceneMeshCount; i++)
+    {
+        meshIds[i] = geometryPool.AddMesh(sceneMesh(i));
 
-    void *colorData = nullptr;
-    VK_CHECK(vkMapMemory(device, batch.colorMem, 0, colorBufferSize, 0, &colorData));
+        // Not expected: the pool was sized for the whole scene, on a fresh range allocator.
+        if (meshIds[i] == GeometryPool::INVALID_MESH)
+        {
+            throw std::runtime_error("Scene mesh doesn't fit in the geometry pool");
+        }
+    }
 
-    memcpy(colorData, &batchData.color[0], sizeof(glm::vec4) * batchData.color.size());
+    batchMesh = meshIds[0];
 
-    vkUnmapMemory(device, batch.colorMem);
+    drawList.reserve(generatedScene.instances.size());
+    uint64_t drawnIndexCount = 0;
 
-    const size_t actualIndexBufferSize = sizeof(uint32_t) * batchData.indices.size();
-    const size_t indexBufferSize = static_cast<size_t>(Utils::ToClosestPowerOfTwo(
-        static_cast<float>(actualIndexBufferSize)));
-    vk_create_buffer(device, gpu, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        nullptr,
-        &batch.indexBuffer, &batch.indexMem);
+    for (const SceneInstance &instance : generatedScene.instances)
+    {
+        drawList.push_back({meshIds[instance.meshIndex], instance.model});
+        drawnIndexCount += sceneMesh(instance.meshIndex).indices.size();
+    }
 
-    void *index_data = nullptr;
-    VK_CHECK(
-        vkMapMemory(
-            device,
-            batch.indexMem,
-            0,
-            indexBufferSize,
-            0,
-            &index_data));
-
-    memcpy(
-        index_data,
-        &batchData.indices[0],
-        sizeof(uint32_t) * batchData.indices.size());
-
-    vkUnmapMemory(
-        device,
-        batch.indexMem);
+    INDICES_COUNT = drawnIndexCount;
+
+    // Geometry must be resident before the first frame: no point in spreading it over frames.
+    // The generated meshes are read by the flushes, released after this.
+    FlushUploadsAndWait();
+
+    // The pool has its copy now.
+    generatedScene = {};
+
+    const double uploadSeconds = static_cast<double>(SDL_GetPerformanceCounter() - uploadStart) /
+                                 static_cast<double>(SDL_GetPerformanceFrequency());
+
+    sceneLoadMs += uploadSeconds * 1000.0;
+
+    const double uploadMiB = static_cast<double>(
+                                 (sizeof(glm::vec3) * 2 + sizeof(glm::vec4) + sizeof(glm::vec2)) * sceneVertexCount +
+                                 sizeof(uint32_t) * sceneIndexCount) /
+                             (1024.0 * 1024.0);
+
+    printf("\nscene: %u meshes, %zu draws, %llu triangles",
+        sceneMeshCount,
+        drawList.size(),
+        static_cast<unsigned long long>(drawnIndexCount / 3));
+
+    printf("\ngeometry upload (%s): %.2f MiB in %.2f ms, %.1f MiB/s",
+        GEOMETRY_PATH_NAME,
+        uploadMiB,
+        uploadSeconds * 1000.0,
+        uploadMiB / uploadSeconds);
+
+    const GeometryPoolStats poolStats = geometryPool.Stats();
+
+    printf("\ngeometry pool: %llu/%llu vertices, %llu/%llu indices, fragmentation %.2f/%.2f",
+        static_cast<unsigned long long>(poolStats.vertices.used),
+        static_cast<unsigned long long>(poolStats.vertices.capacity),
+        static_cast<unsigned long long>(poolStats.indices.used),
+        static_cast<unsigned long long>(poolStats.indices.capacity),
+        poolStats.vertices.fragmentation,
+        poolStats.indices.fragmentation);
+
+    // In MiB as floating point: small meshes are well under one MiB.
+    const MemoryCounter geometryMemory = memoryAllocator.Budget().Category(MemoryCategory::GEOMETRY);
+
+    printf("\ngeometry memory: %.2f MiB in %u allocations",
+        static_cast<double>(geometryMemory.current) / (1024.0 * 1024.0),
+        geometryMemory.allocationCount);
+}
+
+void Renderer::FlushUploadsAndWait()
+{
+    PROFILE_FUNCTION();
+
+    // Borrow the first frame resources, the main loop is not running yet.
+    const VkCommandBuffer cmd = framesInFlight[0].commandBuffer;
+    const VkSemaphore timeline = frameTimeline.Semaphore();
+
+    while (stagingRing.HasPendingUploads())
+    {
+        VK_CHECK(vkResetCommandPool(device, framesInFlight[0].commandPool, 0));
+
+        VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+        commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        VK_CHECK(vkBeginCommandBuffer(cmd, &commandBufferBeginInfo));
+
+        if (stagingRing.Flush(cmd, 0))
+        {
+            RecordGeometryUploadBarrier(cmd);
+        }
+
+        VK_CHECK(vkEndCommandBuffer(cmd));
+
+        // On the frame timeline like any other submission: the first frame waits for it too.
+        const uint64_t value = frameTimeline.NextValue();
+        framesInFlight[0].submitValue = value;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &value;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &cmd;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timeline;
+
+        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+        frameTimeline.Wait(value);
+
+        stagingRing.Reclaim(0);
+    }
+}
+
+void Renderer::InitCompute()
+{
+    PROFILE_FUNCTION();
+
+    computeScheduler.Init(device, gpu, computeQueueFamilyIndex, computeQueue, queueFamilyIndex,
+        &frameTimeline, config.framesInFlight, allocationCallbacks);
+
+    // Written by the compute family, read by the graphics one.
+    const uint32_t queueFamilies[] = {queueFamilyIndex, computeQueueFamilyIndex};
 
-    printf("\ntotal mem: %zd",
-        (positionBufferSize + normalBufferSize + colorBufferSize + indexBufferSize) /
-        (1024 * 1024));
+    // Generated scenes may hold more draws than the default.
+    const uint32_t cullingCapacity = std::max(GpuCulling::DEFAULT_CAPACITY, static_cast<uint32_t>(drawList.size()));
+
+    culling.Init(device, &memoryAllocator, config.framesInFlight,
+        cullingCapacity, computeScheduler.IsAsync() ? 2 : 1, &queueFamilies[0], pipelineCache.Cache());
+
+    ComputePass cullingPass = {};
+    cullingPass.name = "culling";
+    cullingPass.queue = ComputePassQueue::ASYNC;
+    cullingPass.consumerStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    cullingPass.consumerAccess = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    cullingPass.record = [this](VkCommandBuffer cmd, uint32_t frame_index)
+    {
+        culling.Record(cmd, frame_index);
+    };
+
+    computeScheduler.AddPass(cullingPass);
+}
+
+void Renderer::RecordGeometryUploadBarrier(VkCommandBuffer cmd)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
 }
 
 void Renderer::InitFramebuffers() const
 {
-    for (size_t i = 0; i < surfaceCapabilities.minImageCount; i++)
+    PROFILE_FUNCTION();
+
+    for (uint32_t i = 0; i < presentationFrames.imageCount; i++)
     {
         const VkImageView attachments[3] = {
             framebufferSampleImageView, // Multisample
@@ -979,13 +2371,15 @@ void Renderer::InitFramebuffers() const
             vkCreateFramebuffer(
                 device,
                 &framebufferInfo,
-                nullptr,
+                allocationCallbacks,
                 &presentationFrames.framebuffer[i]));
     }
 }
 
 void Renderer::InitRenderpass()
 {
+    PROFILE_FUNCTION();
+
     VkSampleCountFlagBits sampleCounts = VK_SAMPLE_COUNT_1_BIT;
     vk_query_sample_counts(
         gpu,
@@ -1015,7 +2409,10 @@ void Renderer::InitRenderpass()
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Headless: left ready for the readback copy.
+    colorAttachmentResolve.finalLayout = config.headless
+                                             ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                             : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentResolveRef = {};
     colorAttachmentResolveRef.attachment = 2;
@@ -1063,6 +2460,21 @@ void Renderer::InitRenderpass()
                                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     dependency.dependencyFlags = 0;
 
+    // Headless: the resolve and the transition to TRANSFER_SRC before the readback copy.
+    VkSubpassDependency readbackDependency = {};
+    readbackDependency.srcSubpass = 0;
+    readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    readbackDependency.dependencyFlags = 0;
+
+    const VkSubpassDependency dependencies[2] = {
+        dependency,
+        readbackDependency,
+    };
+
     constexpr uint32_t attachmentDescCount = 3;
     const VkAttachmentDescription attachment_descs[attachmentDescCount] = {
         color_attachment,
@@ -1078,379 +2490,334 @@ void Renderer::InitRenderpass()
     renderPassCreateInfo.pAttachments = &attachment_descs[0];
     renderPassCreateInfo.subpassCount = 1;
     renderPassCreateInfo.pSubpasses = &subpass;
-    renderPassCreateInfo.dependencyCount = 1;
-    renderPassCreateInfo.pDependencies = &dependency;
+    renderPassCreateInfo.dependencyCount = config.headless ? 2 : 1;
+    renderPassCreateInfo.pDependencies = &dependencies[0];
 
-    VK_CHECK(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &renderPass));
+    VK_CHECK(vkCreateRenderPass(device, &renderPassCreateInfo, allocationCallbacks, &renderPass));
 }
 
 void Renderer::InitUniformBuffer()
 {
-    for (uint32_t i = 0; i < FramesInFlightType::MAX_FIF_COUNT; i++)
-    {
-        constexpr VkDeviceSize bufferSize = sizeof(PerFrameDataCpu);
+    PROFILE_FUNCTION();
 
-        vk_create_buffer(device, gpu, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, nullptr,
-            &uniformBufferFrames.buffers[i], &uniformBufferFrames.memory[i]);
-    }
+    // After InitBatch: one PerDrawDataCpu per draw every frame, each padded to the
+    // offset alignment (256 bytes at most), plus the per-frame data.
+    const VkDeviceSize frameSize = std::max(
+        UniformRing::DEFAULT_FRAME_SIZE,
+        static_cast<VkDeviceSize>(drawList.size() + 1) * 256);
+
+    uniformRing.Init(
+        device,
+        gpu,
+        &memoryAllocator,
+        config.framesInFlight,
+        frameSize);
 }
 
-void Renderer::InitPipeline()
+void Renderer::ReadShaders()
 {
-    auto vertShaderCode = FileSystem::ReadFile(
-        "../Resources/Shaders/vert.spv");
-    auto fragShaderCode = FileSystem::ReadFile(
-        "../Resources/Shaders/frag.spv");
-
-    VkShaderModule shaderModules[2] = {};
-
-    VkShaderModuleCreateInfo vertModuleInfo = {};
-    vertModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vertModuleInfo.flags = 0;
-    vertModuleInfo.codeSize = static_cast<uint32_t>(vertShaderCode.size());
-    vertModuleInfo.pCode = reinterpret_cast<const uint32_t *>(vertShaderCode.data());
-
-    VK_CHECK(
-        vkCreateShaderModule(
-            device,
-            &vertModuleInfo,
-            nullptr,
-            &shaderModules[0]));
-
-    VkShaderModuleCreateInfo fragModuleInfo = {};
-    fragModuleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    fragModuleInfo.flags = 0;
-    fragModuleInfo.codeSize = static_cast<uint32_t>(fragShaderCode.size());
-    fragModuleInfo.pCode = reinterpret_cast<const uint32_t *>(fragShaderCode.data());
-
-    VK_CHECK(vkCreateShaderModule(device, &fragModuleInfo, nullptr, &shaderModules[1]));
-
-    VkPipelineShaderStageCreateInfo vertStageInfo = {};
-    vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertStageInfo.flags = 0;
-    vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertStageInfo.module = shaderModules[0];
-    vertStageInfo.pName = "main";
-    vertStageInfo.pSpecializationInfo = nullptr;
-
-    VkPipelineShaderStageCreateInfo fragStageInfo = {};
-    fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragStageInfo.flags = 0;
-    fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragStageInfo.module = shaderModules[1];
-    fragStageInfo.pName = "main";
-    fragStageInfo.pSpecializationInfo = nullptr;
-
-    const VkPipelineShaderStageCreateInfo shaderStages[] = {
-        vertStageInfo,
-        fragStageInfo
-    };
-
-    const std::vector<VkDynamicState> dynamicStates = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR,
-    };
-
-    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCreateInfo.flags = 0;
-    dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
-
-    constexpr VkVertexInputBindingDescription bindDesc[] = {
-        // position
-        {
-            .binding = 0,
-            .stride = sizeof(glm::vec3),
-            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-        },
-        // color.
-        {
-            .binding = 1,
-            .stride = sizeof(glm::vec4),
-            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-        },
-        // normal.
-        {
-            .binding = 2,
-            .stride = sizeof(glm::vec3),
-            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-        }
-    };
+    PROFILE_FUNCTION();
 
-    constexpr VkVertexInputAttributeDescription attributeDescs[3] = {
-        {
-            .location = 0,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = 0
-        },
-        {
-            .location = 1,
-            .binding = 1,
-            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
-            .offset = 0
-        },
-        {
-            .location = 2,
-            .binding = 2,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = 0
-        }
-    };
+    vertShaderCode = FileSystem::ReadFile(
+        "../Resources/Shaders/shader.vert.spv");
+    fragShaderCode = FileSystem::ReadFile(
+        "../Resources/Shaders/shader.frag.spv");
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.flags = 0;
-    vertexInputInfo.vertexBindingDescriptionCount = 3;
-    vertexInputInfo.pVertexBindingDescriptions = &bindDesc[0];
-    vertexInputInfo.vertexAttributeDescriptionCount = 3;
-    vertexInputInfo.pVertexAttributeDescriptions = &attributeDescs[0];
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-    inputAssemblyInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyInfo.pNext = nullptr;
-    inputAssemblyInfo.flags = 0;
-    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-    const VkViewport viewport = {
-        .x = 0.0f,
-        .y = 0.0f,
-        .width = static_cast<float>(surfaceCapabilities.currentExtent.width),
-        .height = static_cast<float>(surfaceCapabilities.currentExtent.height),
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f,
-    };
+    if (config.virtualTexturePath != nullptr)
+    {
+        virtualTextureFragShaderCode = FileSystem::ReadFile(
+            "../Resources/Shaders/shader_vt.frag.spv");
+    }
+}
 
-    const VkRect2D scissor = {
-        .offset = {0, 0},
-        .extent = surfaceCapabilities.currentExtent,
-    };
+void Renderer::InitPipeline()
+{
+    PROFILE_FUNCTION();
 
-    // ReSharper disable once CppVariableCanBeMadeConstexpr
-    VkPipelineViewportStateCreateInfo viewportInfo = {};
-    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportInfo.flags = 0;
-    viewportInfo.viewportCount = 1;
-    viewportInfo.pViewports = &viewport;
-    viewportInfo.scissorCount = 1;
-    viewportInfo.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
-    rasterizationInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizationInfo.flags = 0;
-    rasterizationInfo.depthClampEnable = VK_FALSE;
-    rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
-    rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizationInfo.depthBiasEnable = VK_FALSE;
-    rasterizationInfo.depthBiasConstantFactor = 0.0f;
-    rasterizationInfo.depthBiasClamp = 0.0f;
-    rasterizationInfo.depthBiasSlopeFactor = 0.0f;
-    rasterizationInfo.lineWidth = 1.0f;
+    pipelineRegistry.Init(device, &pipelineCache, PipelineRegistry::DEFAULT_COMPILE_THREADS,
+        hasPipelineExecutableInfo, allocationCallbacks);
 
-    VkSampleCountFlagBits sampleCounts = VK_SAMPLE_COUNT_1_BIT;
-    vk_query_sample_counts(gpu, &sampleCounts);
+    // Per-view and per-draw constants: both live in the uniform ring.
+    VkDescriptorSetLayoutBinding uniformBufferSetBindings[2] = {};
+    uniformBufferSetBindings[0].binding = 0;
+    uniformBufferSetBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uniformBufferSetBindings[0].descriptorCount = 1;
+    uniformBufferSetBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uniformBufferSetBindings[0].pImmutableSamplers = nullptr;
 
-    VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
-    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleInfo.flags = 0;
-    multisampleInfo.rasterizationSamples = sampleCounts;
-    multisampleInfo.sampleShadingEnable = VK_TRUE;
-    multisampleInfo.minSampleShading = 1.0f;
-    multisampleInfo.pSampleMask = nullptr;
-    multisampleInfo.alphaToCoverageEnable = VK_FALSE;
-    multisampleInfo.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.blendEnable = VK_FALSE;
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-    VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
-    colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendInfo.flags = 0;
-    colorBlendInfo.logicOpEnable = VK_FALSE;
-    colorBlendInfo.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendInfo.attachmentCount = 1;
-    colorBlendInfo.pAttachments = &colorBlendAttachment;
-    colorBlendInfo.blendConstants[0] = 0.0f;
-    colorBlendInfo.blendConstants[1] = 0.0f;
-    colorBlendInfo.blendConstants[2] = 0.0f;
-    colorBlendInfo.blendConstants[3] = 0.0f;
-
-    VkDescriptorSetLayoutBinding uniformBufferSetBinding = {};
-    uniformBufferSetBinding.binding = 0;
-    uniformBufferSetBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uniformBufferSetBinding.descriptorCount = 1;
-    uniformBufferSetBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    uniformBufferSetBinding.pImmutableSamplers = nullptr;
+    uniformBufferSetBindings[1] = uniformBufferSetBindings[0];
+    uniformBufferSetBindings[1].binding = 1;
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uniformBufferSetBinding;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = &uniformBufferSetBindings[0];
 
-    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr,
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, allocationCallbacks,
         &descriptorSetLayout));
 
+    // Page table and physical cache of the virtual texture, read by shader_vt.frag.
+    if (hasVirtualTexture)
+    {
+        VkDescriptorSetLayoutBinding virtualTextureBindings[2] = {};
+        virtualTextureBindings[0].binding = 0;
+        virtualTextureBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        virtualTextureBindings[0].descriptorCount = 1;
+        virtualTextureBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        virtualTextureBindings[0].pImmutableSamplers = nullptr;
+
+        virtualTextureBindings[1] = virtualTextureBindings[0];
+        virtualTextureBindings[1].binding = 1;
+
+        VkDescriptorSetLayoutCreateInfo virtualTextureLayoutInfo = {};
+        virtualTextureLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        virtualTextureLayoutInfo.bindingCount = 2;
+        virtualTextureLayoutInfo.pBindings = &virtualTextureBindings[0];
+
+        VK_CHECK(vkCreateDescriptorSetLayout(device, &virtualTextureLayoutInfo, allocationCallbacks,
+            &virtualTextureSetLayout));
+    }
+
+    const VkDescriptorSetLayout setLayouts[2] = {descriptorSetLayout, virtualTextureSetLayout};
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.flags = 0;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.setLayoutCount = hasVirtualTexture ? 2 : 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayouts[0];
     pipelineLayoutInfo.pushConstantRangeCount = 0;
     pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocationCallbacks,
         &pipelineLayout));
 
-    // depth + stencil
-    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
-    depthStencilStateCreateInfo.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
-    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
-    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
-    depthStencilStateCreateInfo.stencilTestEnable = VK_FALSE;
-    depthStencilStateCreateInfo.front = {};
-    depthStencilStateCreateInfo.back = {};
-    depthStencilStateCreateInfo.minDepthBounds = 0.0f;
-    depthStencilStateCreateInfo.maxDepthBounds = 1.0f;
-
-    VkGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.flags = 0;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-    pipelineInfo.pTessellationState = nullptr;
-    pipelineInfo.pViewportState = &viewportInfo;
-    pipelineInfo.pRasterizationState = &rasterizationInfo;
-    pipelineInfo.pMultisampleState = &multisampleInfo;
-    pipelineInfo.pDepthStencilState = &depthStencilStateCreateInfo;
-    pipelineInfo.pColorBlendState = &colorBlendInfo;
-    pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    VkPipelineRasterizationStateCreateInfo rasterizationInfoWireframe = {};
-    rasterizationInfoWireframe.sType =
-        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizationInfoWireframe.flags = 0;
-    rasterizationInfoWireframe.depthClampEnable = VK_FALSE;
-    rasterizationInfoWireframe.rasterizerDiscardEnable = VK_FALSE;
-    rasterizationInfoWireframe.polygonMode = VK_POLYGON_MODE_LINE;
-    rasterizationInfoWireframe.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizationInfoWireframe.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizationInfoWireframe.depthBiasEnable = VK_FALSE;
-    rasterizationInfoWireframe.depthBiasConstantFactor = 0.0f;
-    rasterizationInfoWireframe.depthBiasClamp = 0.0f;
-    rasterizationInfoWireframe.depthBiasSlopeFactor = 0.0f;
-    rasterizationInfoWireframe.lineWidth = 1.0f;
-
-    VkGraphicsPipelineCreateInfo pipelineInfoWireframe = {};
-    pipelineInfoWireframe.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfoWireframe.flags = 0;
-    pipelineInfoWireframe.stageCount = 2;
-    pipelineInfoWireframe.pStages = shaderStages;
-    pipelineInfoWireframe.pVertexInputState = &vertexInputInfo;
-    pipelineInfoWireframe.pInputAssemblyState = &inputAssemblyInfo;
-    pipelineInfoWireframe.pTessellationState = nullptr;
-    pipelineInfoWireframe.pViewportState = &viewportInfo;
-    pipelineInfoWireframe.pRasterizationState = &rasterizationInfoWireframe;
-    pipelineInfoWireframe.pMultisampleState = &multisampleInfo;
-    pipelineInfoWireframe.pDepthStencilState = &depthStencilStateCreateInfo;
-    pipelineInfoWireframe.pColorBlendState = &colorBlendInfo;
-    pipelineInfoWireframe.pDynamicState = &dynamicStateCreateInfo;
-    pipelineInfoWireframe.layout = pipelineLayout;
-    pipelineInfoWireframe.renderPass = renderPass;
-    pipelineInfoWireframe.subpass = 0;
-    pipelineInfoWireframe.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfoWireframe.basePipelineIndex = -1;
-
-    VkGraphicsPipelineCreateInfo pipeline_infos[] = {pipelineInfo,
-                                                     pipelineInfoWireframe};
-
-    VkPipeline pipelines[] = {pipeline, pipelineWireframe};
-
-    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 2, &pipeline_infos[0],
-        nullptr, &pipelines[0]));
-
-    pipeline = pipelines[0];
-    pipelineWireframe = pipelines[1];
-
-    VkDescriptorPoolSize poolSize = {};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = FramesInFlightType::MAX_FIF_COUNT;
+    VkSampleCountFlagBits sampleCounts = VK_SAMPLE_COUNT_1_BIT;
+    vk_query_sample_counts(gpu, &sampleCounts);
+
+    // Position, color, normal and uv, one stream each as the geometry pool stores them.
+    GraphicsPipelineDesc desc = {};
+    desc.vertexShader = pipelineRegistry.AddShader(vertShaderCode);
+    desc.fragmentShader = pipelineRegistry.AddShader(
+        hasVirtualTexture ? virtualTextureFragShaderCode : fragShaderCode);
+
+    desc.vertexBindingCount = 4;
+    desc.vertexBindings[0] = {0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX};
+    desc.vertexBindings[1] = {1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX};
+    desc.vertexBindings[2] = {2, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX};
+    desc.vertexBindings[3] = {3, sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX};
+
+    desc.vertexAttributeCount = 4;
+    desc.vertexAttributes[0] = {0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0};
+    desc.vertexAttributes[1] = {1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0};
+    desc.vertexAttributes[2] = {2, 2, VK_FORMAT_R32G32B32_SFLOAT, 0};
+    desc.vertexAttributes[3] = {3, 3, VK_FORMAT_R32G32_SFLOAT, 0};
+
+    desc.sampleCount = sampleCounts;
+    desc.layout = pipelineLayout;
+    desc.renderPass = renderPass;
+    desc.subpass = 0;
+
+    ShaderVariant variant = {};
+
+    if (config.shaderVariant != nullptr && !ShaderVariant::Parse(config.shaderVariant, &variant))
+    {
+        printf("\nshader variant %s: malformed, using %s", config.shaderVariant, variant.Name().c_str());
+    }
+
+    variant.Specialize(&desc);
+
+    if (hasVirtualTexture)
+    {
+        virtualTexture.Specialize(&desc);
+    }
+
+    meshPipelineDesc = desc;
+
+    // The fill pipeline draws the first frame: waited for. The other modes are requested when first used.
+    const Uint64 pipelineStart = SDL_GetPerformanceCounter();
+
+    meshPipeline = pipelineRegistry.Request(meshPipelineDesc);
+    pipelineRegistry.Wait(meshPipeline);
+
+    // Every other mode falls back to it. The registry printed the VkResult.
+    if (pipelineRegistry.State(meshPipeline) == PipelineState::FAILED)
+    {
+        throw std::runtime_error("Failed to create the mesh pipeline");
+    }
+
+    pipelineMs = static_cast<double>(SDL_GetPerformanceCounter() - pipelineStart) * 1000.0 /
+                 static_cast<double>(SDL_GetPerformanceFrequency());
+
+    printf("\nmesh pipeline %s: %.2f ms, cache %s (%zu bytes loaded)",
+        variant.Name().c_str(),
+        pipelineMs,
+        pipelineCache.IsWarm() ? "warm" : "cold",
+        pipelineCache.LoadedSize());
+
+    // The registry has its modules.
+    vertShaderCode = {};
+    fragShaderCode = {};
+    virtualTextureFragShaderCode = {};
+}
+
+void Renderer::InitDescriptorSets()
+{
+    PROFILE_FUNCTION();
+
+    // The uniform set, and the virtual texture set when there is one.
+    VkDescriptorPoolSize poolSizes[2] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = 2;
 
     VkDescriptorPoolCreateInfo poolCreateInfo = {};
     poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolCreateInfo.maxSets = FramesInFlightType::MAX_FIF_COUNT;
-    poolCreateInfo.poolSizeCount = 1;
-    poolCreateInfo.pPoolSizes = &poolSize;
+    poolCreateInfo.maxSets = hasVirtualTexture ? 2 : 1;
+    poolCreateInfo.poolSizeCount = hasVirtualTexture ? 2 : 1;
+    poolCreateInfo.pPoolSizes = &poolSizes[0];
 
-    VK_CHECK(vkCreateDescriptorPool(device, &poolCreateInfo, nullptr,
+    VK_CHECK(vkCreateDescriptorPool(device, &poolCreateInfo, allocationCallbacks,
         &descriptorPool));
 
-    std::vector<VkDescriptorSetLayout> layouts(FramesInFlightType::MAX_FIF_COUNT,
-        descriptorSetLayout);
-
     VkDescriptorSetAllocateInfo setAllocateInfo = {};
     setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     setAllocateInfo.descriptorPool = descriptorPool;
-    setAllocateInfo.descriptorSetCount = FramesInFlightType::MAX_FIF_COUNT;
-    setAllocateInfo.pSetLayouts = &layouts[0];
+    setAllocateInfo.descriptorSetCount = 1;
+    setAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &setAllocateInfo,
+        &uniformDescriptorSet));
+
+    // Written once: the frame and the draw are selected by the dynamic offsets.
+    VkDescriptorBufferInfo bufferInfos[2] = {};
+    bufferInfos[0].buffer = uniformRing.Buffer();
+    bufferInfos[0].offset = 0;
+    bufferInfos[0].range = sizeof(PerFrameDataCpu);
+
+    bufferInfos[1].buffer = uniformRing.Buffer();
+    bufferInfos[1].offset = 0;
+    bufferInfos[1].range = sizeof(PerDrawDataCpu);
+
+    VkWriteDescriptorSet descriptorSets[2] = {};
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        descriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorSets[i].dstSet = uniformDescriptorSet;
+        descriptorSets[i].dstBinding = i;
+        descriptorSets[i].dstArrayElement = 0;
+        descriptorSets[i].descriptorCount = 1;
+        descriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorSets[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device, 2, &descriptorSets[0], 0, nullptr);
+
+    if (!hasVirtualTexture)
+    {
+        return;
+    }
+
+    setAllocateInfo.pSetLayouts = &virtualTextureSetLayout;
 
     VK_CHECK(vkAllocateDescriptorSets(device, &setAllocateInfo,
-        &uniformBufferFrames.descriptorSets[0]));
+        &virtualTextureDescriptorSet));
 
-    for (size_t i = 0; i < FramesInFlightType::MAX_FIF_COUNT; i++)
+    // Written once too: the images never change, only their content.
+    const VkDescriptorImageInfo imageInfos[2] = {
+        virtualTexture.PageTableDescriptor(),
+        virtualTexture.PhysicalCacheDescriptor(),
+    };
+
+    VkWriteDescriptorSet imageDescriptorSets[2] = {};
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        imageDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        imageDescriptorSets[i].dstSet = virtualTextureDescriptorSet;
+        imageDescriptorSets[i].dstBinding = i;
+        imageDescriptorSets[i].dstArrayElement = 0;
+        imageDescriptorSets[i].descriptorCount = 1;
+        imageDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        imageDescriptorSets[i].pImageInfo = &imageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device, 2, &imageDescriptorSets[0], 0, nullptr);
+}
+
+void Renderer::InitVirtualTexture()
+{
+    PROFILE_FUNCTION();
+
+    if (config.virtualTexturePath == nullptr)
+    {
+        return;
+    }
+
+    VirtualTextureCreateInfo createInfo = {};
+    createInfo.filePath = config.virtualTexturePath;
+    createInfo.framebufferExtent = surfaceCapabilities.currentExtent;
+    createInfo.frameCount = config.framesInFlight;
+
+    // Init throws before creating anything: nothing to clean up.
+    try
+    {
+        virtualTexture.Init(device, &memoryAllocator, createInfo);
+        hasVirtualTexture = true;
+    }
+    catch (const std::runtime_error &error)
     {
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = uniformBufferFrames.buffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(PerFrameDataCpu);
+        printf("\nvirtual texture %s: %s, rendering without it", config.virtualTexturePath, error.what());
+    }
+}
+
+bool Renderer::WriteReadback(uint32_t frame_index, const char *p_path) const
+{
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    // Host coherent: the copy is visible once the submission completed.
+    const auto *pixels = static_cast<const uint8_t *>(framesInFlight[frame_index].readbackMemory.mapped);
 
-        VkWriteDescriptorSet descriptorSet = {};
-        descriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorSet.dstSet = uniformBufferFrames.descriptorSets[i];
-        descriptorSet.dstBinding = 0;
-        descriptorSet.dstArrayElement = 0;
-        descriptorSet.descriptorCount = 1;
-        descriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorSet.pBufferInfo = &bufferInfo;
+    fprintf(file, "P6\n%u %u\n255\n", config.width, config.height);
 
-        vkUpdateDescriptorSets(device, 1, &descriptorSet, 0, nullptr);
+    // PPM has no alpha: RGBA8 rows are written as RGB.
+    std::vector<uint8_t> row(static_cast<size_t>(config.width) * 3);
+
+    for (uint32_t y = 0; y < config.height; y++)
+    {
+        const uint8_t *source = pixels + static_cast<size_t>(y) * config.width * 4;
+
+        for (uint32_t x = 0; x < config.width; x++)
+        {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+
+        fwrite(row.data(), 1, row.size(), file);
     }
 
-    vkDestroyShaderModule(device, shaderModules[0], nullptr);
-    vkDestroyShaderModule(device, shaderModules[1], nullptr);
+    const bool written = ferror(file) == 0;
+    fclose(file);
+
+    return written;
 }
 
 void Renderer::PrepareDepthStencil()
 {
+    PROFILE_FUNCTION();
+
     VkCommandBufferBeginInfo commandBufferBeginInfo = {};
     commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    vkBeginCommandBuffer(framesInFlight.commandBuffer[0], &commandBufferBeginInfo);
+    vkBeginCommandBuffer(framesInFlight[0].commandBuffer, &commandBufferBeginInfo);
 
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1465,17 +2832,17 @@ void Renderer::PrepareDepthStencil()
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
-    vkCmdPipelineBarrier(framesInFlight.commandBuffer[0],
+    vkCmdPipelineBarrier(framesInFlight[0].commandBuffer,
         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
         0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-    vkEndCommandBuffer(framesInFlight.commandBuffer[0]);
+    vkEndCommandBuffer(framesInFlight[0].commandBuffer);
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &framesInFlight.commandBuffer[0];
+    submitInfo.pCommandBuffers = &framesInFlight[0].commandBuffer;
 
     vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
     vkQueueWaitIdle(queue);
@@ -0,0 +1,211 @@
+#include "RendererConfig.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace Renderer
+{
+RendererConfig RendererConfig::FromArgs(int argc, const char *const *argv)
+{
+    RendererConfig config = {};
+
+    // argv[0] is the program.
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+
+        if (std::strcmp(arg, "--host-allocator") == 0)
+        {
+            config.useHostAllocator = true;
+        }
+        else if (std::strncmp(arg, "--record-slices=", 16) == 0)
+        {
+            config.recordSlices = static_cast<uint32_t>(std::strtoul(arg + 16, nullptr, 10));
+        }
+        else if (std::strncmp(arg, "--present-mode=", 15) == 0)
+        {
+            const char *mode = arg + 15;
+
+            if (std::strcmp(mode, "fifo") == 0)
+            {
+                config.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            }
+            else if (std::strcmp(mode, "fifo-relaxed") == 0)
+            {
+                config.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
+            else if (std::strcmp(mode, "mailbox") == 0)
+            {
+                config.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            else if (std::strcmp(mode, "immediate") == 0)
+            {
+                config.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            else
+            {
+                printf("unknown present mode %s, ignored\n", mode);
+            }
+        }
+        else if (std::strncmp(arg, "--max-fps=", 10) == 0)
+        {
+            config.maxFps = static_cast<uint32_t>(std::strtoul(arg + 10, nullptr, 10));
+        }
+        else if (std::strncmp(arg, "--frames-in-flight=", 19) == 0)
+        {
+            config.framesInFlight = std::clamp(
+                static_cast<uint32_t>(std::strtoul(arg + 19, nullptr, 10)),
+                MIN_FRAMES_IN_FLIGHT,
+                MAX_FRAMES_IN_FLIGHT);
+        }
+        else if (std::strcmp(arg, "--headless") == 0)
+        {
+            config.headless = true;
+        }
+        else if (std::strncmp(arg, "--size=", 7) == 0)
+        {
+            char *separator = nullptr;
+            const uint32_t width = static_cast<uint32_t>(std::strtoul(arg + 7, &separator, 10));
+            const uint32_t height = *separator == 'x'
+                                        ? static_cast<uint32_t>(std::strtoul(separator + 1, nullptr, 10))
+                                        : 0;
+
+            if (width != 0 && height != 0)
+            {
+                config.width = width;
+                config.height = height;
+            }
+            else
+            {
+                printf("invalid size %s, ignored\n", arg + 7);
+            }
+        }
+        else if (std::strncmp(arg, "--frames=", 9) == 0)
+        {
+            config.frameCount = static_cast<uint32_t>(std::strtoul(arg + 9, nullptr, 10));
+        }
+        else if (std::strncmp(arg, "--readback=", 11) == 0)
+        {
+            config.readbackPath = arg + 11;
+        }
+        else if (std::strncmp(arg, "--scene=", 8) == 0)
+        {
+            config.scenePath = arg + 8;
+        }
+        else if (std::strcmp(arg, "--benchmark") == 0)
+        {
+            config.benchmark = true;
+        }
+        else if (std::strncmp(arg, "--camera-path=", 14) == 0)
+        {
+            config.cameraPathFile = arg + 14;
+        }
+        else if (std::strncmp(arg, "--benchmark-output=", 19) == 0)
+        {
+            config.benchmarkOutput = arg + 19;
+        }
+        else if (std::strncmp(arg, "--record-camera=", 16) == 0)
+        {
+            config.recordCameraPath = arg + 16;
+        }
+        else if (std::strncmp(arg, "--pipeline-cache=", 17) == 0)
+        {
+            config.pipelineCacheDirectory = arg + 17;
+        }
+        else if (std::strcmp(arg, "--no-pipeline-cache") == 0)
+        {
+            config.pipelineCacheDirectory = nullptr;
+        }
+        else if (std::strncmp(arg, "--shader-variant=", 17) == 0)
+        {
+            config.shaderVariant = arg + 17;
+        }
+        else if (std::strcmp(arg, "--variant-report") == 0)
+        {
+            config.variantReport = true;
+        }
+        else if (std::strncmp(arg, "--virtual-texture=", 18) == 0)
+        {
+            config.virtualTexturePath = arg + 18;
+        }
+        else if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
+        {
+            config.showHelp = true;
+        }
+        else
+        {
+            printf("unknown option %s, ignored\n", arg);
+        }
+    }
+
+    // Comparable numbers: no window, no cap, always the same frame count.
+    if (config.benchmark)
+    {
+        config.headless = true;
+        config.maxFps = 0;
+
+        if (config.frameCount == 0)
+        {
+            config.frameCount = DEFAULT_BENCHMARK_FRAMES;
+        }
+
+        if (config.recordCameraPath != nullptr)
+        {
+            printf("--record-camera records a live session, ignored with --benchmark\n");
+            config.recordCameraPath = nullptr;
+        }
+    }
+
+    // Its own frame count, uncapped: the GPU times compare the variants, not the cap.
+    if (config.variantReport)
+    {
+        config.maxFps = 0;
+
+        if (config.benchmark)
+        {
+            printf("--variant-report renders its own frames, ignored with --benchmark\n");
+            config.variantReport = false;
+        }
+    }
+
+    if (config.readbackPath != nullptr && !config.headless)
+    {
+        printf("--readback needs --headless, ignored\n");
+        config.readbackPath = nullptr;
+    }
+
+    return config;
+}
+
+void RendererConfig::PrintUsage(const char *p_program)
+{
+    printf("usage: %s [options]\n"
+           "  --host-allocator   track the driver host allocations (pooled, per scope and per frame)\n"
+           "  --record-slices=N  record the draw list in at most N parallel slices (0: one per worker)\n"
+           "  --present-mode=M   fifo (default), fifo-relaxed, mailbox or immediate\n"
+           "  --max-fps=N        cap the frame rate to N (default 60, 0: uncapped)\n"
+           "  --frames-in-flight=N  frames recorded ahead of the GPU, 1 to 4 (default 2)\n"
+           "  --headless         render offscreen, without window nor surface\n"
+           "  --size=WxH         extent of the window or the headless images (default 640x480)\n"
+           "  --frames=N         exit after N frames (default 0: run until closed)\n"
+           "  --readback=PATH    headless only, write the last frame to PATH as a PPM image\n"
+           "  --scene=PATH       mesh loaded at startup (default %s)\n"
+           "  --scene=generated:KIND[,key=N...]  synthetic scene instead: KIND instances, grid, clutter,\n"
+           "                     hierarchy or huge-mesh; keys seed, instances, meshes, triangles, depth\n"
+           "  --benchmark        headless, uncapped: replay the camera path and write the frame times\n"
+           "  --camera-path=PATH camera path replayed by --benchmark (default: scripted orbit)\n"
+           "  --benchmark-output=PATH  JSON report of --benchmark (default benchmark.json)\n"
+           "  --record-camera=PATH  save the live camera as a camera path at exit\n"
+           "  --pipeline-cache=DIR  directory of the per-device pipeline cache file (default .)\n"
+           "  --no-pipeline-cache   compile the pipelines cold and don't write the cache\n"
+           "  --shader-variant=K=V[,K=V]  mesh shader toggles: lighting unlit, lambert (default) or\n"
+           "                     half-lambert; debug none (default), normals or lighting\n"
+           "  --variant-report   render every shader variant, print instruction counts and GPU times\n"
+           "  --virtual-texture=PATH  tile file sampled by the meshes, streamed from their feedback\n"
+           "  --help             print this message\n",
+        p_program,
+        DEFAULT_SCENE);
+}
+}
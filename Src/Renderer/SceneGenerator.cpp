@@ -0,0 +1,489 @@
+#include "SceneGenerator.h"
+#include "Renderer.h"
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace Renderer
+{
+namespace
+{
+constexpr SceneKind KINDS[] = {
+    SceneKind::INSTANCES,
+    SceneKind::GRID,
+    SceneKind::CLUTTER,
+    SceneKind::HIERARCHY,
+    SceneKind::HUGE_MESH,
+};
+
+/// Distance between neighbor instances: meshes fit in a sphere of radius ~1.6.
+constexpr float INSTANCE_SPACING = 4.0f;
+
+/// splitmix64: tiny, fast, and the same sequence everywhere.
+struct Random
+{
+    uint64_t state = {};
+
+    uint64_t Next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    /// In [min, max), 24 bits of precision.
+    float Uniform(float min, float max)
+    {
+        const float unit = static_cast<float>(Next() >> 40) * (1.0f / 16777216.0f);
+        return min + (max - min) * unit;
+    }
+
+    /// In [0, count).
+    uint32_t Below(uint32_t count)
+    {
+        return static_cast<uint32_t>(((Next() >> 32) * count) >> 32);
+    }
+
+    glm::vec3 Direction()
+    {
+        // Uniform on the sphere: uniform z and angle around it.
+        const float z = Uniform(-1.0f, 1.0f);
+        const float angle = Uniform(0.0f, glm::two_pi<float>());
+        const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        return {r * std::cos(angle), r * std::sin(angle), z};
+    }
+
+    glm::mat4 Rotation()
+    {
+        return glm::rotate(glm::mat4(1.0f), Uniform(0.0f, glm::two_pi<float>()), Direction());
+    }
+};
+
+glm::mat4 Placement(glm::vec3 position, const glm::mat4 &rotation, float scale)
+{
+    return glm::scale(glm::translate(glm::mat4(1.0f), position) * rotation, glm::vec3(scale));
+}
+}
+
+uint64_t GeneratedScene::TriangleCount() const
+{
+    uint64_t triangles = 0;
+
+    for (const SceneInstance &instance : instances)
+    {
+        triangles += meshes[instance.meshIndex].indices.size() / 3;
+    }
+
+    return triangles;
+}
+
+bool SceneGenerator::Parse(const char *p_spec, SceneDesc *p_desc)
+{
+    SceneDesc desc = *p_desc;
+
+    const size_t kindLength = strcspn(p_spec, ",");
+    bool isKnownKind = false;
+
+    for (const SceneKind kind : KINDS)
+    {
+        const char *name = KindName(kind);
+
+        if (strlen(name) == kindLength && strncmp(p_spec, name, kindLength) == 0)
+        {
+            desc.kind = kind;
+            isKnownKind = true;
+        }
+    }
+
+    if (!isKnownKind)
+    {
+        return false;
+    }
+
+    const char *cursor = p_spec + kindLength;
+
+    while (*cursor == ',')
+    {
+        cursor++;
+
+        char key[16] = {};
+        unsigned int value = 0;
+        int consumed = 0;
+
+        if (sscanf(cursor, "%15[a-z]=%u%n", key, &value, &consumed) != 2)
+        {
+            return false;
+        }
+
+        cursor += consumed;
+
+        if (strcmp(key, "seed") == 0)
+        {
+            desc.seed = value;
+        }
+        else if (strcmp(key, "instances") == 0)
+        {
+            desc.instanceCount = value;
+        }
+        else if (strcmp(key, "meshes") == 0)
+        {
+            desc.meshCount = value;
+        }
+        else if (strcmp(key, "triangles") == 0)
+        {
+            desc.trianglesPerMesh = value;
+        }
+        else if (strcmp(key, "depth") == 0)
+        {
+            desc.depth = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (*cursor != '\0')
+    {
+        return false;
+    }
+
+    *p_desc = desc;
+
+    return true;
+}
+
+void SceneGenerator::Generate(const SceneDesc &desc, GeneratedScene *p_scene)
+{
+    *p_scene = {};
+
+    const bool isHugeMesh = desc.kind == SceneKind::HUGE_MESH;
+    const uint32_t meshCount = isHugeMesh ? 1 : std::max(1u, desc.meshCount);
+    const uint32_t instanceCount = isHugeMesh ? 1 : desc.instanceCount;
+
+    // Each mesh has a seed of its own: changing meshCount keeps the first meshes as they were.
+    p_scene->meshes.resize(meshCount);
+
+    for (uint32_t i = 0; i < meshCount; i++)
+    {
+        GenerateMesh(desc.trianglesPerMesh, static_cast<uint64_t>(desc.seed) * 1000003 + i, &p_scene->meshes[i]);
+    }
+
+    Random random = {static_cast<uint64_t>(desc.seed)};
+    p_scene->instances.resize(instanceCount);
+
+    const float cubeSide = INSTANCE_SPACING * std::cbrt(static_cast<float>(instanceCount));
+    const uint32_t gridColumns = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount)))));
+    const uint32_t depth = std::max(1u, desc.depth);
+
+    for (uint32_t i = 0; i < instanceCount; i++)
+    {
+        SceneInstance &instance = p_scene->instances[i];
+        instance.meshIndex = random.Below(meshCount);
+
+        switch (desc.kind)
+        {
+            case SceneKind::INSTANCES:
+            {
+                const glm::vec3 position = {
+                    random.Uniform(-0.5f, 0.5f) * cubeSide,
+                    random.Uniform(-0.5f, 0.5f) * cubeSide,
+                    random.Uniform(-0.5f, 0.5f) * cubeSide,
+                };
+
+                instance.local = Placement(position, random.Rotation(), random.Uniform(0.5f, 1.5f));
+                break;
+            }
+            case SceneKind::GRID:
+            {
+                const float half = 0.5f * INSTANCE_SPACING * static_cast<float>(gridColumns - 1);
+                const glm::vec3 position = {
+                    static_cast<float>(i % gridColumns) * INSTANCE_SPACING - half,
+                    0.0f,
+                    static_cast<float>(i / gridColumns) * INSTANCE_SPACING - half,
+                };
+
+                const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f),
+                    random.Uniform(0.0f, glm::two_pi<float>()), glm::vec3(0.0f, 1.0f, 0.0f));
+
+                instance.local = Placement(position, rotation, 1.0f);
+                break;
+            }
+            case SceneKind::CLUTTER:
+            {
+                // Four times denser than GRID, on a thin slab: overdraw and overlapping bounds.
+                const float side = 0.5f * INSTANCE_SPACING * std::sqrt(static_cast<float>(instanceCount));
+                const glm::vec3 position = {
+                    random.Uniform(-0.5f, 0.5f) * side,
+                    random.Uniform(0.0f, 2.0f),
+                    random.Uniform(-0.5f, 0.5f) * side,
+                };
+
+                // Log-uniform in [0.02, 2]: pebbles to boulders.
+                const float scale = 0.02f * std::pow(100.0f, random.Uniform(0.0f, 1.0f));
+
+                instance.local = Placement(position, random.Rotation(), scale);
+                break;
+            }
+            case SceneKind::HIERARCHY:
+            {
+                if (i % depth == 0)
+                {
+                    const float side = cubeSide / std::cbrt(static_cast<float>(depth));
+                    const glm::vec3 position = {
+                        random.Uniform(-0.5f, 0.5f) * side,
+                        random.Uniform(-0.5f, 0.5f) * side,
+                        random.Uniform(-0.5f, 0.5f) * side,
+                    };
+
+                    instance.local = Placement(position, random.Rotation(), 1.0f);
+                }
+                else
+                {
+                    // A small turn at every joint: the chains curl, every level matters.
+                    const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f),
+                        random.Uniform(0.1f, 0.4f), random.Direction());
+
+                    instance.parent = static_cast<int32_t>(i - 1);
+                    instance.local = Placement(glm::vec3(0.0f, 2.0f, 0.0f), rotation, 0.97f);
+                }
+                break;
+            }
+            case SceneKind::HUGE_MESH:
+                break;
+        }
+
+        instance.model = instance.parent < 0
+                             ? instance.local
+                             : p_scene->instances[instance.parent].model * instance.local;
+    }
+}
+
+void SceneGenerator::Flatten(const GeneratedScene &scene, BatchCpu *p_batch)
+{
+    *p_batch = {};
+
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+
+    for (const SceneInstance &instance : scene.instances)
+    {
+        vertexCount += scene.meshes[instance.meshIndex].position.size();
+        indexCount += scene.meshes[instance.meshIndex].indices.size();
+    }
+
+    p_batch->position.reserve(vertexCount);
+    p_batch->normals.reserve(vertexCount);
+    p_batch->color.reserve(vertexCount);
+    p_batch->uvs.reserve(vertexCount);
+    p_batch->indices.reserve(indexCount);
+
+    for (const SceneInstance &instance : scene.instances)
+    {
+        const BatchCpu &mesh = scene.meshes[instance.meshIndex];
+        const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+        const uint32_t baseIndex = static_cast<uint32_t>(p_batch->position.size());
+
+        for (size_t i = 0; i < mesh.position.size(); i++)
+        {
+            p_batch->position.emplace_back(instance.model * glm::vec4(mesh.position[i], 1.0f));
+            p_batch->normals.push_back(glm::normalize(normalMatrix * mesh.normals[i]));
+        }
+
+        p_batch->color.insert(p_batch->color.end(), mesh.color.begin(), mesh.color.end());
+        p_batch->uvs.insert(p_batch->uvs.end(), mesh.uvs.begin(), mesh.uvs.end());
+
+        for (const uint32_t index : mesh.indices)
+        {
+            p_batch->indices.push_back(baseIndex + index);
+        }
+    }
+}
+
+bool SceneGenerator::WriteObj(const GeneratedScene &scene, const char *p_path)
+{
+    FILE *file = fopen(p_path, "wb");
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    // One object per instance, written as it is baked: no flattened copy of the whole scene in memory.
+    uint64_t baseIndex = 1;
+
+    for (size_t i = 0; i < scene.instances.size(); i++)
+    {
+        const SceneInstance &instance = scene.instances[i];
+        const BatchCpu &mesh = scene.meshes[instance.meshIndex];
+        const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+
+        fprintf(file, "o instance_%zu\n", i);
+
+        for (const glm::vec3 &position : mesh.position)
+        {
+            const glm::vec3 world = glm::vec3(instance.model * glm::vec4(position, 1.0f));
+            fprintf(file, "v %.6g %.6g %.6g\n", world.x, world.y, world.z);
+        }
+
+        for (const glm::vec3 &normal : mesh.normals)
+        {
+            const glm::vec3 world = glm::normalize(normalMatrix * normal);
+            fprintf(file, "vn %.6g %.6g %.6g\n", world.x, world.y, world.z);
+        }
+
+        for (const glm::vec2 &uv : mesh.uvs)
+        {
+            fprintf(file, "vt %.6g %.6g\n", uv.x, uv.y);
+        }
+
+        for (size_t j = 0; j < mesh.indices.size(); j += 3)
+        {
+            const unsigned long long a = baseIndex + mesh.indices[j + 0];
+            const unsigned long long b = baseIndex + mesh.indices[j + 1];
+            const unsigned long long c = baseIndex + mesh.indices[j + 2];
+
+            fprintf(file, "f %llu/%llu/%llu %llu/%llu/%llu %llu/%llu/%llu\n", a, a, a, b, b, b, c, c, c);
+        }
+
+        baseIndex += mesh.position.size();
+    }
+
+    const bool written = ferror(file) == 0;
+    fclose(file);
+
+    return written;
+}
+
+const char *SceneGenerator::KindName(SceneKind kind)
+{
+    switch (kind)
+    {
+        case SceneKind::INSTANCES: return "instances";
+        case SceneKind::GRID: return "grid";
+        case SceneKind::CLUTTER: return "clutter";
+        case SceneKind::HIERARCHY: return "hierarchy";
+        case SceneKind::HUGE_MESH: return "huge-mesh";
+    }
+
+    return "unknown";
+}
+
+void SceneGenerator::GenerateMesh(uint32_t triangle_count, uint64_t seed, BatchCpu *p_mesh)
+{
+    *p_mesh = {};
+
+    Random random = {seed};
+
+    // A sphere of r rings and s segments has 2 s (r - 1) triangles (one per quad at the poles).
+    // s = 2 (r - 1) keeps the quads about square.
+    const uint32_t bands = std::max(1u, static_cast<uint32_t>(std::lround(std::sqrt(static_cast<double>(triangle_count)) / 2.0)));
+    const uint32_t rings = bands + 1;
+    const uint32_t segments = std::max(3u, static_cast<uint32_t>(std::lround(static_cast<double>(triangle_count) / (2.0 * bands))));
+
+    // Ellipsoid with a few lobes: every mesh has a shape and bounds of its own.
+    const glm::vec3 stretch = {
+        random.Uniform(0.6f, 1.4f),
+        random.Uniform(0.6f, 1.4f),
+        random.Uniform(0.6f, 1.4f),
+    };
+
+    constexpr uint32_t LOBE_COUNT = 3;
+    glm::vec3 lobeDirections[LOBE_COUNT] = {};
+    float lobeFrequencies[LOBE_COUNT] = {};
+    float lobePhases[LOBE_COUNT] = {};
+
+    for (uint32_t i = 0; i < LOBE_COUNT; i++)
+    {
+        lobeDirections[i] = random.Direction();
+        lobeFrequencies[i] = random.Uniform(1.0f, 4.0f);
+        lobePhases[i] = random.Uniform(0.0f, glm::two_pi<float>());
+    }
+
+    const glm::vec4 color = {random.Uniform(0.25f, 0.9f), random.Uniform(0.25f, 0.9f), random.Uniform(0.25f, 0.9f), 1.0f};
+
+    const size_t vertexCount = static_cast<size_t>(rings + 1) * (segments + 1);
+    p_mesh->position.reserve(vertexCount);
+    p_mesh->uvs.reserve(vertexCount);
+
+    for (uint32_t ring = 0; ring <= rings; ring++)
+    {
+        const float theta = glm::pi<float>() * static_cast<float>(ring) / static_cast<float>(rings);
+
+        for (uint32_t segment = 0; segment <= segments; segment++)
+        {
+            const float phi = glm::two_pi<float>() * static_cast<float>(segment) / static_cast<float>(segments);
+            const glm::vec3 direction = {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+
+            float radius = 1.0f;
+
+            for (uint32_t i = 0; i < LOBE_COUNT; i++)
+            {
+                radius += 0.05f * std::sin(glm::dot(direction, lobeDirections[i]) * lobeFrequencies[i] * glm::pi<float>() + lobePhases[i]);
+            }
+
+            p_mesh->position.push_back(direction * radius * stretch);
+            p_mesh->uvs.emplace_back(static_cast<float>(segment) / static_cast<float>(segments),
+                static_cast<float>(ring) / static_cast<float>(rings));
+        }
+    }
+
+    p_mesh->color.assign(vertexCount, color);
+
+    // Counter clockwise seen from outside.
+    p_mesh->indices.reserve(static_cast<size_t>(segments) * bands * 6);
+
+    for (uint32_t ring = 0; ring < rings; ring++)
+    {
+        for (uint32_t segment = 0; segment < segments; segment++)
+        {
+            const uint32_t v00 = ring * (segments + 1) + segment;
+            const uint32_t v01 = v00 + 1;
+            const uint32_t v10 = v00 + segments + 1;
+            const uint32_t v11 = v10 + 1;
+
+            // The other triangle of the pole quads is degenerate.
+            if (ring != 0)
+            {
+                p_mesh->indices.insert(p_mesh->indices.end(), {v00, v01, v10});
+            }
+
+            if (ring != rings - 1)
+            {
+                p_mesh->indices.insert(p_mesh->indices.end(), {v01, v11, v10});
+            }
+        }
+    }
+
+    // Area weighted face normals: the lobes make the sphere normals wrong.
+    p_mesh->normals.assign(vertexCount, glm::vec3(0.0f));
+
+    for (size_t i = 0; i < p_mesh->indices.size(); i += 3)
+    {
+        const uint32_t a = p_mesh->indices[i + 0];
+        const uint32_t b = p_mesh->indices[i + 1];
+        const uint32_t c = p_mesh->indices[i + 2];
+
+        const glm::vec3 normal = glm::cross(p_mesh->position[b] - p_mesh->position[a],
+            p_mesh->position[c] - p_mesh->position[a]);
+
+        p_mesh->normals[a] += normal;
+        p_mesh->normals[b] += normal;
+        p_mesh->normals[c] += normal;
+    }
+
+    for (glm::vec3 &normal : p_mesh->normals)
+    {
+        // Pole vertices of the degenerate triangles may have none.
+        normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+}
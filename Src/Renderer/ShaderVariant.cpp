@@ -0,0 +1,182 @@
+#include "ShaderVariant.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+namespace Renderer
+{
+void ShaderVariant::Specialize(GraphicsPipelineDesc *p_desc) const
+{
+    static_assert(DEBUG_VIEW_CONSTANT < GraphicsPipelineDesc::MAX_SPECIALIZATION_CONSTANTS);
+
+    p_desc->specializationCount = std::max(p_desc->specializationCount, DEBUG_VIEW_CONSTANT + 1);
+    p_desc->specialization[LIGHTING_MODEL_CONSTANT] = static_cast<uint32_t>(lightingModel);
+    p_desc->specialization[DEBUG_VIEW_CONSTANT] = static_cast<uint32_t>(debugView);
+}
+
+std::string ShaderVariant::Name() const
+{
+    return std::string(LightingModelName(lightingModel)) + "/" + DebugViewName(debugView);
+}
+
+bool ShaderVariant::Parse(const char *p_spec, ShaderVariant *p_variant)
+{
+    ShaderVariant variant = *p_variant;
+
+    const char *cursor = p_spec;
+
+    while (*cursor != '\0')
+    {
+        char key[16] = {};
+        char value[16] = {};
+        int consumed = 0;
+
+        if (sscanf(cursor, "%15[a-z]=%15[a-z-]%n", key, value, &consumed) != 2)
+        {
+            return false;
+        }
+
+        cursor += consumed;
+        bool isKnownValue = false;
+
+        if (strcmp(key, "lighting") == 0)
+        {
+            for (uint32_t i = 0; i < static_cast<uint32_t>(LightingModel::COUNT); i++)
+            {
+                if (strcmp(value, LightingModelName(static_cast<LightingModel>(i))) == 0)
+                {
+                    variant.lightingModel = static_cast<LightingModel>(i);
+                    isKnownValue = true;
+                }
+            }
+        }
+        else if (strcmp(key, "debug") == 0)
+        {
+            for (uint32_t i = 0; i < static_cast<uint32_t>(DebugView::COUNT); i++)
+            {
+                if (strcmp(value, DebugViewName(static_cast<DebugView>(i))) == 0)
+                {
+                    variant.debugView = static_cast<DebugView>(i);
+                    isKnownValue = true;
+                }
+            }
+        }
+
+        if (!isKnownValue)
+        {
+            return false;
+        }
+
+        if (*cursor == ',')
+        {
+            cursor++;
+        }
+    }
+
+    *p_variant = variant;
+
+    return true;
+}
+
+std::vector<ShaderVariant> ShaderVariant::All()
+{
+    std::vector<ShaderVariant> variants = {};
+
+    for (uint32_t lighting = 0; lighting < static_cast<uint32_t>(LightingModel::COUNT); lighting++)
+    {
+        for (uint32_t debug = 0; debug < static_cast<uint32_t>(DebugView::COUNT); debug++)
+        {
+            ShaderVariant variant = {};
+            variant.lightingModel = static_cast<LightingModel>(lighting);
+            variant.debugView = static_cast<DebugView>(debug);
+            variants.push_back(variant);
+        }
+    }
+
+    return variants;
+}
+
+const char *ShaderVariant::LightingModelName(LightingModel lighting_model)
+{
+    switch (lighting_model)
+    {
+        case LightingModel::UNLIT:
+            return "unlit";
+        case LightingModel::LAMBERT:
+            return "lambert";
+        case LightingModel::HALF_LAMBERT:
+            return "half-lambert";
+        default:
+            assert(false && "Unknown lighting model");
+            return "unknown";
+    }
+}
+
+const char *ShaderVariant::DebugViewName(DebugView debug_view)
+{
+    switch (debug_view)
+    {
+        case DebugView::NONE:
+            return "none";
+        case DebugView::NORMALS:
+            return "normals";
+        case DebugView::LIGHTING:
+            return "lighting";
+        default:
+            assert(false && "Unknown debug view");
+            return "unknown";
+    }
+}
+
+void ShaderVariant::PrintReport(const std::vector<ShaderVariantStats> &stats)
+{
+    printf("\nshader variants:");
+    printf("\n  %-24s %12s %12s %12s", "variant", "vs instr.", "fs instr.", "main pass");
+
+    for (const ShaderVariantStats &variantStats : stats)
+    {
+        // An executable covering several stages (merged by the driver) counts as the vertex one.
+        uint64_t vertexInstructions = 0;
+        uint64_t fragmentInstructions = 0;
+
+        for (const PipelineExecutableStats &executable : variantStats.executables)
+        {
+            if ((executable.stages & VK_SHADER_STAGE_VERTEX_BIT) != 0)
+            {
+                vertexInstructions += executable.instructionCount;
+            }
+            else if ((executable.stages & VK_SHADER_STAGE_FRAGMENT_BIT) != 0)
+            {
+                fragmentInstructions += executable.instructionCount;
+            }
+        }
+
+        char vertexColumn[24] = "-";
+        char fragmentColumn[24] = "-";
+        char gpuColumn[24] = "-";
+
+        if (vertexInstructions != 0)
+        {
+            snprintf(vertexColumn, sizeof(vertexColumn), "%llu", static_cast<unsigned long long>(vertexInstructions));
+        }
+
+        if (fragmentInstructions != 0)
+        {
+            snprintf(fragmentColumn, sizeof(fragmentColumn), "%llu", static_cast<unsigned long long>(fragmentInstructions));
+        }
+
+        if (variantStats.gpuFrameCount != 0)
+        {
+            snprintf(gpuColumn, sizeof(gpuColumn), "%.3f ms", variantStats.gpuMsSum / variantStats.gpuFrameCount);
+        }
+
+        printf("\n  %-24s %12s %12s %12s",
+            variantStats.variant.Name().c_str(),
+            vertexColumn,
+            fragmentColumn,
+            gpuColumn);
+    }
+}
+}
@@ -0,0 +1,285 @@
+#include "StagingRing.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace Renderer
+{
+void StagingRing::Init(
+    VkDevice device,
+    DeviceMemoryAllocator *p_memory_allocator,
+    VkDeviceSize size)
+{
+    this->device = device;
+    memoryAllocator = p_memory_allocator;
+    capacity = size;
+    head = 0;
+    tail = 0;
+    used = 0;
+
+    vk_create_buffer(
+        device,
+        memoryAllocator,
+        capacity,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        MemoryCategory::STAGING,
+        memoryAllocator->AllocationCallbacks(),
+        &buffer,
+        &memory);
+
+    assert(memory.mapped != nullptr);
+}
+
+void StagingRing::Teardown()
+{
+    vkDestroyBuffer(device, buffer, memoryAllocator->AllocationCallbacks());
+    memoryAllocator->Free(&memory);
+
+    pendingUploads.clear();
+    inFlightRanges.clear();
+    copyBatches.clear();
+}
+
+void StagingRing::Upload(
+    VkBuffer dst_buffer,
+    VkDeviceSize dst_offset,
+    const void *p_data,
+    VkDeviceSize size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    PendingUpload upload = {};
+    upload.dstBuffer = dst_buffer;
+    upload.dstOffset = dst_offset;
+    upload.data = static_cast<const uint8_t *>(p_data);
+    upload.size = size;
+
+    pendingUploads.push_back(upload);
+}
+
+bool StagingRing::Flush(VkCommandBuffer cmd, uint32_t frame_index)
+{
+    flushBytes = 0;
+    copyBatchCount = 0;
+
+    uint8_t *mapped = static_cast<uint8_t *>(memory.mapped);
+
+    // FIFO: uploads land in the order they were requested.
+    while (!pendingUploads.empty())
+    {
+        PendingUpload &upload = pendingUploads.front();
+
+        const VkDeviceSize remaining = upload.size - upload.uploaded;
+        VkDeviceSize ringOffset = 0;
+        VkDeviceSize chunkSize = 0;
+
+        if (!Reserve(remaining, &ringOffset, &chunkSize))
+        {
+            // Ring full, the rest goes with the next frames.
+            break;
+        }
+
+        memcpy(mapped + ringOffset, upload.data + upload.uploaded, chunkSize);
+
+        VkBufferCopy region = {};
+        region.srcOffset = ringOffset;
+        region.dstOffset = upload.dstOffset + upload.uploaded;
+        region.size = chunkSize;
+
+        AddRegion(upload.dstBuffer, region);
+
+        upload.uploaded += chunkSize;
+        stats.uploadedBytes += chunkSize;
+
+        if (upload.uploaded == upload.size)
+        {
+            pendingUploads.pop_front();
+        }
+    }
+
+    if (copyBatchCount == 0)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < copyBatchCount; i++)
+    {
+        const CopyBatch &batch = copyBatches[i];
+
+        vkCmdCopyBuffer(
+            cmd,
+            buffer,
+            batch.dstBuffer,
+            static_cast<uint32_t>(batch.regions.size()),
+            batch.regions.data());
+
+        stats.copyCommands++;
+        stats.copyRegions += batch.regions.size();
+    }
+
+    InFlightRange range = {};
+    range.frameIndex = frame_index;
+    range.end = head;
+    range.size = flushBytes;
+
+    inFlightRanges.push_back(range);
+
+    return true;
+}
+
+void StagingRing::FlushedRanges(std::vector<StagingFlushRange> *p_ranges) const
+{
+    p_ranges->resize(copyBatchCount);
+
+    for (uint32_t i = 0; i < copyBatchCount; i++)
+    {
+        (*p_ranges)[i].buffer = copyBatches[i].dstBuffer;
+        (*p_ranges)[i].offset = copyBatches[i].dstBegin;
+        (*p_ranges)[i].size = copyBatches[i].dstEnd - copyBatches[i].dstBegin;
+    }
+}
+
+void StagingRing::Reclaim(uint32_t frame_index)
+{
+    // Frames complete in submission order, so their ranges are at the front.
+    while (!inFlightRanges.empty() && inFlightRanges.front().frameIndex == frame_index)
+    {
+        const InFlightRange &range = inFlightRanges.front();
+
+        tail = range.end;
+        used -= range.size;
+
+        inFlightRanges.pop_front();
+    }
+
+    if (used == 0)
+    {
+        // Empty: restart from the beginning, the largest run possible.
+        head = 0;
+        tail = 0;
+    }
+}
+
+void StagingRing::RetargetUploads(VkBuffer old_buffer, VkBuffer new_buffer)
+{
+    // Copies already recorded target the old buffer: the mover copies after them.
+    for (PendingUpload &upload : pendingUploads)
+    {
+        if (upload.dstBuffer == old_buffer)
+        {
+            upload.dstBuffer = new_buffer;
+        }
+    }
+}
+
+bool StagingRing::HasPendingUploads() const
+{
+    return !pendingUploads.empty();
+}
+
+StagingRingStats StagingRing::Stats() const
+{
+    StagingRingStats result = stats;
+    result.inFlightBytes = used;
+    return result;
+}
+
+bool StagingRing::Reserve(
+    VkDeviceSize size,
+    VkDeviceSize *p_offset,
+    VkDeviceSize *p_reserved)
+{
+    if (used == capacity)
+    {
+        return false;
+    }
+
+    const VkDeviceSize minSize = std::min(size, MIN_CHUNK_SIZE);
+    const VkDeviceSize alignedHead = std::min(
+        (head + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT,
+        capacity);
+    const VkDeviceSize padding = alignedHead - head;
+
+    if (head >= tail)
+    {
+        // Free space is [head, capacity) and [0, tail).
+        const VkDeviceSize endFree = capacity - alignedHead;
+
+        if (endFree >= minSize)
+        {
+            *p_offset = alignedHead;
+            *p_reserved = std::min(size, endFree);
+
+            used += padding + *p_reserved;
+            flushBytes += padding + *p_reserved;
+            head = alignedHead + *p_reserved;
+            return true;
+        }
+
+        // Wrap, the end of the ring is wasted until the tail passes it.
+        if (tail >= minSize)
+        {
+            const VkDeviceSize waste = capacity - head;
+
+            *p_offset = 0;
+            *p_reserved = std::min(size, tail);
+
+            used += waste + *p_reserved;
+            flushBytes += waste + *p_reserved;
+            head = *p_reserved;
+            return true;
+        }
+
+        return false;
+    }
+
+    // Free space is [head, tail).
+    if (alignedHead < tail && tail - alignedHead >= minSize)
+    {
+        *p_offset = alignedHead;
+        *p_reserved = std::min(size, tail - alignedHead);
+
+        used += padding + *p_reserved;
+        flushBytes += padding + *p_reserved;
+        head = alignedHead + *p_reserved;
+        return true;
+    }
+
+    return false;
+}
+
+void StagingRing::AddRegion(VkBuffer dst_buffer, const VkBufferCopy &region)
+{
+    // Coalesce every region with the same destination in one vkCmdCopyBuffer.
+    // A frame touches a handful of buffers, a linear search is enough.
+    for (uint32_t i = 0; i < copyBatchCount; i++)
+    {
+        if (copyBatches[i].dstBuffer == dst_buffer)
+        {
+            CopyBatch &batch = copyBatches[i];
+            batch.regions.push_back(region);
+            batch.dstBegin = std::min(batch.dstBegin, region.dstOffset);
+            batch.dstEnd = std::max(batch.dstEnd, region.dstOffset + region.size);
+            return;
+        }
+    }
+
+    if (copyBatchCount == copyBatches.size())
+    {
+        copyBatches.emplace_back();
+    }
+
+    CopyBatch &batch = copyBatches[copyBatchCount++];
+    batch.dstBuffer = dst_buffer;
+    batch.regions.clear();
+    batch.regions.push_back(region);
+    batch.dstBegin = region.dstOffset;
+    batch.dstEnd = region.dstOffset + region.size;
+}
+}
@@ -0,0 +1,205 @@
+#include "TaskGraph.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <cassert>
+#include <cstdio>
+
+namespace Renderer
+{
+TaskGraph::TaskId TaskGraph::Add(
+    const char *name,
+    TaskThread thread,
+    std::initializer_list<TaskId> dependencies,
+    Function function)
+{
+    const TaskId id = static_cast<TaskId>(tasks.size());
+
+    Task task = {};
+    task.function = std::move(function);
+    task.thread = thread;
+    task.dependencyCount = static_cast<uint32_t>(dependencies.size());
+
+    for (const TaskId dependency : dependencies)
+    {
+        assert(dependency < id && "A task can only depend on the tasks added before it");
+        tasks[dependency].dependents.push_back(id);
+    }
+
+    tasks.push_back(std::move(task));
+
+    TaskTiming timing = {};
+    timing.name = name;
+    timing.isMainThread = thread == TaskThread::MAIN;
+    timings.push_back(timing);
+
+    return id;
+}
+
+void TaskGraph::Run(ThreadPool *p_thread_pool)
+{
+    threadPool = p_thread_pool;
+    runStartNs = Profiler::NowNs();
+
+    {
+        std::lock_guard lock(mutex);
+
+        pendingCount = static_cast<uint32_t>(tasks.size());
+
+        for (Task &task : tasks)
+        {
+            task.remaining = task.dependencyCount;
+        }
+    }
+
+    for (TaskId id = 0; id < tasks.size(); id++)
+    {
+        if (tasks[id].dependencyCount == 0)
+        {
+            Dispatch(id);
+        }
+    }
+
+    // The calling thread runs the MAIN tasks until every task is done.
+    for (;;)
+    {
+        TaskId id = {};
+
+        {
+            std::unique_lock lock(mutex);
+            mainTaskReady.wait(lock, [this]
+            {
+                return pendingCount == 0 || !mainTasks.empty();
+            });
+
+            if (mainTasks.empty())
+            {
+                break;
+            }
+
+            id = mainTasks.front();
+            mainTasks.pop_front();
+        }
+
+        Execute(id);
+    }
+
+    runMs = static_cast<double>(Profiler::NowNs() - runStartNs) / 1'000'000.0;
+
+    // Every task is done: no worker uses the graph anymore.
+    for (const Task &task : tasks)
+    {
+        if (task.exception != nullptr)
+        {
+            std::rethrow_exception(task.exception);
+        }
+    }
+}
+
+const std::vector<TaskTiming> &TaskGraph::Timings() const
+{
+    return timings;
+}
+
+void TaskGraph::PrintTimings(const char *p_title) const
+{
+    double taskMs = 0.0;
+
+    printf("\n%s:", p_title);
+
+    for (const TaskTiming &timing : timings)
+    {
+        printf("\n  %-16s %8.2f -> %8.2f ms (%7.2f ms, %s)",
+            timing.name,
+            timing.startMs,
+            timing.endMs,
+            timing.endMs - timing.startMs,
+            timing.isMainThread ? "main" : "worker");
+
+        taskMs += timing.endMs - timing.startMs;
+    }
+
+    // Above 1: the tasks overlapped.
+    printf("\n  wall clock %.2f ms for %.2f ms of tasks (%.2fx)", runMs, taskMs, runMs > 0.0 ? taskMs / runMs : 0.0);
+}
+
+void TaskGraph::Dispatch(TaskId id)
+{
+    if (tasks[id].thread == TaskThread::MAIN)
+    {
+        // Notified under the lock, as in Execute: the main thread may run it and return right away.
+        std::lock_guard lock(mutex);
+        mainTasks.push_back(id);
+        mainTaskReady.notify_one();
+    }
+    else
+    {
+        threadPool->Submit([this, id]()
+        {
+            Execute(id);
+        });
+    }
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+    Task &task = tasks[id];
+
+    TaskTiming &timing = timings[id];
+    timing.startMs = static_cast<double>(Profiler::NowNs() - runStartNs) / 1'000'000.0;
+
+    // Set before the dispatch, under the lock: no other thread writes it anymore.
+    if (!task.isSkipped)
+    {
+        PROFILE_ZONE(timing.name);
+
+        // Caught here: escaping a ThreadPool job would terminate the program.
+        try
+        {
+            task.function();
+        }
+        catch (...)
+        {
+            task.exception = std::current_exception();
+        }
+    }
+
+    timing.endMs = static_cast<double>(Profiler::NowNs() - runStartNs) / 1'000'000.0;
+
+    // The dependents would run on what this task didn't initialize.
+    const bool hasFailed = task.isSkipped || task.exception != nullptr;
+
+    // Dispatched out of the lock: the thread pool has a lock of its own.
+    std::vector<TaskId> ready = {};
+
+    {
+        std::lock_guard lock(mutex);
+
+        for (const TaskId dependent : task.dependents)
+        {
+            if (hasFailed)
+            {
+                tasks[dependent].isSkipped = true;
+            }
+
+            if (--tasks[dependent].remaining == 0)
+            {
+                ready.push_back(dependent);
+            }
+        }
+
+        pendingCount--;
+
+        // Under the lock: once the main thread sees zero, Run returns and the graph may be gone.
+        if (pendingCount == 0)
+        {
+            mainTaskReady.notify_one();
+        }
+    }
+
+    for (const TaskId dependent : ready)
+    {
+        Dispatch(dependent);
+    }
+}
+}
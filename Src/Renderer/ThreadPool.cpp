@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+namespace Renderer
+{
+void ThreadPool::Init(uint32_t thread_count)
+{
+    if (thread_count == 0)
+    {
+        const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        thread_count = std::max(hardwareThreads, 2u) - 1;
+    }
+
+    stopping = false;
+    workers.reserve(thread_count);
+
+    for (uint32_t i = 0; i < thread_count; i++)
+    {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+void ThreadPool::Teardown()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+
+    jobAvailable.notify_all();
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    workers.clear();
+}
+
+void ThreadPool::Submit(Job job)
+{
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [this]
+    {
+        return jobs.empty() && busyCount == 0;
+    });
+}
+
+uint32_t ThreadPool::ThreadCount() const
+{
+    return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::WorkerLoop()
+{
+    PROFILE_THREAD("worker");
+
+    for (;;)
+    {
+        Job job = {};
+
+        {
+            std::unique_lock lock(mutex);
+            jobAvailable.wait(lock, [this]
+            {
+                return stopping || !jobs.empty();
+            });
+
+            // Drain the queue before leaving, Teardown() promises the queued jobs run.
+            if (jobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busyCount++;
+        }
+
+        job();
+
+        {
+            std::lock_guard lock(mutex);
+            busyCount--;
+
+            if (jobs.empty() && busyCount == 0)
+            {
+                idle.notify_all();
+            }
+        }
+    }
+}
+}
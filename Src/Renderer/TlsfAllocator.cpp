@@ -0,0 +1,337 @@
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace Renderer
+{
+void TlsfAllocator::Init(uint64_t size)
+{
+    assert(size > 0);
+
+    nodes.clear();
+    unusedNodes.clear();
+
+    flBitmap = 0;
+    std::fill(std::begin(slBitmap), std::end(slBitmap), 0u);
+
+    for (auto &heads : freeHeads)
+    {
+        std::fill(std::begin(heads), std::end(heads), INVALID_NODE);
+    }
+
+    this->size = size;
+    usedSize = 0;
+    allocationCount = 0;
+    freeBlockCount = 0;
+
+    // The whole range starts as one free block.
+    const uint32_t node = NewNode();
+    nodes[node].offset = 0;
+    nodes[node].size = size;
+    InsertFree(node);
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+    size = std::max<uint64_t>(size, 1);
+    alignment = std::max<uint64_t>(alignment, 1);
+
+    // Worst case padding is alignment - 1, so any block of this size fits.
+    const uint64_t searchSize = size + alignment - 1;
+
+    if (searchSize > this->size)
+    {
+        return {};
+    }
+
+    const uint32_t node = FindSuitable(searchSize);
+
+    if (node == INVALID_NODE)
+    {
+        return {};
+    }
+
+    RemoveFree(node);
+
+    const uint64_t alignedOffset = (nodes[node].offset + alignment - 1) / alignment * alignment;
+    const uint64_t padding = alignedOffset - nodes[node].offset;
+
+    assert(nodes[node].size >= size + padding);
+
+    // Give the padding back as a free block. The physical previous block cannot be
+    // free (free neighbours are always merged), so no merge is needed.
+    if (padding > 0)
+    {
+        const uint32_t front = NewNode();
+        nodes[front].offset = nodes[node].offset;
+        nodes[front].size = padding;
+        nodes[front].prevPhysical = nodes[node].prevPhysical;
+        nodes[front].nextPhysical = node;
+
+        if (nodes[front].prevPhysical != INVALID_NODE)
+        {
+            nodes[nodes[front].prevPhysical].nextPhysical = front;
+        }
+
+        nodes[node].prevPhysical = front;
+        nodes[node].offset = alignedOffset;
+        nodes[node].size -= padding;
+
+        InsertFree(front);
+    }
+
+    // Split the remainder.
+    if (nodes[node].size > size)
+    {
+        const uint32_t back = NewNode();
+        nodes[back].offset = nodes[node].offset + size;
+        nodes[back].size = nodes[node].size - size;
+        nodes[back].prevPhysical = node;
+        nodes[back].nextPhysical = nodes[node].nextPhysical;
+
+        if (nodes[back].nextPhysical != INVALID_NODE)
+        {
+            nodes[nodes[back].nextPhysical].prevPhysical = back;
+        }
+
+        nodes[node].nextPhysical = back;
+        nodes[node].size = size;
+
+        InsertFree(back);
+    }
+
+    nodes[node].isFree = false;
+    usedSize += size;
+    allocationCount++;
+
+    Allocation allocation = {};
+    allocation.offset = nodes[node].offset;
+    allocation.size = size;
+    allocation.node = node;
+
+    return allocation;
+}
+
+void TlsfAllocator::Free(const Allocation &allocation)
+{
+    uint32_t node = allocation.node;
+
+    assert(node != INVALID_NODE && node < nodes.size() && !nodes[node].isFree);
+
+    usedSize -= nodes[node].size;
+    allocationCount--;
+
+    // Merge with the previous block.
+    const uint32_t prev = nodes[node].prevPhysical;
+
+    if (prev != INVALID_NODE && nodes[prev].isFree)
+    {
+        RemoveFree(prev);
+
+        nodes[prev].size += nodes[node].size;
+        nodes[prev].nextPhysical = nodes[node].nextPhysical;
+
+        if (nodes[prev].nextPhysical != INVALID_NODE)
+        {
+            nodes[nodes[prev].nextPhysical].prevPhysical = prev;
+        }
+
+        ReleaseNode(node);
+        node = prev;
+    }
+
+    // Merge with the next block.
+    const uint32_t next = nodes[node].nextPhysical;
+
+    if (next != INVALID_NODE && nodes[next].isFree)
+    {
+        RemoveFree(next);
+
+        nodes[node].size += nodes[next].size;
+        nodes[node].nextPhysical = nodes[next].nextPhysical;
+
+        if (nodes[node].nextPhysical != INVALID_NODE)
+        {
+            nodes[nodes[node].nextPhysical].prevPhysical = node;
+        }
+
+        ReleaseNode(next);
+    }
+
+    InsertFree(node);
+}
+
+uint64_t TlsfAllocator::Size() const
+{
+    return size;
+}
+
+uint64_t TlsfAllocator::UsedSize() const
+{
+    return usedSize;
+}
+
+uint32_t TlsfAllocator::AllocationCount() const
+{
+    return allocationCount;
+}
+
+uint32_t TlsfAllocator::FreeBlockCount() const
+{
+    return freeBlockCount;
+}
+
+uint64_t TlsfAllocator::LargestFreeBlock() const
+{
+    if (flBitmap == 0)
+    {
+        return 0;
+    }
+
+    // Only the highest non-empty list can hold the largest block.
+    const uint32_t fl = 63 - std::countl_zero(flBitmap);
+    const uint32_t sl = 31 - std::countl_zero(slBitmap[fl]);
+
+    uint64_t largest = 0;
+
+    for (uint32_t node = freeHeads[fl][sl]; node != INVALID_NODE; node = nodes[node].nextFree)
+    {
+        largest = std::max(largest, nodes[node].size);
+    }
+
+    return largest;
+}
+
+void TlsfAllocator::Mapping(uint64_t size, uint32_t *p_fl, uint32_t *p_sl)
+{
+    if (size < SL_COUNT)
+    {
+        // Small sizes: one list per size in the first level.
+        *p_fl = 0;
+        *p_sl = static_cast<uint32_t>(size);
+        return;
+    }
+
+    const uint32_t log2 = 63 - std::countl_zero(size);
+    *p_sl = static_cast<uint32_t>(size >> (log2 - SL_LOG2)) ^ SL_COUNT;
+    *p_fl = log2 - SL_LOG2 + 1;
+}
+
+uint32_t TlsfAllocator::FindSuitable(uint64_t size) const
+{
+    uint32_t fl = 0, sl = 0;
+    Mapping(size, &fl, &sl);
+
+    // First fit in the list of size: rounding up to the next list would miss a block of
+    // exactly the size, e.g. a whole new block sized for the request.
+    for (uint32_t node = freeHeads[fl][sl]; node != INVALID_NODE; node = nodes[node].nextFree)
+    {
+        if (nodes[node].size >= size)
+        {
+            return node;
+        }
+    }
+
+    // Every block of the next lists is big enough.
+    uint32_t slMap = sl + 1 < SL_COUNT ? slBitmap[fl] & (~0u << (sl + 1)) : 0;
+
+    if (slMap == 0)
+    {
+        const uint64_t flMap = (fl + 1 < 64) ? flBitmap & (~0ull << (fl + 1)) : 0;
+
+        if (flMap == 0)
+        {
+            return INVALID_NODE;
+        }
+
+        fl = std::countr_zero(flMap);
+        slMap = slBitmap[fl];
+    }
+
+    sl = std::countr_zero(slMap);
+
+    return freeHeads[fl][sl];
+}
+
+void TlsfAllocator::InsertFree(uint32_t node)
+{
+    uint32_t fl = 0, sl = 0;
+    Mapping(nodes[node].size, &fl, &sl);
+
+    const uint32_t head = freeHeads[fl][sl];
+
+    nodes[node].isFree = true;
+    nodes[node].prevFree = INVALID_NODE;
+    nodes[node].nextFree = head;
+
+    if (head != INVALID_NODE)
+    {
+        nodes[head].prevFree = node;
+    }
+
+    freeHeads[fl][sl] = node;
+    flBitmap |= 1ull << fl;
+    slBitmap[fl] |= 1u << sl;
+    freeBlockCount++;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t node)
+{
+    uint32_t fl = 0, sl = 0;
+    Mapping(nodes[node].size, &fl, &sl);
+
+    const uint32_t prev = nodes[node].prevFree;
+    const uint32_t next = nodes[node].nextFree;
+
+    if (prev != INVALID_NODE)
+    {
+        nodes[prev].nextFree = next;
+    }
+    else
+    {
+        freeHeads[fl][sl] = next;
+    }
+
+    if (next != INVALID_NODE)
+    {
+        nodes[next].prevFree = prev;
+    }
+
+    if (freeHeads[fl][sl] == INVALID_NODE)
+    {
+        slBitmap[fl] &= ~(1u << sl);
+
+        if (slBitmap[fl] == 0)
+        {
+            flBitmap &= ~(1ull << fl);
+        }
+    }
+
+    nodes[node].isFree = false;
+    nodes[node].prevFree = INVALID_NODE;
+    nodes[node].nextFree = INVALID_NODE;
+    freeBlockCount--;
+}
+
+uint32_t TlsfAllocator::NewNode()
+{
+    if (!unusedNodes.empty())
+    {
+        const uint32_t node = unusedNodes.back();
+        unusedNodes.pop_back();
+        nodes[node] = {};
+        return node;
+    }
+
+    nodes.emplace_back();
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void TlsfAllocator::ReleaseNode(uint32_t node)
+{
+    nodes[node] = {};
+    unusedNodes.push_back(node);
+}
+}
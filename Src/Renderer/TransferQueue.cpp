@@ -0,0 +1,205 @@
+#include "TransferQueue.h"
+#include "Profiler.h"
+#include "VkCommon.h"
+
+#include <cassert>
+
+namespace Renderer
+{
+void TransferQueue::Init(
+    VkDevice device,
+    uint32_t transfer_family,
+    VkQueue transfer_queue,
+    uint32_t graphics_family,
+    uint32_t frame_count,
+    VkAllocationCallbacks *p_allocation_callbacks)
+{
+    this->device = device;
+    queue = transfer_queue;
+    allocationCallbacks = p_allocation_callbacks;
+    transferFamily = transfer_family;
+    graphicsFamily = graphics_family;
+    isDedicated = transfer_family != graphics_family;
+    signaledValue = 0;
+
+    if (!isDedicated)
+    {
+        return;
+    }
+
+    commandPools.resize(frame_count);
+    commandBuffers.resize(frame_count);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = transferFamily;
+
+    for (uint32_t i = 0; i < frame_count; i++)
+    {
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, allocationCallbacks,
+            &commandPools[i]));
+
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = commandPools[i];
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffers[i]));
+    }
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo = {};
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCreateInfo.pNext = &semaphoreTypeInfo;
+
+    VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, allocationCallbacks, &timeline));
+}
+
+void TransferQueue::Teardown()
+{
+    if (!isDedicated)
+    {
+        return;
+    }
+
+    vkDestroySemaphore(device, timeline, allocationCallbacks);
+
+    for (const VkCommandPool commandPool : commandPools)
+    {
+        vkDestroyCommandPool(device, commandPool, allocationCallbacks);
+    }
+
+    commandPools.clear();
+    commandBuffers.clear();
+    flushedRanges.clear();
+    barriers.clear();
+}
+
+bool TransferQueue::IsDedicated() const
+{
+    return isDedicated;
+}
+
+bool TransferQueue::Submit(StagingRing *p_staging_ring, uint32_t frame_index)
+{
+    PROFILE_FUNCTION();
+
+    assert(isDedicated && "Flush the staging ring on the graphics queue instead");
+
+    flushedRanges.clear();
+
+    if (!p_staging_ring->HasPendingUploads())
+    {
+        return false;
+    }
+
+    // The graphics submission of frame_index waited the transfer of frame_index.
+    VK_CHECK(vkResetCommandPool(device, commandPools[frame_index], 0));
+
+    const VkCommandBuffer cmd = commandBuffers[frame_index];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+    if (!p_staging_ring->Flush(cmd, frame_index))
+    {
+        // Ring full: nothing recorded, try again next frame.
+        VK_CHECK(vkEndCommandBuffer(cmd));
+        return false;
+    }
+
+    p_staging_ring->FlushedRanges(&flushedRanges);
+
+    // Release half: only the source access matters, the destination one is ignored.
+    FillOwnershipBarriers(VK_ACCESS_TRANSFER_WRITE_BIT, 0, &barriers);
+
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data(),
+        0, nullptr);
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    signaledValue++;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signaledValue;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline;
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    return true;
+}
+
+void TransferQueue::RecordAcquire(VkCommandBuffer graphics_cmd) const
+{
+    // Acquire half: same ranges and families as the release, only the destination access matters.
+    FillOwnershipBarriers(
+        0,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+        &barriers);
+
+    vkCmdPipelineBarrier(
+        graphics_cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        WAIT_STAGES,
+        0,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data(),
+        0, nullptr);
+}
+
+VkSemaphore TransferQueue::Semaphore() const
+{
+    return timeline;
+}
+
+uint64_t TransferQueue::SignaledValue() const
+{
+    return signaledValue;
+}
+
+void TransferQueue::FillOwnershipBarriers(
+    VkAccessFlags src_access,
+    VkAccessFlags dst_access,
+    std::vector<VkBufferMemoryBarrier> *p_barriers) const
+{
+    p_barriers->resize(flushedRanges.size());
+
+    for (size_t i = 0; i < flushedRanges.size(); i++)
+    {
+        VkBufferMemoryBarrier &barrier = (*p_barriers)[i];
+        barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.buffer = flushedRanges[i].buffer;
+        barrier.offset = flushedRanges[i].offset;
+        barrier.size = flushedRanges[i].size;
+    }
+}
+}
@@ -0,0 +1,94 @@
+#include "UniformRing.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace Renderer
+{
+void UniformRing::Init(
+    VkDevice device,
+    VkPhysicalDevice gpu,
+    DeviceMemoryAllocator *p_memory_allocator,
+    uint32_t frame_count,
+    VkDeviceSize frame_size)
+{
+    this->device = device;
+    memoryAllocator = p_memory_allocator;
+
+    VkPhysicalDeviceProperties gpuProperties = {};
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+
+    alignment = std::max(
+        gpuProperties.limits.minUniformBufferOffsetAlignment,
+        gpuProperties.limits.minStorageBufferOffsetAlignment);
+
+    // Regions start aligned, so do the offsets pushed in them.
+    frameSize = (frame_size + alignment - 1) / alignment * alignment;
+    frameBegin = 0;
+    frameCursor = 0;
+
+    // Dynamic offsets are 32 bits.
+    assert(frameSize * frame_count <= UINT32_MAX);
+
+    vk_create_buffer(
+        device,
+        memoryAllocator,
+        frameSize * frame_count,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        MemoryCategory::UNIFORMS,
+        memoryAllocator->AllocationCallbacks(),
+        &buffer,
+        &memory);
+
+    assert(memory.mapped != nullptr);
+}
+
+void UniformRing::Teardown()
+{
+    vkDestroyBuffer(device, buffer, memoryAllocator->AllocationCallbacks());
+    memoryAllocator->Free(&memory);
+}
+
+void UniformRing::BeginFrame(uint32_t frame_index)
+{
+    frameBegin = frameSize * frame_index;
+    frameCursor = frameBegin;
+    frameRejectedPushes = 0;
+}
+
+uint32_t UniformRing::Push(const void *p_data, VkDeviceSize size)
+{
+    const VkDeviceSize offset = frameCursor;
+
+    // Not an assert: the draw count may outgrow the size given at Init in any build.
+    if (offset + size > frameBegin + frameSize)
+    {
+        frameRejectedPushes++;
+        return INVALID_OFFSET;
+    }
+
+    memcpy(static_cast<uint8_t *>(memory.mapped) + offset, p_data, size);
+
+    frameCursor = (offset + size + alignment - 1) / alignment * alignment;
+
+    return static_cast<uint32_t>(offset);
+}
+
+VkBuffer UniformRing::Buffer() const
+{
+    return buffer;
+}
+
+VkDeviceSize UniformRing::FrameUsedBytes() const
+{
+    return frameCursor - frameBegin;
+}
+
+uint32_t UniformRing::FrameRejectedPushes() const
+{
+    return frameRejectedPushes;
+}
+}
@@ -0,0 +1,1132 @@
+#include "VirtualTexture.h"
+#include "../FileSystem.h"
+#include "VkCommon.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace Renderer
+{
+/// Must match the push constant block of vt_feedback.vert/.frag.
+struct FeedbackPushConstants
+{
+    /// Pushed per draw by PushTransform.
+    glm::mat4 modelViewProjection;
+
+    /// x: virtual size in texels, y: pages per side at mip 0, z: last mip, w: mip bias.
+    glm::vec4 params;
+};
+
+constexpr uint32_t TILE_ID_COORD_BITS = 12;
+constexpr uint32_t TILE_ID_COORD_MASK = (1u << TILE_ID_COORD_BITS) - 1;
+
+// pagesPerSide is at most 1 << TILE_ID_COORD_BITS, halved down to 1 page.
+constexpr uint32_t MAX_MIP_COUNT = TILE_ID_COORD_BITS + 1;
+
+constexpr uint32_t MAX_PHYSICAL_TILES_PER_SIDE = 256; // Slot coordinates are stored in 8 bits.
+
+uint32_t VirtualTexture::PackTileId(uint32_t x, uint32_t y, uint32_t mip)
+{
+    return x | (y << TILE_ID_COORD_BITS) | (mip << (TILE_ID_COORD_BITS * 2));
+}
+
+void VirtualTexture::UnpackTileId(uint32_t tile_id, uint32_t *p_x, uint32_t *p_y, uint32_t *p_mip)
+{
+    *p_x = tile_id & TILE_ID_COORD_MASK;
+    *p_y = (tile_id >> TILE_ID_COORD_BITS) & TILE_ID_COORD_MASK;
+    *p_mip = tile_id >> (TILE_ID_COORD_BITS * 2);
+}
+
+void VirtualTexture::Init(
+    VkDevice device,
+    DeviceMemoryAllocator *p_memory_allocator,
+    const VirtualTextureCreateInfo &create_info)
+{
+    this->device = device;
+    memoryAllocator = p_memory_allocator;
+    createInfo = create_info;
+    filePath = create_info.filePath;
+
+    std::ifstream file(filePath, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open virtual texture");
+    }
+
+    file.read(reinterpret_cast<char *>(&fileHeader), sizeof(fileHeader));
+
+    const bool isPowerOfTwo = fileHeader.pagesPerSide != 0 &&
+                              (fileHeader.pagesPerSide & (fileHeader.pagesPerSide - 1)) == 0;
+
+    if (!file || fileHeader.magic != VirtualTextureFileHeader::MAGIC || !isPowerOfTwo ||
+        fileHeader.pagesPerSide > (1u << TILE_ID_COORD_BITS) ||
+        fileHeader.mipCount == 0 || fileHeader.mipCount > MAX_MIP_COUNT ||
+        (1u << (fileHeader.mipCount - 1)) != fileHeader.pagesPerSide)
+    {
+        throw std::runtime_error("Invalid virtual texture header");
+    }
+
+    if (createInfo.physicalTilesPerSide == 0 || createInfo.physicalTilesPerSide > MAX_PHYSICAL_TILES_PER_SIDE)
+    {
+        throw std::runtime_error("Invalid virtual texture cache size");
+    }
+
+    feedbackExtent.width = std::max(createInfo.framebufferExtent.width / createInfo.feedbackDivisor,
+        1u);
+    feedbackExtent.height = std::max(
+        createInfo.framebufferExtent.height / createInfo.feedbackDivisor, 1u);
+
+    residency.resize(fileHeader.mipCount);
+    pageTable.resize(fileHeader.mipCount);
+    dirtyPages.assign(fileHeader.mipCount, {});
+
+    for (uint32_t mip = 0; mip < fileHeader.mipCount; mip++)
+    {
+        const uint32_t pages = fileHeader.pagesPerSide >> mip;
+        residency[mip].assign(pages * pages, -1);
+        pageTable[mip].assign(pages * pages, 0);
+    }
+
+    // The first Update writes the whole page table.
+    MarkPagesDirty(0, 0, fileHeader.mipCount - 1);
+
+    slots.resize(createInfo.physicalTilesPerSide * createInfo.physicalTilesPerSide);
+
+    // Physical cache: the only storage for texels, its size never depends on the content.
+    const uint32_t cacheSize = createInfo.physicalTilesPerSide * fileHeader.tileSize;
+
+    vk_create_image(
+        device,
+        memoryAllocator,
+        VK_IMAGE_TYPE_2D,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        {cacheSize, cacheSize, 1},
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        MemoryCategory::TEXTURES,
+        memoryAllocator->AllocationCallbacks(),
+        &physicalCacheImage,
+        &physicalCacheMemory);
+
+    vk_create_image_view(
+        device,
+        physicalCacheImage,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_VIEW_TYPE_2D,
+        1,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        {
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY
+        },
+        memoryAllocator->AllocationCallbacks(),
+        &physicalCacheView);
+
+    vk_create_sampler(
+        device,
+        VK_FILTER_LINEAR,
+        VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        0.0f,
+        memoryAllocator->AllocationCallbacks(),
+        &physicalCacheSampler);
+
+    // Page table: one texel per virtual page, one mip per virtual mip.
+    vk_create_image(
+        device,
+        memoryAllocator,
+        VK_IMAGE_TYPE_2D,
+        VK_FORMAT_R8G8B8A8_UINT,
+        {fileHeader.pagesPerSide, fileHeader.pagesPerSide, 1},
+        fileHeader.mipCount,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        MemoryCategory::TEXTURES,
+        memoryAllocator->AllocationCallbacks(),
+        &pageTableImage,
+        &pageTableMemory);
+
+    vk_create_image_view(
+        device,
+        pageTableImage,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_VIEW_TYPE_2D,
+        fileHeader.mipCount,
+        VK_FORMAT_R8G8B8A8_UINT,
+        {
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY,
+            VK_COMPONENT_SWIZZLE_IDENTITY
+        },
+        memoryAllocator->AllocationCallbacks(),
+        &pageTableView);
+
+    vk_create_sampler(
+        device,
+        VK_FILTER_NEAREST,
+        VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        static_cast<float>(fileHeader.mipCount),
+        memoryAllocator->AllocationCallbacks(),
+        &pageTableSampler);
+
+    // Staging: the tile budget plus a full page table, per frame in flight.
+    const VkDeviceSize tileBytes = fileHeader.tileSize * fileHeader.tileSize * 4;
+    stagingRegionSize = createInfo.maxUploadsPerFrame * tileBytes + PageTableByteSize();
+
+    vk_create_buffer(
+        device,
+        memoryAllocator,
+        stagingRegionSize * createInfo.frameCount,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        MemoryCategory::STAGING,
+        memoryAllocator->AllocationCallbacks(),
+        &stagingBuffer,
+        &stagingMemory);
+
+    InitFeedbackPass();
+    InitFeedbackPipeline();
+
+    loadThreads.Init(createInfo.loadThreadCount);
+
+    // The last mip is the fallback of every page, load it right away.
+    RequestTile(PackTileId(0, 0, fileHeader.mipCount - 1));
+}
+
+void VirtualTexture::Teardown()
+{
+    // Loader jobs reference this object.
+    loadThreads.Teardown();
+
+    for (PerFrame &frame : frames)
+    {
+        vkDestroyFramebuffer(device, frame.feedbackFramebuffer, memoryAllocator->AllocationCallbacks());
+        vkDestroyImageView(device, frame.feedbackImageView, memoryAllocator->AllocationCallbacks());
+        vkDestroyImage(device, frame.feedbackImage, memoryAllocator->AllocationCallbacks());
+        memoryAllocator->Free(&frame.feedbackImageMemory);
+        vkDestroyImageView(device, frame.feedbackDepthView, memoryAllocator->AllocationCallbacks());
+        vkDestroyImage(device, frame.feedbackDepthImage, memoryAllocator->AllocationCallbacks());
+        memoryAllocator->Free(&frame.feedbackDepthMemory);
+        vkDestroyBuffer(device, frame.readbackBuffer, memoryAllocator->AllocationCallbacks());
+        memoryAllocator->Free(&frame.readbackMemory);
+    }
+
+    vkDestroyPipeline(device, feedbackPipeline, memoryAllocator->AllocationCallbacks());
+    vkDestroyPipelineLayout(device, feedbackPipelineLayout, memoryAllocator->AllocationCallbacks());
+    vkDestroyRenderPass(device, feedbackRenderPass, memoryAllocator->AllocationCallbacks());
+
+    vkDestroySampler(device, physicalCacheSampler, memoryAllocator->AllocationCallbacks());
+    vkDestroyImageView(device, physicalCacheView, memoryAllocator->AllocationCallbacks());
+    vkDestroyImage(device, physicalCacheImage, memoryAllocator->AllocationCallbacks());
+    memoryAllocator->Free(&physicalCacheMemory);
+
+    vkDestroySampler(device, pageTableSampler, memoryAllocator->AllocationCallbacks());
+    vkDestroyImageView(device, pageTableView, memoryAllocator->AllocationCallbacks());
+    vkDestroyImage(device, pageTableImage, memoryAllocator->AllocationCallbacks());
+    memoryAllocator->Free(&pageTableMemory);
+
+    vkDestroyBuffer(device, stagingBuffer, memoryAllocator->AllocationCallbacks());
+    memoryAllocator->Free(&stagingMemory);
+}
+
+void VirtualTexture::Update(VkCommandBuffer cmd, uint32_t frame_index)
+{
+    frameCounter++;
+    stats.requestedTiles = 0;
+    stats.uploadedTiles = 0;
+    stats.evictedTiles = 0;
+
+    if (frames[frame_index].hasFeedback)
+    {
+        ResolveFeedback(frame_index);
+    }
+
+    // The tiles left without a slot last time first, then the new ones, within the budget.
+    std::vector<LoadedTile> uploads = std::move(retryTiles);
+    retryTiles.clear();
+
+    {
+        std::lock_guard lock(loadedMutex);
+
+        const size_t uploadCount = std::min<size_t>(loadedTiles.size(),
+            createInfo.maxUploadsPerFrame - uploads.size());
+
+        uploads.insert(uploads.end(),
+            std::make_move_iterator(loadedTiles.begin()),
+            std::make_move_iterator(loadedTiles.begin() + uploadCount));
+        loadedTiles.erase(loadedTiles.begin(), loadedTiles.begin() + uploadCount);
+    }
+
+    // Tiles.
+    const VkDeviceSize tileBytes = fileHeader.tileSize * fileHeader.tileSize * 4;
+    const VkDeviceSize regionOffset = stagingRegionSize * frame_index;
+    VkDeviceSize stagingOffset = regionOffset;
+    uint8_t *stagingMapped = static_cast<uint8_t *>(stagingMemory.mapped);
+
+    std::vector<VkBufferImageCopy> tileCopies = {};
+    tileCopies.reserve(uploads.size());
+
+    for (LoadedTile &tile : uploads)
+    {
+        // Failed read: drop it, the feedback will request it again.
+        if (tile.texels.size() != tileBytes)
+        {
+            pendingTiles.erase(tile.tileId);
+            continue;
+        }
+
+        const uint32_t slotIndex = AcquireSlot();
+
+        // Every slot is needed by the current frame: keep the texels for the next Update.
+        if (slotIndex == UINT32_MAX)
+        {
+            retryTiles.push_back(std::move(tile));
+            continue;
+        }
+
+        pendingTiles.erase(tile.tileId);
+
+        PhysicalSlot &slot = slots[slotIndex];
+        uint32_t x = 0, y = 0, mip = 0;
+
+        if (slot.tileId != INVALID_TILE)
+        {
+            UnpackTileId(slot.tileId, &x, &y, &mip);
+            residency[mip][y * (fileHeader.pagesPerSide >> mip) + x] = -1;
+            MarkPagesDirty(x, y, mip);
+            stats.evictedTiles++;
+        }
+
+        UnpackTileId(tile.tileId, &x, &y, &mip);
+        residency[mip][y * (fileHeader.pagesPerSide >> mip) + x] = static_cast<int32_t>(slotIndex);
+        MarkPagesDirty(x, y, mip);
+        slot.tileId = tile.tileId;
+        slot.lastUsedFrame = frameCounter;
+
+        std::memcpy(stagingMapped + stagingOffset, tile.texels.data(), tileBytes);
+
+        VkBufferImageCopy copy = {};
+        copy.bufferOffset = stagingOffset;
+        copy.bufferRowLength = 0;
+        copy.bufferImageHeight = 0;
+        copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        copy.imageOffset = {
+            static_cast<int32_t>((slotIndex % createInfo.physicalTilesPerSide) * fileHeader.tileSize),
+            static_cast<int32_t>((slotIndex / createInfo.physicalTilesPerSide) * fileHeader.tileSize),
+            0
+        };
+        copy.imageExtent = {fileHeader.tileSize, fileHeader.tileSize, 1};
+
+        tileCopies.push_back(copy);
+        stagingOffset += tileBytes;
+        stats.uploadedTiles++;
+    }
+
+    // Page table: only the pages the uploads changed, once for all of them. Its data sits at
+    // the end of the region, after the tile budget.
+    RebuildPageTable();
+
+    const std::vector<VkBufferImageCopy> pageTableCopies = StagePageTable(
+        regionOffset + createInfo.maxUploadsPerFrame * tileBytes);
+
+    stats.residentTiles = static_cast<uint32_t>(std::count_if(slots.begin(), slots.end(),
+        [](const PhysicalSlot &slot)
+        {
+            return slot.tileId != INVALID_TILE;
+        }));
+    stats.pendingLoads = static_cast<uint32_t>(pendingTiles.size());
+
+    // The first Update transitions both images, even with nothing to copy yet.
+    if (tileCopies.empty() && pageTableCopies.empty() && imagesInitialized)
+    {
+        return;
+    }
+
+    const VkImageLayout previousLayout = imagesInitialized
+                                             ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                             : VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImageMemoryBarrier toTransfer[2] = {};
+
+    for (VkImageMemoryBarrier &barrier : toTransfer)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = imagesInitialized ? VK_ACCESS_SHADER_READ_BIT : 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = previousLayout;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+
+    toTransfer[0].image = physicalCacheImage;
+    toTransfer[0].subresourceRange.levelCount = 1;
+    toTransfer[1].image = pageTableImage;
+    toTransfer[1].subresourceRange.levelCount = fileHeader.mipCount;
+
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 2, &toTransfer[0]);
+
+    if (!tileCopies.empty())
+    {
+        vkCmdCopyBufferToImage(cmd, stagingBuffer, physicalCacheImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(tileCopies.size()), tileCopies.data());
+    }
+
+    if (!pageTableCopies.empty())
+    {
+        vkCmdCopyBufferToImage(cmd, stagingBuffer, pageTableImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(pageTableCopies.size()), pageTableCopies.data());
+    }
+
+    VkImageMemoryBarrier toShaderRead[2] = {toTransfer[0], toTransfer[1]};
+
+    for (VkImageMemoryBarrier &barrier : toShaderRead)
+    {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 2, &toShaderRead[0]);
+
+    imagesInitialized = true;
+}
+
+void VirtualTexture::RecordFeedback(
+    VkCommandBuffer cmd,
+    uint32_t frame_index,
+    const std::function<void(VkCommandBuffer)> &draw)
+{
+    PerFrame &frame = frames[frame_index];
+
+    VkClearValue clearValues[2] = {};
+    clearValues[0].color.uint32[0] = INVALID_TILE;
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = feedbackRenderPass;
+    renderPassBeginInfo.framebuffer = frame.feedbackFramebuffer;
+    renderPassBeginInfo.renderArea.offset = {0, 0};
+    renderPassBeginInfo.renderArea.extent = feedbackExtent;
+    renderPassBeginInfo.clearValueCount = 2;
+    renderPassBeginInfo.pClearValues = &clearValues[0];
+
+    vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, feedbackPipeline);
+
+    // The transforms are pushed by the draws.
+    const glm::vec4 params = {
+        static_cast<float>(fileHeader.pagesPerSide * fileHeader.tileSize),
+        static_cast<float>(fileHeader.pagesPerSide),
+        static_cast<float>(fileHeader.mipCount - 1),
+        // Derivatives are feedbackDivisor times larger than at full resolution.
+        -std::log2(static_cast<float>(createInfo.feedbackDivisor)),
+    };
+
+    vkCmdPushConstants(cmd, feedbackPipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, offsetof(FeedbackPushConstants, params),
+        sizeof(params), &params);
+
+    draw(cmd);
+
+    vkCmdEndRenderPass(cmd);
+
+    // The render pass leaves the target in TRANSFER_SRC_OPTIMAL.
+    VkBufferImageCopy copy = {};
+    copy.bufferOffset = 0;
+    copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copy.imageOffset = {0, 0, 0};
+    copy.imageExtent = {feedbackExtent.width, feedbackExtent.height, 1};
+
+    vkCmdCopyImageToBuffer(cmd, frame.feedbackImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        frame.readbackBuffer, 1, &copy);
+
+    VkBufferMemoryBarrier hostBarrier = {};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = frame.readbackBuffer;
+    hostBarrier.offset = 0;
+    hostBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+    frame.hasFeedback = true;
+}
+
+void VirtualTexture::PushTransform(VkCommandBuffer cmd, const glm::mat4 &model_view_projection) const
+{
+    vkCmdPushConstants(cmd, feedbackPipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        offsetof(FeedbackPushConstants, modelViewProjection),
+        sizeof(glm::mat4), &model_view_projection);
+}
+
+void VirtualTexture::Specialize(GraphicsPipelineDesc *p_desc) const
+{
+    static_assert(CACHE_TILES_CONSTANT < GraphicsPipelineDesc::MAX_SPECIALIZATION_CONSTANTS);
+
+    p_desc->specializationCount = std::max(p_desc->specializationCount, CACHE_TILES_CONSTANT + 1);
+    p_desc->specialization[VIRTUAL_SIZE_CONSTANT] = fileHeader.pagesPerSide * fileHeader.tileSize;
+    p_desc->specialization[CACHE_TILES_CONSTANT] = createInfo.physicalTilesPerSide;
+}
+
+VkDescriptorImageInfo VirtualTexture::PhysicalCacheDescriptor() const
+{
+    return {physicalCacheSampler, physicalCacheView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+}
+
+VkDescriptorImageInfo VirtualTexture::PageTableDescriptor() const
+{
+    return {pageTableSampler, pageTableView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+}
+
+const VirtualTextureStats &VirtualTexture::Stats() const
+{
+    return stats;
+}
+
+void VirtualTexture::InitFeedbackPass()
+{
+    VkAttachmentDescription attachments[2] = {};
+
+    // Tile ids.
+    attachments[0].format = VK_FORMAT_R32_UINT;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    // Depth, so only visible surfaces request tiles. D16 is always supported.
+    attachments[1].format = VK_FORMAT_D16_UNORM;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference depthRef = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorRef;
+    subpass.pDepthStencilAttachment = &depthRef;
+
+    VkSubpassDependency dependencies[2] = {};
+
+    // The previous readback copy must be done before clearing the target again.
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // Tile ids are copied to the readback buffer right after the pass.
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassCreateInfo = {};
+    renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassCreateInfo.attachmentCount = 2;
+    renderPassCreateInfo.pAttachments = &attachments[0];
+    renderPassCreateInfo.subpassCount = 1;
+    renderPassCreateInfo.pSubpasses = &subpass;
+    renderPassCreateInfo.dependencyCount = 2;
+    renderPassCreateInfo.pDependencies = &dependencies[0];
+
+    VK_CHECK(vkCreateRenderPass(device, &renderPassCreateInfo, memoryAllocator->AllocationCallbacks(), &feedbackRenderPass));
+
+    frames.resize(createInfo.frameCount);
+
+    for (PerFrame &frame : frames)
+    {
+        vk_create_image(
+            device,
+            memoryAllocator,
+            VK_IMAGE_TYPE_2D,
+            VK_FORMAT_R32_UINT,
+            {feedbackExtent.width, feedbackExtent.height, 1},
+            1,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryCategory::ATTACHMENTS,
+            memoryAllocator->AllocationCallbacks(),
+            &frame.feedbackImage,
+            &frame.feedbackImageMemory);
+
+        vk_create_image_view(
+            device,
+            frame.feedbackImage,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_VIEW_TYPE_2D,
+            1,
+            VK_FORMAT_R32_UINT,
+            {
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY
+            },
+            memoryAllocator->AllocationCallbacks(),
+            &frame.feedbackImageView);
+
+        vk_create_image(
+            device,
+            memoryAllocator,
+            VK_IMAGE_TYPE_2D,
+            VK_FORMAT_D16_UNORM,
+            {feedbackExtent.width, feedbackExtent.height, 1},
+            1,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryCategory::ATTACHMENTS,
+            memoryAllocator->AllocationCallbacks(),
+            &frame.feedbackDepthImage,
+            &frame.feedbackDepthMemory);
+
+        vk_create_image_view(
+            device,
+            frame.feedbackDepthImage,
+            VK_IMAGE_ASPECT_DEPTH_BIT,
+            VK_IMAGE_VIEW_TYPE_2D,
+            1,
+            VK_FORMAT_D16_UNORM,
+            {
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY,
+                VK_COMPONENT_SWIZZLE_IDENTITY
+            },
+            memoryAllocator->AllocationCallbacks(),
+            &frame.feedbackDepthView);
+
+        const VkImageView framebufferAttachments[2] = {
+            frame.feedbackImageView,
+            frame.feedbackDepthView,
+        };
+
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = feedbackRenderPass;
+        framebufferInfo.attachmentCount = 2;
+        framebufferInfo.pAttachments = &framebufferAttachments[0];
+        framebufferInfo.width = feedbackExtent.width;
+        framebufferInfo.height = feedbackExtent.height;
+        framebufferInfo.layers = 1;
+
+        VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, memoryAllocator->AllocationCallbacks(),
+            &frame.feedbackFramebuffer));
+
+        vk_create_buffer(
+            device,
+            memoryAllocator,
+            static_cast<VkDeviceSize>(feedbackExtent.width) * feedbackExtent.height *
+            sizeof(uint32_t),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            MemoryCategory::STAGING,
+            memoryAllocator->AllocationCallbacks(),
+            &frame.readbackBuffer,
+            &frame.readbackMemory);
+    }
+}
+
+void VirtualTexture::InitFeedbackPipeline()
+{
+    auto vertShaderCode = FileSystem::ReadFile(
+        "../Resources/Shaders/vt_feedback.vert.spv");
+    auto fragShaderCode = FileSystem::ReadFile(
+        "../Resources/Shaders/vt_feedback.frag.spv");
+
+    VkShaderModule shaderModules[2] = {};
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = vertShaderCode.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(vertShaderCode.data());
+
+    VK_CHECK(vkCreateShaderModule(device, &moduleInfo, memoryAllocator->AllocationCallbacks(), &shaderModules[0]));
+
+    moduleInfo.codeSize = fragShaderCode.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(fragShaderCode.data());
+
+    VK_CHECK(vkCreateShaderModule(device, &moduleInfo, memoryAllocator->AllocationCallbacks(), &shaderModules[1]));
+
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = shaderModules[0];
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = shaderModules[1];
+    shaderStages[1].pName = "main";
+
+    constexpr VkVertexInputBindingDescription bindDesc[] = {
+        // position
+        {
+            .binding = 0,
+            .stride = sizeof(glm::vec3),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        },
+        // uv, at the binding of GeometryPool::Bind
+        {
+            .binding = 3,
+            .stride = sizeof(glm::vec2),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        },
+    };
+
+    constexpr VkVertexInputAttributeDescription attributeDescs[] = {
+        {
+            .location = 0,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32B32_SFLOAT,
+            .offset = 0
+        },
+        {
+            .location = 1,
+            .binding = 3,
+            .format = VK_FORMAT_R32G32_SFLOAT,
+            .offset = 0
+        },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 2;
+    vertexInputInfo.pVertexBindingDescriptions = &bindDesc[0];
+    vertexInputInfo.vertexAttributeDescriptionCount = 2;
+    vertexInputInfo.pVertexAttributeDescriptions = &attributeDescs[0];
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    const VkViewport viewport = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(feedbackExtent.width),
+        .height = static_cast<float>(feedbackExtent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+
+    const VkRect2D scissor = {
+        .offset = {0, 0},
+        .extent = feedbackExtent,
+    };
+
+    VkPipelineViewportStateCreateInfo viewportInfo = {};
+    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportInfo.viewportCount = 1;
+    viewportInfo.pViewports = &viewport;
+    viewportInfo.scissorCount = 1;
+    viewportInfo.pScissors = &scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
+    rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationInfo.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
+    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+    depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilInfo.depthTestEnable = VK_TRUE;
+    depthStencilInfo.depthWriteEnable = VK_TRUE;
+    depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilInfo.minDepthBounds = 0.0f;
+    depthStencilInfo.maxDepthBounds = 1.0f;
+
+    // Integer target: no blending.
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+    colorBlendAttachment.blendEnable = VK_FALSE;
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+    colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendInfo.attachmentCount = 1;
+    colorBlendInfo.pAttachments = &colorBlendAttachment;
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(FeedbackPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 0;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, memoryAllocator->AllocationCallbacks(),
+        &feedbackPipelineLayout));
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = &shaderStages[0];
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+    pipelineInfo.pViewportState = &viewportInfo;
+    pipelineInfo.pRasterizationState = &rasterizationInfo;
+    pipelineInfo.pMultisampleState = &multisampleInfo;
+    pipelineInfo.pDepthStencilState = &depthStencilInfo;
+    pipelineInfo.pColorBlendState = &colorBlendInfo;
+    pipelineInfo.layout = feedbackPipelineLayout;
+    pipelineInfo.renderPass = feedbackRenderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
+        memoryAllocator->AllocationCallbacks(),
+        &feedbackPipeline));
+
+    vkDestroyShaderModule(device, shaderModules[0], memoryAllocator->AllocationCallbacks());
+    vkDestroyShaderModule(device, shaderModules[1], memoryAllocator->AllocationCallbacks());
+}
+
+void VirtualTexture::ResolveFeedback(uint32_t frame_index)
+{
+    const PerFrame &frame = frames[frame_index];
+    const uint32_t *feedback = static_cast<const uint32_t *>(frame.readbackMemory.mapped);
+    const size_t pixelCount = static_cast<size_t>(feedbackExtent.width) * feedbackExtent.height;
+
+    // Dedupe: sort the requested ids, every run is one tile weighted by its pixel count.
+    std::vector<uint32_t> ids(feedback, feedback + pixelCount);
+    ids.erase(std::remove(ids.begin(), ids.end(), INVALID_TILE), ids.end());
+    std::sort(ids.begin(), ids.end());
+
+    // Missing tiles and their ancestors, weighted by the pixels asking for them.
+    std::unordered_map<uint32_t, uint32_t> missing = {};
+
+    for (size_t i = 0; i < ids.size();)
+    {
+        const uint32_t tileId = ids[i];
+        size_t runEnd = i;
+
+        while (runEnd < ids.size() && ids[runEnd] == tileId)
+        {
+            runEnd++;
+        }
+
+        const uint32_t pixels = static_cast<uint32_t>(runEnd - i);
+        i = runEnd;
+
+        uint32_t x = 0, y = 0, mip = 0;
+        UnpackTileId(tileId, &x, &y, &mip);
+
+        if (mip >= fileHeader.mipCount)
+        {
+            continue;
+        }
+
+        // Walk up the mip chain: resident ancestors are the fallback used while
+        // the tile streams in, keep them alive too.
+        for (; mip < fileHeader.mipCount; mip++, x >>= 1, y >>= 1)
+        {
+            const uint32_t ancestorId = PackTileId(x, y, mip);
+            const int32_t slot = residency[mip][y * (fileHeader.pagesPerSide >> mip) + x];
+
+            if (slot >= 0)
+            {
+                slots[slot].lastUsedFrame = frameCounter;
+            }
+            else if (!pendingTiles.contains(ancestorId))
+            {
+                missing[ancestorId] += pixels;
+            }
+        }
+    }
+
+    struct Request
+    {
+        uint32_t tileId;
+        uint32_t mip;
+        uint32_t pixels;
+    };
+
+    std::vector<Request> requests = {};
+    requests.reserve(missing.size());
+
+    for (const auto &[tileId, pixels] : missing)
+    {
+        uint32_t x = 0, y = 0, mip = 0;
+        UnpackTileId(tileId, &x, &y, &mip);
+        requests.push_back({tileId, mip, pixels});
+    }
+
+    // Coarse mips first (they are the fallback of finer ones), then the most visible.
+    std::sort(requests.begin(), requests.end(), [](const Request &a, const Request &b)
+    {
+        return a.mip != b.mip ? a.mip > b.mip : a.pixels > b.pixels;
+    });
+
+    // Bound the reads in flight so a camera cut does not queue thousands of tiles.
+    const size_t maxPending = static_cast<size_t>(createInfo.maxRequestsPerFrame) * 4;
+
+    for (const Request &request : requests)
+    {
+        if (stats.requestedTiles >= createInfo.maxRequestsPerFrame ||
+            pendingTiles.size() >= maxPending)
+        {
+            break;
+        }
+
+        RequestTile(request.tileId);
+        stats.requestedTiles++;
+    }
+}
+
+void VirtualTexture::RequestTile(uint32_t tile_id)
+{
+    pendingTiles.insert(tile_id);
+
+    loadThreads.Submit([this, tile_id]
+    {
+        LoadTile(tile_id);
+    });
+}
+
+void VirtualTexture::LoadTile(uint32_t tile_id)
+{
+    LoadedTile tile = {};
+    tile.tileId = tile_id;
+
+    std::ifstream file(filePath, std::ios::binary);
+
+    if (file.is_open())
+    {
+        const size_t tileBytes = static_cast<size_t>(fileHeader.tileSize) * fileHeader.tileSize * 4;
+        tile.texels.resize(tileBytes);
+
+        file.seekg(static_cast<std::streamoff>(TileFileOffset(tile_id)));
+        file.read(reinterpret_cast<char *>(tile.texels.data()),
+            static_cast<std::streamsize>(tileBytes));
+
+        if (!file)
+        {
+            tile.texels.clear();
+        }
+    }
+
+    std::lock_guard lock(loadedMutex);
+    loadedTiles.push_back(std::move(tile));
+}
+
+uint32_t VirtualTexture::AcquireSlot()
+{
+    uint32_t candidate = UINT32_MAX;
+
+    for (uint32_t i = 0; i < slots.size(); i++)
+    {
+        const PhysicalSlot &slot = slots[i];
+
+        if (slot.tileId == INVALID_TILE)
+        {
+            return i;
+        }
+
+        uint32_t x = 0, y = 0, mip = 0;
+        UnpackTileId(slot.tileId, &x, &y, &mip);
+
+        // The last mip is pinned, tiles needed by the current frame are not evictable.
+        if (mip == fileHeader.mipCount - 1 || slot.lastUsedFrame == frameCounter)
+        {
+            continue;
+        }
+
+        if (candidate == UINT32_MAX || slot.lastUsedFrame < slots[candidate].lastUsedFrame)
+        {
+            candidate = i;
+        }
+    }
+
+    return candidate;
+}
+
+void VirtualTexture::MarkPagesDirty(uint32_t x, uint32_t y, uint32_t mip)
+{
+    // Finer pages inherit the entry of their ancestor: the tile covers 2^(mip - level) pages per side at level.
+    for (uint32_t level = 0; level <= mip; level++)
+    {
+        const uint32_t shift = mip - level;
+        PageRect &rect = dirtyPages[level];
+
+        rect.minX = std::min(rect.minX, x << shift);
+        rect.minY = std::min(rect.minY, y << shift);
+        rect.maxX = std::max(rect.maxX, ((x + 1) << shift) - 1);
+        rect.maxY = std::max(rect.maxY, ((y + 1) << shift) - 1);
+    }
+}
+
+void VirtualTexture::RebuildPageTable()
+{
+    // From the coarsest mip: a page without its own tile inherits its parent entry, rebuilt just before.
+    for (int32_t mip = static_cast<int32_t>(fileHeader.mipCount) - 1; mip >= 0; mip--)
+    {
+        const PageRect &rect = dirtyPages[mip];
+
+        if (rect.minX > rect.maxX)
+        {
+            continue;
+        }
+
+        const uint32_t pages = fileHeader.pagesPerSide >> mip;
+
+        for (uint32_t y = rect.minY; y <= rect.maxY; y++)
+        {
+            for (uint32_t x = rect.minX; x <= rect.maxX; x++)
+            {
+                const int32_t slot = residency[mip][y * pages + x];
+                uint32_t entry = 0;
+
+                if (slot >= 0)
+                {
+                    const uint32_t slotX = slot % createInfo.physicalTilesPerSide;
+                    const uint32_t slotY = slot / createInfo.physicalTilesPerSide;
+                    entry = slotX | (slotY << 8) | (static_cast<uint32_t>(mip) << 16) | (1u << 24);
+                }
+                else if (mip + 1 < static_cast<int32_t>(fileHeader.mipCount))
+                {
+                    const uint32_t parentPages = pages >> 1;
+                    entry = pageTable[mip + 1][(y >> 1) * parentPages + (x >> 1)];
+                }
+
+                pageTable[mip][y * pages + x] = entry;
+            }
+        }
+    }
+}
+
+std::vector<VkBufferImageCopy> VirtualTexture::StagePageTable(VkDeviceSize staging_offset)
+{
+    uint8_t *stagingMapped = static_cast<uint8_t *>(stagingMemory.mapped);
+    std::vector<VkBufferImageCopy> copies = {};
+
+    for (uint32_t mip = 0; mip < fileHeader.mipCount; mip++)
+    {
+        PageRect &rect = dirtyPages[mip];
+
+        if (rect.minX > rect.maxX)
+        {
+            continue;
+        }
+
+        const uint32_t pages = fileHeader.pagesPerSide >> mip;
+        const uint32_t width = rect.maxX - rect.minX + 1;
+        const uint32_t height = rect.maxY - rect.minY + 1;
+
+        VkBufferImageCopy copy = {};
+        copy.bufferOffset = staging_offset;
+        copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1};
+        copy.imageOffset = {static_cast<int32_t>(rect.minX), static_cast<int32_t>(rect.minY), 0};
+        copy.imageExtent = {width, height, 1};
+
+        // Rows of the rectangle, packed: at most the whole mip, the region has room for all of them.
+        for (uint32_t y = rect.minY; y <= rect.maxY; y++)
+        {
+            std::memcpy(stagingMapped + staging_offset, &pageTable[mip][y * pages + rect.minX],
+                width * sizeof(uint32_t));
+            staging_offset += width * sizeof(uint32_t);
+        }
+
+        copies.push_back(copy);
+        rect = {};
+    }
+
+    return copies;
+}
+
+uint64_t VirtualTexture::TileFileOffset(uint32_t tile_id) const
+{
+    uint32_t x = 0, y = 0, mip = 0;
+    UnpackTileId(tile_id, &x, &y, &mip);
+
+    const uint64_t tileBytes = static_cast<uint64_t>(fileHeader.tileSize) * fileHeader.tileSize * 4;
+    uint64_t offset = sizeof(VirtualTextureFileHeader);
+
+    for (uint32_t i = 0; i < mip; i++)
+    {
+        const uint64_t pages = fileHeader.pagesPerSide >> i;
+        offset += pages * pages * tileBytes;
+    }
+
+    const uint64_t pages = fileHeader.pagesPerSide >> mip;
+
+    return offset + (y * pages + x) * tileBytes;
+}
+
+VkDeviceSize VirtualTexture::PageTableByteSize() const
+{
+    VkDeviceSize size = 0;
+
+    for (uint32_t mip = 0; mip < fileHeader.mipCount; mip++)
+    {
+        const VkDeviceSize pages = fileHeader.pagesPerSide >> mip;
+        size += pages * pages * sizeof(uint32_t);
+    }
+
+    return size;
+}
+}
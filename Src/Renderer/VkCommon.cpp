@@ -3,6 +3,9 @@
 //
 
 #include "VkCommon.h"
+#include "MemoryAllocator.h"
+
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
@@ -71,8 +74,8 @@ void QueryGpu(
             &gpu_extension_count,
             &gpu_extension_properties[0]));
 
-        // Check extensions.
-        bool all_ext_supported = false;
+        // Check extensions: every requested one, none requested is trivially supported.
+        bool all_ext_supported = true;
 
         for (uint32_t j = 0; j < requested_extension_count; j++)
         {
@@ -89,7 +92,7 @@ void QueryGpu(
                 }
             }
 
-            all_ext_supported |= ext_supported;
+            all_ext_supported &= ext_supported;
         }
 
         // Check features
@@ -225,7 +228,7 @@ void vk_query_sample_counts(
 void QueryQueueFamily(
     VkPhysicalDevice gpu,
     VkQueueFlagBits queue_flag_bits_requested,
-    const bool must_support_presentation,
+    VkSurfaceKHR surface,
     const uint32_t family_idx_discarded_count,
     const uint32_t *family_idx_discarded,
     uint32_t *p_queue_family_idx)
@@ -250,10 +253,12 @@ void QueryQueueFamily(
         *p_queue_family_idx = i;
 
         // Check presentation support if requested, otherwise mark it as true.
-        const bool support_presentation = must_support_presentation
-                                              ? vkGetPhysicalDeviceWin32PresentationSupportKHR(gpu,
-                                                  i)
-                                              : true;
+        VkBool32 support_presentation = VK_TRUE;
+
+        if (surface != VK_NULL_HANDLE)
+        {
+            VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(gpu, i, surface, &support_presentation));
+        }
 
         // Check flags, presentation support, unique idx(if requested).
         is_queue_family_found = !is_queue_discarded &&
@@ -267,6 +272,32 @@ void QueryQueueFamily(
         : VK_ERROR_INITIALIZATION_FAILED);
 }
 
+bool vk_query_dedicated_queue_family(
+    VkPhysicalDevice gpu,
+    VkQueueFlags required_flags,
+    VkQueueFlags excluded_flags,
+    uint32_t *p_queue_family_idx)
+{
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, queue_families.data());
+
+    for (uint32_t i = 0; i < queue_family_count; i++)
+    {
+        const VkQueueFlags flags = queue_families[i].queueFlags;
+
+        if ((flags & required_flags) == required_flags && (flags & excluded_flags) == 0)
+        {
+            *p_queue_family_idx = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void vk_query_supported_format(
     VkPhysicalDevice gpu,
     uint32_t requested_format_count,
@@ -360,6 +391,119 @@ void vk_query_surface_capabilities(
     }
 }
 
+void vk_query_present_mode(
+    VkPhysicalDevice gpu,
+    VkSurfaceKHR surface,
+    VkPresentModeKHR requested_mode,
+    VkPresentModeKHR *p_present_mode)
+{
+    uint32_t mode_count = 0;
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &mode_count, nullptr));
+
+    std::vector<VkPresentModeKHR> modes(mode_count);
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &mode_count, modes.data()));
+
+    const auto is_supported = [&modes](VkPresentModeKHR mode)
+    {
+        return std::find(modes.begin(), modes.end(), mode) != modes.end();
+    };
+
+    // Closest latency first: MAILBOX and IMMEDIATE both present without waiting for a vblank.
+    // FIFO_RELAXED falls back to FIFO directly.
+    VkPresentModeKHR candidates[3] = {requested_mode, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR};
+
+    if (requested_mode == VK_PRESENT_MODE_MAILBOX_KHR)
+    {
+        candidates[1] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    else if (requested_mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+    {
+        candidates[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+    }
+
+    *p_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+
+    for (const VkPresentModeKHR candidate : candidates)
+    {
+        if (is_supported(candidate))
+        {
+            *p_present_mode = candidate;
+            return;
+        }
+    }
+}
+
+const char *vk_present_mode_name(VkPresentModeKHR present_mode)
+{
+    switch (present_mode)
+    {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+        default: return "unknown";
+    }
+}
+
+bool vk_query_instance_extension_support(const char *p_extension)
+{
+    uint32_t extension_count = 0;
+    VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr));
+
+    std::vector<VkExtensionProperties> extension_properties(extension_count);
+    VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &extension_count,
+        extension_properties.data()));
+
+    for (const VkExtensionProperties &properties : extension_properties)
+    {
+        if (std::strcmp(p_extension, properties.extensionName) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool vk_query_instance_layer_support(const char *p_layer)
+{
+    uint32_t layer_count = 0;
+    VK_CHECK(vkEnumerateInstanceLayerProperties(&layer_count, nullptr));
+
+    std::vector<VkLayerProperties> layer_properties(layer_count);
+    VK_CHECK(vkEnumerateInstanceLayerProperties(&layer_count, layer_properties.data()));
+
+    for (const VkLayerProperties &properties : layer_properties)
+    {
+        if (std::strcmp(p_layer, properties.layerName) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool vk_query_device_extension_support(VkPhysicalDevice gpu, const char *p_extension)
+{
+    uint32_t extension_count = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extension_count, nullptr));
+
+    std::vector<VkExtensionProperties> extension_properties(extension_count);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extension_count,
+        extension_properties.data()));
+
+    for (const VkExtensionProperties &properties : extension_properties)
+    {
+        if (std::strcmp(p_extension, properties.extensionName) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 uint32_t vk_query_memory_type_idx(
     uint32_t type_filter,
     VkMemoryPropertyFlags memory_property_flags,
@@ -442,6 +586,7 @@ void vk_create_swapchain(
     VkSurfaceKHR surface,
     VkSurfaceFormatKHR *p_format,
     VkSurfaceCapabilitiesKHR *p_capabilities,
+    VkPresentModeKHR present_mode,
     VkSwapchainKHR old_swapchain,
     VkAllocationCallbacks *p_allocator,
     VkSwapchainKHR *p_swapchain)
@@ -461,7 +606,7 @@ void vk_create_swapchain(
     swapchain_create_info.pQueueFamilyIndices = nullptr;
     swapchain_create_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchain_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swapchain_create_info.presentMode = present_mode;
     swapchain_create_info.clipped = VK_TRUE;
     swapchain_create_info.oldSwapchain = old_swapchain;
 
@@ -475,19 +620,13 @@ void vk_create_swapchain(
 void vk_query_swapchain_images(
     VkDevice device,
     VkSwapchainKHR swapchain,
+    uint32_t *p_swapchain_image_count,
     VkImage *p_swapchain_images)
 {
-    uint32_t swapchain_image_count = 0;
-    VK_CHECK(vkGetSwapchainImagesKHR(
-        device,
-        swapchain,
-        &swapchain_image_count,
-        nullptr));
-
     VK_CHECK(vkGetSwapchainImagesKHR(
         device,
         swapchain,
-        &swapchain_image_count,
+        p_swapchain_image_count,
         p_swapchain_images));
 }
 #pragma endregion
@@ -499,21 +638,52 @@ void vk_query_swapchain_images(
 #pragma region VkBuffer / VkBufferView
 void vk_create_buffer(
     VkDevice device,
-    VkPhysicalDevice physical_device,
+    DeviceMemoryAllocator *p_memory_allocator,
     VkDeviceSize size,
     VkBufferUsageFlags usage_flags,
     VkMemoryPropertyFlags memory_property_flag_bits,
+    MemoryCategory category,
     VkAllocationCallbacks *p_allocator,
     VkBuffer *p_buffer,
-    VkDeviceMemory *p_memory)
+    DeviceAllocation *p_allocation)
 {
+    vk_create_concurrent_buffer(
+        device,
+        p_memory_allocator,
+        size,
+        usage_flags,
+        memory_property_flag_bits,
+        category,
+        0,
+        nullptr,
+        p_allocator,
+        p_buffer,
+        p_allocation);
+}
+
+void vk_create_concurrent_buffer(
+    VkDevice device,
+    DeviceMemoryAllocator *p_memory_allocator,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage_flags,
+    VkMemoryPropertyFlags memory_property_flag_bits,
+    MemoryCategory category,
+    uint32_t queue_family_count,
+    const uint32_t *p_queue_family_indices,
+    VkAllocationCallbacks *p_allocator,
+    VkBuffer *p_buffer,
+    DeviceAllocation *p_allocation)
+{
+    const bool is_concurrent = queue_family_count > 1;
+
     VkBufferCreateInfo buffer_create_info = {};
     buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_create_info.flags = 0;
     buffer_create_info.size = size;
     buffer_create_info.usage = usage_flags;
-    buffer_create_info.queueFamilyIndexCount = 0;
-    buffer_create_info.pQueueFamilyIndices = nullptr;
+    buffer_create_info.sharingMode = is_concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    buffer_create_info.queueFamilyIndexCount = is_concurrent ? queue_family_count : 0;
+    buffer_create_info.pQueueFamilyIndices = is_concurrent ? p_queue_family_indices : nullptr;
 
     VK_CHECK(vkCreateBuffer(
         device,
@@ -527,26 +697,20 @@ void vk_create_buffer(
         *p_buffer,
         &mem_requirements);
 
-    // Gpus have multiple heaps and each heap has different memory type support.
-    // VkPhysicalDeviceMemoryProperties contains all memory types of every heap.
-    VkPhysicalDeviceMemoryProperties memory_properties = {};
-    vkGetPhysicalDeviceMemoryProperties(
-        physical_device,
-        &memory_properties);
-
-    const uint32_t memory_type_index = vk_query_memory_type_idx(
-        mem_requirements.memoryTypeBits,
-        memory_property_flag_bits,
-        memory_properties);
-
-    VkMemoryAllocateInfo buffer_memory_allocate_info = {};
-    buffer_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    buffer_memory_allocate_info.pNext = nullptr;
-    buffer_memory_allocate_info.allocationSize = mem_requirements.size;
-    buffer_memory_allocate_info.memoryTypeIndex = memory_type_index;
+    if (p_memory_allocator->Allocate(
+            mem_requirements,
+            memory_property_flag_bits,
+            true,
+            false,
+            category,
+            p_allocation) != VK_SUCCESS)
+    {
+        vkDestroyBuffer(device, *p_buffer, p_allocator);
+        *p_buffer = VK_NULL_HANDLE;
+        throw std::runtime_error("Failed to allocate buffer memory!");
+    }
 
-    VK_CHECK(vkAllocateMemory(device, &buffer_memory_allocate_info, p_allocator, p_memory));
-    VK_CHECK(vkBindBufferMemory(device, *p_buffer, *p_memory, 0));
+    VK_CHECK(vkBindBufferMemory(device, *p_buffer, p_allocation->memory, p_allocation->offset));
 }
 
 void vk_create_buffer_view(
@@ -582,17 +746,19 @@ void vk_create_buffer_view(
 #pragma region VkImage / VkImageView
 void vk_create_image(
     VkDevice device,
-    VkPhysicalDevice physical_device,
+    DeviceMemoryAllocator *p_memory_allocator,
     VkImageType image_type,
     VkFormat format,
     VkExtent3D extent,
+    uint32_t mip_levels,
     VkSampleCountFlagBits samples,
     VkImageTiling tiling,
     VkImageUsageFlags usage,
     VkMemoryPropertyFlagBits memory_property_flag_bits,
+    MemoryCategory category,
     VkAllocationCallbacks *p_allocator,
     VkImage *p_image,
-    VkDeviceMemory *p_memory)
+    DeviceAllocation *p_allocation)
 {
     VkImageCreateInfo image_info = {};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -600,7 +766,7 @@ void vk_create_image(
     image_info.imageType = image_type;
     image_info.format = format;
     image_info.extent = extent;
-    image_info.mipLevels = 1;
+    image_info.mipLevels = mip_levels;
     image_info.arrayLayers = 1;
     image_info.samples = samples;
     image_info.tiling = tiling;
@@ -613,37 +779,33 @@ void vk_create_image(
     VK_CHECK(vkCreateImage(
         device,
         &image_info,
-        nullptr,
+        p_allocator,
         p_image));
 
     VkMemoryRequirements mem_requirements = {};
     vkGetImageMemoryRequirements(device, *p_image, &mem_requirements);
 
-    VkPhysicalDeviceMemoryProperties memory_properties = {};
-    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
-
-    const uint32_t mem_type_idx = vk_query_memory_type_idx(
-        mem_requirements.memoryTypeBits,
-        memory_property_flag_bits,
-        memory_properties);
-
-    VkMemoryAllocateInfo allocate_info = {};
-    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocate_info.pNext = nullptr;
-    allocate_info.allocationSize = mem_requirements.size;
-    allocate_info.memoryTypeIndex = mem_type_idx;
+    const bool is_render_target = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
 
-    VK_CHECK(vkAllocateMemory(
-        device,
-        &allocate_info,
-        p_allocator,
-        p_memory));
+    if (p_memory_allocator->Allocate(
+            mem_requirements,
+            memory_property_flag_bits,
+            tiling == VK_IMAGE_TILING_LINEAR,
+            is_render_target,
+            category,
+            p_allocation) != VK_SUCCESS)
+    {
+        vkDestroyImage(device, *p_image, p_allocator);
+        *p_image = VK_NULL_HANDLE;
+        throw std::runtime_error("Failed to allocate image memory!");
+    }
 
     VK_CHECK(vkBindImageMemory(
         device,
         *p_image,
-        *p_memory,
-        0));
+        p_allocation->memory,
+        p_allocation->offset));
 }
 
 void vk_create_image_view(
@@ -651,6 +813,7 @@ void vk_create_image_view(
     VkImage image,
     VkImageAspectFlags aspect_flags,
     VkImageViewType view_type,
+    uint32_t mip_levels,
     VkFormat format,
     VkComponentMapping components,
     VkAllocationCallbacks *p_allocator,
@@ -659,7 +822,7 @@ void vk_create_image_view(
     VkImageSubresourceRange image_subresource_range = {};
     image_subresource_range.aspectMask = aspect_flags;
     image_subresource_range.baseMipLevel = 0;
-    image_subresource_range.levelCount = 1;
+    image_subresource_range.levelCount = mip_levels;
     image_subresource_range.baseArrayLayer = 0;
     image_subresource_range.layerCount = 1;
 
@@ -680,4 +843,45 @@ void vk_create_image_view(
         p_image_view));
 }
 #pragma endregion
+
+// ==========================
+// Sampler
+// ==========================
+
+#pragma region VkSampler
+void vk_create_sampler(
+    VkDevice device,
+    VkFilter filter,
+    VkSamplerMipmapMode mipmap_mode,
+    VkSamplerAddressMode address_mode,
+    float max_lod,
+    VkAllocationCallbacks *p_allocator,
+    VkSampler *p_sampler)
+{
+    VkSamplerCreateInfo sampler_create_info = {};
+    sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_create_info.flags = 0;
+    sampler_create_info.magFilter = filter;
+    sampler_create_info.minFilter = filter;
+    sampler_create_info.mipmapMode = mipmap_mode;
+    sampler_create_info.addressModeU = address_mode;
+    sampler_create_info.addressModeV = address_mode;
+    sampler_create_info.addressModeW = address_mode;
+    sampler_create_info.mipLodBias = 0.0f;
+    sampler_create_info.anisotropyEnable = VK_FALSE;
+    sampler_create_info.maxAnisotropy = 1.0f;
+    sampler_create_info.compareEnable = VK_FALSE;
+    sampler_create_info.compareOp = VK_COMPARE_OP_ALWAYS;
+    sampler_create_info.minLod = 0.0f;
+    sampler_create_info.maxLod = max_lod;
+    sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+    sampler_create_info.unnormalizedCoordinates = VK_FALSE;
+
+    VK_CHECK(vkCreateSampler(
+        device,
+        &sampler_create_info,
+        p_allocator,
+        p_sampler));
+}
+#pragma endregion
 }
\ No newline at end of file